@@ -0,0 +1,66 @@
+/* bench_util.h - common helpers for the pocl microbenchmarks
+
+   Copyright (c) 2015 pocl developers
+   
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+   
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+   
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+   THE SOFTWARE.
+*/
+
+#ifndef POCL_BENCH_UTIL_H
+#define POCL_BENCH_UTIL_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <sys/time.h>
+
+#include "poclu.h"
+
+/* Aborts the benchmark in case an OpenCL call failed. */
+#define BENCH_CHECK(call)                                       \
+  do {                                                          \
+    if (check_cl_error ((call), __LINE__, __func__))            \
+      exit (EXIT_FAILURE);                                      \
+  } while (0)
+
+/* Returns a monotonic timestamp in microseconds. */
+static inline double
+bench_now_us (void)
+{
+#ifdef CLOCK_MONOTONIC
+  struct timespec ts;
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+#else
+  struct timeval tv;
+  gettimeofday (&tv, NULL);
+  return tv.tv_sec * 1e6 + tv.tv_usec;
+#endif
+}
+
+/* Returns the integer in argv[index] or the given default in case the
+   argument was not given. */
+static inline long
+bench_int_arg (int argc, char **argv, int index, long def)
+{
+  if (argc > index)
+    return strtol (argv[index], NULL, 0);
+  return def;
+}
+
+#endif
@@ -0,0 +1,166 @@
+/* buffer_alloc - stresses the buffer allocator of the device
+
+   Copyright (c) 2015 pocl developers
+   
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+   
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+   
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+   THE SOFTWARE.
+*/
+
+/* Usage: buffer_alloc [live buffers] [operations] [max kilobytes] [threads]
+
+   Keeps the given number of buffers of random sizes alive and replaces a
+   randomly picked one with a new buffer of a random size in each
+   operation, reporting the average time of a clReleaseMemObject() and
+   clCreateBuffer() pair. With an allocator whose cost grows with the
+   number of buffers the time per operation grows with the live buffer
+   count; compare e.g. 1000 and 50000 live buffers, or a build with
+   CUSTOM_BUFFER_ALLOCATOR disabled (malloc) for reference. In the
+   multithreaded mode each thread churns its own set of buffers in the
+   same context. */
+
+#include <pthread.h>
+
+#include "bench_util.h"
+
+typedef struct
+{
+  cl_context context;
+  long live;
+  long operations;
+  long max_bytes;
+  unsigned seed;
+  double time;
+} churn_args;
+
+/* A small LCG to get the same sequence of sizes on every platform. */
+static unsigned
+next_random (unsigned *seed)
+{
+  *seed = *seed * 1103515245u + 12345u;
+  return (*seed >> 8) & 0xffffff;
+}
+
+static cl_mem
+create_buffer (churn_args *args)
+{
+  cl_int err;
+  size_t size = 1 + next_random (&args->seed) % args->max_bytes;
+  cl_mem buf = clCreateBuffer (args->context, CL_MEM_READ_WRITE, size,
+                               NULL, &err);
+  BENCH_CHECK (err);
+  return buf;
+}
+
+static void *
+churn (void *data)
+{
+  churn_args *args = (churn_args*)data;
+  cl_mem *buffers = (cl_mem*)malloc (args->live * sizeof (cl_mem));
+  long i, victim;
+  double start;
+
+  if (buffers == NULL)
+    {
+      fprintf (stderr, "out of memory\n");
+      exit (EXIT_FAILURE);
+    }
+
+  for (i = 0; i < args->live; ++i)
+    buffers[i] = create_buffer (args);
+
+  start = bench_now_us ();
+  for (i = 0; i < args->operations; ++i)
+    {
+      victim = next_random (&args->seed) % args->live;
+      BENCH_CHECK (clReleaseMemObject (buffers[victim]));
+      buffers[victim] = create_buffer (args);
+    }
+  args->time = bench_now_us () - start;
+
+  for (i = 0; i < args->live; ++i)
+    BENCH_CHECK (clReleaseMemObject (buffers[i]));
+  free (buffers);
+  return NULL;
+}
+
+int
+main (int argc, char **argv)
+{
+  cl_context context;
+  cl_device_id device;
+  cl_command_queue queue;
+  long live, operations, kilobytes, threads, i;
+  churn_args *args;
+  pthread_t *workers;
+  double time = 0.0;
+
+  live = bench_int_arg (argc, argv, 1, 10000);
+  operations = bench_int_arg (argc, argv, 2, 100000);
+  kilobytes = bench_int_arg (argc, argv, 3, 64);
+  threads = bench_int_arg (argc, argv, 4, 1);
+  if (live < 1)
+    live = 1;
+  if (operations < 1)
+    operations = 1;
+  if (kilobytes < 1)
+    kilobytes = 1;
+  if (threads < 1)
+    threads = 1;
+
+  poclu_get_any_device (&context, &device, &queue);
+  if (context == NULL || device == NULL || queue == NULL)
+    {
+      fprintf (stderr, "no OpenCL device found\n");
+      return EXIT_FAILURE;
+    }
+
+  args = (churn_args*)calloc (threads, sizeof (churn_args));
+  workers = (pthread_t*)calloc (threads, sizeof (pthread_t));
+  if (args == NULL || workers == NULL)
+    {
+      fprintf (stderr, "out of memory\n");
+      return EXIT_FAILURE;
+    }
+
+  for (i = 0; i < threads; ++i)
+    {
+      args[i].context = context;
+      args[i].live = live;
+      args[i].operations = operations;
+      args[i].max_bytes = kilobytes * 1024;
+      args[i].seed = 1 + i;
+      pthread_create (&workers[i], NULL, churn, &args[i]);
+    }
+  for (i = 0; i < threads; ++i)
+    {
+      pthread_join (workers[i], NULL);
+      time += args[i].time;
+    }
+
+  printf ("live buffers: %ld, max size: %ld kB, threads: %ld\n",
+          live, kilobytes, threads);
+  printf ("%10.3f us per release + create\n",
+          time / threads / operations);
+
+  free (workers);
+  free (args);
+  clReleaseCommandQueue (queue);
+  clReleaseContext (context);
+
+  return EXIT_SUCCESS;
+}
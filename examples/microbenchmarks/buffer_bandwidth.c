@@ -0,0 +1,141 @@
+/* buffer_bandwidth - measures the bandwidth of the buffer transfer
+   commands.
+
+   Copyright (c) 2015 pocl developers
+   
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+   
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+   
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+   THE SOFTWARE.
+*/
+
+/* Usage: buffer_bandwidth [megabytes] [iterations] [parallel]
+
+   Times blocking clEnqueueReadBuffer, clEnqueueWriteBuffer and
+   clEnqueueCopyBuffer of the given size and a plain memcpy() of the same
+   size on the host for reference. With the parallel argument 0 or 1 the
+   benchmark sets POCL_PTHREAD_PARALLEL_TRANSFERS accordingly before
+   initializing OpenCL, which allows comparing the multithreaded transfers
+   of the pthread device with the single threaded ones. */
+
+#include <string.h>
+
+#include "bench_util.h"
+
+static void
+report (const char *what, size_t size, long iterations, double time)
+{
+  printf ("%-8s %10.3f ms %10.3f GB/s\n", what, time / iterations / 1e3,
+          (double)size * iterations / time / 1e3);
+}
+
+int
+main (int argc, char **argv)
+{
+  cl_context context;
+  cl_device_id device;
+  cl_command_queue queue;
+  cl_mem a, b;
+  cl_int err;
+  char *host_src, *host_dst;
+  long megabytes, iterations, parallel, i;
+  size_t size;
+  double start;
+
+  megabytes = bench_int_arg (argc, argv, 1, 256);
+  iterations = bench_int_arg (argc, argv, 2, 10);
+  parallel = bench_int_arg (argc, argv, 3, -1);
+  if (megabytes < 1)
+    megabytes = 1;
+  if (iterations < 1)
+    iterations = 1;
+  size = (size_t)megabytes * 1024 * 1024;
+
+  if (parallel >= 0)
+    setenv ("POCL_PTHREAD_PARALLEL_TRANSFERS", parallel ? "1" : "0", 1);
+
+  poclu_get_any_device (&context, &device, &queue);
+  if (context == NULL || device == NULL || queue == NULL)
+    {
+      fprintf (stderr, "no OpenCL device found\n");
+      return EXIT_FAILURE;
+    }
+
+  host_src = (char*)malloc (size);
+  host_dst = (char*)malloc (size);
+  if (host_src == NULL || host_dst == NULL)
+    {
+      fprintf (stderr, "out of memory\n");
+      return EXIT_FAILURE;
+    }
+  /* Fault in the host pages outside of the timed regions. */
+  memset (host_src, 1, size);
+  memset (host_dst, 0, size);
+
+  a = clCreateBuffer (context, CL_MEM_READ_WRITE, size, NULL, &err);
+  BENCH_CHECK (err);
+  b = clCreateBuffer (context, CL_MEM_READ_WRITE, size, NULL, &err);
+  BENCH_CHECK (err);
+
+  /* Warm up: allocates the device memory and touches it. */
+  BENCH_CHECK (clEnqueueWriteBuffer (queue, a, CL_TRUE, 0, size, host_src,
+                                     0, NULL, NULL));
+  BENCH_CHECK (clEnqueueCopyBuffer (queue, a, b, 0, 0, size, 0, NULL, NULL));
+  BENCH_CHECK (clFinish (queue));
+
+  printf ("size: %ld MB, iterations: %ld, parallel transfers: %s\n",
+          megabytes, iterations,
+          parallel < 0 ? "default" : (parallel ? "on" : "off"));
+
+  start = bench_now_us ();
+  for (i = 0; i < iterations; ++i)
+    memcpy (host_dst, host_src, size);
+  report ("memcpy", size, iterations, bench_now_us () - start);
+
+  start = bench_now_us ();
+  for (i = 0; i < iterations; ++i)
+    BENCH_CHECK (clEnqueueWriteBuffer (queue, a, CL_TRUE, 0, size, host_src,
+                                       0, NULL, NULL));
+  report ("write", size, iterations, bench_now_us () - start);
+
+  start = bench_now_us ();
+  for (i = 0; i < iterations; ++i)
+    BENCH_CHECK (clEnqueueReadBuffer (queue, a, CL_TRUE, 0, size, host_dst,
+                                      0, NULL, NULL));
+  report ("read", size, iterations, bench_now_us () - start);
+
+  start = bench_now_us ();
+  for (i = 0; i < iterations; ++i)
+    BENCH_CHECK (clEnqueueCopyBuffer (queue, a, b, 0, 0, size, 0, NULL,
+                                      NULL));
+  BENCH_CHECK (clFinish (queue));
+  report ("copy", size, iterations, bench_now_us () - start);
+
+  if (memcmp (host_src, host_dst, size) != 0)
+    {
+      fprintf (stderr, "the read data does not match the written one\n");
+      return EXIT_FAILURE;
+    }
+
+  clReleaseMemObject (b);
+  clReleaseMemObject (a);
+  free (host_dst);
+  free (host_src);
+  clReleaseCommandQueue (queue);
+  clReleaseContext (context);
+
+  return EXIT_SUCCESS;
+}
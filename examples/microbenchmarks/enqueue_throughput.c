@@ -0,0 +1,190 @@
+/* enqueue_throughput - measures the cost of enqueuing commands from several
+   host threads.
+
+   Copyright (c) 2015 pocl developers
+   
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+   
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+   
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+   THE SOFTWARE.
+*/
+
+/* Usage: enqueue_throughput [threads] [commands] [shared-queue]
+
+   The given number of host threads enqueue the given total number of
+   markers, either each to its own in-order queue or all to a single
+   shared one. The queues are held back by a user event until all the
+   commands have been enqueued, thus the queues are as deep as they get
+   while enqueuing; the enqueue cost must not grow with the depth. The
+   time to drain the queues after releasing the user event is reported
+   separately.
+
+   The benchmark fails in case enqueuing the second half of the commands
+   of a thread, to a queue that is already half full, takes more than
+   ENQUEUE_SCALING_LIMIT times as long as enqueuing the first half. */
+
+#include <pthread.h>
+
+#include "bench_util.h"
+
+/* With a constant enqueue cost both halves take about as long, with one
+   linear in the queue depth the second half takes three times as
+   long. */
+#define ENQUEUE_SCALING_LIMIT 2.0
+
+typedef struct
+{
+  cl_command_queue queue;
+  long commands;
+  double time;
+  /* The times to enqueue the first and the second half of the commands. */
+  double shallow_time;
+  double deep_time;
+} enqueue_thread_data;
+
+static void *
+enqueue_thread (void *p)
+{
+  enqueue_thread_data *td = (enqueue_thread_data*)p;
+  double start = bench_now_us (), half;
+  long i;
+
+  for (i = 0; i < td->commands / 2; ++i)
+    BENCH_CHECK (clEnqueueMarkerWithWaitList (td->queue, 0, NULL, NULL));
+  half = bench_now_us ();
+  for (; i < td->commands; ++i)
+    BENCH_CHECK (clEnqueueMarkerWithWaitList (td->queue, 0, NULL, NULL));
+  td->time = bench_now_us () - start;
+  td->shallow_time = half - start;
+  td->deep_time = td->time - td->shallow_time;
+  return NULL;
+}
+
+int
+main (int argc, char **argv)
+{
+  cl_context context;
+  cl_device_id device;
+  cl_command_queue queue;
+  cl_command_queue *queues;
+  cl_event gate;
+  cl_int err;
+  pthread_t *threads;
+  enqueue_thread_data *data;
+  long num_threads, commands, shared, i;
+  double start, enqueue, drain, slowest = 0.0;
+  double shallow = 0.0, deep = 0.0;
+
+  num_threads = bench_int_arg (argc, argv, 1, 4);
+  commands = bench_int_arg (argc, argv, 2, 100000);
+  shared = bench_int_arg (argc, argv, 3, 0);
+  if (num_threads < 1)
+    num_threads = 1;
+
+  poclu_get_any_device (&context, &device, &queue);
+  if (context == NULL || device == NULL || queue == NULL)
+    {
+      fprintf (stderr, "no OpenCL device found\n");
+      return EXIT_FAILURE;
+    }
+
+  queues = (cl_command_queue*)calloc (num_threads, sizeof (cl_command_queue));
+  threads = (pthread_t*)calloc (num_threads, sizeof (pthread_t));
+  data = (enqueue_thread_data*)calloc (num_threads,
+                                       sizeof (enqueue_thread_data));
+  if (queues == NULL || threads == NULL || data == NULL)
+    {
+      fprintf (stderr, "out of memory\n");
+      return EXIT_FAILURE;
+    }
+
+  gate = clCreateUserEvent (context, &err);
+  BENCH_CHECK (err);
+
+  for (i = 0; i < num_threads; ++i)
+    {
+      if (shared)
+        queues[i] = queue;
+      else
+        {
+          queues[i] = clCreateCommandQueue (context, device, 0, &err);
+          BENCH_CHECK (err);
+        }
+      /* Everything enqueued after this one waits in the queue. */
+      if (i == 0 || !shared)
+        BENCH_CHECK (clEnqueueMarkerWithWaitList (queues[i], 1, &gate,
+                                                  NULL));
+      data[i].queue = queues[i];
+      data[i].commands = commands / num_threads
+        + (i < commands % num_threads ? 1 : 0);
+    }
+
+  start = bench_now_us ();
+  for (i = 0; i < num_threads; ++i)
+    {
+      if (pthread_create (&threads[i], NULL, enqueue_thread, &data[i]))
+        {
+          fprintf (stderr, "could not start a thread\n");
+          return EXIT_FAILURE;
+        }
+    }
+  for (i = 0; i < num_threads; ++i)
+    {
+      pthread_join (threads[i], NULL);
+      if (data[i].time > slowest)
+        slowest = data[i].time;
+      shallow += data[i].shallow_time;
+      deep += data[i].deep_time;
+    }
+  enqueue = bench_now_us () - start;
+
+  start = bench_now_us ();
+  BENCH_CHECK (clSetUserEventStatus (gate, CL_COMPLETE));
+  for (i = 0; i < num_threads; ++i)
+    {
+      if (i == 0 || !shared)
+        BENCH_CHECK (clFinish (queues[i]));
+    }
+  drain = bench_now_us () - start;
+
+  printf ("threads: %ld, commands: %ld, %s\n", num_threads, commands,
+          shared ? "one shared queue" : "one queue per thread");
+  printf ("enqueue:        %10.3f us per command (wall clock)\n",
+          enqueue / commands);
+  printf ("enqueue thread: %10.3f us per command (slowest thread)\n",
+          slowest * num_threads / commands);
+  printf ("drain:          %10.3f us per command\n", drain / commands);
+  printf ("deep/shallow:   %10.3f enqueue time ratio\n", deep / shallow);
+
+  clReleaseEvent (gate);
+  for (i = 0; i < num_threads; ++i)
+    {
+      if (!shared)
+        clReleaseCommandQueue (queues[i]);
+    }
+  free (data);
+  free (threads);
+  free (queues);
+  clReleaseCommandQueue (queue);
+  clReleaseContext (context);
+
+  if (deep > shallow * ENQUEUE_SCALING_LIMIT)
+    {
+      printf ("FAIL: the enqueue cost grows with the queue depth\n");
+      return EXIT_FAILURE;
+    }
+  return EXIT_SUCCESS;
+}
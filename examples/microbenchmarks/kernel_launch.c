@@ -0,0 +1,116 @@
+/* kernel_launch - measures the host side overhead of launching small
+   kernels.
+
+   Copyright (c) 2015 pocl developers
+   
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+   
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+   
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+   THE SOFTWARE.
+*/
+
+/* Usage: kernel_launch [launches] [work-groups]
+
+   Enqueues the given number of launches of an almost empty kernel, each
+   with the given number of work-groups of a single work-item, and waits
+   for them. The reported time per launch is dominated by the runtime's
+   command handling and the wakeup latency of the device's worker threads
+   instead of the kernel itself.
+
+   With the pthread device, compare a run with POCL_PTHREAD_WORKER_SPIN=0
+   to one with the default: the difference in the launch+finish time is
+   the wakeup latency saved by the idle workers polling for the next
+   launch instead of sleeping. */
+
+#include "bench_util.h"
+
+static const char *kernel_source =
+  "kernel void tiny (global int *out) {\n"
+  "  out[get_global_id (0)] = get_group_id (0);\n"
+  "}\n";
+
+int
+main (int argc, char **argv)
+{
+  cl_context context;
+  cl_device_id device;
+  cl_command_queue queue;
+  cl_program program;
+  cl_kernel kernel;
+  cl_mem buf;
+  cl_int err;
+  size_t global, local = 1;
+  long launches, i;
+  double start, blocking, batched;
+
+  launches = bench_int_arg (argc, argv, 1, 10000);
+  global = (size_t)bench_int_arg (argc, argv, 2, 16);
+
+  poclu_get_any_device (&context, &device, &queue);
+  if (context == NULL || device == NULL || queue == NULL)
+    {
+      fprintf (stderr, "no OpenCL device found\n");
+      return EXIT_FAILURE;
+    }
+
+  program = clCreateProgramWithSource (context, 1, &kernel_source, NULL, &err);
+  BENCH_CHECK (err);
+  BENCH_CHECK (clBuildProgram (program, 0, NULL, NULL, NULL, NULL));
+  kernel = clCreateKernel (program, "tiny", &err);
+  BENCH_CHECK (err);
+  buf = clCreateBuffer (context, CL_MEM_READ_WRITE, global * sizeof (cl_int),
+                        NULL, &err);
+  BENCH_CHECK (err);
+  BENCH_CHECK (clSetKernelArg (kernel, 0, sizeof (cl_mem), &buf));
+
+  /* Warm up: the first launch compiles the work-group function. */
+  BENCH_CHECK (clEnqueueNDRangeKernel (queue, kernel, 1, NULL, &global, &local,
+                                       0, NULL, NULL));
+  BENCH_CHECK (clFinish (queue));
+
+  /* Launch and wait one at a time: the full round trip latency. */
+  start = bench_now_us ();
+  for (i = 0; i < launches; ++i)
+    {
+      BENCH_CHECK (clEnqueueNDRangeKernel (queue, kernel, 1, NULL, &global,
+                                           &local, 0, NULL, NULL));
+      BENCH_CHECK (clFinish (queue));
+    }
+  blocking = bench_now_us () - start;
+
+  /* Enqueue all and wait once: the throughput of back-to-back launches. */
+  start = bench_now_us ();
+  for (i = 0; i < launches; ++i)
+    BENCH_CHECK (clEnqueueNDRangeKernel (queue, kernel, 1, NULL, &global,
+                                         &local, 0, NULL, NULL));
+  BENCH_CHECK (clFinish (queue));
+  batched = bench_now_us () - start;
+
+  printf ("launches: %ld, work-groups per launch: %lu, worker spin: %s\n",
+          launches, (unsigned long)global,
+          getenv ("POCL_PTHREAD_WORKER_SPIN") != NULL
+          ? getenv ("POCL_PTHREAD_WORKER_SPIN") : "default");
+  printf ("launch+finish: %10.2f us per launch\n", blocking / launches);
+  printf ("batched:       %10.2f us per launch\n", batched / launches);
+
+  clReleaseMemObject (buf);
+  clReleaseKernel (kernel);
+  clReleaseProgram (program);
+  clReleaseCommandQueue (queue);
+  clReleaseContext (context);
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,126 @@
+/* launch_rate - measures the host side cost of enqueuing kernel launches.
+
+   Copyright (c) 2015 pocl developers
+   
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+   
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+   
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+   THE SOFTWARE.
+*/
+
+/* Usage: launch_rate [launches] [configurations]
+
+   Enqueues the given number of launches of an almost empty kernel,
+   cycling through the given number of different local sizes. The launches
+   are held back by a user event until all of them have been enqueued, thus
+   the reported rate is the cost of clEnqueueNDRangeKernel() itself: the
+   argument copying, the command creation and the lookup of the already
+   compiled launch configuration, without any execution or file system
+   access in between. */
+
+#include "bench_util.h"
+
+static const char *kernel_source =
+  "kernel void tiny (global int *out) {\n"
+  "  out[get_global_id (0)] = get_group_id (0);\n"
+  "}\n";
+
+int
+main (int argc, char **argv)
+{
+  cl_context context;
+  cl_device_id device;
+  cl_command_queue queue;
+  cl_program program;
+  cl_kernel kernel;
+  cl_mem buf;
+  cl_event gate;
+  cl_int err;
+  size_t global, local;
+  long launches, configs, i;
+  double start, enqueue, drain;
+
+  launches = bench_int_arg (argc, argv, 1, 100000);
+  configs = bench_int_arg (argc, argv, 2, 4);
+  if (configs < 1)
+    configs = 1;
+  /* Every local size 1..configs divides the global size. */
+  global = 1;
+  for (i = 1; i <= configs; ++i)
+    {
+      if (global % i != 0)
+        global *= i;
+    }
+
+  poclu_get_any_device (&context, &device, &queue);
+  if (context == NULL || device == NULL || queue == NULL)
+    {
+      fprintf (stderr, "no OpenCL device found\n");
+      return EXIT_FAILURE;
+    }
+
+  program = clCreateProgramWithSource (context, 1, &kernel_source, NULL, &err);
+  BENCH_CHECK (err);
+  BENCH_CHECK (clBuildProgram (program, 0, NULL, NULL, NULL, NULL));
+  kernel = clCreateKernel (program, "tiny", &err);
+  BENCH_CHECK (err);
+  buf = clCreateBuffer (context, CL_MEM_READ_WRITE, global * sizeof (cl_int),
+                        NULL, &err);
+  BENCH_CHECK (err);
+  BENCH_CHECK (clSetKernelArg (kernel, 0, sizeof (cl_mem), &buf));
+
+  /* Warm up: compile the work-group function of every configuration. */
+  for (i = 0; i < configs; ++i)
+    {
+      local = (size_t)i + 1;
+      BENCH_CHECK (clEnqueueNDRangeKernel (queue, kernel, 1, NULL, &global,
+                                           &local, 0, NULL, NULL));
+    }
+  BENCH_CHECK (clFinish (queue));
+
+  gate = clCreateUserEvent (context, &err);
+  BENCH_CHECK (err);
+  BENCH_CHECK (clEnqueueMarkerWithWaitList (queue, 1, &gate, NULL));
+
+  start = bench_now_us ();
+  for (i = 0; i < launches; ++i)
+    {
+      local = (size_t)(i % configs) + 1;
+      BENCH_CHECK (clEnqueueNDRangeKernel (queue, kernel, 1, NULL, &global,
+                                           &local, 0, NULL, NULL));
+    }
+  enqueue = bench_now_us () - start;
+
+  start = bench_now_us ();
+  BENCH_CHECK (clSetUserEventStatus (gate, CL_COMPLETE));
+  BENCH_CHECK (clFinish (queue));
+  drain = bench_now_us () - start;
+
+  printf ("launches: %ld, local size configurations: %ld\n",
+          launches, configs);
+  printf ("enqueue: %10.3f us per launch (%.0f launches/s)\n",
+          enqueue / launches, launches / (enqueue / 1e6));
+  printf ("drain:   %10.3f us per launch\n", drain / launches);
+
+  clReleaseEvent (gate);
+  clReleaseMemObject (buf);
+  clReleaseKernel (kernel);
+  clReleaseProgram (program);
+  clReleaseCommandQueue (queue);
+  clReleaseContext (context);
+
+  return EXIT_SUCCESS;
+}
@@ -243,6 +243,40 @@ typedef CL_API_ENTRY cl_int (CL_API_CALL *clTerminateContextKHR_fn)(cl_context /
 
 #endif /* CL_VERSION_1_1 */
 
+/*********************************
+* cl_pocl_memory_placement extension
+*
+* pocl specific cl_mem_flags for placing the memory of the buffers on the
+* CPU devices. The flags are hints: an implementation that cannot honor
+* them allocates the buffer as usual.
+*
+* CL_MEM_HUGE_PAGES_POCL backs the buffer with huge pages, the explicitly
+* reserved ones if available, transparent huge pages otherwise.
+* CL_MEM_NUMA_INTERLEAVED_POCL spreads the pages of the buffer evenly over
+* all the NUMA nodes. CL_MEM_NUMA_LOCAL_POCL places them on the NUMA node
+* of the thread that creates the buffer. The two NUMA flags are mutually
+* exclusive.
+*********************************/
+#define cl_pocl_memory_placement 1
+
+#define CL_MEM_HUGE_PAGES_POCL                      (1 << 28)
+#define CL_MEM_NUMA_INTERLEAVED_POCL                (1 << 29)
+#define CL_MEM_NUMA_LOCAL_POCL                      (1 << 30)
+
+/*********************************
+* pocl specific debugging entry points
+*
+* Not an advertised extension, queried with clGetExtensionFunctionAddress.
+*
+* clGetAllocationCountPOCL returns the number of the objects the runtime
+* has allocated from the heap on behalf of the enqueued commands: the
+* events, the command nodes, the buffer mappings and the kernel launch
+* arenas of the threads. Once warmed up, repeated launches reuse them and
+* the count stays flat.
+*********************************/
+typedef CL_API_ENTRY cl_ulong
+(CL_API_CALL *clGetAllocationCountPOCL_fn)(void);
+
 #ifdef __cplusplus
 }
 #endif
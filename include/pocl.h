@@ -56,6 +56,11 @@ struct _mem_mapping {
   void *host_ptr; /* the location of the mapped buffer chunk in the host memory */
   size_t offset; /* offset to the beginning of the buffer */
   size_t size;
+  cl_map_flags map_flags;
+  /* A copy of the region as it was read from the device, compared against
+     at unmap to write back only the pages the host modified. Used only for
+     the CL_MAP_WRITE mappings of devices that do not map in place. */
+  void *clean_copy;
   mem_mapping_t *prev, *next;
 };
 
@@ -65,8 +70,12 @@ struct _mem_mapping {
 typedef struct
 {
   void *data;
+  /* The kernel compiler cache directory of the launch configuration.
+     Owned by the kernel, not the command. */
   char *tmp_dir; 
-  pocl_workgroup wg;
+  /* The compiled launcher that executes a range of work-groups per
+     call. */
+  pocl_workgroup_range wg;
   cl_kernel kernel;
   /* A list of argument buffers to free after the command has 
      been executed. */
@@ -151,10 +160,12 @@ typedef struct
   mem_mapping_t *mapping;
 } _cl_command_unmap;
 
-/* clEnqueueFillImage */
+/* clEnqueueFillImage and clEnqueueFillBuffer */
 typedef struct
 {
   void *data;
+  /* The retained buffer of a buffer fill, NULL for images. */
+  cl_mem memobj;
   void *device_ptr;
   size_t buffer_origin[3];
   size_t region[3];
@@ -183,15 +194,47 @@ typedef union
   _cl_command_unmap unmap;
 } _cl_command_t;
 
+/* The number of wait list entries stored inside the command node itself.
+   Longer wait lists are allocated from the heap. */
+#define POCL_INLINE_WAIT_LIST_SIZE 4
+
+struct _cl_command_node_struct;
+
+/* Links a command to the list of the commands waiting for an event. */
+typedef struct _cl_dependency_struct
+{
+  struct _cl_command_node_struct *node;
+  struct _cl_dependency_struct *next;
+} _cl_dependency;
+
 // one item in the command queue
 typedef struct _cl_command_node_struct
 {
   _cl_command_t command;
   cl_command_type type;
   struct _cl_command_node_struct *next; // for linked-list storage
+  struct _cl_command_node_struct *prev;
   cl_event event;
-  const cl_event *event_wait_list;
+  /* Points either to inline_wait_list or to a heap allocated array. */
+  cl_event *event_wait_list;
   cl_int num_events_in_wait_list;
+  cl_event inline_wait_list[POCL_INLINE_WAIT_LIST_SIZE];
+  /* The entries of the dependent lists of the events in the wait list,
+     parallel to event_wait_list. Point either to inline_dependencies or
+     to a heap allocated array. */
+  _cl_dependency *dependencies;
+  _cl_dependency inline_dependencies[POCL_INLINE_WAIT_LIST_SIZE];
+  /* The number of events in the wait list that have not completed yet,
+     plus one while the command is being submitted. The command becomes
+     ready to execute when this drops to zero. */
+  volatile int unresolved_dependencies;
+  /* Negative in case one of the events in the wait list terminated
+     abnormally, in which case the command is terminated instead of
+     executed. */
+  cl_int dependency_status;
+  /* The links of the list of the uncompleted commands of the queue. */
+  struct _cl_command_node_struct *queue_next;
+  struct _cl_command_node_struct *queue_prev;
   cl_device_id device;
 } _cl_command_node;
 
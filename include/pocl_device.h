@@ -36,11 +36,19 @@ struct pocl_context {
   size_t num_groups[3];
   size_t group_id[3];
   size_t global_offset[3];
-  
+  /* Read only by the work-group functions compiled for any local size
+     (see POCL_DYNAMIC_LOCAL_SIZE). */
+  size_t local_size[3];
 };
 
 typedef void (*pocl_workgroup) (void **, struct pocl_context *);
 
+/* Executes the work-groups with the flat indices [first, last] (x being
+   the fastest changing dimension) in a single call. The group ids of the
+   context are ignored. */
+typedef void (*pocl_workgroup_range) (void **, struct pocl_context *,
+                                      size_t first, size_t last);
+
 #define MAX_KERNEL_ARGS 64
 #define MAX_KERNEL_NAME_LENGTH 64
 
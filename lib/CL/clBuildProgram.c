@@ -273,10 +273,19 @@ CL_API_SUFFIX__VERSION_1_0
       MEM_ASSERT(program->binaries == NULL, ERROR_CLEAN_PROGRAM);
       memset(program->binaries, 0, length);
 
-      length = sizeof(void*) * real_num_devices;
-      program->llvm_irs = (void**) realloc (program->llvm_irs, length);
-      MEM_ASSERT(program->llvm_irs == NULL, ERROR_CLEAN_PROGRAM);
-      memset(program->llvm_irs, 0, length);
+      /* The modules of a previous build are indexed by the program's
+         devices, drop them along with their contexts. */
+      if (program->llvm_irs == NULL)
+        {
+          program->llvm_irs =
+            (void**) calloc (program->num_devices, sizeof (void*));
+          MEM_ASSERT(program->llvm_irs == NULL, ERROR_CLEAN_PROGRAM);
+        }
+      else
+        {
+          for (i = 0; i < program->num_devices; ++i)
+            pocl_free_llvm_irs (program, i);
+        }
     }
 
   POCL_MSG_PRINT_INFO("building program with options %s\n",
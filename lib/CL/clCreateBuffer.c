@@ -53,8 +53,16 @@ POname(clCreateBuffer)(cl_context context,
   
   /* validate flags */
   
-  POCL_GOTO_ERROR_ON((flags > (1<<10)-1), CL_INVALID_VALUE, "Flags must "
-    "be < 1024 (there are only 10 flags)\n");
+  POCL_GOTO_ERROR_ON(((flags & ~(cl_mem_flags)(CL_MEM_HUGE_PAGES_POCL |
+    CL_MEM_NUMA_INTERLEAVED_POCL | CL_MEM_NUMA_LOCAL_POCL))
+    > (1<<10)-1), CL_INVALID_VALUE, "Flags must "
+    "be < 1024 (there are only 10 flags) apart from the pocl memory "
+    "placement ones\n");
+
+  POCL_GOTO_ERROR_ON(((flags & CL_MEM_NUMA_INTERLEAVED_POCL) &&
+    (flags & CL_MEM_NUMA_LOCAL_POCL)), CL_INVALID_VALUE, "Invalid flags: "
+    "can't have both CL_MEM_NUMA_INTERLEAVED_POCL and "
+    "CL_MEM_NUMA_LOCAL_POCL\n");
 
   POCL_GOTO_ERROR_ON(((flags & CL_MEM_READ_WRITE) &&
     (flags & CL_MEM_WRITE_ONLY || flags & CL_MEM_READ_ONLY)),
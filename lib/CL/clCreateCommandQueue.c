@@ -38,10 +38,6 @@ POname(clCreateCommandQueue)(cl_context context,
   POCL_GOTO_ERROR_ON((properties > (1<<2)-1), CL_INVALID_VALUE,
             "Properties must be <= 3 (there are only 2)\n");
 
-  /* we don't handle out-of-order queues yet */
-  POCL_GOTO_ERROR_ON((properties & CL_QUEUE_OUT_OF_ORDER_EXEC_MODE_ENABLE),
-      CL_INVALID_QUEUE_PROPERTIES, "Pocl doesn't have out-of-order queues yet\n");
-
   for (i=0; i<context->num_devices; i++)
     {
       if (context->devices[i] == device)
@@ -51,6 +47,12 @@ POname(clCreateCommandQueue)(cl_context context,
   POCL_GOTO_ERROR_ON((found == CL_FALSE), CL_INVALID_DEVICE,
                                 "Could not find device i2An the context\n");
 
+  POCL_GOTO_ERROR_ON((properties & CL_QUEUE_OUT_OF_ORDER_EXEC_MODE_ENABLE &&
+                      !(device->queue_properties & 
+                        CL_QUEUE_OUT_OF_ORDER_EXEC_MODE_ENABLE)),
+      CL_INVALID_QUEUE_PROPERTIES, 
+      "The device doesn't support out-of-order queues\n");
+
   cl_command_queue command_queue = (cl_command_queue) malloc(sizeof(struct _cl_command_queue));
   if (command_queue == NULL)
   {
@@ -63,7 +65,11 @@ POname(clCreateCommandQueue)(cl_context context,
   command_queue->context = context;
   command_queue->device = device;
   command_queue->properties = properties;
-  command_queue->root = NULL;
+  command_queue->last_event = NULL;
+  command_queue->barrier_event = NULL;
+  command_queue->commands = NULL;
+  command_queue->command_count = 0;
+  pthread_cond_init (&command_queue->idle_cond, NULL);
 
   if (errcode_ret != NULL)
     *errcode_ret = CL_SUCCESS;
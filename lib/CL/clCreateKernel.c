@@ -101,6 +101,8 @@ POname(clCreateKernel)(cl_program program,
   kernel->context = program->context;
   kernel->program = program;
   kernel->next = NULL;
+  memset ((void*)kernel->wg_cache, 0, sizeof (kernel->wg_cache));
+  POCL_INIT_LOCK (kernel->wg_cache_lock);
 
   POCL_LOCK_OBJ (program);
   cl_kernel k = program->kernels;
@@ -24,13 +24,30 @@
 #include "pocl_util.h"
 #include "pocl_cl.h"
 
+/* The affinity domains tried for CL_DEVICE_AFFINITY_DOMAIN_NEXT_PARTITIONABLE,
+   from the largest to the smallest. */
+static const cl_device_affinity_domain affinity_domains[] = {
+  CL_DEVICE_AFFINITY_DOMAIN_NUMA,
+  CL_DEVICE_AFFINITY_DOMAIN_L4_CACHE,
+  CL_DEVICE_AFFINITY_DOMAIN_L3_CACHE,
+  CL_DEVICE_AFFINITY_DOMAIN_L2_CACHE,
+  CL_DEVICE_AFFINITY_DOMAIN_L1_CACHE
+};
+
+static int
+supports_partition_type (cl_device_id device,
+                         cl_device_partition_property type)
+{
+  const cl_device_partition_property *p;
+  for (p = device->device_partition_properties; *p != 0; ++p)
+    if (*p == type)
+      return 1;
+  return 0;
+}
 
 /* Creates an array of sub-devices that each reference a non-intersecting 
    set of compute units within in_device, according to a partition scheme 
    given by properties. */
-    
-
-  
 CL_API_ENTRY cl_int CL_API_CALL
 POname(clCreateSubDevices)(cl_device_id in_device,
                            const cl_device_partition_property *properties,
@@ -38,37 +55,160 @@ POname(clCreateSubDevices)(cl_device_id in_device,
                            cl_device_id *out_devices,
                            cl_uint *num_devices_ret) CL_API_SUFFIX__VERSION_1_2
 {
-   int errcode;
-   cl_device_id sub1 = in_device;
-   cl_device_id sub2 = in_device;
+  int errcode;
+  unsigned *counts = NULL;
+  unsigned num_parts = 0, total = 0, first, i;
+  size_t num_properties = 0;
+  cl_device_partition_property *partition_type = NULL;
+  cl_device_affinity_domain domain;
+  cl_device_id sub;
 
-   POCL_GOTO_ERROR_COND((in_device == NULL), CL_INVALID_DEVICE);
+  POCL_GOTO_ERROR_COND((in_device == NULL), CL_INVALID_DEVICE);
+  POCL_GOTO_ERROR_COND((properties == NULL), CL_INVALID_VALUE);
 
-   POCL_INIT_OBJECT(sub1);
-   sub1->parent_device = in_device;
+  POCL_GOTO_ERROR_ON((in_device->ops->init_sub_device == NULL
+                      || !supports_partition_type (in_device, properties[0])),
+                     CL_INVALID_VALUE, "The device does not support the "
+                     "partition type %lx\n", (unsigned long)properties[0]);
 
-   POCL_INIT_OBJECT(sub2);
-   sub2->parent_device = in_device;
-   
-   out_devices[0] = sub1;
-   out_devices[1] = sub2;
+  /* A device cannot have more sub-devices than compute units. */
+  counts = (unsigned*)calloc (in_device->max_compute_units, sizeof (unsigned));
+  POCL_GOTO_ERROR_COND((counts == NULL), CL_OUT_OF_HOST_MEMORY);
 
-   POCL_RETAIN_OBJECT(in_device);
-   POCL_RETAIN_OBJECT(in_device);
-   
-   return CL_SUCCESS;
-    
-ERROR: 
-   if (&sub1 == &sub2) 
-     {
-        POCL_MEM_FREE(sub1);
-     } 
-   else 
-     {
-        POCL_MEM_FREE(sub1);
-        POCL_MEM_FREE(sub2);
-     }
-   return errcode;
+  switch (properties[0])
+    {
+    case CL_DEVICE_PARTITION_EQUALLY:
+      POCL_GOTO_ERROR_ON((properties[1] <= 0), CL_INVALID_VALUE,
+                         "The number of compute units must be positive\n");
+      num_parts = in_device->max_compute_units / properties[1];
+      POCL_GOTO_ERROR_ON((num_parts == 0), CL_DEVICE_PARTITION_FAILED,
+                         "The device has fewer than %lu compute units\n",
+                         (unsigned long)properties[1]);
+      for (i = 0; i < num_parts; ++i)
+        counts[i] = properties[1];
+      num_properties = 2;
+      break;
+
+    case CL_DEVICE_PARTITION_BY_COUNTS:
+      for (i = 1; properties[i] != CL_DEVICE_PARTITION_BY_COUNTS_LIST_END;
+           ++i)
+        {
+          POCL_GOTO_ERROR_ON((properties[i] <= 0),
+                             CL_INVALID_DEVICE_PARTITION_COUNT,
+                             "The compute unit counts must be positive\n");
+          POCL_GOTO_ERROR_ON((num_parts == in_device->max_compute_units
+                              || total + properties[i]
+                                 > in_device->max_compute_units),
+                             CL_INVALID_DEVICE_PARTITION_COUNT,
+                             "The device has only %u compute units\n",
+                             in_device->max_compute_units);
+          counts[num_parts++] = properties[i];
+          total += properties[i];
+        }
+      POCL_GOTO_ERROR_ON((num_parts == 0), CL_INVALID_VALUE,
+                         "No compute unit counts given\n");
+      num_properties = i + 1;
+      break;
+
+    case CL_DEVICE_PARTITION_BY_AFFINITY_DOMAIN:
+      domain = (cl_device_affinity_domain)properties[1];
+      POCL_GOTO_ERROR_ON((in_device->ops->partition_by_affinity == NULL
+                          || (domain & ~in_device->partition_affinity_domains)
+                          || (domain & (domain - 1)) || domain == 0),
+                         CL_INVALID_VALUE, "Unsupported affinity domain "
+                         "%lx\n", (unsigned long)domain);
+      if (domain == CL_DEVICE_AFFINITY_DOMAIN_NEXT_PARTITIONABLE)
+        {
+          /* The first level that actually splits the device. */
+          for (i = 0; i < sizeof (affinity_domains)
+                 / sizeof (affinity_domains[0]); ++i)
+            {
+              num_parts = in_device->ops->partition_by_affinity
+                (in_device, affinity_domains[i], counts,
+                 in_device->max_compute_units);
+              if (num_parts > 1)
+                {
+                  domain = affinity_domains[i];
+                  break;
+                }
+            }
+          if (num_parts < 2)
+            num_parts = 0;
+        }
+      else
+        num_parts = in_device->ops->partition_by_affinity
+          (in_device, domain, counts, in_device->max_compute_units);
+      POCL_GOTO_ERROR_ON((num_parts == 0), CL_DEVICE_PARTITION_FAILED,
+                         "The device cannot be partitioned by the affinity "
+                         "domain %lx\n", (unsigned long)domain);
+      num_properties = 2;
+      break;
+    }
+
+  POCL_GOTO_ERROR_COND((out_devices != NULL && num_devices < num_parts),
+                       CL_INVALID_VALUE);
+
+  if (num_devices_ret != NULL)
+    *num_devices_ret = num_parts;
+
+  if (out_devices == NULL)
+    {
+      POCL_MEM_FREE (counts);
+      return CL_SUCCESS;
+    }
+
+  first = 0;
+  for (i = 0; i < num_parts; ++i)
+    {
+      /* The properties the sub-device was created with, with the affinity
+         domain actually used for the next partitionable one. */
+      partition_type = (cl_device_partition_property*)
+        malloc ((num_properties + 1) * sizeof (cl_device_partition_property));
+      sub = (cl_device_id)malloc (sizeof (struct _cl_device_id));
+      if (partition_type == NULL || sub == NULL)
+        {
+          POCL_MEM_FREE (partition_type);
+          POCL_MEM_FREE (sub);
+          errcode = CL_OUT_OF_HOST_MEMORY;
+          goto ERROR_SUB_DEVICES;
+        }
+      memcpy (partition_type, properties,
+              num_properties * sizeof (cl_device_partition_property));
+      partition_type[num_properties] = 0;
+      if (properties[0] == CL_DEVICE_PARTITION_BY_AFFINITY_DOMAIN)
+        partition_type[1] = domain;
+
+      /* The sub-device shares the memories and the compiled kernels of
+         its parent, only the execution resources are its own. */
+      *sub = *in_device;
+      POCL_INIT_OBJECT(sub);
+      sub->parent_device = in_device;
+      sub->partition_type = partition_type;
+      sub->max_compute_units = counts[i];
+      sub->type &= ~CL_DEVICE_TYPE_DEFAULT;
+      sub->data = NULL;
+      sub->executor = NULL;
+
+      errcode = in_device->ops->init_sub_device (sub, first);
+      if (errcode != CL_SUCCESS)
+        {
+          POCL_MEM_FREE (partition_type);
+          POCL_MEM_FREE (sub);
+          goto ERROR_SUB_DEVICES;
+        }
+      POname(clRetainDevice) (in_device);
+      out_devices[i] = sub;
+      first += counts[i];
+    }
+
+  POCL_MEM_FREE (counts);
+  return CL_SUCCESS;
 
+ERROR_SUB_DEVICES:
+  while (i > 0)
+    POname(clReleaseDevice) (out_devices[--i]);
+ERROR:
+  POCL_MEM_FREE (counts);
+  return errcode;
 }
 POsym(clCreateSubDevices)
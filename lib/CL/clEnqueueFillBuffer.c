@@ -0,0 +1,131 @@
+/* OpenCL runtime library: clEnqueueFillBuffer()
+
+   Copyright (c) 2015 pocl developers
+   
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+   
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+   
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+   THE SOFTWARE.
+*/
+
+
+#include "pocl_util.h"
+#include <assert.h>
+#include <string.h>
+
+CL_API_ENTRY cl_int CL_API_CALL
+POname(clEnqueueFillBuffer)(cl_command_queue  command_queue,
+                            cl_mem            buffer,
+                            const void *      pattern,
+                            size_t            pattern_size,
+                            size_t            offset,
+                            size_t            size,
+                            cl_uint           num_events_in_wait_list,
+                            const cl_event*   event_wait_list,
+                            cl_event*         event)
+CL_API_SUFFIX__VERSION_1_2
+{
+  cl_device_id device_id;
+  unsigned i;
+  _cl_command_node *cmd = NULL;
+  void *fill_pattern = NULL;
+  int errcode;
+
+  POCL_RETURN_ERROR_COND((command_queue == NULL), CL_INVALID_COMMAND_QUEUE);
+
+  POCL_RETURN_ERROR_COND((buffer == NULL), CL_INVALID_MEM_OBJECT);
+
+  POCL_RETURN_ERROR_ON((buffer->type != CL_MEM_OBJECT_BUFFER),
+      CL_INVALID_MEM_OBJECT, "buffer is not a CL_MEM_OBJECT_BUFFER\n");
+
+  POCL_RETURN_ERROR_ON((command_queue->context != buffer->context),
+      CL_INVALID_CONTEXT,
+      "buffer and command_queue are not from the same context\n");
+
+  POCL_RETURN_ERROR_COND((pattern == NULL), CL_INVALID_VALUE);
+
+  POCL_RETURN_ERROR_ON((pattern_size == 0 || pattern_size > 128
+      || (pattern_size & (pattern_size - 1)) != 0), CL_INVALID_VALUE,
+      "pattern_size (%zu) is not one of {1, 2, 4, 8, 16, 32, 64, 128}\n",
+      pattern_size);
+
+  POCL_RETURN_ERROR_ON((offset % pattern_size != 0), CL_INVALID_VALUE,
+      "offset (%zu) is not a multiple of pattern_size (%zu)\n",
+      offset, pattern_size);
+
+  POCL_RETURN_ERROR_ON((size % pattern_size != 0), CL_INVALID_VALUE,
+      "size (%zu) is not a multiple of pattern_size (%zu)\n",
+      size, pattern_size);
+
+  POCL_RETURN_ERROR_ON((offset > buffer->size || size > buffer->size
+      || offset + size > buffer->size), CL_INVALID_VALUE,
+      "offset + size (%zu) > buffer->size (%zu)\n",
+      offset + size, buffer->size);
+
+  POCL_RETURN_ERROR_COND((event_wait_list == NULL && num_events_in_wait_list > 0),
+    CL_INVALID_EVENT_WAIT_LIST);
+
+  POCL_RETURN_ERROR_COND((event_wait_list != NULL && num_events_in_wait_list == 0),
+    CL_INVALID_EVENT_WAIT_LIST);
+
+  device_id = command_queue->device;
+
+  for (i = 0; i < command_queue->context->num_devices; ++i)
+    {
+      if (command_queue->context->devices[i] == device_id)
+        break;
+    }
+  assert(i < command_queue->context->num_devices);
+
+  /* The pattern can be reused by the application as soon as this call
+     returns. */
+  fill_pattern = malloc (pattern_size);
+  if (fill_pattern == NULL)
+    return CL_OUT_OF_HOST_MEMORY;
+  memcpy (fill_pattern, pattern, pattern_size);
+
+  errcode = pocl_create_command (&cmd, command_queue, CL_COMMAND_FILL_BUFFER,
+                                 event, num_events_in_wait_list,
+                                 event_wait_list);
+  if (errcode != CL_SUCCESS)
+    {
+      POCL_MEM_FREE (fill_pattern);
+      return errcode;
+    }
+
+  /* The buffer is filled as a single row of pattern sized "pixels". */
+  cmd->command.fill_image.data = device_id->data;
+  cmd->command.fill_image.memobj = buffer;
+  cmd->command.fill_image.device_ptr =
+    buffer->device_ptrs[device_id->dev_id].mem_ptr;
+  cmd->command.fill_image.buffer_origin[0] = offset / pattern_size;
+  cmd->command.fill_image.buffer_origin[1] = 0;
+  cmd->command.fill_image.buffer_origin[2] = 0;
+  cmd->command.fill_image.region[0] = size / pattern_size;
+  cmd->command.fill_image.region[1] = 1;
+  cmd->command.fill_image.region[2] = 1;
+  cmd->command.fill_image.rowpitch = buffer->size;
+  cmd->command.fill_image.slicepitch = buffer->size;
+  cmd->command.fill_image.fill_pixel = fill_pattern;
+  cmd->command.fill_image.pixel_size = pattern_size;
+
+  POname(clRetainMemObject) (buffer);
+
+  pocl_command_enqueue (command_queue, cmd);
+
+  return CL_SUCCESS;
+}
+POsym(clEnqueueFillBuffer)
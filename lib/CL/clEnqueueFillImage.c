@@ -115,6 +115,7 @@ CL_API_SUFFIX__VERSION_1_2
     goto ERROR_CLEAN;
 
   cmd->command.fill_image.data = command_queue->device->data;
+  cmd->command.fill_image.memobj = NULL;
   cmd->command.fill_image.device_ptr = 
     image->device_ptrs[command_queue->device->dev_id].mem_ptr;
   memcpy (&(cmd->command.fill_image.buffer_origin), origin, 
@@ -24,9 +24,15 @@
 #include "pocl_cl.h"
 #include "utlist.h"
 #include <assert.h>
+#include <string.h>
 #include "pocl_util.h"
+#include "pocl_mem_management.h"
 #include "clEnqueueMapBuffer.h"
 
+/* The granularity the modifications of a mapped region are tracked in.
+   Consecutive modified pages are written back with a single transfer. */
+#define MAP_DIRTY_PAGE_SIZE 4096
+
 CL_API_ENTRY void * CL_API_CALL
 POname(clEnqueueMapBuffer)(cl_command_queue command_queue,
                    cl_mem           buffer,
@@ -75,12 +81,25 @@ POname(clEnqueueMapBuffer)(cl_command_queue command_queue,
       "buffer has been created with CL_MEM_HOST_READ_ONL or CL_MEM_HOST_NO_ACCESS "
       "and CL_MAP_WRITE or CL_MAP_WRITE_INVALIDATE_REGION is set in map_flags\n")
 
+  POCL_GOTO_ERROR_ON((map_flags & CL_MAP_WRITE_INVALIDATE_REGION &&
+      map_flags & (CL_MAP_READ | CL_MAP_WRITE)), CL_INVALID_VALUE,
+      "CL_MAP_WRITE_INVALIDATE_REGION cannot be combined with CL_MAP_READ "
+      "or CL_MAP_WRITE\n")
+
+  /* No flags means the region is both read and written. */
+  if ((map_flags & (CL_MAP_READ | CL_MAP_WRITE
+                    | CL_MAP_WRITE_INVALIDATE_REGION)) == 0)
+    map_flags |= CL_MAP_READ | CL_MAP_WRITE;
+
   device = command_queue->device;
  
-  /* Ensure the parent buffer is not freed prematurely. */
+  /* Ensure the parent buffer is not freed prematurely. The reference is
+     released when the region is unmapped. */
   POname(clRetainMemObject) (buffer);
 
-  mapping_info = (mem_mapping_t*) calloc (1, sizeof (mem_mapping_t));
+  /* The mappings are recycled, mapping a buffer of a device that maps in
+     place allocates nothing. */
+  mapping_info = pocl_mem_manager_new_mapping ();
   if (mapping_info == NULL)
     {
       errcode = CL_OUT_OF_HOST_MEMORY;
@@ -127,6 +146,7 @@ POname(clEnqueueMapBuffer)(cl_command_queue command_queue,
   mapping_info->host_ptr = host_ptr;
   mapping_info->offset = offset;
   mapping_info->size = size;
+  mapping_info->map_flags = map_flags;
   POCL_LOCK_OBJ (buffer);
   DL_APPEND (buffer->mappings, mapping_info);  
   POCL_UNLOCK_OBJ (buffer);
@@ -152,7 +172,7 @@ POname(clEnqueueMapBuffer)(cl_command_queue command_queue,
     POCL_MEM_FREE(*event);
   POCL_MEM_FREE(cmd);
   POCL_MEM_FREE(event);
-  POCL_MEM_FREE(mapping_info);
+  pocl_mem_manager_free_mapping (mapping_info);
   if (errcode_ret)
     *errcode_ret = errcode;
   return NULL;
@@ -164,15 +184,93 @@ pocl_map_mem_cmd(cl_device_id device,
                  cl_mem buffer, 
                  mem_mapping_t *mapping_info) {
 
-
-  
   /* The second call ensures the memory is flushed/updated to the
-     host location. */
-  device->ops->map_mem 
-    (device->data, buffer->device_ptrs[device->dev_id].mem_ptr, 
-     mapping_info->offset, mapping_info->size, mapping_info->host_ptr);
+     host location. The contents of an invalidated region are undefined
+     anyway, thus they are not read. */
+  if (!(mapping_info->map_flags & CL_MAP_WRITE_INVALIDATE_REGION))
+    device->ops->map_mem 
+      (device->data, buffer->device_ptrs[device->dev_id].mem_ptr, 
+       mapping_info->offset, mapping_info->size, mapping_info->host_ptr);
+
+  /* Remember what was read to find the pages the host writes to. In case
+     there is no memory for the copy, the whole region is written back. */
+  if (device->ops->unmap_mem != NULL
+      && (mapping_info->map_flags & CL_MAP_WRITE)
+      && mapping_info->size > 0)
+    {
+      mapping_info->clean_copy = malloc (mapping_info->size);
+      if (mapping_info->clean_copy != NULL)
+        memcpy (mapping_info->clean_copy, mapping_info->host_ptr,
+                mapping_info->size);
+    }
   
   buffer->map_count++;
   return mapping_info->host_ptr;
 
 }
+
+/* Writes back the runs of consecutive pages of the mapping that differ
+   from the copy taken at map time. */
+static void
+write_back_dirty_pages (cl_device_id device, void *device_ptr,
+                        mem_mapping_t *mapping)
+{
+  const char *host = (const char*)mapping->host_ptr;
+  const char *clean = (const char*)mapping->clean_copy;
+  size_t page, len, dirty_start = 0;
+  int in_run = 0;
+
+  for (page = 0; page < mapping->size; page += MAP_DIRTY_PAGE_SIZE)
+    {
+      len = min (mapping->size - page, (size_t)MAP_DIRTY_PAGE_SIZE);
+      if (memcmp (host + page, clean + page, len) != 0)
+        {
+          if (!in_run)
+            dirty_start = page;
+          in_run = 1;
+          continue;
+        }
+      if (in_run)
+        device->ops->write (device->data, host + dirty_start, device_ptr,
+                            mapping->offset + dirty_start,
+                            page - dirty_start);
+      in_run = 0;
+    }
+  if (in_run)
+    device->ops->write (device->data, host + dirty_start, device_ptr,
+                        mapping->offset + dirty_start,
+                        mapping->size - dirty_start);
+}
+
+void
+pocl_unmap_mem_cmd(cl_device_id device,
+                   cl_mem memobj,
+                   mem_mapping_t *mapping_info)
+{
+  void *device_ptr = memobj->device_ptrs[device->dev_id].mem_ptr;
+
+  /* Devices that map in place see the host writes as they happen. */
+  if (device->ops->unmap_mem != NULL)
+    {
+      if (mapping_info->map_flags & CL_MAP_WRITE_INVALIDATE_REGION
+          || (mapping_info->map_flags & CL_MAP_WRITE
+              && mapping_info->clean_copy == NULL))
+        {
+          if (mapping_info->size > 0)
+            device->ops->write (device->data, mapping_info->host_ptr,
+                                device_ptr, mapping_info->offset,
+                                mapping_info->size);
+        }
+      else if (mapping_info->map_flags & CL_MAP_WRITE)
+        write_back_dirty_pages (device, device_ptr, mapping_info);
+
+      /* The host_ptr of the buffer is the user's memory. */
+      if (!(memobj->flags & CL_MEM_USE_HOST_PTR))
+        device->ops->unmap_mem (device->data, mapping_info->host_ptr,
+                                device_ptr, mapping_info->size);
+    }
+
+  POCL_MEM_FREE (mapping_info->clean_copy);
+  memobj->map_count--;
+  pocl_mem_manager_free_mapping (mapping_info);
+}
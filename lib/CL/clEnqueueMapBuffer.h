@@ -32,4 +32,11 @@ pocl_map_mem_cmd(cl_device_id device,
                  cl_mem buffer, 
                  mem_mapping_t *mapping_info);
 
+/* Writes the parts of the mapped region the host modified back to the
+   device and releases the mapping. */
+void
+pocl_unmap_mem_cmd(cl_device_id device,
+                   cl_mem memobj,
+                   mem_mapping_t *mapping_info);
+
 #endif
@@ -24,6 +24,7 @@
 #include "pocl_cl.h"
 #include "pocl_image_util.h"
 #include "pocl_util.h"
+#include "pocl_mem_management.h"
 #include "utlist.h"
 #include <stdlib.h>
 #include <string.h>
@@ -92,7 +93,7 @@ CL_API_SUFFIX__VERSION_1_0
   
   offset = image->image_channels * image->image_elem_size * origin[0];
   
-  mapping_info = (mem_mapping_t*) malloc (sizeof (mem_mapping_t));
+  mapping_info = pocl_mem_manager_new_mapping ();
   if (mapping_info == NULL)
     {
       errcode = CL_OUT_OF_HOST_MEMORY;
@@ -135,17 +136,21 @@ CL_API_SUFFIX__VERSION_1_0
   mapping_info->host_ptr = map;
   mapping_info->offset = offset;
   mapping_info->size = 0;/* not needed ?? */
-  POCL_LOCK_OBJ (image);
-  DL_APPEND (image->mappings, mapping_info);
-  POCL_UNLOCK_OBJ (image);
+  mapping_info->map_flags = map_flags;
 
   errcode = pocl_create_command (&cmd, command_queue, CL_COMMAND_MAP_IMAGE, 
                                  event, num_events_in_wait_list, 
                                  event_wait_list);
   if (errcode != CL_SUCCESS)
     goto ERROR;
+
+  POCL_LOCK_OBJ (image);
+  DL_APPEND (image->mappings, mapping_info);
+  POCL_UNLOCK_OBJ (image);
       
   
+  /* Released when the image is unmapped. */
+  POname(clRetainMemObject) (image);
   cmd->command.map.buffer = image;
   cmd->command.map.mapping = mapping_info;
   pocl_command_enqueue(command_queue, cmd);
@@ -167,7 +172,7 @@ CL_API_SUFFIX__VERSION_1_0
  ERROR:
   POCL_MEM_FREE(map);
   POCL_MEM_FREE(cmd);
-  POCL_MEM_FREE(mapping_info);
+  pocl_mem_manager_free_mapping (mapping_info);
   if (event != NULL)
     POCL_MEM_FREE(*event);
   if(errcode_ret != NULL)
@@ -26,6 +26,7 @@
 #include "pocl_cl.h"
 #include "pocl_llvm.h"
 #include "pocl_util.h"
+#include "pocl_wg_cache.h"
 #include "utlist.h"
 #ifndef _MSC_VER
 #  include <unistd.h>
@@ -42,6 +43,75 @@
 
 //#define DEBUG_NDRANGE
 
+/* Creates the kernel compiler cache directory of a new launch
+   configuration and, unless the device JIT compiles the work-group
+   functions itself, generates the work-group function bitcode there.
+   Records the configuration to the kernel's cache. Must be called with
+   the kernel's wg_cache_lock held. */
+static cl_int
+prepare_configuration (cl_device_id device, cl_kernel kernel,
+                       size_t local_x, size_t local_y, size_t local_z,
+                       pocl_wg_cache_entry **entry)
+{
+  char cachedir[POCL_FILENAME_LENGTH];
+  char kernel_filename[POCL_FILENAME_LENGTH];
+  char parallel_filename[POCL_FILENAME_LENGTH];
+  char so_filename[POCL_FILENAME_LENGTH];
+  char *tmp_dir;
+  int error;
+
+  snprintf (cachedir, POCL_FILENAME_LENGTH, "%s/%s/%s/%zu-%zu-%zu",
+            kernel->program->cache_dir, device->cache_dir_name,
+            kernel->name,
+            local_x, local_y, local_z);
+
+  if (access (cachedir, F_OK) != 0)
+    mkdir (cachedir, S_IRWXU);
+  
+  error = snprintf
+          (parallel_filename, POCL_FILENAME_LENGTH,
+          "%s/%s", cachedir, POCL_PARALLEL_BC_FILENAME);
+  if (error < 0)
+    return CL_OUT_OF_HOST_MEMORY;
+
+  error = snprintf
+          (so_filename, POCL_FILENAME_LENGTH,
+          "%s/%s.so", cachedir, kernel->name);
+  if (error < 0)
+    return CL_OUT_OF_HOST_MEMORY;
+
+  error = snprintf
+          (kernel_filename, POCL_FILENAME_LENGTH,
+           "%s/%s/%s", kernel->program->cache_dir,
+           device->cache_dir_name, POCL_PROGRAM_BC_FILENAME);
+  if (error < 0)
+    return CL_OUT_OF_HOST_MEMORY;
+
+  /* A JIT device generates the work-group function in memory when it
+     executes the command. */
+  if (!device->jit_workgroup_functions
+      && access(so_filename, F_OK) != 0)
+    {
+      error = pocl_llvm_generate_workgroup_function
+          (device, kernel, local_x, local_y, local_z,
+           parallel_filename, kernel_filename);
+
+      if (error)  return error;
+    }
+
+  tmp_dir = strdup (cachedir);
+  if (tmp_dir == NULL)
+    return CL_OUT_OF_HOST_MEMORY;
+  *entry = pocl_wg_cache_insert (kernel, device, local_x, local_y, local_z,
+                                 tmp_dir);
+  if (*entry == NULL)
+    {
+      POCL_MEM_FREE (tmp_dir);
+      return CL_OUT_OF_HOST_MEMORY;
+    }
+  return CL_SUCCESS;
+}
+
 CL_API_ENTRY cl_int CL_API_CALL
 POname(clEnqueueNDRangeKernel)(cl_command_queue command_queue,
                        cl_kernel kernel,
@@ -56,12 +126,10 @@ POname(clEnqueueNDRangeKernel)(cl_command_queue command_queue,
   size_t offset_x, offset_y, offset_z;
   size_t global_x, global_y, global_z;
   size_t local_x, local_y, local_z;
-  char cachedir[POCL_FILENAME_LENGTH];
-  char kernel_filename[POCL_FILENAME_LENGTH];
-  char parallel_filename[POCL_FILENAME_LENGTH];
-  char so_filename[POCL_FILENAME_LENGTH];
+  size_t wg_x, wg_y, wg_z;
   int i, count;
-  int error;
+  int error = CL_SUCCESS;
+  pocl_wg_cache_entry *wg_entry;
   struct pocl_context pc;
   _cl_command_node *command_node;
 
@@ -231,41 +299,26 @@ POname(clEnqueueNDRangeKernel)(cl_command_queue command_queue,
     CL_INVALID_EVENT_WAIT_LIST);
 
 
-  snprintf (cachedir, POCL_FILENAME_LENGTH, "%s/%s/%s/%zu-%zu-%zu",
-            kernel->program->cache_dir, command_queue->device->cache_dir_name,
-            kernel->name,
-            local_x, local_y, local_z);
-
-  if (access (cachedir, F_OK) != 0)
-    mkdir (cachedir, S_IRWXU);
-  
-  error = snprintf
-          (parallel_filename, POCL_FILENAME_LENGTH,
-          "%s/%s", cachedir, POCL_PARALLEL_BC_FILENAME);
-  if (error < 0)
-    return CL_OUT_OF_HOST_MEMORY;
-
-  error = snprintf
-          (so_filename, POCL_FILENAME_LENGTH,
-          "%s/%s.so", cachedir, kernel->name);
-  if (error < 0)
-    return CL_OUT_OF_HOST_MEMORY;
-
-  error = snprintf
-          (kernel_filename, POCL_FILENAME_LENGTH,
-           "%s/%s/%s", kernel->program->cache_dir,
-           command_queue->device->cache_dir_name, POCL_PROGRAM_BC_FILENAME);
-  if (error < 0)
-    return CL_OUT_OF_HOST_MEMORY;
-
-  if (access(so_filename, F_OK) != 0)
+  /* Only the first launch of a configuration touches the file system;
+     the later ones find the prepared configuration in the kernel. */
+  wg_x = local_x;
+  wg_y = local_y;
+  wg_z = local_z;
+  pocl_wg_cache_compiled_local_size (kernel, command_queue->device,
+                                     &wg_x, &wg_y, &wg_z);
+  wg_entry = pocl_wg_cache_lookup (kernel, command_queue->device,
+                                   wg_x, wg_y, wg_z);
+  if (wg_entry == NULL)
     {
-      error = pocl_llvm_generate_workgroup_function
-          (command_queue->device,
-           kernel, local_x, local_y, local_z,
-           parallel_filename, kernel_filename);
-
-      if (error)  return error;
+      POCL_LOCK (kernel->wg_cache_lock);
+      wg_entry = pocl_wg_cache_lookup (kernel, command_queue->device,
+                                       wg_x, wg_y, wg_z);
+      if (wg_entry == NULL)
+        error = prepare_configuration (command_queue->device, kernel,
+                                       wg_x, wg_y, wg_z, &wg_entry);
+      POCL_UNLOCK (kernel->wg_cache_lock);
+      if (error != CL_SUCCESS)
+        return error;
     }
 
   error = pocl_create_command (&command_node, command_queue,
@@ -282,10 +335,13 @@ POname(clEnqueueNDRangeKernel)(cl_command_queue command_queue,
   pc.global_offset[0] = offset_x;
   pc.global_offset[1] = offset_y;
   pc.global_offset[2] = offset_z;
+  pc.local_size[0] = local_x;
+  pc.local_size[1] = local_y;
+  pc.local_size[2] = local_z;
 
   command_node->type = CL_COMMAND_NDRANGE_KERNEL;
   command_node->command.run.data = command_queue->device->data;
-  command_node->command.run.tmp_dir = strdup(cachedir);
+  command_node->command.run.tmp_dir = wg_entry->tmp_dir;
   command_node->command.run.kernel = kernel;
   command_node->command.run.pc = pc;
   command_node->command.run.local_x = local_x;
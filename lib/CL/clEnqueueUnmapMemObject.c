@@ -53,12 +53,16 @@ POname(clEnqueueUnmapMemObject)(cl_command_queue command_queue,
   POCL_RETURN_ERROR_COND((event_wait_list != NULL && num_events_in_wait_list == 0),
     CL_INVALID_EVENT_WAIT_LIST);
 
+  /* The mapping is taken off the list right away so the same pointer
+     cannot be unmapped twice. The unmap command owns it from now on. */
   POCL_LOCK_OBJ (memobj);
   DL_FOREACH (memobj->mappings, mapping)
     {
       if (mapping->host_ptr == mapped_ptr)
           break;
     }
+  if (mapping != NULL)
+    DL_DELETE (memobj->mappings, mapping);
   POCL_UNLOCK_OBJ (memobj);
   POCL_RETURN_ERROR_ON((mapping == NULL), CL_INVALID_VALUE,
       "Could not find mapping of this memobj\n");
@@ -88,8 +92,9 @@ POname(clEnqueueUnmapMemObject)(cl_command_queue command_queue,
   return CL_SUCCESS;
 
  ERROR:
-  POCL_MEM_FREE(*event);
-  POCL_MEM_FREE(cmd);
+  POCL_LOCK_OBJ (memobj);
+  DL_APPEND (memobj->mappings, mapping);
+  POCL_UNLOCK_OBJ (memobj);
   return errcode;
 }
 POsym(clEnqueueUnmapMemObject)
@@ -94,19 +94,11 @@ POname(clEnqueueWriteBufferRect)(cl_command_queue command_queue,
   /* execute directly */
   /* TODO: enqueue the write_rect if this is a non-blocking read (see
      clEnqueueWriteBuffer) */
-  if (command_queue->properties & CL_QUEUE_OUT_OF_ORDER_EXEC_MODE_ENABLE)
-    {
-      /* wait for the event in event_wait_list to finish */
-      POCL_ABORT_UNIMPLEMENTED("clEnqueueReadBufferRect: Out-of-order queue");
-    }
-  else
-    {
-      /* in-order queue - all previously enqueued commands must 
-       * finish before this read */
-      // ensure our buffer is not freed yet
-      POname(clRetainMemObject) (buffer);
-      POname(clFinish)(command_queue);
-    }
+  /* All previously enqueued commands must finish before this one. In
+     out-of-order queues this is a superset of the event wait list. */
+  // ensure our buffer is not freed yet
+  POname(clRetainMemObject) (buffer);
+  POname(clFinish)(command_queue);
 
   POCL_UPDATE_EVENT_RUNNING(event, command_queue);
 
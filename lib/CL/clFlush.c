@@ -30,8 +30,10 @@ POname(clFlush)(cl_command_queue command_queue) CL_API_SUFFIX__VERSION_1_0
   /* "clFlush only guarantees that all queued commands to command_queue
      will eventually be submitted to the appropriate device. There is no guarantee 
      that they will be complete after clFlush returns." */
-  /* This could be implemented as an asyc clFinish(), executing it in another
-     thread? */
-  return POname(clFinish) (command_queue);
+  /* The commands are handed to the device's executor already at enqueue
+     time, thus there is nothing left to do here. */
+  POCL_RETURN_ERROR_COND((command_queue == NULL), CL_INVALID_COMMAND_QUEUE);
+
+  return CL_SUCCESS;
 }
 POsym(clFlush)
@@ -232,24 +232,38 @@ POname(clGetDeviceInfo)(cl_device_id   device,
   case CL_DEVICE_BUILT_IN_KERNELS                  :
     POCL_RETURN_GETINFO_STR("");
 
-  /* TODO proper device partition support. For the time being,
-   * the values returned only serve the purpose of indicating
-   * that it is not actually supported */
   case CL_DEVICE_PARENT_DEVICE                     :
-    POCL_RETURN_GETINFO(cl_device_id, NULL);
+    POCL_RETURN_GETINFO(cl_device_id, device->parent_device);
   case CL_DEVICE_PARTITION_MAX_SUB_DEVICES         :
-    POCL_RETURN_GETINFO(cl_uint, 2);
+    POCL_RETURN_GETINFO(cl_uint, (device->device_partition_properties[0] != 0)
+                        ? device->max_compute_units : 0);
   case CL_DEVICE_PARTITION_PROPERTIES              :
+    {
+      /* The supported partition types, or { 0 } if there are none. */
+      size_t n = 0;
+      while (device->device_partition_properties[n] != 0)
+        ++n;
+      POCL_RETURN_GETINFO_SIZE(max (n, (size_t)1)
+                               * sizeof (cl_device_partition_property),
+                               device->device_partition_properties);
+    }
   case CL_DEVICE_PARTITION_TYPE                    :
     {
-      /* since we don't support sub-devices, querying the partition type
-       * presently returns the same thing as querying the available partition
-       * properties, i.e. { 0} */
-      typedef struct { cl_device_partition_property prop[1]; } dev_pp_1;
-      POCL_RETURN_GETINFO(dev_pp_1, *(const dev_pp_1*)device->device_partition_properties);
+      /* The properties the sub-device was created with, { 0 } for the
+         root devices. */
+      static const cl_device_partition_property none = 0;
+      size_t n = 0;
+      if (device->partition_type == NULL)
+        POCL_RETURN_GETINFO_SIZE(sizeof (cl_device_partition_property),
+                                 &none);
+      while (device->partition_type[n] != 0)
+        ++n;
+      POCL_RETURN_GETINFO_SIZE((n + 1) * sizeof (cl_device_partition_property),
+                               device->partition_type);
     }
   case CL_DEVICE_PARTITION_AFFINITY_DOMAIN         :
-    POCL_RETURN_GETINFO(cl_device_affinity_domain, 0);
+    POCL_RETURN_GETINFO(cl_device_affinity_domain,
+                        device->partition_affinity_domains);
 
   case CL_DEVICE_PREFERRED_INTEROP_USER_SYNC       :
     POCL_RETURN_GETINFO(cl_bool, CL_TRUE);
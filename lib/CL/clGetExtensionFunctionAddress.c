@@ -1,7 +1,14 @@
 #include "pocl_cl.h"
+#include "pocl_mem_management.h"
 
 #include <string.h>
 
+static cl_ulong CL_API_CALL
+get_allocation_count (void)
+{
+  return pocl_mem_manager_allocation_count ();
+}
+
 /* Note - this is deprecated in 1.1, but (some of) the ICD loaders are built
  * against OCL 1.1, so we need it.
  */ 
@@ -16,6 +23,8 @@ CL_EXT_SUFFIX__VERSION_1_0
 #endif
   if( strcmp(func_name, "clGetPlatformInfo")==0 )
     return (void *)&POname(clGetPlatformInfo);
+  if( strcmp(func_name, "clGetAllocationCountPOCL")==0 )
+    return (void *)&get_allocation_count;
   
   return NULL;
 }
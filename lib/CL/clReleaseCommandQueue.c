@@ -34,6 +34,7 @@ POname(clReleaseCommandQueue)(cl_command_queue command_queue) CL_API_SUFFIX__VER
   POCL_RELEASE_OBJECT(command_queue, new_refcount);
   if (new_refcount == 0)
     {
+      pthread_cond_destroy (&command_queue->idle_cond);
       POCL_MEM_FREE(command_queue);
       /* TODO: should clReleaseContext()? */
     }
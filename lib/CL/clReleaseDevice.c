@@ -22,19 +22,36 @@
 */
 
 #include "pocl_cl.h"
+#include "pocl_exec.h"
 
 CL_API_ENTRY cl_int CL_API_CALL
 POname(clReleaseDevice)(cl_device_id device) CL_API_SUFFIX__VERSION_1_2 
 {
   int new_refcount;
-  POCL_RELEASE_OBJECT (device, new_refcount);
-  (void)new_refcount;
+
+  POCL_RETURN_ERROR_COND((device == NULL), CL_INVALID_DEVICE);
 
   /* Cannot free() the device driver objects because they
      can be in use in other contexts and might be needed
      later on. The device driver table initialized in devices.c
-     is reused across many contexts.
+     is reused across many contexts. Only the sub-devices are
+     reference counted.
   */
+  if (device->parent_device == NULL)
+    return CL_SUCCESS;
+
+  POCL_RELEASE_OBJECT (device, new_refcount);
+  if (new_refcount == 0)
+    {
+      /* Stop the executor threads started for the sub-device at its first
+         command and then its workers. */
+      pocl_exec_shutdown (device);
+      if (device->ops->uninit != NULL)
+        device->ops->uninit (device);
+      POname(clReleaseDevice) (device->parent_device);
+      POCL_MEM_FREE (device->partition_type);
+      POCL_MEM_FREE (device);
+    }
 
   return CL_SUCCESS;
 }
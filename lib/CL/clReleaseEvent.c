@@ -30,13 +30,14 @@ POname(clReleaseEvent)(cl_event event) CL_API_SUFFIX__VERSION_1_0
   int new_refcount;
   POCL_RETURN_ERROR_COND((event == NULL), CL_INVALID_EVENT);
 
-  POCL_RETURN_ERROR_COND((event->queue == NULL), CL_INVALID_EVENT);
-
   POCL_RELEASE_OBJECT (event, new_refcount);
 
   if (new_refcount == 0)
     {
-      POname(clReleaseCommandQueue) (event->queue);
+      /* User events are not associated with a queue. */
+      if (event->queue != NULL)
+        POname(clReleaseCommandQueue) (event->queue);
+      pthread_cond_destroy (&event->status_cond);
       pocl_mem_manager_free_event (event);
     }
 
@@ -23,6 +23,7 @@
 
 #include "pocl_cl.h"
 #include "pocl_util.h"
+#include "pocl_wg_cache.h"
 
 CL_API_ENTRY cl_int CL_API_CALL
 POname(clReleaseKernel)(cl_kernel kernel) CL_API_SUFFIX__VERSION_1_0
@@ -73,6 +74,8 @@ POname(clReleaseKernel)(cl_kernel kernel) CL_API_SUFFIX__VERSION_1_0
 
       POCL_MEM_FREE(kernel->dyn_arguments);
       POCL_MEM_FREE(kernel->reqd_wg_size);
+      pocl_wg_cache_free (kernel);
+      POCL_DESTROY_LOCK (kernel->wg_cache_lock);
       POCL_MEM_FREE(kernel);
     }
   
@@ -23,6 +23,7 @@
 
 #include "utlist.h"
 #include "pocl_cl.h"
+#include "pocl_mem_management.h"
 
 CL_API_ENTRY cl_int CL_API_CALL
 POname(clReleaseMemObject)(cl_mem memobj) CL_API_SUFFIX__VERSION_1_0
@@ -63,7 +64,8 @@ POname(clReleaseMemObject)(cl_mem memobj) CL_API_SUFFIX__VERSION_1_0
       POCL_RELEASE_OBJECT(memobj->context, new_refcount);
       DL_FOREACH_SAFE(memobj->mappings, mapping, temp)
         {
-          POCL_MEM_FREE(mapping);
+          POCL_MEM_FREE(mapping->clean_copy);
+          pocl_mem_manager_free_mapping (mapping);
         }
       memobj->mappings = NULL;
       
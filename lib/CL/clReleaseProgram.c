@@ -32,6 +32,7 @@
 
 #include "pocl_cl.h"
 #include "pocl_util.h"
+#include "pocl_llvm.h"
 #include "pocl_runtime_config.h"
 
 CL_API_ENTRY cl_int CL_API_CALL
@@ -39,6 +40,7 @@ POname(clReleaseProgram)(cl_program program) CL_API_SUFFIX__VERSION_1_0
 {
   int new_refcount;
   cl_kernel k;
+  unsigned i;
 
   POCL_RETURN_ERROR_COND((program == NULL), CL_INVALID_PROGRAM);
 
@@ -76,6 +78,11 @@ POname(clReleaseProgram)(cl_program program) CL_API_SUFFIX__VERSION_1_0
           pocl_remove_directory (program->cache_dir);
         }
 
+      if (program->llvm_irs != NULL)
+        {
+          for (i = 0; i < program->num_devices; ++i)
+            pocl_free_llvm_irs (program, i);
+        }
       POCL_MEM_FREE(program->llvm_irs);
       POCL_MEM_FREE(program->cache_dir);
       POCL_MEM_FREE(program);
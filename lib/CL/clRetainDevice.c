@@ -25,7 +25,11 @@
 CL_API_ENTRY cl_int CL_API_CALL
 POname(clRetainDevice)(cl_device_id device) CL_API_SUFFIX__VERSION_1_2
 {
-  POCL_RETAIN_OBJECT (device);
+  POCL_RETURN_ERROR_COND((device == NULL), CL_INVALID_DEVICE);
+
+  /* The root devices are not reference counted, see clReleaseDevice(). */
+  if (device->parent_device != NULL)
+    POCL_RETAIN_OBJECT (device);
   return CL_SUCCESS;
 }
 POsym(clRetainDevice)
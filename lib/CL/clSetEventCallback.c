@@ -27,7 +27,19 @@ POname(clSetEventCallback) (cl_event     event ,
   cb_ptr->trigger_status = command_exec_callback_type;
   cb_ptr->next = NULL;
 
+  /* The command might have completed already in the background, in which
+     case the executor has consumed the callback list and we must call the
+     function ourselves. */
   POCL_LOCK_OBJ (event);
+  if (event->status == CL_COMPLETE || event->status < 0)
+    {
+      POCL_UNLOCK_OBJ (event);
+      cb_ptr->callback_function (event, event->status < 0 ? event->status
+                                 : cb_ptr->trigger_status,
+                                 cb_ptr->user_data);
+      POCL_MEM_FREE (cb_ptr);
+      return CL_SUCCESS;
+    }
   LL_APPEND (event->callback_list, cb_ptr);
   POCL_UNLOCK_OBJ (event);
 
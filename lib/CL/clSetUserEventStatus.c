@@ -1,13 +1,32 @@
 #include "pocl_cl.h"
+#include "pocl_exec.h"
+
 CL_API_ENTRY cl_int CL_API_CALL
 POname(clSetUserEventStatus)(cl_event    event ,
                      cl_int      execution_status ) CL_API_SUFFIX__VERSION_1_1
 {
-  if(event == NULL)
-    return CL_INVALID_EVENT;
+  POCL_RETURN_ERROR_COND((event == NULL), CL_INVALID_EVENT);
+
+  POCL_RETURN_ERROR_COND((event->command_type != CL_COMMAND_USER),
+                         CL_INVALID_EVENT);
 
+  POCL_RETURN_ERROR_ON((execution_status != CL_COMPLETE &&
+                        execution_status >= 0), CL_INVALID_VALUE,
+       "execution status must be CL_COMPLETE or a negative error code\n");
+
+  POCL_LOCK_OBJ (event);
+  if (event->status == CL_COMPLETE || event->status < 0)
+    {
+      POCL_UNLOCK_OBJ (event);
+      POCL_RETURN_ERROR_ON(1, CL_INVALID_OPERATION,
+                           "the status of the user event was set already\n");
+    }
   event->status = execution_status;
-  
+  POCL_UNLOCK_OBJ (event);
+  /* Calls the callbacks and executes the commands waiting for the event,
+     or terminates them in case of an error status. */
+  pocl_exec_event_finished (event);
+
   return CL_SUCCESS;
 }
 POsym(clSetUserEventStatus)
@@ -28,11 +28,29 @@ POname(clWaitForEvents)(cl_uint              num_events ,
                   const cl_event *     event_list ) CL_API_SUFFIX__VERSION_1_0
 {
   int event_i;
-  // dummy implementation, waits until *all* events have completed.
+  cl_int ret = CL_SUCCESS;
+  cl_event event;
+
+  POCL_RETURN_ERROR_COND((num_events == 0 || event_list == NULL),
+                         CL_INVALID_VALUE);
+
+  for (event_i = 0; event_i < num_events; ++event_i)
+    {
+      POCL_RETURN_ERROR_COND((event_list[event_i] == NULL), CL_INVALID_EVENT);
+    }
+
+  /* The commands were submitted to the executors at enqueue time, wait
+     only for the completion of the requested ones. */
   for (event_i = 0; event_i < num_events; ++event_i)
     {
-      POname(clFinish)(event_list[event_i]->queue);
+      event = event_list[event_i];
+      POCL_LOCK_OBJ (event);
+      while (event->status > CL_COMPLETE)
+        pthread_cond_wait (&event->status_cond, &event->pocl_lock);
+      if (event->status < 0)
+        ret = CL_EXEC_STATUS_ERROR_FOR_EVENTS_IN_WAIT_LIST;
+      POCL_UNLOCK_OBJ (event);
     }
-  return CL_SUCCESS;
+  return ret;
 }
 POsym(clWaitForEvents)
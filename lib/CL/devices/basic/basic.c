@@ -28,6 +28,11 @@
 #include "common.h"
 #include "utlist.h"
 #include "devices.h"
+#include "pocl_llvm.h"
+#include "pocl_runtime_config.h"
+#include "pocl_wg_cache.h"
+#include "memfill.h"
+#include "rectcopy.h"
 
 #include <assert.h>
 #include <string.h>
@@ -35,6 +40,7 @@
 #include <dev_image.h>
 
 #ifndef _MSC_VER
+#  include <sys/stat.h>
 #  include <sys/time.h>
 #  include <unistd.h>
 #else
@@ -46,6 +52,10 @@
 #define COMMAND_LENGTH 2048
 #define WORKGROUP_STRING_LENGTH 128
 
+/* The number of launches of a local size after which a kernel compiled
+   for a dynamic local size gets a version specialized for it. */
+#define HOT_LOCAL_SIZE_LAUNCHES 8
+
 struct data {
   /* Currently loaded kernel. */
   cl_kernel current_kernel;
@@ -282,7 +292,11 @@ pocl_basic_init_device_infos(struct _cl_device_id* dev)
   dev->available = CL_TRUE;
   dev->compiler_available = CL_TRUE;
   dev->execution_capabilities = CL_EXEC_KERNEL | CL_EXEC_NATIVE_KERNEL;
-  dev->queue_properties = CL_QUEUE_PROFILING_ENABLE;
+  /* The out-of-order queues are executed by the common command executor
+     (pocl_exec.c), one command at a time unless num_executor_threads is
+     raised. */
+  dev->queue_properties = CL_QUEUE_PROFILING_ENABLE |
+    CL_QUEUE_OUT_OF_ORDER_EXEC_MODE_ENABLE;
   dev->platform = 0;
   dev->device_partition_properties[0] = 0;
   dev->printf_buffer_size = 0;
@@ -344,6 +358,12 @@ pocl_basic_init (cl_device_id device, const char* parameters)
   d->current_kernel = NULL;
   d->current_dlhandle = 0;
   device->data = d;
+  device->jit_workgroup_functions = 
+    pocl_get_bool_option (KERNEL_JIT_ENV, 1);
+  device->dynamic_local_size =
+    pocl_get_bool_option (DYNAMIC_LOCAL_SIZE_ENV, 0);
+  device->tiered_compilation =
+    pocl_get_bool_option (TIERED_COMPILATION_ENV, 0);
   pocl_topology_detect_device_info(device);
   pocl_cpuinfo_detect_device_info(device);
 
@@ -461,9 +481,8 @@ pocl_basic_run
  _cl_command_node* cmd)
 {
   struct data *d;
-  struct pocl_argument *al;
-  size_t x, y, z;
-  unsigned i;
+  void **arguments;
+  size_t num_groups;
   cl_kernel kernel = cmd->command.run.kernel;
   struct pocl_context *pc = &cmd->command.run.pc;
 
@@ -472,110 +491,22 @@ pocl_basic_run
 
   d->current_kernel = kernel;
 
-  void **arguments = (void**)malloc(
-      sizeof(void*) * (kernel->num_args + kernel->num_locals)
-    );
-
   /* Process the kernel arguments. Convert the opaque buffer
-     pointers to real device pointers, allocate dynamic local 
+     pointers to real device pointers, set up the dynamic local
      memory buffers, etc. */
-  for (i = 0; i < kernel->num_args; ++i)
-    {
-      al = &(cmd->command.run.arguments[i]);
-      if (kernel->arg_info[i].is_local)
-        {
-          arguments[i] = malloc (sizeof (void *));
-          *(void **)(arguments[i]) = pocl_basic_malloc(data, 0, al->size, NULL);
-        }
-      else if (kernel->arg_info[i].type == POCL_ARG_TYPE_POINTER)
-        {
-          /* It's legal to pass a NULL pointer to clSetKernelArguments. In 
-             that case we must pass the same NULL forward to the kernel.
-             Otherwise, the user must have created a buffer with per device
-             pointers stored in the cl_mem. */
-          if (al->value == NULL)
-            {
-              arguments[i] = malloc (sizeof (void *));
-              *(void **)arguments[i] = NULL;
-            }
-          else
-            arguments[i] = &((*(cl_mem *) (al->value))->device_ptrs[cmd->device->dev_id].mem_ptr);
-        }
-      else if (kernel->arg_info[i].type == POCL_ARG_TYPE_IMAGE)
-        {
-          dev_image_t di;
-          fill_dev_image_t (&di, al, cmd->device);
-
-          void* devptr = pocl_basic_malloc (data, 0, sizeof(dev_image_t), NULL);
-          arguments[i] = malloc (sizeof (void *));
-          *(void **)(arguments[i]) = devptr; 
-          pocl_basic_write (data, &di, devptr, 0, sizeof(dev_image_t));
-        }
-      else if (kernel->arg_info[i].type == POCL_ARG_TYPE_SAMPLER)
-        {
-          dev_sampler_t ds;
-          
-          arguments[i] = malloc (sizeof (void *));
-          *(void **)(arguments[i]) = pocl_basic_malloc 
-            (data, 0, sizeof(dev_sampler_t), NULL);
-          pocl_basic_write (data, &ds, *(void**)arguments[i], 0, 
-                            sizeof(dev_sampler_t));
-        }
-      else
-        {
-          arguments[i] = al->value;
-        }
-    }
-  for (i = kernel->num_args;
-       i < kernel->num_args + kernel->num_locals;
-       ++i)
+  arguments = pocl_setup_launch_arguments (kernel,
+                                           cmd->command.run.arguments,
+                                           cmd->device);
+  if (arguments == NULL)
     {
-      al = &(cmd->command.run.arguments[i]);
-      arguments[i] = malloc (sizeof (void *));
-      *(void **)(arguments[i]) = pocl_basic_malloc (data, 0, al->size, NULL);
+      cmd->event->status = CL_OUT_OF_RESOURCES;
+      return;
     }
 
-  for (z = 0; z < pc->num_groups[2]; ++z)
-    {
-      for (y = 0; y < pc->num_groups[1]; ++y)
-        {
-          for (x = 0; x < pc->num_groups[0]; ++x)
-            {
-              pc->group_id[0] = x;
-              pc->group_id[1] = y;
-              pc->group_id[2] = z;
-
-              cmd->command.run.wg (arguments, pc);
-
-            }
-        }
-    }
-  for (i = 0; i < kernel->num_args; ++i)
-    {
-      if (kernel->arg_info[i].is_local)
-        {
-          pocl_basic_free (data, 0, *(void **)(arguments[i]));
-          POCL_MEM_FREE(arguments[i]);
-        }
-      else if (kernel->arg_info[i].type == POCL_ARG_TYPE_IMAGE)
-        {
-          pocl_basic_free (data, 0, *(void **)(arguments[i]));
-          POCL_MEM_FREE(arguments[i]);
-        }
-      else if (kernel->arg_info[i].type == POCL_ARG_TYPE_SAMPLER || 
-               (kernel->arg_info[i].type == POCL_ARG_TYPE_POINTER && *(void**)arguments[i] == NULL))
-        {
-          POCL_MEM_FREE(arguments[i]);
-        }
-    }
-  for (i = kernel->num_args;
-       i < kernel->num_args + kernel->num_locals;
-       ++i)
-    {
-      pocl_basic_free(data, 0, *(void **)(arguments[i]));
-      POCL_MEM_FREE(arguments[i]);
-    }
-  free(arguments);
+  /* The launcher loops over the groups itself. */
+  num_groups = pc->num_groups[0] * pc->num_groups[1] * pc->num_groups[2];
+  if (num_groups > 0)
+    cmd->command.run.wg (arguments, pc, 0, num_groups - 1);
 }
 
 void
@@ -608,22 +539,12 @@ pocl_basic_copy_rect (void *data,
                       size_t const dst_row_pitch,
                       size_t const dst_slice_pitch)
 {
-  char const *__restrict const adjusted_src_ptr = 
-    (char const*)src_ptr +
-    src_origin[0] + src_row_pitch * src_origin[1] + src_slice_pitch * src_origin[2];
-  char *__restrict__ const adjusted_dst_ptr = 
-    (char*)dst_ptr +
-    dst_origin[0] + dst_row_pitch * dst_origin[1] + dst_slice_pitch * dst_origin[2];
-  
-  size_t j, k;
+  pocl_rect_transfer r;
 
-  /* TODO: handle overlaping regions */
-  
-  for (k = 0; k < region[2]; ++k)
-    for (j = 0; j < region[1]; ++j)
-      memcpy (adjusted_dst_ptr + dst_row_pitch * j + dst_slice_pitch * k,
-              adjusted_src_ptr + src_row_pitch * j + src_slice_pitch * k,
-              region[0]);
+  pocl_rect_transfer_init (&r, dst_ptr, src_ptr, dst_origin, src_origin,
+                           region, dst_row_pitch, dst_slice_pitch,
+                           src_row_pitch, src_slice_pitch);
+  pocl_rect_copy (&r);
 }
 
 void
@@ -638,22 +559,13 @@ pocl_basic_write_rect (void *data,
                        size_t const host_row_pitch,
                        size_t const host_slice_pitch)
 {
-  char *__restrict const adjusted_device_ptr = 
-    (char*)device_ptr +
-    buffer_origin[0] + buffer_row_pitch * buffer_origin[1] + buffer_slice_pitch * buffer_origin[2];
-  char const *__restrict__ const adjusted_host_ptr = 
-    (char const*)host_ptr +
-    host_origin[0] + host_row_pitch * host_origin[1] + host_slice_pitch * host_origin[2];
-  
-  size_t j, k;
+  pocl_rect_transfer r;
 
-  /* TODO: handle overlaping regions */
-  
-  for (k = 0; k < region[2]; ++k)
-    for (j = 0; j < region[1]; ++j)
-      memcpy (adjusted_device_ptr + buffer_row_pitch * j + buffer_slice_pitch * k,
-              adjusted_host_ptr + host_row_pitch * j + host_slice_pitch * k,
-              region[0]);
+  pocl_rect_transfer_init (&r, device_ptr, host_ptr, buffer_origin,
+                           host_origin, region, buffer_row_pitch,
+                           buffer_slice_pitch, host_row_pitch,
+                           host_slice_pitch);
+  pocl_rect_copy (&r);
 }
 
 void
@@ -668,22 +580,13 @@ pocl_basic_read_rect (void *data,
                       size_t const host_row_pitch,
                       size_t const host_slice_pitch)
 {
-  char const *__restrict const adjusted_device_ptr = 
-    (char const*)device_ptr +
-    buffer_origin[2] * buffer_slice_pitch + buffer_origin[1] * buffer_row_pitch + buffer_origin[0];
-  char *__restrict__ const adjusted_host_ptr = 
-    (char*)host_ptr +
-    host_origin[2] * host_slice_pitch + host_origin[1] * host_row_pitch + host_origin[0];
-  
-  size_t j, k;
-  
-  /* TODO: handle overlaping regions */
-  
-  for (k = 0; k < region[2]; ++k)
-    for (j = 0; j < region[1]; ++j)
-      memcpy (adjusted_host_ptr + host_row_pitch * j + host_slice_pitch * k,
-              adjusted_device_ptr + buffer_row_pitch * j + buffer_slice_pitch * k,
-              region[0]);
+  pocl_rect_transfer r;
+
+  pocl_rect_transfer_init (&r, host_ptr, device_ptr, host_origin,
+                           buffer_origin, region, host_row_pitch,
+                           host_slice_pitch, buffer_row_pitch,
+                           buffer_slice_pitch);
+  pocl_rect_copy (&r);
 }
 
 /* origin and region must be in original shape unlike in copy/read/write_rect()
@@ -702,15 +605,13 @@ pocl_basic_fill_rect (void *data,
     + buffer_origin[0] * pixel_size 
     + buffer_row_pitch * buffer_origin[1] 
     + buffer_slice_pitch * buffer_origin[2];
-    
-  size_t i, j, k;
-
-  for (k = 0; k < region[2]; ++k)
-    for (j = 0; j < region[1]; ++j)
-      for (i = 0; i < region[0]; ++i)
-        memcpy (adjusted_device_ptr + pixel_size * i 
-                + buffer_row_pitch * j 
-                + buffer_slice_pitch * k, fill_pixel, pixel_size);
+
+  if (region[0] == 0 || region[1] == 0 || region[2] == 0)
+    return;
+
+  pocl_fill_rows (adjusted_device_ptr, region[0] * pixel_size, region[1],
+                  buffer_row_pitch, buffer_slice_pitch,
+                  0, region[1] * region[2] - 1, fill_pixel, pixel_size);
 }
 
 void *
@@ -766,43 +667,213 @@ pocl_basic_get_supported_image_formats (cl_mem_flags flags,
     return CL_SUCCESS; 
 }
 
-typedef struct compiler_cache_item compiler_cache_item;
-struct compiler_cache_item
+/* The object file of the optimized JIT compiled work-group function of
+   the cache entry in the kernel compiler cache. */
+static void
+jit_object_filename (cl_kernel kernel, pocl_wg_cache_entry *e,
+                     char *object_filename)
 {
-  char *tmp_dir;
-  char *function_name;
-  pocl_workgroup wg;
-  compiler_cache_item *next;
-};
+  snprintf (object_filename, POCL_FILENAME_LENGTH, "%s/%s.jit.o",
+            e->tmp_dir, kernel->function_name);
+}
 
-static compiler_cache_item *compiler_cache;
-static pocl_lock_t compiler_cache_lock;
+/* Compiles the work-group function of the kernel's launch configuration
+   in memory, without going through parallel.bc, an object file and the
+   external linker. The optimized code is stored in the kernel compiler
+   cache and loaded from there by the later runs. The handle of the code
+   is stored to *jit. */
+static pocl_workgroup_range
+jit_workgroup_function (cl_kernel kernel, cl_device_id device,
+                        pocl_wg_cache_entry *e, int optimize, void **jit)
+{
+  char kernel_filename[POCL_FILENAME_LENGTH];
+  char parallel_filename[POCL_FILENAME_LENGTH];
+  char object_filename[POCL_FILENAME_LENGTH];
+  int keep_bitcode =
+    pocl_get_bool_option ("POCL_LEAVE_KERNEL_COMPILER_TEMP_FILES", 0);
+
+  /* The program bitcode is only read in case the program has no
+     in-memory IR for the device. */
+  snprintf (kernel_filename, POCL_FILENAME_LENGTH, "%s/%s/%s",
+            kernel->program->cache_dir, device->cache_dir_name,
+            POCL_PROGRAM_BC_FILENAME);
+  snprintf (parallel_filename, POCL_FILENAME_LENGTH, "%s/%s",
+            e->tmp_dir, POCL_PARALLEL_BC_FILENAME);
+  jit_object_filename (kernel, e, object_filename);
+
+  return (pocl_workgroup_range) pocl_llvm_jit_workgroup_function
+    (device, kernel, e->local_x, e->local_y, e->local_z,
+     keep_bitcode ? parallel_filename : NULL, kernel_filename,
+     optimize ? object_filename : NULL, optimize, jit);
+}
 
-void check_compiler_cache (_cl_command_node *cmd)
+/* A work-group function that runs its quickly compiled version, or the
+   generic one of a dynamic local size, until the optimized one has been
+   compiled in the background. The job holds a reference to the kernel
+   and the device, thus neither can be freed before it has finished. */
+typedef struct tier_up_job
 {
-  char workgroup_string[WORKGROUP_STRING_LENGTH];
-  lt_dlhandle dlhandle;
-  compiler_cache_item *ci = NULL;
-  
-  if (compiler_cache == NULL)
-    POCL_INIT_LOCK (compiler_cache_lock);
+  cl_kernel kernel;
+  cl_device_id device;
+  pocl_wg_cache_entry *entry;
+  struct tier_up_job *next;
+} tier_up_job;
+
+/* The jobs are compiled one at a time in the order they were queued by a
+   single thread shared by all the devices, which leaves the other cores
+   to the launches. The thread exits once it runs out of jobs and is
+   joined by queue_tier_up() before starting the next one, thus it never
+   outlives the objects of its jobs. */
+static pocl_lock_t tier_up_lock = POCL_LOCK_INITIALIZER;
+static tier_up_job *tier_up_queue = NULL;
+static pthread_t tier_up_thread_id;
+/* Nonzero while the thread is compiling the queued jobs. */
+static int tier_up_thread_running = 0;
+/* Nonzero if the thread has been started and not joined yet. */
+static int tier_up_thread_joinable = 0;
+
+static void *
+tier_up_thread (void *unused)
+{
+  tier_up_job *job;
+  pocl_workgroup_range wg;
+  void *jit;
+
+  POCL_LOCK (tier_up_lock);
+  while (tier_up_queue != NULL)
+    {
+      job = tier_up_queue;
+      LL_DELETE (tier_up_queue, job);
+      POCL_UNLOCK (tier_up_lock);
+
+      wg = jit_workgroup_function (job->kernel, job->device, job->entry, 1,
+                                   &jit);
+
+      /* The launches that loaded the quick version keep executing it, the
+         entry retires its code until the kernel is freed. */
+      POCL_LOCK (job->kernel->wg_cache_lock);
+      pocl_wg_cache_set_wg (job->entry, wg, jit);
+      POCL_UNLOCK (job->kernel->wg_cache_lock);
+
+      POname(clReleaseKernel) (job->kernel);
+      POname(clReleaseDevice) (job->device);
+      POCL_MEM_FREE (job);
+      POCL_LOCK (tier_up_lock);
+    }
+  tier_up_thread_running = 0;
+  POCL_UNLOCK (tier_up_lock);
+  return NULL;
+}
+
+/* Queues the optimized compilation of the entry's work-group function
+   for the local size of the entry, starting the thread if it is not
+   running. The entry is freed with the kernel, thus it outlives the
+   job. */
+static void
+queue_tier_up (cl_kernel kernel, cl_device_id device,
+               pocl_wg_cache_entry *e)
+{
+  tier_up_job *job = (tier_up_job*)malloc (sizeof (tier_up_job));
+  /* Running the quick version for good is not an error. */
+  if (job == NULL)
+    return;
 
-  POCL_LOCK (compiler_cache_lock);
-  LL_FOREACH (compiler_cache, ci)
+  POname(clRetainKernel) (kernel);
+  POname(clRetainDevice) (device);
+  job->kernel = kernel;
+  job->device = device;
+  job->entry = e;
+  job->next = NULL;
+
+  POCL_LOCK (tier_up_lock);
+  if (!tier_up_thread_running)
     {
-      if (strcmp (ci->tmp_dir, cmd->command.run.tmp_dir) == 0 &&
-          strcmp (ci->function_name, 
-                  cmd->command.run.kernel->function_name) == 0)
+      /* The previous thread has left its loop already. */
+      if (tier_up_thread_joinable)
         {
-          POCL_UNLOCK (compiler_cache_lock);
-          cmd->command.run.wg = ci->wg;
-          return;
+          pthread_join (tier_up_thread_id, NULL);
+          tier_up_thread_joinable = 0;
+        }
+      if (pthread_create (&tier_up_thread_id, NULL, tier_up_thread,
+                          NULL) == 0)
+        tier_up_thread_running = tier_up_thread_joinable = 1;
+    }
+  if (!tier_up_thread_running)
+    {
+      POCL_UNLOCK (tier_up_lock);
+      POname(clReleaseKernel) (kernel);
+      POname(clReleaseDevice) (device);
+      POCL_MEM_FREE (job);
+      return;
+    }
+  LL_APPEND (tier_up_queue, job);
+  POCL_UNLOCK (tier_up_lock);
+}
+
+/* Returns the work-group function specialized for the local size of the
+   launch of a kernel compiled for a dynamic local size, or NULL in case
+   the generic one should be used. The launches of each local size are
+   counted in a cache entry of their own; once the local size has been
+   launched HOT_LOCAL_SIZE_LAUNCHES times, a version with the local size
+   fixed (and thus unrollable loops and static context arrays) is compiled
+   in the background and published to that entry. */
+static pocl_workgroup_range
+specialized_workgroup_function (_cl_command_node *cmd)
+{
+  cl_kernel kernel = cmd->command.run.kernel;
+  cl_device_id device = cmd->device;
+  size_t local_x = cmd->command.run.local_x;
+  size_t local_y = cmd->command.run.local_y;
+  size_t local_z = cmd->command.run.local_z;
+  char cachedir[POCL_FILENAME_LENGTH];
+  char *tmp_dir;
+  pocl_wg_cache_entry *e;
+  pocl_workgroup_range wg;
+
+  e = pocl_wg_cache_lookup (kernel, device, local_x, local_y, local_z);
+  if (e == NULL)
+    {
+      POCL_LOCK (kernel->wg_cache_lock);
+      e = pocl_wg_cache_lookup (kernel, device, local_x, local_y, local_z);
+      if (e == NULL)
+        {
+          snprintf (cachedir, POCL_FILENAME_LENGTH, "%s/%s/%s/%zu-%zu-%zu",
+                    kernel->program->cache_dir, device->cache_dir_name,
+                    kernel->name, local_x, local_y, local_z);
+          if (access (cachedir, F_OK) != 0)
+            mkdir (cachedir, S_IRWXU);
+          tmp_dir = strdup (cachedir);
+          if (tmp_dir != NULL)
+            {
+              e = pocl_wg_cache_insert (kernel, device, local_x, local_y,
+                                        local_z, tmp_dir);
+              if (e == NULL)
+                POCL_MEM_FREE (tmp_dir);
+            }
         }
+      POCL_UNLOCK (kernel->wg_cache_lock);
+      /* Staying with the generic function is not an error. */
+      if (e == NULL)
+        return NULL;
     }
-  ci = (compiler_cache_item*) malloc (sizeof (compiler_cache_item));
-  ci->next = NULL;
-  ci->tmp_dir = strdup(cmd->command.run.tmp_dir);
-  ci->function_name = strdup (cmd->command.run.kernel->function_name);
+
+  wg = e->wg;
+  if (wg != NULL)
+    return wg;
+
+  /* Exactly one launch reaches the threshold. */
+  if (__sync_add_and_fetch (&e->launches, 1) == HOT_LOCAL_SIZE_LAUNCHES)
+    queue_tier_up (kernel, device, e);
+  return NULL;
+}
+
+/* Generates the code through parallel.bc and the external linker and
+   loads it as a shared library. */
+static pocl_workgroup_range
+load_workgroup_function (_cl_command_node *cmd)
+{
+  char workgroup_string[WORKGROUP_STRING_LENGTH];
+  lt_dlhandle dlhandle;
   const char* module_fn = llvm_codegen (cmd->command.run.tmp_dir,
                                         cmd->command.run.kernel,
                                         cmd->device);
@@ -816,13 +887,71 @@ void check_compiler_cache (_cl_command_node *cmd)
       abort();
     }
   snprintf (workgroup_string, WORKGROUP_STRING_LENGTH,
-            "_%s_workgroup", cmd->command.run.kernel->function_name);
-  cmd->command.run.wg = ci->wg = 
-    (pocl_workgroup) lt_dlsym (dlhandle, workgroup_string);
+            "_%s_workgroup_range", cmd->command.run.kernel->function_name);
+  return (pocl_workgroup_range) lt_dlsym (dlhandle, workgroup_string);
+}
 
-  LL_APPEND (compiler_cache, ci);
-  POCL_UNLOCK (compiler_cache_lock);
+void check_compiler_cache (_cl_command_node *cmd)
+{
+  cl_kernel kernel = cmd->command.run.kernel;
+  pocl_wg_cache_entry *e;
+  pocl_workgroup_range wg;
+  void *jit = NULL;
+  char object_filename[POCL_FILENAME_LENGTH];
+  int tier_up = 0;
+  size_t local_x = cmd->command.run.local_x;
+  size_t local_y = cmd->command.run.local_y;
+  size_t local_z = cmd->command.run.local_z;
+
+  /* clEnqueueNDRangeKernel() has created the entry already. */
+  pocl_wg_cache_compiled_local_size (kernel, cmd->device,
+                                     &local_x, &local_y, &local_z);
+
+  if (local_x == 0 && cmd->device->jit_workgroup_functions)
+    {
+      wg = specialized_workgroup_function (cmd);
+      if (wg != NULL)
+        {
+          cmd->command.run.wg = wg;
+          return;
+        }
+    }
+
+  e = pocl_wg_cache_lookup (kernel, cmd->device, local_x, local_y, local_z);
+  assert (e != NULL);
+
+  /* The common case: the configuration has been executed before. */
+  wg = e->wg;
+  if (wg != NULL)
+    {
+      cmd->command.run.wg = wg;
+      return;
+    }
+
+  POCL_LOCK (kernel->wg_cache_lock);
+  /* Another launch might have compiled it while we waited for the lock. */
+  wg = e->wg;
+  if (wg == NULL)
+    {
+      if (cmd->device->jit_workgroup_functions)
+        {
+          /* No need for the quick version in case an earlier run has
+             stored the optimized one in the kernel compiler cache. */
+          jit_object_filename (kernel, e, object_filename);
+          tier_up = cmd->device->tiered_compilation
+            && access (object_filename, F_OK) != 0;
+          wg = jit_workgroup_function (kernel, cmd->device, e, !tier_up,
+                                       &jit);
+        }
+      else
+        wg = load_workgroup_function (cmd);
+      pocl_wg_cache_set_wg (e, wg, jit);
+    }
+  POCL_UNLOCK (kernel->wg_cache_lock);
+  cmd->command.run.wg = wg;
 
+  if (tier_up)
+    queue_tier_up (kernel, cmd->device, e);
 }
 
 void
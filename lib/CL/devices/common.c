@@ -23,6 +23,7 @@
    THE SOFTWARE.
 */
 #include "common.h"
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -44,6 +45,33 @@
 
 #define COMMAND_LENGTH 2048
 
+/* The space reserved in the launch arenas for the argument arrays and
+   the descriptors on top of the local memory. */
+#define LAUNCH_ARENA_ARGUMENT_SPACE (16 * 1024)
+
+/* The alignment of the local buffers, also the cache line alignment of
+   the arena. */
+#define LAUNCH_ARENA_ALIGNMENT MAX_EXTENDED_ALIGNMENT
+
+typedef struct launch_arena
+{
+  char *memory;
+  size_t size;
+} launch_arena;
+
+/* The arenas of a thread: one for the argument array shared by all the
+   workers of a launch and one for the private local buffers of the
+   worker. The same thread can be both the submitter and a worker of a
+   launch, thus the two cannot share memory. */
+typedef struct launch_arenas
+{
+  launch_arena launch;
+  launch_arena worker;
+} launch_arenas;
+
+static pthread_key_t launch_arena_key;
+static pthread_once_t launch_arena_once = PTHREAD_ONCE_INIT;
+
 /**
  * Generate code from the final bitcode using the LLVM
  * tools.
@@ -153,4 +181,222 @@ pocl_memalign_alloc(size_t align_width, size_t size)
 #endif
 }
 
+static void
+free_launch_arenas (void *data)
+{
+  launch_arenas *arenas = (launch_arenas*)data;
+  POCL_MEM_FREE (arenas->launch.memory);
+  POCL_MEM_FREE (arenas->worker.memory);
+  POCL_MEM_FREE (arenas);
+}
+
+static void
+create_launch_arena_key (void)
+{
+  pthread_key_create (&launch_arena_key, free_launch_arenas);
+}
+
+static size_t
+arena_align (size_t size)
+{
+  return (size + LAUNCH_ARENA_ALIGNMENT - 1)
+    & ~(size_t)(LAUNCH_ARENA_ALIGNMENT - 1);
+}
+
+/* Returns the calling thread's arenas, NULL if they could not be
+   allocated. */
+static launch_arenas *
+get_launch_arenas (void)
+{
+  launch_arenas *arenas;
+
+  pthread_once (&launch_arena_once, create_launch_arena_key);
+  arenas = (launch_arenas*)pthread_getspecific (launch_arena_key);
+  if (arenas == NULL)
+    {
+      arenas = (launch_arenas*)calloc (1, sizeof (launch_arenas));
+      if (arenas == NULL)
+        return NULL;
+      pocl_mem_manager_count_allocation ();
+      pthread_setspecific (launch_arena_key, arenas);
+    }
+  return arenas;
+}
+
+/* Makes the arena of the given kind of the calling thread at least size
+   bytes, but no less than minimum_size when it has to be (re)allocated.
+   Returns NULL if the memory could not be allocated. */
+static char *
+reserve_launch_arena (int worker, size_t size, size_t minimum_size)
+{
+  launch_arenas *arenas = get_launch_arenas ();
+  launch_arena *arena;
+
+  if (arenas == NULL)
+    return NULL;
+  arena = worker ? &arenas->worker : &arenas->launch;
+  if (arena->size < size)
+    {
+      POCL_MEM_FREE (arena->memory);
+      arena->size = max (size, arena_align (minimum_size));
+      arena->memory = (char*)pocl_memalign_alloc (LAUNCH_ARENA_ALIGNMENT,
+                                                  arena->size);
+      if (arena->memory == NULL)
+        {
+          /* Retried with the next launch. */
+          arena->size = 0;
+          POCL_MSG_PRINT_INFO ("Could not allocate a launch arena of %zu "
+                               "bytes\n", max (size,
+                                               arena_align (minimum_size)));
+          return NULL;
+        }
+      pocl_mem_manager_count_allocation ();
+      /* With the debug messages on, the steady state launches print
+         none of these. */
+      POCL_MSG_PRINT_INFO ("Allocated a launch arena of %zu bytes, "
+                           "%lu runtime allocations in total\n", arena->size,
+                           pocl_mem_manager_allocation_count ());
+    }
+  return arena->memory;
+}
+
+static int
+is_local_argument (cl_kernel kernel, unsigned i)
+{
+  return i >= kernel->num_args || kernel->arg_info[i].is_local;
+}
+
+void **
+pocl_build_launch_arguments (cl_kernel kernel,
+                             struct pocl_argument *arguments,
+                             cl_device_id device)
+{
+  unsigned num_args = kernel->num_args + kernel->num_locals;
+  size_t array_size = arena_align (num_args * sizeof (void*));
+  size_t size = 2 * array_size;
+  void **args, **slots;
+  char *memory, *next;
+  struct pocl_argument *al;
+  unsigned i;
 
+  /* The image and sampler descriptors need memory of their own. */
+  for (i = 0; i < kernel->num_args; ++i)
+    {
+      if (kernel->arg_info[i].is_local)
+        continue;
+      if (kernel->arg_info[i].type == POCL_ARG_TYPE_IMAGE)
+        size += arena_align (sizeof (dev_image_t));
+      else if (kernel->arg_info[i].type == POCL_ARG_TYPE_SAMPLER)
+        size += arena_align (sizeof (dev_sampler_t));
+    }
+
+  memory = reserve_launch_arena (0, size, LAUNCH_ARENA_ARGUMENT_SPACE);
+  if (memory == NULL)
+    return NULL;
+  args = (void**)memory;
+  slots = (void**)(memory + array_size);
+  next = memory + 2 * array_size;
+
+  for (i = 0; i < num_args; ++i)
+    {
+      al = &arguments[i];
+      if (is_local_argument (kernel, i))
+        {
+          /* Set up by each worker in pocl_setup_worker_arguments (). */
+          args[i] = NULL;
+        }
+      else if (kernel->arg_info[i].type == POCL_ARG_TYPE_POINTER)
+        {
+          /* It's legal to pass a NULL pointer to clSetKernelArguments. In 
+             that case we must pass the same NULL forward to the kernel.
+             Otherwise, the user must have created a buffer with per device
+             pointers stored in the cl_mem. */
+          if (al->value == NULL)
+            {
+              slots[i] = NULL;
+              args[i] = &slots[i];
+            }
+          else
+            args[i] = &((*(cl_mem *)(al->value))->device_ptrs[device->dev_id].mem_ptr);
+        }
+      else if (kernel->arg_info[i].type == POCL_ARG_TYPE_IMAGE)
+        {
+          fill_dev_image_t ((dev_image_t*)next, al, device);
+          slots[i] = next;
+          args[i] = &slots[i];
+          next += arena_align (sizeof (dev_image_t));
+        }
+      else if (kernel->arg_info[i].type == POCL_ARG_TYPE_SAMPLER)
+        {
+          memset (next, 0, sizeof (dev_sampler_t));
+          slots[i] = next;
+          args[i] = &slots[i];
+          next += arena_align (sizeof (dev_sampler_t));
+        }
+      else
+        args[i] = al->value;
+    }
+
+  return args;
+}
+
+void **
+pocl_setup_worker_arguments (cl_kernel kernel,
+                             struct pocl_argument *arguments,
+                             void **launch_arguments,
+                             cl_device_id device)
+{
+  unsigned num_args = kernel->num_args + kernel->num_locals;
+  size_t array_size = arena_align (num_args * sizeof (void*));
+  size_t size = 2 * array_size;
+  int has_locals = 0;
+  void **args, **slots;
+  char *memory, *next;
+  unsigned i;
+
+  for (i = 0; i < num_args; ++i)
+    {
+      if (is_local_argument (kernel, i))
+        {
+          size += arena_align (arguments[i].size);
+          has_locals = 1;
+        }
+    }
+
+  /* Without local buffers there is nothing private to the worker. */
+  if (!has_locals)
+    return launch_arguments;
+
+  memory = reserve_launch_arena (1, size, device->local_mem_size
+                                 + LAUNCH_ARENA_ARGUMENT_SPACE);
+  if (memory == NULL)
+    return NULL;
+  args = (void**)memory;
+  slots = (void**)(memory + array_size);
+  next = memory + 2 * array_size;
+
+  memcpy (args, launch_arguments, num_args * sizeof (void*));
+  for (i = 0; i < num_args; ++i)
+    {
+      if (!is_local_argument (kernel, i))
+        continue;
+      slots[i] = next;
+      args[i] = &slots[i];
+      next += arena_align (arguments[i].size);
+    }
+
+  return args;
+}
+
+void **
+pocl_setup_launch_arguments (cl_kernel kernel,
+                             struct pocl_argument *arguments,
+                             cl_device_id device)
+{
+  void **launch_arguments = pocl_build_launch_arguments (kernel, arguments,
+                                                         device);
+  if (launch_arguments == NULL)
+    return NULL;
+  return pocl_setup_worker_arguments (kernel, arguments, launch_arguments,
+                                      device);
+}
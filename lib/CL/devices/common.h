@@ -73,6 +73,20 @@
 #define POCL_DEVICES_PREFERRED_VECTOR_WIDTH_HALF POCL_DEVICES_PREFERRED_VECTOR_WIDTH_SHORT
 #define POCL_DEVICES_NATIVE_VECTOR_WIDTH_HALF POCL_DEVICES_NATIVE_VECTOR_WIDTH_SHORT
 
+/* Set to zero to generate the work-group functions of the host devices
+   through parallel.bc, an object file and the external linker instead of
+   compiling them in memory. */
+#define KERNEL_JIT_ENV "POCL_KERNEL_JIT"
+
+/* Set to nonzero to compile a single work-group function per kernel that
+   reads the local size from the context, see pocl_wg_cache.h. */
+#define DYNAMIC_LOCAL_SIZE_ENV "POCL_DYNAMIC_LOCAL_SIZE"
+
+/* Set to nonzero to run the first launches of a JIT compiled work-group
+   function with a quickly compiled version while the optimized one is
+   compiled in the background. */
+#define TIERED_COMPILATION_ENV "POCL_TIERED_COMPILATION"
+
 const char* llvm_codegen (const char* tmpdir,
                           cl_kernel kernel,
                           cl_device_id device);
@@ -82,4 +96,35 @@ void fill_dev_image_t (dev_image_t* di, struct pocl_argument* parg,
 
 void* pocl_memalign_alloc(size_t align_width, size_t size);
 
+/* Builds the argument array of a kernel launch on the calling thread:
+   the pointer arguments are converted to device pointers and the image
+   and sampler descriptors are filled in. The array and the descriptors
+   are carved from a scratch arena owned by the thread, which is reused by
+   its next launches, and they stay valid until the thread builds its
+   next array. The entries of the local buffers are left NULL. The array
+   is never written to afterwards, thus all the workers of the launch can
+   read it concurrently. Returns NULL if the arena could not be allocated,
+   in which case the launch should fail with CL_OUT_OF_RESOURCES. */
+void **pocl_build_launch_arguments (cl_kernel kernel,
+                                    struct pocl_argument *arguments,
+                                    cl_device_id device);
+
+/* Returns the argument array for a worker executing work-groups of the
+   launch, that is, the shared array with the local buffers private to
+   the calling thread. Kernels without local buffers use the shared
+   array as is. Otherwise a copy of it with the local buffers is set up
+   in a second arena of the thread, sized from the local memory size of
+   the device, which grows only when a launch does not fit. The array
+   stays valid until the thread sets up its next worker arguments. Returns
+   NULL if the arena could not be allocated. */
+void **pocl_setup_worker_arguments (cl_kernel kernel,
+                                    struct pocl_argument *arguments,
+                                    void **launch_arguments,
+                                    cl_device_id device);
+
+/* Both of the above for a launch executed by the calling thread alone. */
+void **pocl_setup_launch_arguments (cl_kernel kernel,
+                                    struct pocl_argument *arguments,
+                                    cl_device_id device);
+
 #endif
@@ -0,0 +1,172 @@
+/* memfill.c - filling memory with a repeated pattern
+
+   Copyright (c) 2015 pocl developers
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+   THE SOFTWARE.
+*/
+
+#include <stdint.h>
+#include <string.h>
+
+#ifdef __SSE2__
+#  include <emmintrin.h>
+#endif
+
+#include "memfill.h"
+
+/* The size of the pattern block the generic path copies at a time. */
+#define FILL_BLOCK_SIZE 1024
+
+/* Fills by copying a block of whole patterns at a time. */
+static void
+fill_blocks (char *dst, size_t size, const void *pattern,
+             size_t pattern_size)
+{
+  char block[FILL_BLOCK_SIZE];
+  size_t block_size = pattern_size;
+  size_t n;
+
+  if (pattern_size > FILL_BLOCK_SIZE / 2)
+    {
+      for (n = 0; n < size; n += pattern_size)
+        memcpy (dst + n, pattern, pattern_size);
+      return;
+    }
+
+  /* Double the pattern up to the largest multiple of it that fits the
+     block. */
+  memcpy (block, pattern, pattern_size);
+  while (block_size * 2 <= FILL_BLOCK_SIZE)
+    {
+      memcpy (block + block_size, block, block_size);
+      block_size *= 2;
+    }
+
+  for (; size >= block_size; size -= block_size, dst += block_size)
+    memcpy (dst, block, block_size);
+  memcpy (dst, block, size);
+}
+
+#ifdef __SSE2__
+/* Fills with 16 byte stores of the pattern broadcast to v. The stores start
+   at the beginning of a pattern, thus the phase of the pattern stays the
+   same in every store. */
+static void
+fill_vector (char *dst, size_t size, __m128i v)
+{
+  char tail[16];
+
+  for (; size >= 64; size -= 64, dst += 64)
+    {
+      _mm_storeu_si128 ((__m128i*)dst, v);
+      _mm_storeu_si128 ((__m128i*)(dst + 16), v);
+      _mm_storeu_si128 ((__m128i*)(dst + 32), v);
+      _mm_storeu_si128 ((__m128i*)(dst + 48), v);
+    }
+  for (; size >= 16; size -= 16, dst += 16)
+    _mm_storeu_si128 ((__m128i*)dst, v);
+
+  _mm_storeu_si128 ((__m128i*)tail, v);
+  memcpy (dst, tail, size);
+}
+#endif
+
+void
+pocl_fill_memory (void *dst, size_t size, const void *pattern,
+                  size_t pattern_size)
+{
+#ifdef __SSE2__
+  uint16_t p16;
+  uint32_t p32;
+#endif
+
+  if (pattern_size == 1)
+    {
+      memset (dst, *(const unsigned char*)pattern, size);
+      return;
+    }
+
+#ifdef __SSE2__
+  switch (pattern_size)
+    {
+    case 2:
+      memcpy (&p16, pattern, 2);
+      fill_vector ((char*)dst, size, _mm_set1_epi16 ((short)p16));
+      return;
+    case 4:
+      memcpy (&p32, pattern, 4);
+      fill_vector ((char*)dst, size, _mm_set1_epi32 ((int)p32));
+      return;
+    case 8:
+      {
+        __m128i v = _mm_loadl_epi64 ((const __m128i*)pattern);
+        fill_vector ((char*)dst, size, _mm_unpacklo_epi64 (v, v));
+        return;
+      }
+    case 16:
+      fill_vector ((char*)dst, size,
+                   _mm_loadu_si128 ((const __m128i*)pattern));
+      return;
+    default:
+      break;
+    }
+#endif
+
+  fill_blocks ((char*)dst, size, pattern, pattern_size);
+}
+
+void
+pocl_fill_rows (char *dst, size_t row_size, size_t rows_per_slice,
+                size_t row_pitch, size_t slice_pitch,
+                size_t first_row, size_t last_row,
+                const void *pattern, size_t pattern_size)
+{
+  size_t row = first_row, end;
+
+  /* The whole region is one block. */
+  if (row_pitch == row_size && slice_pitch == row_size * rows_per_slice)
+    {
+      pocl_fill_memory (dst + first_row * row_size,
+                        (last_row - first_row + 1) * row_size,
+                        pattern, pattern_size);
+      return;
+    }
+
+  while (row <= last_row)
+    {
+      char *p = dst + (row % rows_per_slice) * row_pitch
+        + (row / rows_per_slice) * slice_pitch;
+
+      /* The rows of a slice are one block. */
+      if (row_pitch == row_size)
+        {
+          end = (row / rows_per_slice + 1) * rows_per_slice - 1;
+          if (end > last_row)
+            end = last_row;
+          pocl_fill_memory (p, (end - row + 1) * row_size,
+                            pattern, pattern_size);
+          row = end + 1;
+        }
+      else
+        {
+          pocl_fill_memory (p, row_size, pattern, pattern_size);
+          ++row;
+        }
+    }
+}
@@ -0,0 +1,61 @@
+/* memfill.h - filling memory with a repeated pattern
+
+   Copyright (c) 2015 pocl developers
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+   THE SOFTWARE.
+*/
+
+#ifndef POCL_MEMFILL_H
+#define POCL_MEMFILL_H
+
+#include <stddef.h>
+
+#pragma GCC visibility push(hidden)
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Fills size bytes at dst by repeating the pattern_size bytes long
+   pattern, e.g., a pixel of an image or the pattern of
+   clEnqueueFillBuffer(). size must be a multiple of pattern_size. The
+   pattern is broadcast to a SIMD register when its size divides one, the
+   other sizes are filled with block copies. */
+void pocl_fill_memory (void *dst, size_t size, const void *pattern,
+                       size_t pattern_size);
+
+/* Fills the rows first_row..last_row of a region that is row_size bytes
+   wide and rows_per_slice rows high. The rows are numbered slice by
+   slice: row r starts at
+   dst + (r % rows_per_slice) * row_pitch + (r / rows_per_slice) * slice_pitch.
+
+   In case the rows of the region are contiguous, they are filled as one
+   block. */
+void pocl_fill_rows (char *dst, size_t row_size, size_t rows_per_slice,
+                     size_t row_pitch, size_t slice_pitch,
+                     size_t first_row, size_t last_row,
+                     const void *pattern, size_t pattern_size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#pragma GCC visibility pop
+
+#endif
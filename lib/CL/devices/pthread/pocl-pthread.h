@@ -38,4 +38,16 @@ GEN_PROTOTYPES (pthread)
 #include "prototypes.inc"
 GEN_PROTOTYPES (basic)
 
+#pragma GCC visibility push(hidden)
+
+cl_int pocl_pthread_init_sub_device (cl_device_id sub_device,
+                                     unsigned first_compute_unit);
+
+unsigned pocl_pthread_partition_by_affinity (cl_device_id device,
+                                             cl_device_affinity_domain domain,
+                                             unsigned *counts,
+                                             unsigned max_groups);
+
+#pragma GCC visibility pop
+
 #endif /* POCL_PTHREAD_H */
@@ -44,18 +44,21 @@
 #include "devices.h"
 #include "pocl_util.h"
 #include "pocl_mem_management.h"
+#include "pthread_scheduler.h"
+#include "pthread_transfer.h"
+#include "pthread_placement.h"
 
 #ifdef CUSTOM_BUFFER_ALLOCATOR
 
-#include "bufalloc.h"
+#include "segalloc.h"
 #include <dev_image.h>
 
-/* Instead of mallocing a buffer size for a region, try to allocate 
+/* Instead of mallocing a buffer size for an arena, try to allocate 
    this many times the buffer size to hopefully avoid mallocs for 
    the next buffer allocations.
    
    Falls back to single multiple allocation if fails to allocate a
-   larger region. */
+   larger arena. */
 #define ALLOCATION_MULTIPLE 32
 
 /* To avoid memory hogging in case of larger buffers, limit the
@@ -66,16 +69,12 @@
  */
 #define ADDITIONAL_ALLOCATION_MAX_MB 100
 
-/* Always create regions with at least this size to avoid allocating
-   small regions when there are lots of small buffers, which would counter 
-   a purpose of having own buffer management. It would end up having a lot of
-   small regions with linear searches over them.  */
+/* Always create arenas with at least this size to avoid allocating
+   small arenas when there are lots of small buffers, which would counter 
+   a purpose of having own buffer management. The arenas are kept for
+   reuse until the device is uninitialized. */
 #define NEW_REGION_MIN_MB 10
 
-/* Whether to immediately free a region in case the last chunk was
-   deallocated. If 0, it can reuse the same region over multiple kernels. */
-#define FREE_EMPTY_REGIONS 0
-
 /* CUSTOM_BUFFER_ALLOCATOR */
 #endif
 
@@ -86,26 +85,34 @@
    for the thread execution. */
 #define THREAD_COUNT_ENV "POCL_MAX_PTHREAD_COUNT"
 
-typedef struct thread_arguments thread_arguments;
-struct thread_arguments 
-{
-  void *data;
-  cl_kernel kernel;
-  cl_device_id device;
-  struct pocl_context pc;
-  int last_gid_x; 
-  pocl_workgroup workgroup;
-  struct pocl_argument *kernel_args;
-  thread_arguments *volatile next;
-};
+/* The environment variable and the default for the number of commands
+   executed concurrently, e.g., independent kernels of an out-of-order
+   queue. The kernels share the same worker threads. */
+#define CONCURRENT_COMMANDS_ENV "POCL_PTHREAD_CONCURRENT_COMMANDS"
+#define DEFAULT_CONCURRENT_COMMANDS 4
 
+/* The environment variable for disabling the use of the worker threads in
+   the buffer transfers. */
+#define PARALLEL_TRANSFERS_ENV "POCL_PTHREAD_PARALLEL_TRANSFERS"
 
-#ifdef CUSTOM_BUFFER_ALLOCATOR
-typedef struct _mem_regions_management{
-  ba_lock_t mem_regions_lock;
-  struct memory_region *mem_regions;
-} mem_regions_management;
-#endif
+/* The environment variable for disabling the transparent huge pages of
+   the large buffers allocated without CL_MEM_HUGE_PAGES_POCL. */
+#define HUGE_PAGES_ENV "POCL_PTHREAD_HUGE_PAGES"
+
+/* The environment variable for disabling the pinning of the worker
+   threads to the cores. */
+#define PIN_THREADS_ENV "POCL_PTHREAD_PIN_THREADS"
+
+/* The environment variable for creating a pthread device for each
+   processor socket instead of a single one for the whole host. */
+#define SOCKET_DEVICES_ENV "POCL_PTHREAD_SOCKET_DEVICES"
+
+/* The environment variable and the default for how many times an idle
+   worker polls for new launches before going to sleep. Launches that
+   arrive within this window are picked up without a futex wakeup, which
+   dominates the launch latency of short kernels. */
+#define WORKER_SPIN_ENV "POCL_PTHREAD_WORKER_SPIN"
+#define DEFAULT_WORKER_SPIN_COUNT 20000
 
 struct data {
   /* Currently loaded kernel. */
@@ -114,50 +121,26 @@ struct data {
   lt_dlhandle current_dlhandle;
 
 #ifdef CUSTOM_BUFFER_ALLOCATOR
-  /* Lock for protecting the mem_regions linked list. Held when new mem_regions
-     are created or old ones freed. */
-  mem_regions_management* mem_regions;
+  /* The allocator of the buffers, shared by all the pthread devices. */
+  seg_allocator *allocator;
 #endif
 
+  /* The maximum number of threads (including the submitting one) to
+     execute the work-groups of a kernel launch with. */
+  int max_threads;
+  /* The pool of worker threads that execute the work-groups. */
+  scheduler_data scheduler;
+  /* The maximum number of threads to copy the large buffers with. */
+  unsigned transfer_threads;
+  /* The hardware threads the device executes on as a range of logical
+     hwloc indices, see pocl_topology_get_pus (). They are the compute
+     units of the device in the same order. */
+  unsigned first_pu;
+  unsigned num_pus;
 };
 
-
-static thread_arguments *volatile thread_argument_pool = 0;
-static int argument_pool_initialized = 0;
-pocl_lock_t ta_pool_lock;
-static int get_max_thread_count();
-static void * workgroup_thread (void *p);
-
-static void pocl_init_thread_argument_manager (void)
-{
-  if (!argument_pool_initialized)
-    {
-      argument_pool_initialized = 1;
-      POCL_INIT_LOCK (ta_pool_lock);
-    }
-}
-
-static thread_arguments* new_thread_arguments ()
-{
-  thread_arguments *ta = NULL;
-  POCL_LOCK (ta_pool_lock);
-  if ((ta = thread_argument_pool))
-    {
-      LL_DELETE (thread_argument_pool, ta);
-      POCL_UNLOCK (ta_pool_lock);
-      return ta;
-    }
-  POCL_UNLOCK (ta_pool_lock);
-    
-  return (thread_arguments*)calloc (1, sizeof (thread_arguments));
-}
-
-static void free_thread_arguments (thread_arguments *ta)
-{
-  POCL_LOCK (ta_pool_lock);
-  LL_PREPEND (thread_argument_pool, ta);
-  POCL_UNLOCK (ta_pool_lock);
-}
+static int get_max_thread_count(cl_device_id device);
+static void workgroup_thread (kernel_run_command *k, unsigned participant);
 
 void
 pocl_pthread_init_device_ops(struct pocl_device_ops *ops)
@@ -176,9 +159,14 @@ pocl_pthread_init_device_ops(struct pocl_device_ops *ops)
   ops->read = pocl_pthread_read;
   ops->write = pocl_pthread_write;
   ops->copy = pocl_pthread_copy;
-  ops->copy_rect = pocl_basic_copy_rect;
+  ops->read_rect = pocl_pthread_read_rect;
+  ops->write_rect = pocl_pthread_write_rect;
+  ops->copy_rect = pocl_pthread_copy_rect;
+  ops->fill_rect = pocl_pthread_fill_rect;
   ops->run = pocl_pthread_run;
   ops->compile_submitted_kernels = pocl_basic_compile_submitted_kernels;
+  ops->init_sub_device = pocl_pthread_init_sub_device;
+  ops->partition_by_affinity = pocl_pthread_partition_by_affinity;
 
 }
 
@@ -188,7 +176,11 @@ pocl_pthread_probe(struct pocl_device_ops *ops)
   int env_count = pocl_device_get_env_count(ops->device_name);
   /* Env was not specified, default behavior was to use 1 pthread device */
   if(env_count < 0)
-    return 1;
+    env_count = 1;
+
+  /* A device for each socket in place of each one asked for. */
+  if (env_count > 0 && pocl_get_bool_option (SOCKET_DEVICES_ENV, 0))
+    return env_count * pocl_topology_num_sockets ();
 
   return env_count;
 }
@@ -205,13 +197,34 @@ pocl_pthread_init_device_infos(struct _cl_device_id* dev)
 
 }
 
+/* Starts the worker pool of the device. The thread that calls run()
+   works on the work-groups too, thus one less worker is needed. */
+static void
+start_workers (struct data *d, int max_threads)
+{
+  d->max_threads = max_threads;
+  if (d->max_threads < 1)
+    d->max_threads = 1;
+  pthread_scheduler_init (&d->scheduler, d->max_threads - 1,
+                          pocl_get_bool_option (PIN_THREADS_ENV, 1),
+                          d->first_pu, d->num_pus,
+                          max (pocl_get_int_option (WORKER_SPIN_ENV,
+                                                    DEFAULT_WORKER_SPIN_COUNT),
+                               0));
+  d->transfer_threads =
+    pocl_get_bool_option (PARALLEL_TRANSFERS_ENV, 1) ? d->max_threads : 1;
+}
+
 void
 pocl_pthread_init (cl_device_id device, const char* parameters)
 {
   struct data *d; 
 #ifdef CUSTOM_BUFFER_ALLOCATOR  
-  static mem_regions_management* mrm = NULL;
+  static seg_allocator *allocator = NULL;
 #endif
+  /* The number of pthread devices initialized so far. */
+  static unsigned num_initialized = 0;
+  int socket = -1;
 
   // TODO: this checks if the device was already initialized previously.
   // Should we instead have a separate bool field in device, or do the
@@ -223,16 +236,28 @@ pocl_pthread_init (cl_device_id device, const char* parameters)
   
   d->current_kernel = NULL;
   d->current_dlhandle = 0;
+  if (pocl_get_bool_option (SOCKET_DEVICES_ENV, 0))
+    socket = num_initialized % pocl_topology_num_sockets ();
+  ++num_initialized;
+  pocl_topology_get_pus (socket, &d->first_pu, &d->num_pus);
 
   device->data = d;
+  device->jit_workgroup_functions = 
+    pocl_get_bool_option (KERNEL_JIT_ENV, 1);
+  device->dynamic_local_size =
+    pocl_get_bool_option (DYNAMIC_LOCAL_SIZE_ENV, 0);
+  device->tiered_compilation =
+    pocl_get_bool_option (TIERED_COMPILATION_ENV, 0);
 #ifdef CUSTOM_BUFFER_ALLOCATOR  
-  if (mrm == NULL)
+  if (allocator == NULL)
     {
-      mrm = (mem_regions_management*)malloc (sizeof (mem_regions_management));
-      BA_INIT_LOCK (mrm->mem_regions_lock);
-      mrm->mem_regions = NULL;
+      allocator = (seg_allocator*)malloc (sizeof (seg_allocator));
+      seg_allocator_init (allocator, MAX_EXTENDED_ALIGNMENT,
+                          NEW_REGION_MIN_MB * 1024 * 1024,
+                          ALLOCATION_MULTIPLE,
+                          ADDITIONAL_ALLOCATION_MAX_MB * 1024 * 1024);
     }
-  d->mem_regions = mrm;
+  d->allocator = allocator;
 #endif  
 
   device->address_bits = sizeof(void*) * 8;
@@ -265,10 +290,30 @@ pocl_pthread_init (cl_device_id device, const char* parameters)
 #define HALF_EXT
 #endif
 
-  device->extensions = DOUBLE_EXT HALF_EXT "cl_khr_byte_addressable_store";
+  device->extensions = DOUBLE_EXT HALF_EXT "cl_khr_byte_addressable_store "
+    "cl_pocl_memory_placement";
 
   pocl_topology_detect_device_info(device);
   pocl_cpuinfo_detect_device_info(device);
+  if (socket >= 0)
+    device->max_compute_units = d->num_pus;
+
+  /* The device can be split to sub-devices each with its own workers
+     pinned to a subset of the hardware threads. */
+  if (device->max_compute_units == d->num_pus)
+    {
+      device->device_partition_properties[0] = CL_DEVICE_PARTITION_EQUALLY;
+      device->device_partition_properties[1] = CL_DEVICE_PARTITION_BY_COUNTS;
+      device->device_partition_properties[2] =
+        CL_DEVICE_PARTITION_BY_AFFINITY_DOMAIN;
+      device->device_partition_properties[3] = 0;
+      device->partition_affinity_domains =
+        CL_DEVICE_AFFINITY_DOMAIN_NUMA | CL_DEVICE_AFFINITY_DOMAIN_L4_CACHE
+        | CL_DEVICE_AFFINITY_DOMAIN_L3_CACHE
+        | CL_DEVICE_AFFINITY_DOMAIN_L2_CACHE
+        | CL_DEVICE_AFFINITY_DOMAIN_L1_CACHE
+        | CL_DEVICE_AFFINITY_DOMAIN_NEXT_PARTITIONABLE;
+    }
 
   if(!strcmp(device->llvm_cpu, "(unknown)"))
     device->llvm_cpu = NULL;
@@ -278,8 +323,48 @@ pocl_pthread_init (cl_device_id device, const char* parameters)
   device->has_64bit_long=0;
   #endif
 
-  pocl_init_thread_argument_manager();
-  
+  /* Start the worker pool only after the topology detection so we know
+     how many compute units there are. */
+  start_workers (d, get_max_thread_count(device));
+
+  pthread_placement_init (pocl_get_bool_option (HUGE_PAGES_ENV, 1));
+
+  device->num_executor_threads = 
+    pocl_get_int_option (CONCURRENT_COMMANDS_ENV, DEFAULT_CONCURRENT_COMMANDS);
+}
+
+cl_int
+pocl_pthread_init_sub_device (cl_device_id sub_device,
+                              unsigned first_compute_unit)
+{
+  struct data *parent = (struct data*)sub_device->parent_device->data;
+  struct data *d = (struct data *) malloc (sizeof (struct data));
+  if (d == NULL)
+    return CL_OUT_OF_HOST_MEMORY;
+
+  d->current_kernel = NULL;
+  d->current_dlhandle = 0;
+#ifdef CUSTOM_BUFFER_ALLOCATOR
+  d->allocator = parent->allocator;
+#endif
+  d->first_pu = parent->first_pu + first_compute_unit;
+  d->num_pus = sub_device->max_compute_units;
+  sub_device->data = d;
+
+  /* The sub-device executes on its own compute units only, regardless of
+     POCL_MAX_PTHREAD_COUNT. */
+  start_workers (d, sub_device->max_compute_units);
+  return CL_SUCCESS;
+}
+
+unsigned
+pocl_pthread_partition_by_affinity (cl_device_id device,
+                                    cl_device_affinity_domain domain,
+                                    unsigned *counts, unsigned max_groups)
+{
+  struct data *d = (struct data*)device->data;
+  return pocl_topology_partition (d->first_pu, d->num_pus, domain, counts,
+                                  max_groups);
 }
 
 void
@@ -287,90 +372,39 @@ pocl_pthread_uninit (cl_device_id device)
 {
   struct data *d = (struct data*)device->data;
 #ifdef CUSTOM_BUFFER_ALLOCATOR
-  memory_region_t *region, *temp;
-  DL_FOREACH_SAFE(d->mem_regions->mem_regions, region, temp)
-    {
-      DL_DELETE(d->mem_regions->mem_regions, region);
-      free((void*)region->chunks->start_address);
-      region->chunks->start_address = 0;
-      POCL_MEM_FREE(region);
-    }
-  d->mem_regions->mem_regions = NULL;
+  /* The sub-devices share the allocator of their root device. */
+  if (device->parent_device == NULL)
+    seg_allocator_release (d->allocator);
 #endif  
+  pthread_scheduler_uninit (&d->scheduler);
   POCL_MEM_FREE(d);
   device->data = NULL;
 }
 
 
+/* The buffers that call for a placement get pages of their own, the rest
+   come from the regular allocator. */
 #ifdef CUSTOM_BUFFER_ALLOCATOR
 static int
-allocate_aligned_buffer (struct data* d, void **memptr, size_t alignment, size_t size) 
+allocate_aligned_buffer (struct data* d, void **memptr, size_t alignment,
+                         size_t size, cl_mem_flags flags)
 {
-  BA_LOCK(d->mem_regions->mem_regions_lock);
-  chunk_info_t *chunk = alloc_buffer (d->mem_regions->mem_regions, size);
-  if (chunk == NULL)
-    {
-      memory_region_t *new_mem_region = 
-        (memory_region_t*)malloc (sizeof (memory_region_t));
-
-      if (new_mem_region == NULL) 
-        {
-          BA_UNLOCK (d->mem_regions->mem_regions_lock);
-          return ENOMEM;
-        }
-
-      /* Fallback to the minimum size in case of overflow. 
-         Allocate a larger chunk to avoid allocation overheads
-         later on. */
-      size_t region_size = 
-          max(max(min(size + ADDITIONAL_ALLOCATION_MAX_MB * 1024 * 1024, 
-                      size * ALLOCATION_MULTIPLE), size),
-              NEW_REGION_MIN_MB * 1024 * 1024);
-
-      assert (region_size >= size);
-
-      void* space = NULL;
-      space = pocl_memalign_alloc(alignment, region_size);
-      if (space == NULL)
-        {
-          /* Failed to allocate a large region. Fall back to allocating 
-             the smallest possible region for the buffer. */
-	        space = pocl_memalign_alloc(alignment, size);
-          if (space == NULL) 
-            {
-              BA_UNLOCK (d->mem_regions->mem_regions_lock);
-              return ENOMEM;
-            }
-          region_size = size;
-        }
-
-      init_mem_region (new_mem_region, (memory_address_t)space, region_size);
-      new_mem_region->alignment = alignment;
-      DL_APPEND (d->mem_regions->mem_regions, new_mem_region);
-      chunk = alloc_buffer_from_region (new_mem_region, size);
-
-      if (chunk == NULL)
-      {
-        printf("pocl error: could not allocate a buffer of size %zu from the newly created region of size %zu.\n",
-               size, region_size);
-        print_chunks(new_mem_region->chunks);
-        /* In case the malloc didn't fail it should have been able to allocate 
-           the buffer to a newly created Region. */
-        assert (chunk != NULL);
-      }
-    }
-  BA_UNLOCK (d->mem_regions->mem_regions_lock);
-  
-  *memptr = (void*) chunk->start_address;
-  return 0;
+  assert (alignment <= d->allocator->alignment);
+  *memptr = pthread_placement_alloc (flags, size);
+  if (*memptr == NULL)
+    *memptr = seg_alloc (d->allocator, size);
+  return (((*memptr) == NULL)? ENOMEM: 0);
 }
 
 #else
 
 static int
-allocate_aligned_buffer (struct data* d, void **memptr, size_t alignment, size_t size) 
+allocate_aligned_buffer (struct data* d, void **memptr, size_t alignment,
+                         size_t size, cl_mem_flags flags)
 {
-  *memptr = pocl_memalign_alloc(alignment, size);
+  *memptr = pthread_placement_alloc (flags, size);
+  if (*memptr == NULL)
+    *memptr = pocl_memalign_alloc(alignment, size);
   return (((*memptr) == NULL)? -1: 0);
 }
 
@@ -384,9 +418,11 @@ pocl_pthread_malloc (void *device_data, cl_mem_flags flags, size_t size, void *h
 
   if (flags & CL_MEM_COPY_HOST_PTR)
     {
-      if (allocate_aligned_buffer (d, &b, MAX_EXTENDED_ALIGNMENT, size) == 0)
+      if (allocate_aligned_buffer (d, &b, MAX_EXTENDED_ALIGNMENT, size,
+                               flags) == 0)
         {
-          memcpy (b, host_ptr, size);
+          pthread_transfer_copy (&d->scheduler, d->transfer_threads,
+                                 b, host_ptr, size);
           return b;
         }
       
@@ -398,7 +434,8 @@ pocl_pthread_malloc (void *device_data, cl_mem_flags flags, size_t size, void *h
       return host_ptr;
     }
 
-  if (allocate_aligned_buffer (d, &b, MAX_EXTENDED_ALIGNMENT, size) == 0)
+  if (allocate_aligned_buffer (d, &b, MAX_EXTENDED_ALIGNMENT, size,
+                               flags) == 0)
     return b;
   
   return NULL;
@@ -409,7 +446,7 @@ pocl_pthread_alloc_mem_obj (cl_device_id device, cl_mem mem_obj)
 {
   void *b = NULL;
   struct data* d = (struct data*)device->data;
-  cl_int flags = mem_obj->flags;
+  cl_mem_flags flags = mem_obj->flags;
 
   /* if memory for this global memory is not yet allocated -> do it */
   if (mem_obj->device_ptrs[device->global_mem_id].mem_ptr == NULL)
@@ -419,11 +456,12 @@ pocl_pthread_alloc_mem_obj (cl_device_id device, cl_mem mem_obj)
           b = mem_obj->mem_host_ptr;
         }
       else if (allocate_aligned_buffer (d, &b, MAX_EXTENDED_ALIGNMENT, 
-                                        mem_obj->size) != 0)
+                                        mem_obj->size, flags) != 0)
         return CL_MEM_OBJECT_ALLOCATION_FAILURE;
 
       if (flags & CL_MEM_COPY_HOST_PTR)
-        memcpy (b, mem_obj->mem_host_ptr, mem_obj->size);
+        pthread_transfer_copy (&d->scheduler, d->transfer_threads,
+                               b, mem_obj->mem_host_ptr, mem_obj->size);
     
       mem_obj->device_ptrs[device->global_mem_id].mem_ptr = b;
       mem_obj->device_ptrs[device->global_mem_id].global_mem_id = 
@@ -441,31 +479,12 @@ void
 pocl_pthread_free (void *device_data, cl_mem_flags flags, void *ptr)
 {
   struct data* d = (struct data*) device_data;
-  memory_region_t *region = NULL;
 
   if (flags & CL_MEM_USE_HOST_PTR)
       return; /* The host code should free the host ptr. */
 
-  region = free_buffer (d->mem_regions->mem_regions, (memory_address_t)ptr);
-
-  assert(region != NULL && "Unable to find the region for chunk.");
-
-#if FREE_EMPTY_REGIONS == 1
-  BA_LOCK(d->mem_regions->mem_regions_lock);
-  BA_LOCK(region->lock);
-  if (region->last_chunk == region->chunks && 
-      !region->chunks->is_allocated) 
-    {
-      /* All chunks have been deallocated. free() the whole 
-         memory region at once. */
-      DL_DELETE(d->mem_regions->mem_regions, region);
-      free((void*)region->last_chunk->start_address);
-      region->last_chunk->start_address = 0;
-      POCL_MEM_FREE(region);
-    }  
-  BA_UNLOCK(region->lock);
-  BA_UNLOCK(d->mem_regions->mem_regions_lock);
-#endif
+  if (!pthread_placement_free (ptr))
+    seg_free (d->allocator, ptr);
 }
 
 #else
@@ -476,7 +495,8 @@ pocl_pthread_free (void *data, cl_mem_flags flags, void *ptr)
   if (flags & CL_MEM_USE_HOST_PTR)
     return;
   
-  POCL_MEM_FREE(ptr);
+  if (!pthread_placement_free (ptr))
+    POCL_MEM_FREE(ptr);
 }
 #endif
 
@@ -484,30 +504,126 @@ void
 pocl_pthread_read (void *data, void *host_ptr, const void *device_ptr, 
                    size_t offset, size_t cb)
 {
+  struct data *d = (struct data*)data;
   if (host_ptr == device_ptr)
     return;
 
-  memcpy (host_ptr, device_ptr + offset, cb);
+  pthread_transfer_copy (&d->scheduler, d->transfer_threads,
+                         host_ptr, device_ptr + offset, cb);
 }
 
 void
 pocl_pthread_write (void *data, const void *host_ptr, void *device_ptr, 
                     size_t offset, size_t cb)
 {
+  struct data *d = (struct data*)data;
   if (host_ptr == device_ptr)
     return;
   
-  memcpy (device_ptr + offset, host_ptr, cb);
+  pthread_transfer_copy (&d->scheduler, d->transfer_threads,
+                         device_ptr + offset, host_ptr, cb);
 }
 
 void
 pocl_pthread_copy (void *data, const void *src_ptr, size_t src_offset, 
                    void *__restrict__ dst_ptr, size_t dst_offset, size_t cb)
 {
+  struct data *d = (struct data*)data;
   if (src_ptr == dst_ptr)
     return;
   
-  memcpy (dst_ptr + dst_offset, src_ptr + src_offset, cb);
+  pthread_transfer_copy (&d->scheduler, d->transfer_threads,
+                         dst_ptr + dst_offset, src_ptr + src_offset, cb);
+}
+
+void
+pocl_pthread_copy_rect (void *data,
+                        const void *__restrict const src_ptr,
+                        void *__restrict__ const dst_ptr,
+                        const size_t *__restrict__ const src_origin,
+                        const size_t *__restrict__ const dst_origin,
+                        const size_t *__restrict__ const region,
+                        size_t const src_row_pitch,
+                        size_t const src_slice_pitch,
+                        size_t const dst_row_pitch,
+                        size_t const dst_slice_pitch)
+{
+  struct data *d = (struct data*)data;
+  pocl_rect_transfer r;
+
+  pocl_rect_transfer_init (&r, dst_ptr, src_ptr, dst_origin, src_origin,
+                           region, dst_row_pitch, dst_slice_pitch,
+                           src_row_pitch, src_slice_pitch);
+  pthread_transfer_copy_rect (&d->scheduler, d->transfer_threads, &r);
+}
+
+void
+pocl_pthread_write_rect (void *data,
+                         const void *__restrict__ const host_ptr,
+                         void *__restrict__ const device_ptr,
+                         const size_t *__restrict__ const buffer_origin,
+                         const size_t *__restrict__ const host_origin,
+                         const size_t *__restrict__ const region,
+                         size_t const buffer_row_pitch,
+                         size_t const buffer_slice_pitch,
+                         size_t const host_row_pitch,
+                         size_t const host_slice_pitch)
+{
+  struct data *d = (struct data*)data;
+  pocl_rect_transfer r;
+
+  pocl_rect_transfer_init (&r, device_ptr, host_ptr, buffer_origin,
+                           host_origin, region, buffer_row_pitch,
+                           buffer_slice_pitch, host_row_pitch,
+                           host_slice_pitch);
+  pthread_transfer_copy_rect (&d->scheduler, d->transfer_threads, &r);
+}
+
+void
+pocl_pthread_read_rect (void *data,
+                        void *__restrict__ const host_ptr,
+                        void *__restrict__ const device_ptr,
+                        const size_t *__restrict__ const buffer_origin,
+                        const size_t *__restrict__ const host_origin,
+                        const size_t *__restrict__ const region,
+                        size_t const buffer_row_pitch,
+                        size_t const buffer_slice_pitch,
+                        size_t const host_row_pitch,
+                        size_t const host_slice_pitch)
+{
+  struct data *d = (struct data*)data;
+  pocl_rect_transfer r;
+
+  pocl_rect_transfer_init (&r, host_ptr, device_ptr, host_origin,
+                           buffer_origin, region, host_row_pitch,
+                           host_slice_pitch, buffer_row_pitch,
+                           buffer_slice_pitch);
+  pthread_transfer_copy_rect (&d->scheduler, d->transfer_threads, &r);
+}
+
+void
+pocl_pthread_fill_rect (void *data,
+                        void *__restrict__ const device_ptr,
+                        const size_t *__restrict__ const buffer_origin,
+                        const size_t *__restrict__ const region,
+                        size_t const buffer_row_pitch,
+                        size_t const buffer_slice_pitch,
+                        void *fill_pixel,
+                        size_t pixel_size)
+{
+  struct data *d = (struct data*)data;
+  char *adjusted_device_ptr = (char*)device_ptr
+    + buffer_origin[0] * pixel_size
+    + buffer_row_pitch * buffer_origin[1]
+    + buffer_slice_pitch * buffer_origin[2];
+
+  if (region[0] == 0)
+    return;
+
+  pthread_transfer_fill_rect (&d->scheduler, d->transfer_threads,
+                              adjusted_device_ptr, region[0] * pixel_size,
+                              region[1], region[2], buffer_row_pitch,
+                              buffer_slice_pitch, fill_pixel, pixel_size);
 }
 
 #define FALLBACK_MAX_THREAD_COUNT 8
@@ -534,73 +650,34 @@ pocl_pthread_run
 (void *data, 
  _cl_command_node* cmd)
 {
-  int error;
-  unsigned i;
-  cl_kernel kernel = cmd->command.run.kernel;
-  struct pocl_context *pc = &cmd->command.run.pc;
-  struct thread_arguments *arguments;
-  static int max_threads = 0; /* this needs to be asked only once */
-
-  int num_groups_x = pc->num_groups[0];
-  /* TODO: distributing the work groups in the x dimension is not always the
-     best option. This assumes x dimension has enough work groups to utilize
-     all the threads. */
-  if (max_threads == 0)
-    max_threads = get_max_thread_count(cmd->device);
-
-  int num_threads = min(max_threads, num_groups_x);
-  pthread_t *threads = (pthread_t*) malloc (sizeof (pthread_t)*num_threads);
-  
-  int wgs_per_thread = num_groups_x / num_threads;
-  /* In case the work group count is not divisible by the
-     number of threads, we have to execute the remaining
-     workgroups in one of the threads. */
-  /* TODO: This is inefficient; it is better to round up when
-     calculating wgs_per_thread */
-  int leftover_wgs = num_groups_x - (num_threads*wgs_per_thread);
-
-#ifdef DEBUG_MT    
-  printf("### creating %d work group threads\n", num_threads);
-  printf("### wgs per thread==%d leftover wgs==%d\n", wgs_per_thread, leftover_wgs);
-#endif
-  
-  int first_gid_x = 0;
-  int last_gid_x = wgs_per_thread - 1;
-  for (i = 0; i < num_threads; 
-       ++i, first_gid_x += wgs_per_thread, last_gid_x += wgs_per_thread) {
-
-    if (i + 1 == num_threads) last_gid_x += leftover_wgs;
-
-#ifdef DEBUG_MT       
-    printf("### creating wg thread: first_gid_x==%d, last_gid_x==%d\n",
-           first_gid_x, last_gid_x);
-#endif
-    arguments = new_thread_arguments();
-    arguments->data = data;
-    arguments->kernel = kernel;
-    arguments->device = cmd->device;
-    arguments->pc = *pc;
-    arguments->pc.group_id[0] = first_gid_x;
-    arguments->workgroup = cmd->command.run.wg;
-    arguments->last_gid_x = last_gid_x;
-    arguments->kernel_args = cmd->command.run.arguments;
-
-    /* TODO: pool of worker threads to avoid syscalls here */
-    error = pthread_create (&threads[i],
-                            NULL,
-                            workgroup_thread,
-                            arguments);
-    assert(!error);
-  }
-
-  for (i = 0; i < num_threads; ++i) {
-    pthread_join(threads[i], NULL);
-#ifdef DEBUG_MT       
-    printf("### thread %u finished\n", (unsigned)threads[i]);
-#endif
-  }
-
-  POCL_MEM_FREE(threads);
+  struct data *d = (struct data*)data;
+  kernel_run_command k;
+
+  k.data = data;
+  k.kernel = cmd->command.run.kernel;
+  k.device = cmd->device;
+  k.pc = cmd->command.run.pc;
+  k.workgroup = cmd->command.run.wg;
+  k.kernel_args = cmd->command.run.arguments;
+  /* The arguments are marshalled once here, the participants only add
+     their local buffers. The submitting thread does not build another
+     array before the launch has finished. */
+  k.arguments = pocl_build_launch_arguments (k.kernel, k.kernel_args,
+                                             k.device);
+  if (k.arguments == NULL)
+    {
+      cmd->event->status = CL_OUT_OF_RESOURCES;
+      return;
+    }
+  k.failed = 0;
+  k.run = workgroup_thread;
+  /* The work-groups of all dimensions are distributed among the threads,
+     the scheduler limits this to the number of work-groups. */
+  k.num_participants = d->max_threads;
+
+  pthread_scheduler_run (&d->scheduler, &k);
+  if (k.failed)
+    cmd->event->status = CL_OUT_OF_RESOURCES;
 }
 
 void *
@@ -612,123 +689,26 @@ pocl_pthread_map_mem (void *data, void *buf_ptr,
   return (char*)buf_ptr + offset;
 }
 
-void *
-workgroup_thread (void *p)
+static void
+workgroup_thread (kernel_run_command *ta, unsigned participant)
 {
-  struct thread_arguments *ta = (struct thread_arguments *) p;
-  void **arguments = (void**)alloca((ta->kernel->num_args + ta->kernel->num_locals)*sizeof(void*));
-  struct pocl_argument *al;  
-  unsigned i = 0;
-
-  /* TODO: refactor this to share code with basic.c 
-
-     To function 
-     void setup_kernel_arg_array(void **arguments, cl_kernel kernel)
-     or similar
-  */
-  cl_kernel kernel = ta->kernel;
-  for (i = 0; i < kernel->num_args; ++i)
-    {
-      al = &(ta->kernel_args[i]);
-      if (kernel->arg_info[i].is_local)
-        {
-          arguments[i] = malloc (sizeof (void *));
-          *(void **)(arguments[i]) = pocl_pthread_malloc(ta->data, 0, al->size, NULL);
-        }
-      else if (kernel->arg_info[i].type == POCL_ARG_TYPE_POINTER)
-      {
-        /* It's legal to pass a NULL pointer to clSetKernelArguments. In 
-           that case we must pass the same NULL forward to the kernel.
-           Otherwise, the user must have created a buffer with per device
-           pointers stored in the cl_mem. */
-        if (al->value == NULL) 
-          {
-            arguments[i] = malloc (sizeof (void *));
-            *(void **)arguments[i] = NULL;
-          }
-        else
-          {
-            arguments[i] = 
-              &((*(cl_mem *)(al->value))->device_ptrs[ta->device->dev_id].mem_ptr);
-          }
-      }
-      else if (kernel->arg_info[i].type == POCL_ARG_TYPE_IMAGE)
-        {
-          dev_image_t di;
-          fill_dev_image_t(&di, al, ta->device);
-          void* devptr = pocl_pthread_malloc(ta->data, 0, sizeof(dev_image_t), NULL);
-          arguments[i] = malloc (sizeof (void *));
-          *(void **)(arguments[i]) = devptr;       
-          pocl_pthread_write (ta->data, &di, devptr, 0, sizeof(dev_image_t));
-        }
-      else if (kernel->arg_info[i].type == POCL_ARG_TYPE_SAMPLER)
-        {
-          dev_sampler_t ds;
-          
-          arguments[i] = malloc (sizeof (void *));
-          *(void **)(arguments[i]) = pocl_pthread_malloc 
-            (ta->data, 0, sizeof(dev_sampler_t), NULL);
-          pocl_pthread_write (ta->data, &ds, *(void**)arguments[i], 0, 
-                              sizeof(dev_sampler_t));
-        }
-      else
-        arguments[i] = al->value;
-    }
-
-  /* Allocate the automatic local buffers which are implemented as implicit
-     extra arguments at the end of the kernel argument list. */
-  for (i = kernel->num_args;
-       i < kernel->num_args + kernel->num_locals;
-       ++i)
-    {
-      al = &(ta->kernel_args[i]);
-      arguments[i] = malloc (sizeof (void *));
-      *(void **)(arguments[i]) = pocl_pthread_malloc (ta->data, 0, al->size, 
-                                                      NULL);
-    }
-
-  int first_gid_x = ta->pc.group_id[0];
-  unsigned gid_z, gid_y, gid_x;
-  for (gid_z = 0; gid_z < ta->pc.num_groups[2]; ++gid_z)
+  size_t first, last;
+  void **arguments;
+
+  /* The local buffers are private to each participant, the rest of the
+     arguments are shared. */
+  arguments = pocl_setup_worker_arguments (ta->kernel, ta->kernel_args,
+                                           ta->arguments, ta->device);
+  /* The others steal the work-groups left in the deque of the
+     participant, but the launch fails regardless. */
+  if (arguments == NULL)
     {
-      for (gid_y = 0; gid_y < ta->pc.num_groups[1]; ++gid_y)
-        {
-          for (gid_x = first_gid_x; gid_x <= ta->last_gid_x; ++gid_x)
-            {
-              ta->pc.group_id[0] = gid_x;
-              ta->pc.group_id[1] = gid_y;
-              ta->pc.group_id[2] = gid_z;
-              ta->workgroup (arguments, &(ta->pc));              
-            }
-        }
+      ta->failed = 1;
+      return;
     }
 
-  for (i = 0; i < kernel->num_args; ++i)
-    {
-      if (kernel->arg_info[i].is_local )
-        {
-          pocl_pthread_free (ta->data, 0, *(void **)(arguments[i]));
-          POCL_MEM_FREE(arguments[i]);
-        }
-      else if (kernel->arg_info[i].type == POCL_ARG_TYPE_IMAGE)
-        {
-          pocl_pthread_free (ta->data, 0, *(void **)(arguments[i]));
-          POCL_MEM_FREE(arguments[i]);
-        }
-      else if (kernel->arg_info[i].type == POCL_ARG_TYPE_SAMPLER || 
-               (kernel->arg_info[i].type == POCL_ARG_TYPE_POINTER && *(void**)arguments[i] == NULL))
-        {
-          POCL_MEM_FREE(arguments[i]);
-        }
-    }
-  for (i = kernel->num_args;
-       i < kernel->num_args + kernel->num_locals;
-       ++i)
-    {
-      pocl_pthread_free (ta->data, 0, *(void **)(arguments[i]));
-      POCL_MEM_FREE(arguments[i]);
-    }
-  free_thread_arguments (ta);
-
-  return NULL;
+  /* The launcher steps through the group ids of the chunk itself and
+     ignores the ones in the context, which is thus shared as is. */
+  while (pthread_scheduler_get_work (ta, participant, &first, &last))
+    ta->workgroup (arguments, &ta->pc, first, last);
 }
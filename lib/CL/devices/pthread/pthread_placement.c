@@ -0,0 +1,306 @@
+/* pthread_placement.c - huge page and NUMA placement of the buffers of the
+                         pthread device
+
+   Copyright (c) 2015 pocl developers
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+   THE SOFTWARE.
+*/
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#ifndef _MSC_VER
+#  include <sys/mman.h>
+#  include <unistd.h>
+#endif
+
+#include "pthread_placement.h"
+#include "topology/pocl_topology.h"
+
+#if defined(MAP_ANON) && !defined(MAP_ANONYMOUS)
+#  define MAP_ANONYMOUS MAP_ANON
+#endif
+
+/* The buffers at least this large get transparent huge pages by default.
+   With the smaller ones the TLB savings are not worth the memory wasted
+   in the partially used last huge page. */
+#define HUGE_PAGE_THRESHOLD (8 * 1024 * 1024)
+
+/* The size of the huge pages, the default one of x86-64 and the other
+   common targets with transparent huge pages. */
+#define HUGE_PAGE_SIZE (2 * 1024 * 1024)
+
+/* The placed buffers have pages of their own. They are not taken from the
+   regular allocator of the device as the placement applies to whole pages.
+
+   The frees of the device look the placed buffers up by address from an
+   open addressing hash table. Only the insertions and the removals take
+   the lock, the lookups are lock-free, so the frees of the regular buffers
+   never touch it. A used slot is never emptied but marked deleted, thus a
+   lookup racing with the insertion or the removal of another buffer does
+   not stop early. A grown table is published atomically and the replaced
+   ones are kept as lookups may still be reading them. */
+#define DELETED_SLOT ((void*)1)
+#define MIN_TABLE_CAPACITY 64
+
+typedef struct placement_table placement_table;
+struct placement_table
+{
+  /* A power of two. */
+  size_t capacity;
+  /* The number of buffers in the table. */
+  size_t live;
+  /* The number of buffers plus the slots marked deleted. */
+  size_t used;
+  void *volatile *ptrs;
+  /* The lengths of the mappings. */
+  size_t *sizes;
+  placement_table *replaced;
+};
+
+static pocl_lock_t placement_lock = POCL_LOCK_INITIALIZER;
+static placement_table *volatile placed_buffers = NULL;
+static int default_huge_pages = 0;
+
+void
+pthread_placement_init (int huge_pages)
+{
+  default_huge_pages = huge_pages;
+}
+
+#ifndef _MSC_VER
+
+static void *
+map_anonymous (size_t size, int extra_flags)
+{
+  void *ptr = mmap (NULL, size, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS | extra_flags, -1, 0);
+  return (ptr == MAP_FAILED) ? NULL : ptr;
+}
+
+/* Maps fresh pages for the buffer. The pages are not touched, thus the
+   NUMA policy set for them afterwards decides where they end up. */
+static void *
+map_pages (size_t size, int huge, int explicit_huge)
+{
+  char *ptr, *start;
+  size_t head;
+
+#ifdef MAP_HUGETLB
+  if (explicit_huge)
+    {
+      ptr = (char*)map_anonymous (size, MAP_HUGETLB);
+      if (ptr != NULL)
+        return ptr;
+      /* There are not enough huge pages reserved, fall back to the
+         transparent ones. */
+    }
+#endif
+
+  if (!huge)
+    return map_anonymous (size, 0);
+
+  /* The kernel backs only huge page aligned ranges with transparent huge
+     pages, thus map an extra huge page and trim the mapping to an aligned
+     start. */
+  ptr = (char*)map_anonymous (size + HUGE_PAGE_SIZE, 0);
+  if (ptr == NULL)
+    return NULL;
+  start = (char*)(((uintptr_t)ptr + HUGE_PAGE_SIZE - 1)
+                  & ~(uintptr_t)(HUGE_PAGE_SIZE - 1));
+  head = start - ptr;
+  if (head > 0)
+    munmap (ptr, head);
+  munmap (start + size, HUGE_PAGE_SIZE - head);
+#ifdef MADV_HUGEPAGE
+  madvise (start, size, MADV_HUGEPAGE);
+#endif
+  return start;
+}
+
+static size_t
+hash_slot (void *ptr, size_t capacity)
+{
+  /* The buffers are page aligned, the low bits carry no information. */
+  size_t h = (size_t)((uintptr_t)ptr >> 12);
+  h ^= h >> 15;
+  h *= 2654435761u;
+  h ^= h >> 13;
+  return h & (capacity - 1);
+}
+
+/* Returns the slot of the buffer, or the capacity of the table in case it
+   is not in the table. Does not need the lock. */
+static size_t
+find_slot (placement_table *t, void *ptr)
+{
+  size_t slot = hash_slot (ptr, t->capacity);
+  size_t n;
+  for (n = 0; n < t->capacity; ++n)
+    {
+      void *p = t->ptrs[slot];
+      if (p == ptr)
+        return slot;
+      if (p == NULL)
+        break;
+      slot = (slot + 1) & (t->capacity - 1);
+    }
+  return t->capacity;
+}
+
+/* Adds the buffer to the table, first replacing the table with a larger
+   one without the deleted slots in case it is getting full. Must be called
+   with the lock held. Returns zero in case out of memory. */
+static int
+insert_buffer (void *ptr, size_t size)
+{
+  placement_table *t = placed_buffers;
+  size_t slot, i;
+
+  if (t == NULL || (t->used + 1) * 2 > t->capacity)
+    {
+      placement_table *grown;
+      size_t capacity = MIN_TABLE_CAPACITY;
+      while (t != NULL && capacity < (t->live + 1) * 4)
+        capacity *= 2;
+
+      grown = (placement_table*)calloc (1, sizeof (placement_table));
+      if (grown == NULL)
+        return 0;
+      grown->capacity = capacity;
+      grown->ptrs = (void *volatile*)calloc (capacity, sizeof (void*));
+      grown->sizes = (size_t*)calloc (capacity, sizeof (size_t));
+      if (grown->ptrs == NULL || grown->sizes == NULL)
+        {
+          free ((void*)grown->ptrs);
+          free (grown->sizes);
+          free (grown);
+          return 0;
+        }
+
+      for (i = 0; t != NULL && i < t->capacity; ++i)
+        {
+          void *p = t->ptrs[i];
+          if (p == NULL || p == DELETED_SLOT)
+            continue;
+          slot = hash_slot (p, capacity);
+          while (grown->ptrs[slot] != NULL)
+            slot = (slot + 1) & (capacity - 1);
+          grown->ptrs[slot] = p;
+          grown->sizes[slot] = t->sizes[i];
+          ++grown->live;
+          ++grown->used;
+        }
+      grown->replaced = t;
+      /* The lookups must not see the table before its contents. */
+      __sync_synchronize ();
+      placed_buffers = t = grown;
+    }
+
+  /* Deleted slots can be reused: a lookup passing them finds the new
+     buffer or continues the probing as before. */
+  slot = hash_slot (ptr, t->capacity);
+  while (t->ptrs[slot] != NULL && t->ptrs[slot] != DELETED_SLOT)
+    slot = (slot + 1) & (t->capacity - 1);
+  if (t->ptrs[slot] == NULL)
+    ++t->used;
+  ++t->live;
+  t->sizes[slot] = size;
+  __sync_synchronize ();
+  t->ptrs[slot] = ptr;
+  return 1;
+}
+
+void *
+pthread_placement_alloc (cl_mem_flags flags, size_t size)
+{
+  int explicit_huge = (flags & CL_MEM_HUGE_PAGES_POCL) != 0;
+  int huge = explicit_huge
+    || (default_huge_pages && size >= HUGE_PAGE_THRESHOLD);
+  int numa = (flags & (CL_MEM_NUMA_INTERLEAVED_POCL
+                       | CL_MEM_NUMA_LOCAL_POCL)) != 0;
+  size_t page_size = huge ? HUGE_PAGE_SIZE : (size_t)sysconf (_SC_PAGESIZE);
+  void *ptr;
+
+  if ((!huge && !numa) || size == 0)
+    return NULL;
+
+  size = (size + page_size - 1) & ~(page_size - 1);
+  ptr = map_pages (size, huge, explicit_huge);
+  if (ptr == NULL)
+    return NULL;
+
+  /* A failed binding still leaves a usable buffer, placed by the default
+     policy of the system. */
+  if (numa && pocl_topology_bind_memory
+      (ptr, size, (flags & CL_MEM_NUMA_INTERLEAVED_POCL) != 0) != 0)
+    POCL_MSG_PRINT_INFO ("Could not bind a buffer of %zu bytes to the "
+                         "NUMA nodes\n", size);
+
+  POCL_LOCK (placement_lock);
+  if (!insert_buffer (ptr, size))
+    {
+      POCL_UNLOCK (placement_lock);
+      munmap (ptr, size);
+      return NULL;
+    }
+  POCL_UNLOCK (placement_lock);
+  return ptr;
+}
+
+int
+pthread_placement_free (void *ptr)
+{
+  placement_table *t = placed_buffers;
+  size_t slot, size;
+
+  if (t == NULL || find_slot (t, ptr) == t->capacity)
+    return 0;
+
+  POCL_LOCK (placement_lock);
+  t = placed_buffers;
+  slot = find_slot (t, ptr);
+  assert (slot < t->capacity);
+  size = t->sizes[slot];
+  t->ptrs[slot] = DELETED_SLOT;
+  --t->live;
+  POCL_UNLOCK (placement_lock);
+
+  munmap (ptr, size);
+  return 1;
+}
+
+#else
+
+/* Without mmap() all the buffers are allocated as usual. */
+
+void *
+pthread_placement_alloc (cl_mem_flags flags, size_t size)
+{
+  return NULL;
+}
+
+int
+pthread_placement_free (void *ptr)
+{
+  return 0;
+}
+
+#endif
@@ -0,0 +1,57 @@
+/* pthread_placement.h - huge page and NUMA placement of the buffers of the
+                         pthread device
+
+   Copyright (c) 2015 pocl developers
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+   THE SOFTWARE.
+*/
+
+#ifndef POCL_PTHREAD_PLACEMENT_H
+#define POCL_PTHREAD_PLACEMENT_H
+
+#include "pocl_cl.h"
+
+#pragma GCC visibility push(hidden)
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Sets up the placement of the buffers. If default_huge_pages is nonzero,
+   the buffers large enough to benefit from them get transparent huge
+   pages even without CL_MEM_HUGE_PAGES_POCL. */
+void pthread_placement_init (int default_huge_pages);
+
+/* Allocates a buffer of its own pages in case the flags or the size of it
+   call for a placement, see the cl_pocl_memory_placement flags in
+   cl_ext.h. Returns NULL when the buffer does not need a placement, or
+   the placement failed, in which case it should be allocated as usual. */
+void *pthread_placement_alloc (cl_mem_flags flags, size_t size);
+
+/* Frees the buffer if it was allocated by pthread_placement_alloc ().
+   Returns zero if it was not, in which case no lock is taken. */
+int pthread_placement_free (void *ptr);
+
+#ifdef __cplusplus
+}
+#endif
+
+#pragma GCC visibility pop
+
+#endif
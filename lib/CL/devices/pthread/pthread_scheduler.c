@@ -0,0 +1,339 @@
+/* pthread_scheduler.c - a pool of persistent worker threads for the
+                         pthread device
+
+   Copyright (c) 2015 pocl developers
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+   THE SOFTWARE.
+*/
+
+#include <assert.h>
+#include <sched.h>
+#include <stdlib.h>
+
+#include "pthread_scheduler.h"
+#include "topology/pocl_topology.h"
+#include "utlist.h"
+
+/* Tells the CPU the thread is busy-waiting, which frees the execution
+   resources for the sibling hardware thread and avoids the memory order
+   violation penalty when the spin ends. */
+#if defined(__i386__) || defined(__x86_64__)
+#  define SPIN_PAUSE() __builtin_ia32_pause ()
+#elif defined(__aarch64__) || defined(__arm__)
+#  define SPIN_PAUSE() __asm__ __volatile__ ("yield" ::: "memory")
+#else
+#  define SPIN_PAUSE() sched_yield ()
+#endif
+
+/* The number of chunks each participant's initial share of work-groups
+   is popped in. Smaller chunks balance irregular kernels better at the
+   cost of more deque operations. */
+#define CHUNKS_PER_PARTICIPANT 8
+
+/* Claims a participant slot of the first launch in the work queue (or of
+   the given launch), the preferred one if it is still free. Must be called
+   with the scheduler lock held. Returns NULL in case there is no slot
+   available. */
+static kernel_run_command *
+claim_participant (scheduler_data *s, kernel_run_command *only,
+                   unsigned preferred, int node, unsigned *participant)
+{
+  kernel_run_command *k = (only != NULL) ? only : s->work_queue;
+  unsigned slot;
+
+  if (k == NULL || k->unclaimed == 0)
+    return NULL;
+
+  slot = preferred % k->num_participants;
+  if (k->deques[slot].claimed)
+    {
+      for (slot = 0; k->deques[slot].claimed; ++slot)
+        ;
+    }
+  k->deques[slot].claimed = 1;
+  k->deques[slot].node = node;
+  *participant = slot;
+
+  --k->unclaimed;
+  ++k->active_participants;
+  if (k->unclaimed == 0 && k->queued)
+    {
+      LL_DELETE (s->work_queue, k);
+      k->queued = 0;
+    }
+  return k;
+}
+
+static void
+execute_participant (scheduler_data *s, kernel_run_command *k,
+                     unsigned participant)
+{
+  k->run (k, participant);
+
+  POCL_LOCK (s->lock);
+  /* Once any participant runs out of work, all the work-groups have been
+     started, thus there's no point for others to join in anymore. */
+  if (k->queued)
+    {
+      LL_DELETE (s->work_queue, k);
+      k->queued = 0;
+    }
+  if (--k->active_participants == 0)
+    pthread_cond_broadcast (&s->done_cond);
+  POCL_UNLOCK (s->lock);
+}
+
+static int
+pop_chunk (wg_deque *d, size_t chunk_size, size_t *first, size_t *last)
+{
+  int found = 0;
+  POCL_LOCK (d->lock);
+  if (d->start < d->end)
+    {
+      *first = d->start;
+      d->start += min (chunk_size, d->end - d->start);
+      *last = d->start - 1;
+      found = 1;
+    }
+  POCL_UNLOCK (d->lock);
+  return found;
+}
+
+/* Moves the upper half of the victim's remaining work-groups to the
+   thief's (empty) deque. Only one deque lock is held at a time; the
+   stolen range belongs to nobody else but the thief in between. */
+static int
+steal_half (wg_deque *victim, wg_deque *thief)
+{
+  size_t start, end;
+  POCL_LOCK (victim->lock);
+  end = victim->end;
+  if (victim->start >= end)
+    {
+      POCL_UNLOCK (victim->lock);
+      return 0;
+    }
+  start = victim->start + (end - victim->start) / 2;
+  victim->end = start;
+  POCL_UNLOCK (victim->lock);
+
+  POCL_LOCK (thief->lock);
+  thief->start = start;
+  thief->end = end;
+  POCL_UNLOCK (thief->lock);
+  return 1;
+}
+
+int
+pthread_scheduler_get_work (kernel_run_command *k, unsigned participant,
+                            size_t *first, size_t *last)
+{
+  wg_deque *own = &k->deques[participant];
+  unsigned i, pass;
+
+  if (pop_chunk (own, k->chunk_size, first, last))
+    return 1;
+
+  /* Start from the neighbour to spread the thieves over the victims.
+     The work-groups of the participants on the same node are stolen
+     first as their data is more likely to be local. */
+  for (pass = (own->node < 0) ? 1 : 0; pass < 2; ++pass)
+    {
+      for (i = 1; i < k->num_participants; ++i)
+        {
+          unsigned victim = (participant + i) % k->num_participants;
+          if (pass == 0 && k->deques[victim].node != own->node)
+            continue;
+          if (steal_half (&k->deques[victim], own)
+              && pop_chunk (own, k->chunk_size, first, last))
+            return 1;
+        }
+    }
+  return 0;
+}
+
+static void *
+pocl_pthread_driver_thread (void *p)
+{
+  pool_thread_data *td = (pool_thread_data*)p;
+  scheduler_data *s = td->scheduler;
+  kernel_run_command *k;
+  unsigned participant, spin;
+
+  /* The submitting thread takes the first slot, thus the first hardware
+     thread is left for it. */
+  td->node = -1;
+  if (s->pin_threads)
+    td->node = pocl_topology_bind_thread (s->first_pu, s->num_pus,
+                                          td->index + 1);
+
+  POCL_LOCK (s->lock);
+  while (1)
+    {
+      if (s->shutdown)
+        break;
+
+      k = claim_participant (s, NULL, td->index + 1, td->node,
+                             &participant);
+      if (k != NULL)
+        {
+          POCL_UNLOCK (s->lock);
+          execute_participant (s, k, participant);
+          POCL_LOCK (s->lock);
+          continue;
+        }
+
+      /* Poll for a while before sleeping to catch back-to-back launches
+         without the cost of a wakeup. The fields are written with the
+         lock held; the atomic loads keep the compiler from hoisting them
+         out of the loop. */
+      POCL_UNLOCK (s->lock);
+      for (spin = 0; spin < s->spin_count; ++spin)
+        {
+          if (__atomic_load_n (&s->work_queue, __ATOMIC_ACQUIRE) != NULL
+              || __atomic_load_n (&s->shutdown, __ATOMIC_ACQUIRE))
+            break;
+          SPIN_PAUSE ();
+        }
+      POCL_LOCK (s->lock);
+      if (s->work_queue == NULL && !s->shutdown)
+        {
+          ++s->sleeping;
+          pthread_cond_wait (&s->wake_cond, &s->lock);
+          --s->sleeping;
+        }
+    }
+  POCL_UNLOCK (s->lock);
+
+  return NULL;
+}
+
+void
+pthread_scheduler_init (scheduler_data *s, unsigned num_threads,
+                        int pin_threads, unsigned first_pu, unsigned num_pus,
+                        unsigned spin_count)
+{
+  unsigned i;
+  int error;
+
+  POCL_INIT_LOCK (s->lock);
+  pthread_cond_init (&s->wake_cond, NULL);
+  pthread_cond_init (&s->done_cond, NULL);
+  s->work_queue = NULL;
+  s->shutdown = 0;
+  s->sleeping = 0;
+  s->spin_count = spin_count;
+  s->num_threads = num_threads;
+  s->pin_threads = pin_threads;
+  s->first_pu = first_pu;
+  s->num_pus = num_pus;
+  s->thread_pool = (pool_thread_data*)
+    calloc (num_threads > 0 ? num_threads : 1, sizeof (pool_thread_data));
+
+  for (i = 0; i < num_threads; ++i)
+    {
+      s->thread_pool[i].index = i;
+      s->thread_pool[i].scheduler = s;
+      error = pthread_create (&s->thread_pool[i].thread, NULL,
+                              pocl_pthread_driver_thread,
+                              &s->thread_pool[i]);
+      assert (!error);
+    }
+}
+
+void
+pthread_scheduler_uninit (scheduler_data *s)
+{
+  unsigned i;
+
+  POCL_LOCK (s->lock);
+  s->shutdown = 1;
+  pthread_cond_broadcast (&s->wake_cond);
+  POCL_UNLOCK (s->lock);
+
+  for (i = 0; i < s->num_threads; ++i)
+    pthread_join (s->thread_pool[i].thread, NULL);
+
+  POCL_MEM_FREE (s->thread_pool);
+  pthread_cond_destroy (&s->wake_cond);
+  pthread_cond_destroy (&s->done_cond);
+  POCL_DESTROY_LOCK (s->lock);
+}
+
+void
+pthread_scheduler_run (scheduler_data *s, kernel_run_command *k)
+{
+  unsigned participant, i;
+  size_t share;
+
+  k->num_groups = k->pc.num_groups[0] * k->pc.num_groups[1]
+    * k->pc.num_groups[2];
+  if (k->num_participants > k->num_groups)
+    k->num_participants = k->num_groups;
+  if (k->num_participants == 0)
+    k->num_participants = 1;
+
+  /* Start with an even static split; stealing fixes the imbalance of
+     kernels with irregular work-group costs. The deques live only as long
+     as this call, which does not return before all participants have
+     left. */
+  k->deques = (wg_deque*)alloca (k->num_participants * sizeof (wg_deque));
+  for (i = 0; i < k->num_participants; ++i)
+    {
+      POCL_INIT_LOCK (k->deques[i].lock);
+      k->deques[i].start = k->num_groups * i / k->num_participants;
+      k->deques[i].end = k->num_groups * (i + 1) / k->num_participants;
+      k->deques[i].claimed = 0;
+      k->deques[i].node = -1;
+    }
+  share = k->num_groups / k->num_participants;
+  k->chunk_size = max (share / CHUNKS_PER_PARTICIPANT, (size_t)1);
+
+  k->unclaimed = k->num_participants;
+  k->active_participants = 0;
+  k->queued = 0;
+  k->next = NULL;
+
+  POCL_LOCK (s->lock);
+  /* A single participant is not worth waking anyone up for. */
+  if (k->num_participants > 1)
+    {
+      LL_APPEND (s->work_queue, k);
+      k->queued = 1;
+      /* The spinning workers pick the launch up by themselves. */
+      if (s->sleeping > 0)
+        pthread_cond_broadcast (&s->wake_cond);
+    }
+
+  if (claim_participant (s, k, 0, -1, &participant) != NULL)
+    {
+      POCL_UNLOCK (s->lock);
+      execute_participant (s, k, participant);
+      POCL_LOCK (s->lock);
+    }
+
+  /* Our own participation ends only after all the work-groups have been
+     started, wait for the ones still executing in the workers. */
+  while (k->active_participants > 0)
+    pthread_cond_wait (&s->done_cond, &s->lock);
+  POCL_UNLOCK (s->lock);
+
+  for (i = 0; i < k->num_participants; ++i)
+    POCL_DESTROY_LOCK (k->deques[i].lock);
+}
@@ -0,0 +1,176 @@
+/* pthread_scheduler.h - a pool of persistent worker threads for the
+                         pthread device
+
+   Copyright (c) 2015 pocl developers
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+   THE SOFTWARE.
+*/
+
+#ifndef POCL_PTHREAD_SCHEDULER_H
+#define POCL_PTHREAD_SCHEDULER_H
+
+#include <pthread.h>
+#include "pocl_cl.h"
+
+#pragma GCC visibility push(hidden)
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct kernel_run_command kernel_run_command;
+typedef struct wg_deque wg_deque;
+typedef struct pool_thread_data pool_thread_data;
+typedef struct scheduler_data scheduler_data;
+
+/* Executes work-groups of the given launch on the calling thread until
+   pthread_scheduler_get_work() returns no more work for the participant. */
+typedef void (*pocl_participant_func) (kernel_run_command *k,
+                                       unsigned participant);
+
+/* The not yet started work-groups of one participant of a launch as a
+   range [start, end) of flat work-group indices. The owner pops chunks
+   from the start while the thieves steal from the end. */
+struct wg_deque
+{
+  pocl_lock_t lock;
+  size_t start;
+  size_t end;
+  /* Nonzero once a thread has taken the participant slot. Protected by
+     the scheduler lock. */
+  int claimed;
+  /* The NUMA node of the thread that took the slot, -1 if unknown. */
+  int node;
+};
+
+/* A single NDRange launch handed to the worker pool. The structure is
+   owned by the submitting thread which blocks in pthread_scheduler_run()
+   until all of its work-groups have been executed. */
+struct kernel_run_command
+{
+  /* The device data for kernel launches, the command specific data for
+     the other users of the pool, e.g., the transfers. */
+  void *data;
+  cl_kernel kernel;
+  cl_device_id device;
+  struct pocl_context pc;
+  pocl_workgroup_range workgroup;
+  struct pocl_argument *kernel_args;
+  /* The argument array built once for the launch with the local buffers
+     left out. Only read by the participants. */
+  void **arguments;
+  pocl_participant_func run;
+  /* Set by a participant that could not execute its work-groups. Read
+     by the caller after pthread_scheduler_run() has returned. */
+  int failed;
+
+  /* The work-groups of all three dimensions flattened with x being the
+     fastest changing index. */
+  size_t num_groups;
+  /* The maximum number of work-groups a participant pops from its own
+     deque at a time. */
+  size_t chunk_size;
+  /* The number of threads (including the submitting one) that execute
+     the launch, each owning one deque. Set by the caller. */
+  unsigned num_participants;
+  wg_deque *deques;
+
+  /* The number of participant slots not taken yet. Protected by the
+     scheduler lock. */
+  unsigned unclaimed;
+  /* The number of participants currently executing the launch. Protected
+     by the scheduler lock. */
+  unsigned active_participants;
+  /* Nonzero while the launch is in the work queue. Protected by the
+     scheduler lock. */
+  int queued;
+
+  kernel_run_command *next;
+};
+
+struct pool_thread_data
+{
+  pthread_t thread;
+  unsigned index;
+  /* The NUMA node the thread is pinned to, -1 if it is not pinned. */
+  int node;
+  scheduler_data *scheduler;
+};
+
+struct scheduler_data
+{
+  pocl_lock_t lock;
+  /* The idle workers sleep on this one until new work arrives. */
+  pthread_cond_t wake_cond;
+  /* The submitters sleep on this one until their launch has finished. */
+  pthread_cond_t done_cond;
+  /* The launches with unclaimed participant slots left. The idle workers
+     poll it without the lock for spin_count rounds before sleeping. */
+  kernel_run_command *work_queue;
+  unsigned spin_count;
+  /* The number of workers sleeping on wake_cond. Protected by the lock. */
+  unsigned sleeping;
+  unsigned num_threads;
+  pool_thread_data *thread_pool;
+  /* Nonzero if the workers are pinned to the hardware threads
+     [first_pu, first_pu + num_pus) of the host. */
+  int pin_threads;
+  unsigned first_pu;
+  unsigned num_pus;
+  int shutdown;
+};
+
+/* Starts num_threads worker threads. The thread that submits a launch
+   always executes work-groups of it too, thus a pool of N-1 workers is
+   enough to keep N cores busy.
+
+   If pin_threads is nonzero, the workers are pinned to the hardware
+   threads [first_pu, first_pu + num_pus), see pocl_topology_get_pus ().
+   Each worker then prefers the same participant slot, that is, the same
+   share of the work-groups and of the transferred data, in every launch.
+   The pages the worker touches in the parallel transfers are thus likely
+   local to its node when it executes the matching work-groups.
+
+   An idle worker polls for new launches spin_count times before going to
+   sleep, zero makes it sleep right away. */
+void pthread_scheduler_init (scheduler_data *s, unsigned num_threads,
+                             int pin_threads, unsigned first_pu,
+                             unsigned num_pus, unsigned spin_count);
+
+/* Wakes up and joins all the workers. */
+void pthread_scheduler_uninit (scheduler_data *s);
+
+/* Executes all the work-groups of the launch using the pool and the
+   calling thread. Returns after every work-group has finished. */
+void pthread_scheduler_run (scheduler_data *s, kernel_run_command *k);
+
+/* Fetches the next range [*first, *last] of flat work-group indices for
+   the participant to execute, stealing from the other participants when
+   its own deque has run dry, from the ones on the same NUMA node first.
+   Returns zero when the launch has no unstarted work-groups left. */
+int pthread_scheduler_get_work (kernel_run_command *k, unsigned participant,
+                                size_t *first, size_t *last);
+
+#ifdef __cplusplus
+}
+#endif
+
+#pragma GCC visibility pop
+
+#endif
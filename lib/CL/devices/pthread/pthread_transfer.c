@@ -0,0 +1,289 @@
+/* pthread_transfer.c - memory transfers executed by the worker pool of the
+                        pthread device
+
+   Copyright (c) 2015 pocl developers
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+   THE SOFTWARE.
+*/
+
+#include <stdint.h>
+#include <string.h>
+
+#ifdef __SSE2__
+#  include <emmintrin.h>
+#endif
+
+#include "pthread_transfer.h"
+#include "memfill.h"
+#include "rectcopy.h"
+
+/* Copies smaller than this are done with a single memcpy() on the calling
+   thread as waking up the workers would cost more than it saves. */
+#define PARALLEL_COPY_THRESHOLD (1024 * 1024)
+
+/* Copies at least this large are assumed to not fit in the caches, thus
+   there is no point in polluting them with the destination. */
+#define STREAMING_COPY_THRESHOLD (8 * 1024 * 1024)
+
+/* The unit of work distributed among the threads. A multiple of the page
+   size so that no page of the destination is written by two threads. */
+#define COPY_CHUNK_SIZE (256 * 1024)
+#define COPY_PAGE_SIZE 4096
+
+typedef struct transfer_command
+{
+  char *dst;
+  const char *src;
+  size_t size;
+  /* The offset of dst from the previous page boundary. The chunks are
+     aligned to the pages of the destination. */
+  size_t skew;
+  int streaming;
+
+  /* The fills. */
+  const void *pattern;
+  size_t pattern_size;
+  /* The chunk size of contiguous fills, a multiple of the pattern. */
+  size_t chunk_size;
+  /* The shape of the region of rect fills, which are distributed in
+     rows. */
+  size_t row_size;
+  size_t rows_per_slice;
+  size_t row_pitch;
+  size_t slice_pitch;
+
+  /* The rect copies, distributed in rows. */
+  const pocl_rect_transfer *rect;
+} transfer_command;
+
+/* Copies with non-temporal stores. The stores of the thread are fenced
+   before returning, the scheduler orders them with the submitter. */
+static void
+stream_copy (char *dst, const char *src, size_t cb)
+{
+#ifdef __SSE2__
+  size_t head = (size_t)(-(uintptr_t)dst & 15);
+  if (head > cb)
+    head = cb;
+  memcpy (dst, src, head);
+  dst += head;
+  src += head;
+  cb -= head;
+
+  for (; cb >= 64; cb -= 64, src += 64, dst += 64)
+    {
+      __m128i a = _mm_loadu_si128 ((const __m128i*)src);
+      __m128i b = _mm_loadu_si128 ((const __m128i*)(src + 16));
+      __m128i c = _mm_loadu_si128 ((const __m128i*)(src + 32));
+      __m128i d = _mm_loadu_si128 ((const __m128i*)(src + 48));
+      _mm_stream_si128 ((__m128i*)dst, a);
+      _mm_stream_si128 ((__m128i*)(dst + 16), b);
+      _mm_stream_si128 ((__m128i*)(dst + 32), c);
+      _mm_stream_si128 ((__m128i*)(dst + 48), d);
+    }
+  _mm_sfence ();
+#endif
+  memcpy (dst, src, cb);
+}
+
+static void
+copy_range (transfer_command *t, size_t start, size_t end)
+{
+  if (t->streaming)
+    stream_copy (t->dst + start, t->src + start, end - start);
+  else
+    memcpy (t->dst + start, t->src + start, end - start);
+}
+
+static void
+transfer_participant (kernel_run_command *k, unsigned participant)
+{
+  transfer_command *t = (transfer_command*)k->data;
+  size_t first, last, start, end;
+
+  while (pthread_scheduler_get_work (k, participant, &first, &last))
+    {
+      start = first * COPY_CHUNK_SIZE;
+      start = (start > t->skew) ? start - t->skew : 0;
+      end = min ((last + 1) * COPY_CHUNK_SIZE - t->skew, t->size);
+      copy_range (t, start, end);
+    }
+}
+
+void
+pthread_transfer_copy (scheduler_data *s, unsigned max_participants,
+                       void *__restrict__ dst,
+                       const void *__restrict__ src, size_t cb)
+{
+  transfer_command t;
+  kernel_run_command k;
+
+  t.dst = (char*)dst;
+  t.src = (const char*)src;
+  t.size = cb;
+  t.skew = (uintptr_t)dst & (COPY_PAGE_SIZE - 1);
+  t.streaming = (cb >= STREAMING_COPY_THRESHOLD);
+
+  if (cb < PARALLEL_COPY_THRESHOLD || max_participants < 2)
+    {
+      copy_range (&t, 0, cb);
+      return;
+    }
+
+  memset (&k, 0, sizeof (k));
+  k.data = &t;
+  k.run = transfer_participant;
+  k.pc.num_groups[0] = (cb + t.skew + COPY_CHUNK_SIZE - 1) / COPY_CHUNK_SIZE;
+  k.pc.num_groups[1] = 1;
+  k.pc.num_groups[2] = 1;
+  k.num_participants = max_participants;
+
+  pthread_scheduler_run (s, &k);
+}
+
+static void
+fill_participant (kernel_run_command *k, unsigned participant)
+{
+  transfer_command *t = (transfer_command*)k->data;
+  size_t first, last, start, end;
+
+  while (pthread_scheduler_get_work (k, participant, &first, &last))
+    {
+      start = first * t->chunk_size;
+      end = min ((last + 1) * t->chunk_size, t->size);
+      pocl_fill_memory (t->dst + start, end - start, t->pattern,
+                        t->pattern_size);
+    }
+}
+
+static void
+fill_rows_participant (kernel_run_command *k, unsigned participant)
+{
+  transfer_command *t = (transfer_command*)k->data;
+  size_t first, last;
+
+  while (pthread_scheduler_get_work (k, participant, &first, &last))
+    pocl_fill_rows (t->dst, t->row_size, t->rows_per_slice, t->row_pitch,
+                    t->slice_pitch, first, last, t->pattern,
+                    t->pattern_size);
+}
+
+void
+pthread_transfer_fill_rect (scheduler_data *s, unsigned max_participants,
+                            void *dst, size_t row_size,
+                            size_t rows_per_slice, size_t slices,
+                            size_t row_pitch, size_t slice_pitch,
+                            const void *pattern, size_t pattern_size)
+{
+  transfer_command t;
+  kernel_run_command k;
+  size_t rows = rows_per_slice * slices;
+
+  memset (&t, 0, sizeof (t));
+  t.dst = (char*)dst;
+  t.size = row_size * rows;
+  t.pattern = pattern;
+  t.pattern_size = pattern_size;
+  t.row_size = row_size;
+  t.rows_per_slice = rows_per_slice;
+  t.row_pitch = row_pitch;
+  t.slice_pitch = slice_pitch;
+
+  if (rows == 0)
+    return;
+
+  if (t.size < PARALLEL_COPY_THRESHOLD || max_participants < 2)
+    {
+      pocl_fill_rows (t.dst, row_size, rows_per_slice, row_pitch,
+                      slice_pitch, 0, rows - 1, pattern, pattern_size);
+      return;
+    }
+
+  memset (&k, 0, sizeof (k));
+  k.data = &t;
+  k.pc.num_groups[1] = 1;
+  k.pc.num_groups[2] = 1;
+  k.num_participants = max_participants;
+
+  if ((rows_per_slice == 1 || row_pitch == row_size)
+      && (slices == 1 || slice_pitch == row_size * rows_per_slice))
+    {
+      /* A contiguous region, split it regardless of the rows. */
+      t.chunk_size = COPY_CHUNK_SIZE - COPY_CHUNK_SIZE % pattern_size;
+      k.run = fill_participant;
+      k.pc.num_groups[0] = (t.size + t.chunk_size - 1) / t.chunk_size;
+    }
+  else
+    {
+      k.run = fill_rows_participant;
+      k.pc.num_groups[0] = rows;
+    }
+
+  pthread_scheduler_run (s, &k);
+}
+
+static void
+rect_participant (kernel_run_command *k, unsigned participant)
+{
+  transfer_command *t = (transfer_command*)k->data;
+  size_t first, last;
+
+  while (pthread_scheduler_get_work (k, participant, &first, &last))
+    pocl_rect_copy_rows (t->rect, first, last);
+}
+
+void
+pthread_transfer_copy_rect (scheduler_data *s, unsigned max_participants,
+                            const pocl_rect_transfer *r)
+{
+  transfer_command t;
+  kernel_run_command k;
+  size_t rows = r->rows * r->slices;
+
+  if (rows == 0 || r->row_size == 0)
+    return;
+
+  /* The region was coalesced to a single block. */
+  if (rows == 1 && !pocl_rect_transfer_overlaps (r))
+    {
+      pthread_transfer_copy (s, max_participants, r->dst, r->src,
+                             r->row_size);
+      return;
+    }
+
+  if (rows * r->row_size < PARALLEL_COPY_THRESHOLD || max_participants < 2
+      || pocl_rect_transfer_overlaps (r))
+    {
+      pocl_rect_copy (r);
+      return;
+    }
+
+  memset (&t, 0, sizeof (t));
+  t.rect = r;
+
+  memset (&k, 0, sizeof (k));
+  k.data = &t;
+  k.run = rect_participant;
+  k.pc.num_groups[0] = rows;
+  k.pc.num_groups[1] = 1;
+  k.pc.num_groups[2] = 1;
+  k.num_participants = max_participants;
+
+  pthread_scheduler_run (s, &k);
+}
@@ -0,0 +1,70 @@
+/* pthread_transfer.h - memory transfers executed by the worker pool of the
+                        pthread device
+
+   Copyright (c) 2015 pocl developers
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+   THE SOFTWARE.
+*/
+
+#ifndef POCL_PTHREAD_TRANSFER_H
+#define POCL_PTHREAD_TRANSFER_H
+
+#include "pthread_scheduler.h"
+#include "rectcopy.h"
+
+#pragma GCC visibility push(hidden)
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Copies cb bytes from src to dst. Copies large enough to benefit from it
+   are split to page aligned chunks which are copied by up to
+   max_participants threads of the pool, the calling thread included. The
+   chunks are handed out as contiguous ranges per thread so that, with the
+   first touch policy, a thread writing fresh pages gets them from its own
+   NUMA node. The largest copies bypass the caches with non-temporal stores
+   where the target supports them.
+
+   The ranges must not overlap. */
+void pthread_transfer_copy (scheduler_data *s, unsigned max_participants,
+                            void *__restrict__ dst,
+                            const void *__restrict__ src, size_t cb);
+
+/* Fills a region of slices * rows_per_slice rows, each row_size bytes, with
+   the pattern. Large regions are split to the threads by rows, or in
+   chunks in case the region is contiguous. */
+void pthread_transfer_fill_rect (scheduler_data *s, unsigned max_participants,
+                                 void *dst, size_t row_size,
+                                 size_t rows_per_slice, size_t slices,
+                                 size_t row_pitch, size_t slice_pitch,
+                                 const void *pattern, size_t pattern_size);
+
+/* Copies the rect region. Large regions are split to the threads by rows,
+   overlapping ones are copied on the calling thread. */
+void pthread_transfer_copy_rect (scheduler_data *s, unsigned max_participants,
+                                 const pocl_rect_transfer *r);
+
+#ifdef __cplusplus
+}
+#endif
+
+#pragma GCC visibility pop
+
+#endif
@@ -0,0 +1,206 @@
+/* rectcopy.c - copying rectangular regions of memory
+
+   Copyright (c) 2015 pocl developers
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+   THE SOFTWARE.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "rectcopy.h"
+
+/* Merges the slices to rows or the rows to the row size when the strides
+   allow it in both the source and the destination. */
+static void
+coalesce (pocl_rect_transfer *r)
+{
+  /* A single row per slice: the slices are the rows. */
+  if (r->rows == 1)
+    {
+      r->rows = r->slices;
+      r->slices = 1;
+      r->dst_row_pitch = r->dst_slice_pitch;
+      r->src_row_pitch = r->src_slice_pitch;
+    }
+
+  /* The slices follow each other at the row pitch: one slice of more
+     rows. */
+  if (r->slices > 1
+      && r->dst_slice_pitch == r->rows * r->dst_row_pitch
+      && r->src_slice_pitch == r->rows * r->src_row_pitch)
+    {
+      r->rows *= r->slices;
+      r->slices = 1;
+    }
+
+  /* Contiguous rows: one row per slice. */
+  if (r->rows > 1 && r->dst_row_pitch == r->row_size
+      && r->src_row_pitch == r->row_size)
+    {
+      r->row_size *= r->rows;
+      r->rows = r->slices;
+      r->slices = 1;
+      r->dst_row_pitch = r->dst_slice_pitch;
+      r->src_row_pitch = r->src_slice_pitch;
+
+      /* ...and contiguous slices. */
+      if (r->rows > 1 && r->dst_row_pitch == r->row_size
+          && r->src_row_pitch == r->row_size)
+        {
+          r->row_size *= r->rows;
+          r->rows = 1;
+        }
+    }
+
+  if (r->rows == 1)
+    r->dst_row_pitch = r->src_row_pitch = r->row_size;
+  if (r->slices == 1)
+    {
+      r->dst_slice_pitch = r->rows * r->dst_row_pitch;
+      r->src_slice_pitch = r->rows * r->src_row_pitch;
+    }
+}
+
+void
+pocl_rect_transfer_init (pocl_rect_transfer *r,
+                         void *dst, const void *src,
+                         const size_t *dst_origin,
+                         const size_t *src_origin,
+                         const size_t *region,
+                         size_t dst_row_pitch, size_t dst_slice_pitch,
+                         size_t src_row_pitch, size_t src_slice_pitch)
+{
+  r->dst = (char*)dst + dst_origin[0] + dst_row_pitch * dst_origin[1]
+    + dst_slice_pitch * dst_origin[2];
+  r->src = (const char*)src + src_origin[0] + src_row_pitch * src_origin[1]
+    + src_slice_pitch * src_origin[2];
+  r->row_size = region[0];
+  r->rows = region[1];
+  r->slices = region[2];
+  r->dst_row_pitch = dst_row_pitch;
+  r->dst_slice_pitch = dst_slice_pitch;
+  r->src_row_pitch = src_row_pitch;
+  r->src_slice_pitch = src_slice_pitch;
+
+  if (r->row_size > 0 && r->rows > 0 && r->slices > 0)
+    coalesce (r);
+}
+
+int
+pocl_rect_transfer_overlaps (const pocl_rect_transfer *r)
+{
+  size_t dst_span, src_span;
+
+  if (r->row_size == 0 || r->rows == 0 || r->slices == 0)
+    return 0;
+
+  dst_span = (r->slices - 1) * r->dst_slice_pitch
+    + (r->rows - 1) * r->dst_row_pitch + r->row_size;
+  src_span = (r->slices - 1) * r->src_slice_pitch
+    + (r->rows - 1) * r->src_row_pitch + r->row_size;
+
+  return r->dst < r->src + src_span && r->src < r->dst + dst_span;
+}
+
+void
+pocl_rect_copy_rows (const pocl_rect_transfer *r, size_t first_row,
+                     size_t last_row)
+{
+  size_t row, y, z;
+
+  for (row = first_row; row <= last_row; ++row)
+    {
+      y = row % r->rows;
+      z = row / r->rows;
+      memcpy (r->dst + y * r->dst_row_pitch + z * r->dst_slice_pitch,
+              r->src + y * r->src_row_pitch + z * r->src_slice_pitch,
+              r->row_size);
+    }
+}
+
+void
+pocl_rect_copy (const pocl_rect_transfer *r)
+{
+  size_t rows = r->rows * r->slices;
+  size_t row, y, z;
+  char *tmp;
+
+  if (rows == 0 || r->row_size == 0)
+    return;
+
+  if (!pocl_rect_transfer_overlaps (r))
+    {
+      pocl_rect_copy_rows (r, 0, rows - 1);
+      return;
+    }
+
+  /* With the same layout every byte moves by the same distance. Walking
+     the rows away from the direction of the move never overwrites a row
+     that is still to be read. */
+  if (r->dst_row_pitch == r->src_row_pitch
+      && r->dst_slice_pitch == r->src_slice_pitch
+      && r->src_row_pitch >= r->row_size
+      && r->src_slice_pitch >= r->rows * r->src_row_pitch)
+    {
+      if (r->dst == r->src)
+        return;
+      for (row = 0; row < rows; ++row)
+        {
+          size_t i = (r->dst < r->src) ? row : rows - 1 - row;
+          size_t offset = (i % r->rows) * r->src_row_pitch
+            + (i / r->rows) * r->src_slice_pitch;
+          memmove (r->dst + offset, r->src + offset, r->row_size);
+        }
+      return;
+    }
+
+  /* The layouts differ, go through a packed copy of the source. */
+  tmp = (char*)malloc (rows * r->row_size);
+  if (tmp == NULL)
+    {
+      /* Out of memory, a best effort move row by row. */
+      for (row = 0; row < rows; ++row)
+        {
+          y = row % r->rows;
+          z = row / r->rows;
+          memmove (r->dst + y * r->dst_row_pitch + z * r->dst_slice_pitch,
+                   r->src + y * r->src_row_pitch + z * r->src_slice_pitch,
+                   r->row_size);
+        }
+      return;
+    }
+
+  for (row = 0; row < rows; ++row)
+    {
+      y = row % r->rows;
+      z = row / r->rows;
+      memcpy (tmp + row * r->row_size,
+              r->src + y * r->src_row_pitch + z * r->src_slice_pitch,
+              r->row_size);
+    }
+  for (row = 0; row < rows; ++row)
+    {
+      y = row % r->rows;
+      z = row / r->rows;
+      memcpy (r->dst + y * r->dst_row_pitch + z * r->dst_slice_pitch,
+              tmp + row * r->row_size, r->row_size);
+    }
+  free (tmp);
+}
@@ -0,0 +1,85 @@
+/* rectcopy.h - copying rectangular regions of memory
+
+   Copyright (c) 2015 pocl developers
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+   THE SOFTWARE.
+*/
+
+#ifndef POCL_RECTCOPY_H
+#define POCL_RECTCOPY_H
+
+#include <stddef.h>
+
+#pragma GCC visibility push(hidden)
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* A copy of a 3D region between two pitched layouts, i.e., the transfer
+   of the copy/read/write_rect() device operations. The dimensions are
+   coalesced at initialization: rows and slices that are contiguous in
+   both the source and the destination are merged so that, e.g., a
+   region spanning whole rows of a buffer becomes a single block copy. */
+typedef struct pocl_rect_transfer
+{
+  char *dst;
+  const char *src;
+  /* The size of the region: bytes per row, rows per slice and slices. */
+  size_t row_size;
+  size_t rows;
+  size_t slices;
+  size_t dst_row_pitch;
+  size_t dst_slice_pitch;
+  size_t src_row_pitch;
+  size_t src_slice_pitch;
+} pocl_rect_transfer;
+
+/* Initializes the transfer of the region at the given origins, with
+   origin[0] and region[0] in bytes, and coalesces its dimensions. */
+void pocl_rect_transfer_init (pocl_rect_transfer *r,
+                              void *dst, const void *src,
+                              const size_t *dst_origin,
+                              const size_t *src_origin,
+                              const size_t *region,
+                              size_t dst_row_pitch, size_t dst_slice_pitch,
+                              size_t src_row_pitch, size_t src_slice_pitch);
+
+/* Returns nonzero in case the memory spans of the source and the
+   destination overlap, e.g., when a buffer using the host pointer is
+   read to the same host memory. */
+int pocl_rect_transfer_overlaps (const pocl_rect_transfer *r);
+
+/* Copies the rows first_row..last_row of the transfer. The rows are
+   numbered slice by slice. The source and destination must not
+   overlap. */
+void pocl_rect_copy_rows (const pocl_rect_transfer *r, size_t first_row,
+                          size_t last_row);
+
+/* Copies the whole region on the calling thread. Overlapping source and
+   destination are copied as if through an intermediate buffer. */
+void pocl_rect_copy (const pocl_rect_transfer *r);
+
+#ifdef __cplusplus
+}
+#endif
+
+#pragma GCC visibility pop
+
+#endif
@@ -0,0 +1,414 @@
+/* segalloc.c - a segregated-fit allocator for the host buffers
+
+   Copyright (c) 2015 pocl developers
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+   THE SOFTWARE.
+*/
+/**
+ * A two-level segregated-fit allocator for the buffers of the host
+ * devices, in the spirit of TLSF.
+ *
+ * The memory is obtained from the system in large arenas which are split
+ * to blocks. Each block starts with a header which links it to its
+ * neighbours in the arena, thus freeing finds the block of an address and
+ * merges it with the free neighbours in constant time. The free blocks
+ * are kept in lists of size classes with bitmaps of the non-empty ones,
+ * which makes finding a large enough free block a couple of bit scans
+ * regardless of the number of buffers allocated.
+ *
+ * Small blocks freed by a thread are kept in a small per-thread cache
+ * and reused by its next allocations of similar size without taking the
+ * allocator lock.
+ */
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "segalloc.h"
+#include "common.h"
+
+/* The number of blocks and the largest block size (excluding the header)
+   in the per-thread caches. */
+#define SEG_CACHE_ENTRIES 16
+#define SEG_CACHE_MAX_SIZE (256 * 1024)
+
+typedef struct seg_thread_cache
+{
+  seg_allocator *allocator;
+  /* The allocator epoch the cached blocks belong to. */
+  unsigned epoch;
+  unsigned count;
+  seg_block *blocks[SEG_CACHE_ENTRIES];
+} seg_thread_cache;
+
+/* The index of the most significant set bit. */
+static unsigned
+find_last_set (size_t x)
+{
+#ifdef __GNUC__
+  return sizeof (unsigned long long) * 8 - 1
+    - __builtin_clzll ((unsigned long long)x);
+#else
+  unsigned i = 0;
+  while (x >>= 1)
+    ++i;
+  return i;
+#endif
+}
+
+/* The index of the least significant set bit. */
+static unsigned
+find_first_set (size_t x)
+{
+#ifdef __GNUC__
+  return __builtin_ctzll ((unsigned long long)x);
+#else
+  unsigned i = 0;
+  while (!(x & 1))
+    {
+      x >>= 1;
+      ++i;
+    }
+  return i;
+#endif
+}
+
+/* The size class of a block of n allocation units. The classes below
+   SEG_SL_COUNT units are exact, above that each power of two is split to
+   SEG_SL_COUNT equally wide classes. */
+static void
+size_class (size_t n, unsigned *fl, unsigned *sl)
+{
+  unsigned t;
+  if (n < SEG_SL_COUNT)
+    {
+      *fl = 0;
+      *sl = n;
+      return;
+    }
+  t = find_last_set (n);
+  *fl = t - SEG_SL_BITS + 1;
+  *sl = (n >> (t - SEG_SL_BITS)) - SEG_SL_COUNT;
+}
+
+static void
+insert_free (seg_allocator *a, seg_block *b)
+{
+  unsigned fl, sl;
+  size_class (b->size / a->alignment, &fl, &sl);
+
+  b->is_free = 1;
+  b->prev_free = NULL;
+  b->next_free = a->free_lists[fl][sl];
+  if (b->next_free != NULL)
+    b->next_free->prev_free = b;
+  a->free_lists[fl][sl] = b;
+
+  a->fl_bitmap |= (size_t)1 << fl;
+  a->sl_bitmap[fl] |= 1u << sl;
+}
+
+static void
+remove_free (seg_allocator *a, seg_block *b)
+{
+  unsigned fl, sl;
+  size_class (b->size / a->alignment, &fl, &sl);
+
+  if (b->prev_free != NULL)
+    b->prev_free->next_free = b->next_free;
+  else
+    a->free_lists[fl][sl] = b->next_free;
+  if (b->next_free != NULL)
+    b->next_free->prev_free = b->prev_free;
+
+  if (a->free_lists[fl][sl] == NULL)
+    {
+      a->sl_bitmap[fl] &= ~(1u << sl);
+      if (a->sl_bitmap[fl] == 0)
+        a->fl_bitmap &= ~((size_t)1 << fl);
+    }
+  b->is_free = 0;
+}
+
+/* Finds a free block of at least n allocation units. The size is rounded
+   up to the next class boundary so that any block of the found class
+   fits. */
+static seg_block *
+find_free (seg_allocator *a, size_t n)
+{
+  unsigned fl, sl;
+  size_t sl_map, fl_map;
+
+  if (n >= SEG_SL_COUNT)
+    n += ((size_t)1 << (find_last_set (n) - SEG_SL_BITS)) - 1;
+  size_class (n, &fl, &sl);
+
+  sl_map = a->sl_bitmap[fl] & (~0u << sl);
+  if (sl_map == 0)
+    {
+      if (fl + 1 >= SEG_FL_COUNT)
+        return NULL;
+      fl_map = a->fl_bitmap & (~(size_t)0 << (fl + 1));
+      if (fl_map == 0)
+        return NULL;
+      fl = find_first_set (fl_map);
+      sl_map = a->sl_bitmap[fl];
+    }
+  sl = find_first_set (sl_map);
+  return a->free_lists[fl][sl];
+}
+
+/* Allocates a new arena for a block of the given size and returns its
+   only (free) block. */
+static seg_block *
+new_arena (seg_allocator *a, size_t size)
+{
+  seg_arena *arena;
+  seg_block *b;
+  size_t arena_size = size + a->max_arena_margin;
+
+  if (size <= (size_t)-1 / a->arena_multiple
+      && size * a->arena_multiple < arena_size)
+    arena_size = size * a->arena_multiple;
+  if (arena_size < a->min_arena_size)
+    arena_size = a->min_arena_size;
+  arena_size = (arena_size + a->alignment - 1) & ~(a->alignment - 1);
+
+  arena = (seg_arena*)malloc (sizeof (seg_arena));
+  if (arena == NULL)
+    return NULL;
+
+  arena->memory = pocl_memalign_alloc (a->alignment, arena_size);
+  if (arena->memory == NULL)
+    {
+      /* Fall back to an arena of just the block. */
+      arena_size = size;
+      arena->memory = pocl_memalign_alloc (a->alignment, arena_size);
+      if (arena->memory == NULL)
+        {
+          POCL_MEM_FREE (arena);
+          return NULL;
+        }
+    }
+  arena->size = arena_size;
+  arena->next = a->arenas;
+  a->arenas = arena;
+
+  b = (seg_block*)arena->memory;
+  b->size = arena_size;
+  b->prev_phys = NULL;
+  b->next_phys = NULL;
+  insert_free (a, b);
+  return b;
+}
+
+static void *
+alloc_locked (seg_allocator *a, size_t size)
+{
+  seg_block *b, *rest;
+
+  b = find_free (a, size / a->alignment);
+  if (b == NULL)
+    b = new_arena (a, size);
+  if (b == NULL)
+    return NULL;
+  remove_free (a, b);
+
+  /* Return the tail to the free lists in case it can hold a block. */
+  if (b->size - size >= a->header_size + a->alignment)
+    {
+      rest = (seg_block*)((char*)b + size);
+      rest->size = b->size - size;
+      rest->prev_phys = b;
+      rest->next_phys = b->next_phys;
+      if (rest->next_phys != NULL)
+        rest->next_phys->prev_phys = rest;
+      b->next_phys = rest;
+      b->size = size;
+      insert_free (a, rest);
+    }
+
+  return (char*)b + a->header_size;
+}
+
+static void
+free_locked (seg_allocator *a, seg_block *b)
+{
+  seg_block *next = b->next_phys, *prev = b->prev_phys;
+
+  if (next != NULL && next->is_free)
+    {
+      remove_free (a, next);
+      b->size += next->size;
+      b->next_phys = next->next_phys;
+      if (b->next_phys != NULL)
+        b->next_phys->prev_phys = b;
+    }
+
+  if (prev != NULL && prev->is_free)
+    {
+      remove_free (a, prev);
+      prev->size += b->size;
+      prev->next_phys = b->next_phys;
+      if (prev->next_phys != NULL)
+        prev->next_phys->prev_phys = prev;
+      b = prev;
+    }
+
+  insert_free (a, b);
+}
+
+/* Returns the blocks of an exiting thread's cache to the allocator. */
+static void
+flush_thread_cache (void *data)
+{
+  seg_thread_cache *c = (seg_thread_cache*)data;
+  seg_allocator *a = c->allocator;
+  unsigned i;
+
+  POCL_LOCK (a->lock);
+  if (c->epoch == a->epoch)
+    {
+      for (i = 0; i < c->count; ++i)
+        free_locked (a, c->blocks[i]);
+    }
+  POCL_UNLOCK (a->lock);
+  POCL_MEM_FREE (c);
+}
+
+static seg_thread_cache *
+get_thread_cache (seg_allocator *a, int create)
+{
+  seg_thread_cache *c =
+    (seg_thread_cache*)pthread_getspecific (a->cache_key);
+
+  if (c == NULL && create)
+    {
+      c = (seg_thread_cache*)calloc (1, sizeof (seg_thread_cache));
+      if (c == NULL)
+        return NULL;
+      c->allocator = a;
+      c->epoch = a->epoch;
+      pthread_setspecific (a->cache_key, c);
+    }
+
+  /* The arenas of the cached blocks have been released. */
+  if (c != NULL && c->epoch != a->epoch)
+    {
+      c->epoch = a->epoch;
+      c->count = 0;
+    }
+  return c;
+}
+
+void
+seg_allocator_init (seg_allocator *a, size_t alignment,
+                    size_t min_arena_size, size_t arena_multiple,
+                    size_t max_arena_margin)
+{
+  assert ((alignment & (alignment - 1)) == 0);
+
+  memset (a, 0, sizeof (seg_allocator));
+  POCL_INIT_LOCK (a->lock);
+  a->alignment = alignment;
+  a->header_size =
+    (sizeof (seg_block) + alignment - 1) & ~(alignment - 1);
+  a->min_arena_size = min_arena_size;
+  a->arena_multiple = arena_multiple > 0 ? arena_multiple : 1;
+  a->max_arena_margin = max_arena_margin;
+  pthread_key_create (&a->cache_key, flush_thread_cache);
+}
+
+void
+seg_allocator_release (seg_allocator *a)
+{
+  seg_arena *arena, *next;
+
+  POCL_LOCK (a->lock);
+  for (arena = a->arenas; arena != NULL; arena = next)
+    {
+      next = arena->next;
+      POCL_MEM_FREE (arena->memory);
+      POCL_MEM_FREE (arena);
+    }
+  a->arenas = NULL;
+  a->fl_bitmap = 0;
+  memset (a->sl_bitmap, 0, sizeof (a->sl_bitmap));
+  memset (a->free_lists, 0, sizeof (a->free_lists));
+  ++a->epoch;
+  POCL_UNLOCK (a->lock);
+}
+
+void *
+seg_alloc (seg_allocator *a, size_t size)
+{
+  seg_thread_cache *c;
+  seg_block *b;
+  void *ptr;
+  unsigned i;
+
+  /* The block size including the header, in whole allocation units. */
+  if (size > (size_t)-1 - a->header_size - a->alignment)
+    return NULL;
+  size = a->header_size + ((size + a->alignment - 1) & ~(a->alignment - 1));
+
+  if (size - a->header_size <= SEG_CACHE_MAX_SIZE
+      && (c = get_thread_cache (a, 0)) != NULL)
+    {
+      /* Do not waste more than half of a cached block. */
+      for (i = 0; i < c->count; ++i)
+        {
+          b = c->blocks[i];
+          if (b->size >= size && b->size / 2 <= size)
+            {
+              c->blocks[i] = c->blocks[--c->count];
+              return (char*)b + a->header_size;
+            }
+        }
+    }
+
+  POCL_LOCK (a->lock);
+  ptr = alloc_locked (a, size);
+  POCL_UNLOCK (a->lock);
+  return ptr;
+}
+
+void
+seg_free (seg_allocator *a, void *ptr)
+{
+  seg_thread_cache *c;
+  seg_block *b;
+
+  if (ptr == NULL)
+    return;
+  b = (seg_block*)((char*)ptr - a->header_size);
+
+  if (b->size - a->header_size <= SEG_CACHE_MAX_SIZE
+      && (c = get_thread_cache (a, 1)) != NULL
+      && c->count < SEG_CACHE_ENTRIES)
+    {
+      c->blocks[c->count++] = b;
+      return;
+    }
+
+  POCL_LOCK (a->lock);
+  free_locked (a, b);
+  POCL_UNLOCK (a->lock);
+}
@@ -0,0 +1,121 @@
+/* segalloc.h - a segregated-fit allocator for the host buffers
+
+   Copyright (c) 2015 pocl developers
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+   THE SOFTWARE.
+*/
+
+#ifndef POCL_SEGALLOC_H
+#define POCL_SEGALLOC_H
+
+#include <pthread.h>
+#include <stddef.h>
+
+#include "pocl_cl.h"
+
+#pragma GCC visibility push(hidden)
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* The free blocks are kept in lists of size classes: every power of two
+   is split to SEG_SL_COUNT classes. */
+#define SEG_SL_BITS 3
+#define SEG_SL_COUNT (1 << SEG_SL_BITS)
+#define SEG_FL_COUNT (sizeof (size_t) * 8)
+
+typedef struct seg_block seg_block;
+typedef struct seg_arena seg_arena;
+typedef struct seg_allocator seg_allocator;
+
+/* The header in front of each block of an arena. The blocks of an arena
+   tile it in address order. */
+struct seg_block
+{
+  /* The size of the block in bytes, including the header. */
+  size_t size;
+  /* The neighbouring blocks in the arena, NULL at its ends. */
+  seg_block *prev_phys;
+  seg_block *next_phys;
+  /* The neighbours in the size class list while the block is free. */
+  seg_block *prev_free;
+  seg_block *next_free;
+  int is_free;
+};
+
+/* A large chunk of memory the blocks are carved from. */
+struct seg_arena
+{
+  void *memory;
+  size_t size;
+  seg_arena *next;
+};
+
+struct seg_allocator
+{
+  pocl_lock_t lock;
+  /* The alignment of the returned memory, also the granularity of the
+     block sizes. */
+  size_t alignment;
+  size_t header_size;
+  /* The sizing of new arenas: the requested size times arena_multiple but
+     at most max_arena_margin more than it, and at least min_arena_size. */
+  size_t min_arena_size;
+  size_t arena_multiple;
+  size_t max_arena_margin;
+  /* Bit i of fl_bitmap is set when any of the lists of the power of two i
+     is non-empty, sl_bitmap[i] tells which ones. */
+  size_t fl_bitmap;
+  unsigned sl_bitmap[SEG_FL_COUNT];
+  seg_block *free_lists[SEG_FL_COUNT][SEG_SL_COUNT];
+  seg_arena *arenas;
+  /* The per-thread caches of recently freed small blocks. */
+  pthread_key_t cache_key;
+  /* Incremented whenever the arenas are released to invalidate the
+     blocks still in the thread caches. */
+  volatile unsigned epoch;
+};
+
+/* Initializes the allocator. The alignment must be a power of two. */
+void seg_allocator_init (seg_allocator *a, size_t alignment,
+                         size_t min_arena_size, size_t arena_multiple,
+                         size_t max_arena_margin);
+
+/* Frees all the arenas. The memory still allocated from the allocator
+   becomes invalid. The allocator can be used again afterwards. */
+void seg_allocator_release (seg_allocator *a);
+
+/* Allocates size bytes aligned to the alignment of the allocator. The
+   free block is found in constant time from the size class lists; a new
+   arena is allocated from the system in case none fits. Returns NULL in
+   case out of memory. */
+void *seg_alloc (seg_allocator *a, size_t size);
+
+/* Frees memory returned by seg_alloc(), merging it with the free
+   neighbouring blocks. */
+void seg_free (seg_allocator *a, void *ptr);
+
+#ifdef __cplusplus
+}
+#endif
+
+#pragma GCC visibility pop
+
+#endif
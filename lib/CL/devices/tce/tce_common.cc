@@ -343,7 +343,7 @@ pocl_tce_write (void *data, const void *host_ptr, void *device_ptr,
 #ifdef DEBUG_TTA_DRIVER
   printf("host: write %x %x %u\n", host_ptr, chunk->start_address, cb);
 #endif
-  d->copyHostToDevice(host_ptr, chunk->start_address, cb);
+  d->copyHostToDevice(host_ptr, chunk->start_address + offset, cb);
 }
 
 void
@@ -355,7 +355,7 @@ pocl_tce_read (void *data, void *host_ptr, const void *device_ptr,
 #ifdef DEBUG_TTA_DRIVER
   printf("host: read to %x (host) from %d (device) %u\n", host_ptr, chunk->start_address, cb);
 #endif
-  d->copyDeviceToHost(chunk->start_address, host_ptr, cb);
+  d->copyDeviceToHost(chunk->start_address + offset, host_ptr, cb);
 }
 
 void *
@@ -590,23 +590,32 @@ pocl_tce_run
 
 void *
 pocl_tce_map_mem (void *data, void *buf_ptr, 
-                  size_t /*offset*/, size_t size,
+                  size_t offset, size_t size,
                   void *host_ptr) 
 {
   void *target = NULL;
   chunk_info_t *chunk = (chunk_info_t*)buf_ptr;
-  if (host_ptr != NULL) 
+  if (host_ptr == NULL) 
     {
-      target = host_ptr;
-    } 
-  else
-    {
-      posix_memalign (&target, ALIGNMENT, size);
+      /* Only tell where the region will be mapped to, the transfer is
+         done when the map command executes. */
+      if (posix_memalign (&target, ALIGNMENT, max (size, (size_t)1)) != 0)
+        return NULL;
+      return target;
     }
 
   /* Synch the device global region to the host memory. */
-  pocl_tce_read (data, target, chunk, 0, size);
-  return target;
+  pocl_tce_read (data, host_ptr, chunk, offset, size);
+  return host_ptr;
+}
+
+void *
+pocl_tce_unmap_mem (void */*data*/, void *host_ptr,
+                    void */*device_start_ptr*/, size_t /*size*/)
+{
+  /* The modified parts have been written back by the runtime already. */
+  free (host_ptr);
+  return NULL;
 }
 
 char* 
@@ -773,10 +782,10 @@ pocl_tce_read_rect (void *data,
   for (k = 0; k < region[2]; ++k)
     for (j = 0; j < region[1]; ++j)
       {
-        char const *__restrict h_ptr = adjusted_host_ptr + host_row_pitch * j 
+        char *__restrict h_ptr = adjusted_host_ptr + host_row_pitch * j 
           + host_slice_pitch * k;       
         size_t offset = base_offset + buffer_row_pitch * j 
           + buffer_slice_pitch * k;
-        pocl_tce_write (data, h_ptr, device_ptr, offset, region[0]);
+        pocl_tce_read (data, h_ptr, device_ptr, offset, region[0]);
       }
 }
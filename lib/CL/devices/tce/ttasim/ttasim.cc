@@ -89,6 +89,7 @@ pocl_ttasim_init_device_ops(struct pocl_device_ops *ops)
   ops->copy = pocl_tce_copy;
   ops->copy_rect = pocl_tce_copy_rect;
   ops->map_mem = pocl_tce_map_mem;
+  ops->unmap_mem = pocl_tce_unmap_mem;
   ops->run = pocl_tce_run;
   ops->get_timer_value = pocl_ttasim_get_timer_value;
   ops->init_build = pocl_tce_init_build;
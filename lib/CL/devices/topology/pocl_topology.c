@@ -26,17 +26,34 @@
 
 #include "pocl_topology.h"
 
+/* The topology of the host. It is loaded once and kept for placing the
+   memory of the buffers. */
+static hwloc_topology_t pocl_topology;
+static int pocl_topology_loaded = 0;
+static pocl_lock_t pocl_topology_lock = POCL_LOCK_INITIALIZER;
+
+static hwloc_topology_t
+get_topology ()
+{
+  POCL_LOCK (pocl_topology_lock);
+  if (!pocl_topology_loaded)
+    {
+      int ret = hwloc_topology_init(&pocl_topology);
+      if (ret == -1)
+        POCL_ABORT("Cannot initialize the topology.\n");
+      ret = hwloc_topology_load(pocl_topology);
+      if (ret == -1)
+        POCL_ABORT("Cannot load the topology.\n");
+      pocl_topology_loaded = 1;
+    }
+  POCL_UNLOCK (pocl_topology_lock);
+  return pocl_topology;
+}
+
 void
 pocl_topology_detect_device_info(cl_device_id device)
 {
-  hwloc_topology_t pocl_topology;
-
-  int ret = hwloc_topology_init(&pocl_topology);
-  if (ret == -1)
-    POCL_ABORT("Cannot initialize the topology.\n");
-  ret = hwloc_topology_load(pocl_topology);
-  if (ret == -1)
-    POCL_ABORT("Cannot load the topology.\n");
+  hwloc_topology_t pocl_topology = get_topology ();
 
   device->global_mem_size = hwloc_get_root_obj(pocl_topology)->memory.total_memory;
 
@@ -51,10 +68,254 @@ pocl_topology_detect_device_info(cl_device_id device)
   int depth = hwloc_get_type_depth(pocl_topology, HWLOC_OBJ_PU);
   if(depth != HWLOC_TYPE_DEPTH_UNKNOWN)
     device->max_compute_units = hwloc_get_nbobjs_by_depth(pocl_topology, depth);
+}
 
-  // Destroy topology object and return
-  hwloc_topology_destroy(pocl_topology);
+unsigned
+pocl_topology_num_sockets ()
+{
+  int sockets = hwloc_get_nbobjs_by_type (get_topology (), HWLOC_OBJ_SOCKET);
+  return (sockets > 0) ? (unsigned)sockets : 1;
+}
+
+void
+pocl_topology_get_pus (int socket, unsigned *first_pu, unsigned *num_pus)
+{
+  hwloc_topology_t topology = get_topology ();
+  hwloc_obj_t obj = NULL;
+  hwloc_obj_t first;
+  int pus;
+
+  if (socket >= 0)
+    obj = hwloc_get_obj_by_type (topology, HWLOC_OBJ_SOCKET, socket);
+  if (obj == NULL)
+    obj = hwloc_get_root_obj (topology);
 
+  /* The logical indices of the hardware threads of a socket are
+     consecutive. */
+  first = hwloc_get_obj_inside_cpuset_by_type (topology, obj->cpuset,
+                                               HWLOC_OBJ_PU, 0);
+  pus = hwloc_get_nbobjs_inside_cpuset_by_type (topology, obj->cpuset,
+                                                HWLOC_OBJ_PU);
+  *first_pu = (first != NULL) ? first->logical_index : 0;
+  *num_pus = (pus > 0) ? (unsigned)pus : 1;
 }
 
+/* The binding of the threads and the memory and the thread location
+   queries appeared in hwloc 1.1 and 1.2, the older ones can only count
+   the hardware threads. */
+#if HWLOC_API_VERSION >= 0x00010200
+
+/* Returns the closest NUMA node of the hardware thread. */
+static hwloc_obj_t
+get_pu_node (hwloc_topology_t topology, hwloc_obj_t pu)
+{
+#if HWLOC_API_VERSION >= 0x00020000
+  /* The NUMA nodes are not in the tree of the cores anymore, but attached
+     to their closest ancestor with memory. */
+  hwloc_obj_t parent = pu->parent;
+  while (parent != NULL && parent->memory_arity == 0)
+    parent = parent->parent;
+  return (parent != NULL) ? parent->memory_first_child : NULL;
+#else
+  return hwloc_get_ancestor_obj_by_type (topology, HWLOC_OBJ_NODE, pu);
+#endif
+}
+
+/* Returns the ancestor of the hardware thread that makes up the given
+   affinity domain, NULL if there is no such one. */
+static hwloc_obj_t
+get_domain_ancestor (hwloc_topology_t topology, hwloc_obj_t pu,
+                     cl_device_affinity_domain domain)
+{
+  hwloc_obj_t obj;
+  unsigned level;
+
+  switch (domain)
+    {
+    case CL_DEVICE_AFFINITY_DOMAIN_NUMA:
+      return get_pu_node (topology, pu);
+    case CL_DEVICE_AFFINITY_DOMAIN_L4_CACHE:
+      level = 4;
+      break;
+    case CL_DEVICE_AFFINITY_DOMAIN_L3_CACHE:
+      level = 3;
+      break;
+    case CL_DEVICE_AFFINITY_DOMAIN_L2_CACHE:
+      level = 2;
+      break;
+    case CL_DEVICE_AFFINITY_DOMAIN_L1_CACHE:
+      level = 1;
+      break;
+    default:
+      return NULL;
+    }
+
+  for (obj = pu->parent; obj != NULL; obj = obj->parent)
+    {
+#if HWLOC_API_VERSION >= 0x00020000
+      if (hwloc_obj_type_is_dcache (obj->type)
+          && obj->attr->cache.depth == level)
+#else
+      if (obj->type == HWLOC_OBJ_CACHE && obj->attr->cache.depth == level)
+#endif
+        return obj;
+    }
+  return NULL;
+}
+
+int
+pocl_topology_bind_thread (unsigned first_pu, unsigned num_pus,
+                           unsigned index)
+{
+  hwloc_topology_t topology = get_topology ();
+  hwloc_cpuset_t set = hwloc_bitmap_alloc ();
+  hwloc_obj_t core, pu = NULL, node;
+  int cores, pus, ret;
+  unsigned i;
+
+  for (i = first_pu; i < first_pu + num_pus; ++i)
+    {
+      hwloc_obj_t obj = hwloc_get_obj_by_type (topology, HWLOC_OBJ_PU, i);
+      if (obj != NULL)
+        hwloc_bitmap_or (set, set, obj->cpuset);
+    }
+
+  /* Spread the threads over the cores first and only then over the
+     hardware threads of each core, the siblings share the execution
+     units. */
+  cores = hwloc_get_nbobjs_inside_cpuset_by_type (topology, set,
+                                                  HWLOC_OBJ_CORE);
+  if (cores > 0)
+    {
+      core = hwloc_get_obj_inside_cpuset_by_type (topology, set,
+                                                  HWLOC_OBJ_CORE,
+                                                  index % cores);
+      /* Only the hardware threads of the core inside the range. */
+      hwloc_bitmap_and (set, set, core->cpuset);
+      pus = hwloc_get_nbobjs_inside_cpuset_by_type (topology, set,
+                                                    HWLOC_OBJ_PU);
+      if (pus > 0)
+        pu = hwloc_get_obj_inside_cpuset_by_type (topology, set,
+                                                  HWLOC_OBJ_PU,
+                                                  (index / cores) % pus);
+    }
+  else
+    {
+      pus = hwloc_get_nbobjs_inside_cpuset_by_type (topology, set,
+                                                    HWLOC_OBJ_PU);
+      if (pus > 0)
+        pu = hwloc_get_obj_inside_cpuset_by_type (topology, set,
+                                                  HWLOC_OBJ_PU, index % pus);
+    }
+  hwloc_bitmap_free (set);
+
+  if (pu == NULL)
+    return -1;
+  ret = hwloc_set_cpubind (topology, pu->cpuset, HWLOC_CPUBIND_THREAD);
+  if (ret != 0)
+    return -1;
+
+  node = get_pu_node (topology, pu);
+  return (node != NULL) ? (int)node->logical_index : 0;
+}
+
+unsigned
+pocl_topology_partition (unsigned first_pu, unsigned num_pus,
+                         cl_device_affinity_domain domain,
+                         unsigned *counts, unsigned max_groups)
+{
+  hwloc_topology_t topology = get_topology ();
+  hwloc_obj_t pu, ancestor, previous = NULL;
+  unsigned i, groups = 0;
+
+  /* The hardware threads sharing a domain are consecutive in the logical
+     order. */
+  for (i = first_pu; i < first_pu + num_pus; ++i)
+    {
+      pu = hwloc_get_obj_by_type (topology, HWLOC_OBJ_PU, i);
+      if (pu == NULL)
+        return 0;
+      ancestor = get_domain_ancestor (topology, pu, domain);
+      if (ancestor == NULL)
+        return 0;
+      if (groups == 0 || ancestor != previous)
+        {
+          if (groups == max_groups)
+            return 0;
+          counts[groups++] = 0;
+          previous = ancestor;
+        }
+      ++counts[groups - 1];
+    }
+  return groups;
+}
+
+int
+pocl_topology_bind_memory (void *addr, size_t size, int interleave)
+{
+  hwloc_topology_t topology = get_topology ();
+  hwloc_nodeset_t nodeset;
+  hwloc_cpuset_t cpuset;
+  int ret;
+
+  /* Nothing to place on a single node machine. */
+  if (hwloc_get_nbobjs_by_type (topology, HWLOC_OBJ_NODE) < 2)
+    return 0;
+
+  nodeset = hwloc_bitmap_alloc ();
+  if (interleave)
+    hwloc_bitmap_copy (nodeset, hwloc_get_root_obj (topology)->nodeset);
+  else
+    {
+      /* The node of the core the calling thread last ran on. */
+      cpuset = hwloc_bitmap_alloc ();
+      ret = hwloc_get_last_cpu_location (topology, cpuset,
+                                         HWLOC_CPUBIND_THREAD);
+      if (ret == 0)
+        hwloc_cpuset_to_nodeset (topology, cpuset, nodeset);
+      hwloc_bitmap_free (cpuset);
+      if (ret != 0)
+        {
+          hwloc_bitmap_free (nodeset);
+          return -1;
+        }
+    }
+
+#if HWLOC_API_VERSION >= 0x00020000
+  ret = hwloc_set_area_membind (topology, addr, size, nodeset,
+                                interleave ? HWLOC_MEMBIND_INTERLEAVE
+                                           : HWLOC_MEMBIND_BIND,
+                                HWLOC_MEMBIND_BYNODESET);
+#else
+  ret = hwloc_set_area_membind_nodeset (topology, addr, size, nodeset,
+                                        interleave ? HWLOC_MEMBIND_INTERLEAVE
+                                                   : HWLOC_MEMBIND_BIND, 0);
+#endif
+  hwloc_bitmap_free (nodeset);
+  return ret;
+}
+
+#else
+
+int
+pocl_topology_bind_thread (unsigned first_pu, unsigned num_pus,
+                           unsigned index)
+{
+  return -1;
+}
+
+unsigned
+pocl_topology_partition (unsigned first_pu, unsigned num_pus,
+                         cl_device_affinity_domain domain,
+                         unsigned *counts, unsigned max_groups)
+{
+  return 0;
+}
+
+int
+pocl_topology_bind_memory (void *addr, size_t size, int interleave)
+{
+  return -1;
+}
 
+#endif
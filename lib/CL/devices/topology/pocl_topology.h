@@ -37,6 +37,39 @@
 
 #pragma GCC visibility push(hidden)
 void pocl_topology_detect_device_info(cl_device_id device);
+
+/* Binds the pages of the given page aligned range, which should not have
+   been touched yet, to the NUMA nodes of the host: spread evenly over all
+   of them if interleave is nonzero, to the node of the calling thread
+   otherwise. Returns 0 on success, including the single node hosts where
+   there is nothing to do. */
+int pocl_topology_bind_memory (void *addr, size_t size, int interleave);
+
+/* The number of processor sockets of the host, at least one. */
+unsigned pocl_topology_num_sockets ();
+
+/* Returns the range of the hardware threads of the given socket, or of
+   the whole host if socket is negative, as logical hwloc indices. The
+   hardware threads sharing a core, a cache or a NUMA node are consecutive
+   in this order. */
+void pocl_topology_get_pus (int socket, unsigned *first_pu,
+                            unsigned *num_pus);
+
+/* Pins the calling thread to the index-th one of the given hardware
+   threads, taking the first hardware thread of each core before their
+   siblings. The index wraps around. Returns the logical index of the NUMA
+   node of the hardware thread, or -1 if the thread could not be pinned. */
+int pocl_topology_bind_thread (unsigned first_pu, unsigned num_pus,
+                               unsigned index);
+
+/* Splits the given hardware threads to the groups sharing the affinity
+   domain, a NUMA node or a cache level. Stores the number of hardware
+   threads of each group to counts, up to max_groups of them. Returns the
+   number of groups, or zero if the hardware threads are not all in such a
+   domain. */
+unsigned pocl_topology_partition (unsigned first_pu, unsigned num_pus,
+                                  cl_device_affinity_domain domain,
+                                  unsigned *counts, unsigned max_groups);
 #pragma GCC visibility pop
 
 #endif /* POCL_TOPOLOGY_H */
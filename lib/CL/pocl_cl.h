@@ -396,15 +396,36 @@ void (*fill_rect) (void *data,
                    size_t pixel_size);
 
   /* Maps 'size' bytes of device global memory at buf_ptr + offset to 
-     host-accessible memory. This might or might not involve copying 
-     the block from the device. */
+     host-accessible memory. With host_ptr NULL, returns the host memory
+     the region will be mapped to without transferring anything. With a
+     non-NULL host_ptr, updates the region at host_ptr from the device,
+     which is skipped for CL_MAP_WRITE_INVALIDATE_REGION. */
   void* (*map_mem) (void *data, void *buf_ptr, size_t offset, size_t size, void *host_ptr);
+  /* Releases the host memory map_mem () returned for a mapping after the
+     runtime has written the modified parts of it back with write (). NULL
+     if the device maps its global memory in place, in which case the map
+     and unmap commands copy nothing. */
   void* (*unmap_mem) (void *data, void *host_ptr, void *device_start_ptr, size_t size);
   
   void (*compile_submitted_kernels) (_cl_command_node* cmd);
   void (*run) (void *data, _cl_command_node* cmd);
   void (*run_native) (void *data, _cl_command_node* cmd);
 
+  /* Sets up the driver data of a sub-device created by
+     clCreateSubDevices (). The sub-device starts as a copy of its parent
+     with max_compute_units set to its share of the compute units of the
+     parent, the first of which is first_compute_unit. NULL if the device
+     cannot be partitioned. */
+  cl_int (*init_sub_device) (cl_device_id sub_device,
+                             unsigned first_compute_unit);
+  /* Splits the compute units of the device to the groups sharing the
+     given affinity domain, in order. Stores the number of compute units of
+     each group to counts, up to max_groups of them, and returns the number
+     of groups. Returns zero if the domain cannot be used. */
+  unsigned (*partition_by_affinity) (cl_device_id device,
+                                     cl_device_affinity_domain domain,
+                                     unsigned *counts, unsigned max_groups);
+
   cl_ulong (*get_timer_value) (void *data); /* The current device timer value in nanoseconds. */
 
   /* Perform initialization steps and can return additional
@@ -484,7 +505,13 @@ struct _cl_device_id {
   cl_device_exec_capabilities execution_capabilities;
   cl_command_queue_properties queue_properties;
   cl_platform_id platform;
-  cl_device_partition_property device_partition_properties[1];
+  /* The supported partition types, terminated by 0. */
+  cl_device_partition_property device_partition_properties[4];
+  /* The affinity domains CL_DEVICE_PARTITION_BY_AFFINITY_DOMAIN supports. */
+  cl_device_affinity_domain partition_affinity_domains;
+  /* The properties a sub-device was created with, terminated by 0. NULL
+     for the root devices. */
+  cl_device_partition_property *partition_type;
   size_t printf_buffer_size;
   char *short_name;
   char *long_name;
@@ -505,8 +532,27 @@ struct _cl_device_id {
   int dev_id;
   int global_mem_id; /* identifier for device global memory */
   int has_64bit_long;  /* Does the device have 64bit longs */
+  /* Nonzero in case the device compiles the work-group functions to
+     machine code in memory when the kernel is first executed (see
+     pocl_llvm_jit_workgroup_function()). No parallel.bc is generated at
+     enqueue time for such a device. */
+  int jit_workgroup_functions;
+  /* Nonzero in case the device executes the kernels of all local sizes
+     with a single work-group function compiled for the local size
+     0, 0, 0, which reads the actual one from the pocl_context. */
+  int dynamic_local_size;
+  /* Nonzero in case the JIT compiled work-group functions are first
+     compiled with light optimizations only and replaced by the fully
+     optimized versions compiled in a background thread. */
+  int tiered_compilation;
 
   struct pocl_device_ops *ops; /* Device operations, shared amongst same devices */
+  /* The number of commands the device can execute concurrently, each in
+     its own executor thread. Zero means one. */
+  cl_uint num_executor_threads;
+  /* The background thread(s) executing the commands enqueued to this
+     device. Started at the first enqueue. */
+  struct pocl_executor *executor;
 };
 
 struct _cl_platform_id {
@@ -537,7 +583,24 @@ struct _cl_command_queue {
   cl_device_id device;
   cl_command_queue_properties properties;
   /* implementation */
-  _cl_command_node *root;
+  /* The event of the most recently enqueued command which has not yet
+     completed. The next command of an in-order queue waits for it. Not
+     a counted reference; cleared by the executor upon completion.
+     Protected by the queue's lock. */
+  cl_event last_event;
+  /* The most recent barrier of an out-of-order queue which has not yet
+     completed. All the later commands wait for it. Not a counted
+     reference. Protected by the queue's lock. */
+  cl_event barrier_event;
+  /* The enqueued commands that have not completed yet, linked through
+     their queue_next fields. The barriers wait for all of them.
+     Protected by the queue's lock. */
+  struct _cl_command_node_struct *commands;
+  /* The number of enqueued commands that have not completed yet.
+     Protected by the queue's lock. */
+  unsigned command_count;
+  /* Signalled when command_count drops to zero. */
+  pthread_cond_t idle_cond;
 };
 
 /* memory identifier: id to point the global memory where memory resides 
@@ -618,6 +681,12 @@ struct _cl_program {
   cl_build_status build_status;
 };
 
+/* The number of hash buckets in the launch configuration cache of each
+   kernel (see pocl_wg_cache.h). Must be a power of two. */
+#define POCL_WG_CACHE_BUCKETS 16
+
+struct pocl_wg_cache_entry;
+
 struct _cl_kernel {
   POCL_ICD_OBJECT
   POCL_OBJECT;
@@ -636,6 +705,14 @@ struct _cl_kernel {
   /* The kernel arguments that are set with clSetKernelArg().
      These are copied to the command queue command at enqueue. */
   struct pocl_argument *dyn_arguments;
+  /* The prepared launch configurations and their compiled work-group
+     functions by device and local size. Read without locks, written
+     with wg_cache_lock held. */
+  struct pocl_wg_cache_entry *volatile wg_cache[POCL_WG_CACHE_BUCKETS];
+  /* Serializes the preparation of new launch configurations and the
+     compilation of their work-group functions. Not the object lock so
+     retaining and releasing the kernel do not wait for a compilation. */
+  pocl_lock_t wg_cache_lock;
   struct _cl_kernel *next;
 };
 
@@ -657,9 +734,15 @@ struct _cl_event {
 
   /* list of callback functions */
   event_callback_item* callback_list;
+  /* The commands waiting for this event to complete. Protected by the
+     event's lock; taken over by pocl_exec_event_finished(). */
+  _cl_dependency *dependents;
 
   /* The execution status of the command this event is monitoring. */
   cl_int status;
+  /* Signalled (with pocl_lock held) when the status changes to
+     CL_COMPLETE or to an error. clWaitForEvents() sleeps on it. */
+  pthread_cond_t status_cond;
 
   /* Profiling data: time stamps of the different phases of execution. */
   cl_ulong time_queue;  /* the enqueue time */
@@ -0,0 +1,673 @@
+/* OpenCL runtime library: pocl_exec asynchronous command execution
+
+   Copyright (c) 2015 pocl developers
+   
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+   
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+   
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+   THE SOFTWARE.
+*/
+
+#include <string.h>
+
+#include "pocl_exec.h"
+#include "pocl_util.h"
+#include "utlist.h"
+#include "clEnqueueMapBuffer.h"
+#include "pocl_mem_management.h"
+
+/* The background executor of a device. */
+typedef struct pocl_executor
+{
+  cl_device_id device;
+  /* Protects the ready list. Submissions to different devices thus never
+     contend for the same lock. */
+  pocl_lock_t lock;
+  /* The executor threads sleep on this one until a command becomes
+     ready. */
+  pthread_cond_t cond;
+  /* The threads executing commands in parallel, see the device's
+     num_executor_threads. */
+  pthread_t *threads;
+  unsigned num_threads;
+  /* The commands whose dependencies have all completed, in the order
+     they became ready. The commands still waiting for events are only
+     referred to by the dependent lists of those events, thus neither
+     submitting nor starting a command scans the other commands. */
+  _cl_command_node *ready;
+  /* The number of submitted commands that have not been executed yet,
+     including the ones waiting for their dependencies. */
+  volatile unsigned outstanding;
+  /* Set by pocl_exec_shutdown(). The threads exit once all the submitted
+     commands have been executed. */
+  int shutdown;
+  /* Set in case the device was released by one of the threads of the
+     executor itself. That thread retires the executor as it exits. */
+  int retire_on_exit;
+  pthread_t retiring_thread;
+  struct pocl_executor *next;
+} pocl_executor;
+
+/* All the executors started so far. Executors are never freed: the ones
+   of the released devices are retired (their device is NULL) and reused
+   for the next device that needs one. New ones are only prepended after
+   they have been fully initialized, thus the list can be walked without
+   a lock. */
+static pocl_executor *volatile executors = NULL;
+/* Serializes the starting and the retiring of executors. */
+static pocl_lock_t executors_lock = POCL_LOCK_INITIALIZER;
+
+static void
+retire_executor (pocl_executor *ex)
+{
+  POCL_LOCK (executors_lock);
+  ex->device = NULL;
+  POCL_UNLOCK (executors_lock);
+}
+
+/* Hands a command whose dependencies have all completed to one thread
+   of its executor. */
+static void
+make_ready (_cl_command_node *node)
+{
+  pocl_executor *ex = node->device->executor;
+  POCL_LOCK (ex->lock);
+  DL_APPEND (ex->ready, node);
+  pthread_cond_signal (&ex->cond);
+  POCL_UNLOCK (ex->lock);
+}
+
+/* Resolves one dependency of the node on an event that finished with the
+   given status. */
+static void
+resolve_dependency (_cl_command_node *node, cl_int status)
+{
+  /* Published to the executor by the atomic decrement. */
+  if (status < 0)
+    node->dependency_status = status;
+  if (__sync_sub_and_fetch (&node->unresolved_dependencies, 1) == 0)
+    make_ready (node);
+}
+
+void
+pocl_exec_event_finished (cl_event event)
+{
+  event_callback_item *cb_ptr, *cb_list;
+  _cl_dependency *dep, *dependents;
+
+  /* Wake up the clWaitForEvents() callers. The status was updated
+     without the lock, but they check it with the lock held, thus cannot
+     miss the signal. The same goes for the commands that register
+     themselves as dependents in wait_for_events(). */
+  POCL_LOCK_OBJ (event);
+  pthread_cond_broadcast (&event->status_cond);
+  /* event callback handling 
+     just call functions in the same order they were added. The ones
+     registered after this point are called by clSetEventCallback(). */
+  cb_list = event->callback_list;
+  event->callback_list = NULL;
+  dependents = event->dependents;
+  event->dependents = NULL;
+  POCL_UNLOCK_OBJ (event);
+
+  /* The dependent might execute and be freed, its entry included, as
+     soon as it has been resolved. */
+  while (dependents != NULL)
+    {
+      dep = dependents;
+      dependents = dep->next;
+      resolve_dependency (dep->node, event->status);
+    }
+
+  while (cb_list != NULL)
+    {
+      cb_ptr = cb_list;
+      cb_list = cb_list->next;
+      /* The abnormally terminated events report their error code. */
+      cb_ptr->callback_function (event, event->status < 0 ? event->status
+                                 : cb_ptr->trigger_status,
+                                 cb_ptr->user_data);
+      POCL_MEM_FREE (cb_ptr);
+    }
+}
+
+/* Releases what the command holds, be it executed or terminated. */
+static void
+release_command (_cl_command_node *node)
+{
+  int i;
+
+  switch (node->type)
+    {
+    case CL_COMMAND_READ_BUFFER:
+      POname(clReleaseMemObject) (node->command.read.buffer);
+      break;
+    case CL_COMMAND_WRITE_BUFFER:
+      POname(clReleaseMemObject) (node->command.write.buffer);
+      break;
+    case CL_COMMAND_COPY_BUFFER:
+      POname(clReleaseMemObject) (node->command.copy.src_buffer);
+      POname(clReleaseMemObject) (node->command.copy.dst_buffer);
+      break;
+    case CL_COMMAND_UNMAP_MEM_OBJECT:
+      /* The reference taken when the region was mapped. */
+      POname(clReleaseMemObject) (node->command.unmap.memobj);
+      break;
+    case CL_COMMAND_NDRANGE_KERNEL:
+      for (i = 0; i < node->command.run.arg_buffer_count; ++i)
+        {
+          cl_mem buf = node->command.run.arg_buffers[i];
+          if (buf == NULL) continue;
+          /*printf ("### releasing arg %d - the buffer %x of kernel %s\n", i, 
+            buf,  node->command.run.kernel->function_name); */
+          POname(clReleaseMemObject) (buf);
+        }
+      POCL_MEM_FREE(node->command.run.arg_buffers);
+      for (i = 0; i < node->command.run.kernel->num_args + 
+             node->command.run.kernel->num_locals; ++i)
+        {
+          pocl_aligned_free (node->command.run.arguments[i].value);
+          node->command.run.arguments[i].value = NULL;
+        }
+      POCL_MEM_FREE(node->command.run.arguments);
+  
+      POname(clReleaseKernel)(node->command.run.kernel);
+      break;
+    case CL_COMMAND_NATIVE_KERNEL:
+      for (i = 0; i < node->command.native.num_mem_objects; ++i)
+        {
+          cl_mem buf = node->command.native.mem_list[i];
+          if (buf == NULL) continue;
+          POname(clReleaseMemObject) (buf);
+        }
+      POCL_MEM_FREE(node->command.native.mem_list);
+      POCL_MEM_FREE(node->command.native.args);
+      break;
+    case CL_COMMAND_FILL_IMAGE:
+    case CL_COMMAND_FILL_BUFFER:
+      POCL_MEM_FREE(node->command.fill_image.fill_pixel);
+      if (node->command.fill_image.memobj != NULL)
+        POname(clReleaseMemObject) (node->command.fill_image.memobj);
+      break;
+    default:
+      break;
+    }
+}
+
+/* Runs the command on its device. */
+static void
+run_command (_cl_command_node *node)
+{
+  cl_event *event = &(node->event);
+  /* Command queue is needed for POCL_UPDATE_EVENT macros */
+  cl_command_queue command_queue = node->event->queue;
+
+  if (node->device->ops->compile_submitted_kernels)
+    node->device->ops->compile_submitted_kernels (node);
+
+  switch (node->type)
+    {
+    case CL_COMMAND_READ_BUFFER:
+      POCL_UPDATE_EVENT_RUNNING(event, command_queue);
+      node->device->ops->read
+        (node->device->data, 
+         node->command.read.host_ptr, 
+         node->command.read.device_ptr,
+         node->command.read.offset,
+         node->command.read.cb); 
+      POCL_UPDATE_EVENT_COMPLETE(event, command_queue);
+      break;
+    case CL_COMMAND_WRITE_BUFFER:
+      POCL_UPDATE_EVENT_RUNNING(event, command_queue);
+      node->device->ops->write
+        (node->device->data, 
+         node->command.write.host_ptr, 
+         node->command.write.device_ptr,
+         node->command.write.offset,
+         node->command.write.cb);
+      POCL_UPDATE_EVENT_COMPLETE(event, command_queue);
+      break;
+    case CL_COMMAND_COPY_BUFFER:
+      POCL_UPDATE_EVENT_RUNNING(event, command_queue);
+      node->device->ops->copy
+        (node->command.copy.data, 
+         node->command.copy.src_ptr,
+         node->command.copy.src_offset,
+         node->command.copy.dst_ptr,
+         node->command.copy.dst_offset,
+         node->command.copy.cb);
+      POCL_UPDATE_EVENT_COMPLETE(event, command_queue);
+      break;
+    case CL_COMMAND_MAP_IMAGE:
+    case CL_COMMAND_MAP_BUFFER: 
+      POCL_UPDATE_EVENT_RUNNING(event, command_queue);            
+      pocl_map_mem_cmd (node->device, node->command.map.buffer, 
+                        node->command.map.mapping);
+      POCL_UPDATE_EVENT_COMPLETE(event, command_queue);
+      break;
+    case CL_COMMAND_WRITE_IMAGE:
+      POCL_UPDATE_EVENT_RUNNING(event, command_queue); 
+      node->device->ops->write_rect 
+        (node->device->data, node->command.rw_image.host_ptr,
+         node->command.rw_image.device_ptr, node->command.rw_image.origin,
+         node->command.rw_image.origin, node->command.rw_image.region, 
+         node->command.rw_image.rowpitch, 
+         node->command.rw_image.slicepitch,
+         node->command.rw_image.rowpitch,
+         node->command.rw_image.slicepitch);
+      POCL_UPDATE_EVENT_COMPLETE(event, command_queue);
+      break;
+    case CL_COMMAND_READ_IMAGE:
+      POCL_UPDATE_EVENT_RUNNING(event, command_queue); 
+      node->device->ops->read_rect 
+        (node->device->data, node->command.rw_image.host_ptr,
+         node->command.rw_image.device_ptr, node->command.rw_image.origin,
+         node->command.rw_image.origin, node->command.rw_image.region, 
+         node->command.rw_image.rowpitch, 
+         node->command.rw_image.slicepitch,
+         node->command.rw_image.rowpitch,
+         node->command.rw_image.slicepitch);
+      POCL_UPDATE_EVENT_COMPLETE(event, command_queue);
+      break;
+    case CL_COMMAND_UNMAP_MEM_OBJECT:
+      POCL_UPDATE_EVENT_RUNNING(event, command_queue);
+      pocl_unmap_mem_cmd (node->device, node->command.unmap.memobj,
+                          node->command.unmap.mapping);
+      POCL_UPDATE_EVENT_COMPLETE(event, command_queue);
+      break;
+    case CL_COMMAND_NDRANGE_KERNEL:
+      assert (*event == node->event);
+      POCL_UPDATE_EVENT_RUNNING(event, command_queue);
+      node->device->ops->run(node->command.run.data, node);
+      /* The device terminates the launch with a negative status if it
+         runs out of resources, which fails the dependents as well. */
+      if ((*event)->status == CL_RUNNING)
+        POCL_UPDATE_EVENT_COMPLETE(event, command_queue);
+      break;
+    case CL_COMMAND_NATIVE_KERNEL:
+      POCL_UPDATE_EVENT_RUNNING(event, command_queue);
+      node->device->ops->run_native(node->command.native.data, node);
+      POCL_UPDATE_EVENT_COMPLETE(event, command_queue);
+      break;
+    case CL_COMMAND_FILL_IMAGE:
+    case CL_COMMAND_FILL_BUFFER:
+      POCL_UPDATE_EVENT_RUNNING(event, command_queue);
+      node->device->ops->fill_rect 
+        (node->command.fill_image.data, 
+         node->command.fill_image.device_ptr,
+         node->command.fill_image.buffer_origin,
+         node->command.fill_image.region,
+         node->command.fill_image.rowpitch, 
+         node->command.fill_image.slicepitch,
+         node->command.fill_image.fill_pixel,
+         node->command.fill_image.pixel_size);
+      POCL_UPDATE_EVENT_COMPLETE(event, command_queue);
+      break;
+    case CL_COMMAND_MARKER:
+    case CL_COMMAND_BARRIER:
+      POCL_UPDATE_EVENT_RUNNING(event, command_queue);
+      POCL_UPDATE_EVENT_COMPLETE(event, command_queue);
+      break;
+    default:
+      POCL_ABORT_UNIMPLEMENTED("pocl_exec: Unknown command");
+      break;
+    }
+}
+
+/* Executes a single command on the calling thread and frees it. In case
+   one of the events it waited for terminated abnormally, the command is
+   terminated instead, without running it on data that was never
+   produced. Its own dependents then terminate in turn. */
+static void
+exec_command (_cl_command_node *node)
+{
+  int i;
+  cl_event *event = &(node->event);
+  cl_command_queue command_queue = node->event->queue;
+
+  if (node->dependency_status < 0)
+    (*event)->status = CL_EXEC_STATUS_ERROR_FOR_EVENTS_IN_WAIT_LIST;
+  else
+    run_command (node);
+  release_command (node);
+
+  pocl_exec_event_finished (*event);
+
+  for (i = 0; i < node->num_events_in_wait_list; ++i)
+    POname(clReleaseEvent) (node->event_wait_list[i]);
+  if (node->event_wait_list != node->inline_wait_list)
+    POCL_MEM_FREE (node->event_wait_list);
+  if (node->dependencies != node->inline_dependencies)
+    POCL_MEM_FREE (node->dependencies);
+
+  /* The later commands must not pick up the event as a dependency once
+     it is about to be released. */
+  POCL_LOCK_OBJ (command_queue);
+  if (node->queue_prev != NULL)
+    node->queue_prev->queue_next = node->queue_next;
+  else
+    command_queue->commands = node->queue_next;
+  if (node->queue_next != NULL)
+    node->queue_next->queue_prev = node->queue_prev;
+  if (command_queue->last_event == *event)
+    command_queue->last_event = NULL;
+  if (command_queue->barrier_event == *event)
+    command_queue->barrier_event = NULL;
+  POCL_UNLOCK_OBJ (command_queue);
+
+  /* Drop the command's own reference to its event before the waiters
+     in clFinish() can see the command as completed. This might release
+     the queue of the event as well, the submission's reference keeps it
+     alive until the count has been updated. */
+  POname(clReleaseEvent) (*event);
+
+  POCL_LOCK_OBJ (command_queue);
+  if (--command_queue->command_count == 0)
+    pthread_cond_broadcast (&command_queue->idle_cond);
+  POCL_UNLOCK_OBJ (command_queue);
+  POname(clReleaseCommandQueue) (command_queue);
+
+  pocl_mem_manager_free_command (node);
+}
+
+static void *
+executor_thread (void *p)
+{
+  pocl_executor *ex = (pocl_executor*)p;
+  _cl_command_node *node;
+  int retire;
+
+  POCL_LOCK (ex->lock);
+  while (1)
+    {
+      node = ex->ready;
+      if (node == NULL)
+        {
+          if (ex->shutdown && ex->outstanding == 0)
+            break;
+          pthread_cond_wait (&ex->cond, &ex->lock);
+          continue;
+        }
+      DL_DELETE (ex->ready, node);
+      POCL_UPDATE_EVENT_SUBMITTED (&node->event, node->event->queue);
+      POCL_UNLOCK (ex->lock);
+
+      exec_command (node);
+
+      POCL_LOCK (ex->lock);
+      __sync_sub_and_fetch (&ex->outstanding, 1);
+    }
+  /* The other threads of a shut down executor might be asleep. */
+  pthread_cond_broadcast (&ex->cond);
+  retire = ex->retire_on_exit
+    && pthread_equal (ex->retiring_thread, pthread_self ());
+  POCL_UNLOCK (ex->lock);
+
+  if (retire)
+    retire_executor (ex);
+  return NULL;
+}
+
+/* Returns the executor of the device, starting it if needed. */
+static pocl_executor *
+get_executor (cl_device_id device)
+{
+  pocl_executor *ex = device->executor;
+  unsigned i;
+  int error;
+  int reused = 1;
+
+  if (ex != NULL)
+    return ex;
+
+  POCL_LOCK (executors_lock);
+  ex = device->executor;
+  if (ex != NULL)
+    {
+      POCL_UNLOCK (executors_lock);
+      return ex;
+    }
+
+  for (ex = executors; ex != NULL; ex = ex->next)
+    {
+      if (ex->device == NULL)
+        break;
+    }
+  if (ex == NULL)
+    {
+      ex = (pocl_executor*)calloc (1, sizeof (pocl_executor));
+      if (ex == NULL)
+        POCL_ABORT ("Could not allocate the command executor\n");
+      POCL_INIT_LOCK (ex->lock);
+      pthread_cond_init (&ex->cond, NULL);
+      reused = 0;
+    }
+  ex->device = device;
+  ex->outstanding = 0;
+  ex->shutdown = 0;
+  ex->retire_on_exit = 0;
+  ex->num_threads = max (device->num_executor_threads, 1u);
+  ex->threads = (pthread_t*)realloc (ex->threads,
+                                     ex->num_threads * sizeof (pthread_t));
+  if (ex->threads == NULL)
+    POCL_ABORT ("Could not allocate the command executor\n");
+  for (i = 0; i < ex->num_threads; ++i)
+    {
+      error = pthread_create (&ex->threads[i], NULL, executor_thread, ex);
+      if (error)
+        POCL_ABORT ("Could not start the command executor thread\n");
+    }
+  if (!reused)
+    {
+      ex->next = executors;
+      executors = ex;
+    }
+  device->executor = ex;
+  POCL_UNLOCK (executors_lock);
+  return ex;
+}
+
+void
+pocl_exec_shutdown (cl_device_id device)
+{
+  pocl_executor *ex = device->executor;
+  pthread_t self = pthread_self ();
+  int own_thread = 0;
+  unsigned i;
+
+  if (ex == NULL)
+    return;
+
+  POCL_LOCK (ex->lock);
+  for (i = 0; i < ex->num_threads; ++i)
+    {
+      if (pthread_equal (ex->threads[i], self))
+        own_thread = 1;
+    }
+  ex->shutdown = 1;
+  ex->retire_on_exit = own_thread;
+  ex->retiring_thread = self;
+  pthread_cond_broadcast (&ex->cond);
+  POCL_UNLOCK (ex->lock);
+
+  /* A thread of the executor releasing the device (from an event callback
+     or by dropping the last reference of a context) cannot join itself.
+     It exits after returning from the command and retires the executor
+     then, as the executor must stay intact until that. */
+  for (i = 0; i < ex->num_threads; ++i)
+    {
+      if (pthread_equal (ex->threads[i], self))
+        pthread_detach (self);
+      else
+        pthread_join (ex->threads[i], NULL);
+    }
+
+  device->executor = NULL;
+  if (!own_thread)
+    retire_executor (ex);
+}
+
+/* Appends the event to the wait list of the node, growing the list as
+   pocl_create_command() reserved room for only one extra event. */
+static void
+add_dependency (_cl_command_node *node, cl_event event, int *room)
+{
+  cl_event *list;
+  if (*room == 0)
+    {
+      int new_room = node->num_events_in_wait_list + 1;
+      if (node->event_wait_list == node->inline_wait_list)
+        {
+          list = (cl_event*)malloc
+            ((node->num_events_in_wait_list + new_room) * sizeof (cl_event));
+          if (list != NULL)
+            memcpy (list, node->inline_wait_list,
+                    node->num_events_in_wait_list * sizeof (cl_event));
+        }
+      else
+        list = (cl_event*)realloc
+          (node->event_wait_list,
+           (node->num_events_in_wait_list + new_room) * sizeof (cl_event));
+      if (list == NULL)
+        POCL_ABORT ("Could not grow the event wait list\n");
+      node->event_wait_list = list;
+      *room = new_room;
+    }
+  POCL_RETAIN_OBJECT (event);
+  node->event_wait_list[node->num_events_in_wait_list++] = event;
+  --*room;
+}
+
+/* Makes the node wait for every command of the queue that has not yet
+   completed. This is how barriers and wait list-less markers order
+   themselves in out-of-order queues. Must be called with the queue lock
+   held. */
+static void
+add_queue_dependencies (cl_command_queue command_queue,
+                        _cl_command_node *node)
+{
+  _cl_command_node *other;
+  int room = 1;
+
+  for (other = command_queue->commands; other != NULL;
+       other = other->queue_next)
+    add_dependency (node, other->event, &room);
+}
+
+/* Adds the node to the dependent lists of the events of its wait list
+   that have not completed yet. */
+static void
+wait_for_events (_cl_command_node *node)
+{
+  _cl_dependency *dep;
+  cl_event event;
+  int i;
+
+  if (node->num_events_in_wait_list <= POCL_INLINE_WAIT_LIST_SIZE)
+    node->dependencies = node->inline_dependencies;
+  else
+    {
+      node->dependencies = (_cl_dependency*)malloc
+        (node->num_events_in_wait_list * sizeof (_cl_dependency));
+      if (node->dependencies == NULL)
+        POCL_ABORT ("Could not allocate the dependencies\n");
+    }
+
+  for (i = 0; i < node->num_events_in_wait_list; ++i)
+    {
+      event = node->event_wait_list[i];
+      POCL_LOCK_OBJ (event);
+      /* pocl_exec_event_finished() takes the list over with the lock
+         held after the status has been set, thus the event either is
+         seen finished here or resolves the entry later. */
+      if (event->status != CL_COMPLETE && event->status >= 0)
+        {
+          dep = &node->dependencies[i];
+          dep->node = node;
+          LL_PREPEND (event->dependents, dep);
+          __sync_add_and_fetch (&node->unresolved_dependencies, 1);
+        }
+      else if (event->status < 0)
+        node->dependency_status = event->status;
+      POCL_UNLOCK_OBJ (event);
+    }
+}
+
+void
+pocl_exec_submit (cl_command_queue command_queue, _cl_command_node *node)
+{
+  pocl_executor *ex = get_executor (node->device);
+  cl_event prev;
+  int room = 1;
+
+  /* The submission itself is one of the dependencies so that the
+     command cannot start before all of them have been registered. */
+  node->unresolved_dependencies = 1;
+  node->dependency_status = CL_SUCCESS;
+  __sync_add_and_fetch (&ex->outstanding, 1);
+
+  /* The queue lock orders the submissions to the same queue. The
+     executor lock is not needed until the command is ready. */
+  POCL_LOCK_OBJ (command_queue);
+
+  if (command_queue->properties & CL_QUEUE_OUT_OF_ORDER_EXEC_MODE_ENABLE)
+    {
+      /* Out-of-order queue: only the explicit wait list and barriers
+         order the commands. */
+      if (node->type == CL_COMMAND_BARRIER 
+          || (node->type == CL_COMMAND_MARKER
+              && node->num_events_in_wait_list == 0))
+        add_queue_dependencies (command_queue, node);
+      else if (command_queue->barrier_event != NULL)
+        add_dependency (node, command_queue->barrier_event, &room);
+
+      if (node->type == CL_COMMAND_BARRIER)
+        command_queue->barrier_event = node->event;
+    }
+  else
+    {
+      /* In-order queue: wait for the previous command, if it has not
+         completed yet. */
+      prev = command_queue->last_event;
+      if (prev != NULL)
+        add_dependency (node, prev, &room);
+    }
+  command_queue->last_event = node->event;
+  ++command_queue->command_count;
+  /* Released by the executor once the command has completed. The
+     queue lock is already held, thus not POCL_RETAIN_OBJECT. */
+  command_queue->pocl_refcount++;
+
+  node->queue_prev = NULL;
+  node->queue_next = command_queue->commands;
+  if (command_queue->commands != NULL)
+    command_queue->commands->queue_prev = node;
+  command_queue->commands = node;
+  POCL_UNLOCK_OBJ (command_queue);
+
+  wait_for_events (node);
+  resolve_dependency (node, CL_SUCCESS);
+}
+
+void
+pocl_exec_wait_queue (cl_command_queue command_queue)
+{
+  POCL_LOCK_OBJ (command_queue);
+  while (command_queue->command_count > 0)
+    pthread_cond_wait (&command_queue->idle_cond,
+                       &command_queue->pocl_lock);
+  POCL_UNLOCK_OBJ (command_queue);
+}
@@ -0,0 +1,62 @@
+/* OpenCL runtime library: pocl_exec asynchronous command execution
+
+   Copyright (c) 2015 pocl developers
+   
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+   
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+   
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+   THE SOFTWARE.
+*/
+
+#ifndef POCL_EXEC_H
+#define POCL_EXEC_H
+
+#include "pocl_cl.h"
+
+#pragma GCC visibility push(hidden)
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Hands the (queued) command over to the background executor of its
+   device. The command is executed as soon as all the events in its wait
+   list have completed, without the host having to call clFinish().
+   In-order queues get the previously enqueued command appended to the
+   wait list here, out-of-order queues the dependencies implied by
+   barriers. The caller must not touch the node afterwards. */
+void pocl_exec_submit (cl_command_queue command_queue,
+                       _cl_command_node *node);
+
+/* Blocks until all the commands enqueued to the queue have completed. */
+void pocl_exec_wait_queue (cl_command_queue command_queue);
+
+/* Wakes up the clWaitForEvents() callers, calls the callbacks of the
+   event and hands the commands that were waiting only for it over to
+   their executors. To be called once the status of the event has become
+   CL_COMPLETE or negative, be it by an executor or by the user. */
+void pocl_exec_event_finished (cl_event event);
+
+/* Stops the executor threads of the device once they have executed all
+   the commands submitted to it. No more commands may be submitted to the
+   device. Afterwards nothing refers to the device from the executor. */
+void pocl_exec_shutdown (cl_device_id device);
+
+#ifdef __cplusplus
+}
+#endif
+#pragma GCC visibility pop
+
+#endif
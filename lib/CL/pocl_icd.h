@@ -151,7 +151,7 @@ struct _cl_icd_dispatch {
   NULL, /* &POclLinkProgram,             */ \
   NULL, /* &POclUnloadPlatformCompiler,  */ \
   &POclGetKernelArgInfo,   \
-  NULL, /* &POclEnqueueFillBuffer,        */ \
+  &POclEnqueueFillBuffer,        \
   &POclEnqueueFillImage,         \
   NULL, /* &POclEnqueueMigrateMemObjects, */ \
   &POclEnqueueMarkerWithWaitList,  \
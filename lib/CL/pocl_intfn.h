@@ -67,6 +67,7 @@ POdeclsym(clEnqueueMarkerWithWaitList)
 POdeclsym(clEnqueueWriteBuffer)
 POdeclsym(clEnqueueWriteBufferRect)
 POdeclsym(clEnqueueWriteImage)
+POdeclsym(clEnqueueFillBuffer)
 POdeclsym(clEnqueueFillImage)
 POdeclsym(clFinish)
 POdeclsym(clFlush)
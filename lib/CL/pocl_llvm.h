@@ -62,9 +62,8 @@ int pocl_llvm_get_kernel_metadata
  * Output is a LLVM bitcode file that contains a work-group function
  * and its associated launchers. 
  *
- * TODO: this is not thread-safe, it changes the LLVM global options to
- * control the compilation. We should enforce only one compilations is done
- * at a time or control the options through thread safe methods.
+ * Can be called from multiple threads at the same time, each compilation
+ * runs in a kernel compiler context of its own.
  */
 int pocl_llvm_generate_workgroup_function
 (cl_device_id device,
@@ -73,6 +72,43 @@ int pocl_llvm_generate_workgroup_function
  const char* parallel_filename,
  const char* kernel_filename);
 
+/**
+ * Generates the work-group function for the given local size like
+ * pocl_llvm_generate_workgroup_function() but compiles it to machine code
+ * in memory instead of writing parallel.bc for an external code generator
+ * and linker. The bitcode is written to parallel_filename only if it is
+ * not NULL, for debugging.
+ *
+ * Unless optimize is nonzero, the work-group function is compiled quickly
+ * with light optimizations only, for running the first launches while the
+ * optimized version is being compiled.
+ *
+ * If object_filename is not NULL, the machine code is loaded from that
+ * file in the kernel compiler cache in case it exists, and written there
+ * after compiling otherwise (with LLVM 3.6 and later only).
+ *
+ * Returns the address of the _KERNELNAME_workgroup_range function (see
+ * pocl_workgroup_range) and stores the handle of the code to *jit. The
+ * code stays valid until the handle is passed to
+ * pocl_llvm_free_jit_workgroup_function().
+ */
+void* pocl_llvm_jit_workgroup_function
+(cl_device_id device,
+ cl_kernel kernel,
+ size_t local_x, size_t local_y, size_t local_z,
+ const char* parallel_filename,
+ const char* kernel_filename,
+ const char* object_filename,
+ int optimize,
+ void** jit);
+
+/**
+ * Frees the machine code of a work-group function returned by
+ * pocl_llvm_jit_workgroup_function(). No launch may be executing it
+ * anymore. Accepts NULL.
+ */
+void pocl_llvm_free_jit_workgroup_function(void* jit);
+
 /**
  * Update the program->binaries[] representation of the kernels
  * from the program->llvm_irs[] representation.
@@ -105,6 +141,10 @@ void
 pocl_update_program_llvm_irs(cl_program program,
                        cl_device_id device, const char* program_filename);
 
+/* Delete the program's llvm::Module of the device and its LLVMContext. */
+void
+pocl_free_llvm_irs(cl_program program, int device_i);
+
 #ifdef __cplusplus
 }
 #endif
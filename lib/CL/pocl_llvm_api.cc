@@ -33,6 +33,13 @@
 #include "llvm/PassManager.h"
 #include "llvm/Bitcode/ReaderWriter.h"
 #include "llvm/Transforms/Utils/Cloning.h"
+#include "llvm/ExecutionEngine/ExecutionEngine.h"
+#include "llvm/ExecutionEngine/MCJIT.h"
+#if !(defined LLVM_3_2 || defined LLVM_3_3 || defined LLVM_3_4 || \
+      defined LLVM_3_5)
+#include "llvm/ExecutionEngine/ObjectCache.h"
+#include "llvm/Object/ObjectFile.h"
+#endif
 
 #if (defined LLVM_3_2 || defined LLVM_3_3 || defined LLVM_3_4)
 #include "llvm/Linker.h"
@@ -55,14 +62,19 @@
 #include "llvm/IRReader/IRReader.h"
 #endif
 
+#include "llvm/Support/DynamicLibrary.h"
 #include "llvm/Support/FileSystem.h"
 #include "llvm/Support/FormattedStream.h"
 #include "llvm/Support/Host.h"
 #include "llvm/Support/Path.h"
+#include "llvm/Support/MemoryBuffer.h"
 #include "llvm/Support/MutexGuard.h"
 #include "llvm/Support/raw_os_ostream.h"
 #include "llvm/Support/SourceMgr.h"
 #include "llvm/Support/TargetSelect.h"
+#if (defined LLVM_3_2 || defined LLVM_3_3 || defined LLVM_3_4)
+#include "llvm/Support/Threading.h"
+#endif
 #include "llvm/Support/TargetRegistry.h"
 #include "llvm/Support/ToolOutputFile.h"
 #include "llvm/Target/TargetMachine.h"
@@ -75,6 +87,7 @@
 #include <iostream>
 #include <fstream>
 #include <vector>
+#include <map>
 #include <sstream>
 #include <string>
 #include <cstdio>
@@ -110,25 +123,42 @@ using llvm::sys::fs::F_Binary;
 
 
 /**
- * Use one global LLVMContext across all LLVM bitcodes. This is because
- * we want to cache the bitcode IR libraries and reuse them when linking
- * new kernels. The CloneModule etc. seem to assume we are linking
- * bitcodes with a same LLVMContext. Unfortunately, this requires serializing
- * all calls to the LLVM APIs with mutex.
- * Freeing/deleting the context crashes LLVM 3.2 (at program exit), as a
- * work-around, allocate this from heap.
+ * LLVM objects of different LLVMContexts can be used from parallel threads,
+ * the ones of a single context cannot. Therefore each program build gets
+ * an LLVMContext of its own for the llvm::Modules of the program, and the
+ * work-group functions are generated in kernel compiler contexts that are
+ * used by one thread at a time. This way independent builds and
+ * work-group function specializations run in parallel.
+ *
+ * The context of a program is deleted together with its llvm::Modules
+ * when the program is released. Freeing/deleting a context crashes LLVM 3.2
+ * at program exit, as a work-around, the kernel compiler contexts are
+ * allocated from heap and never freed.
  */
-static LLVMContext *globalContext = NULL;
-LLVMContext *GlobalContext() {
-  if (globalContext == NULL) globalContext = new LLVMContext();
-  return globalContext;
-}
-
-/* The LLVM API interface functions are not at the moment not thread safe,
-   ensure only one thread is using this layer at the time with a mutex. */
 
+/* Protects the process wide LLVM state (the target and pass registries and
+   the command line options the kernel compiler sets) and serializes the
+   accesses to the llvm::Modules of the programs, which are shared by all
+   the kernels of the program. It is not held while compiling. */
 static llvm::sys::Mutex kernelCompilerLock;
 
+/**
+ * The state for generating work-group functions in one thread at a time:
+ * an LLVMContext with the kernel library and the kernel compiler passes
+ * of each device loaded to it. The idle ones are pooled for reuse as
+ * parsing the library and setting up the passes is costly.
+ */
+struct KernelCompilerContext {
+  LLVMContext *context;
+  std::map<cl_device_id, llvm::Module*> libs;
+  std::map<cl_device_id, PassManager*> passes;
+  /* The passes of the quickly compiled, lightly optimized tier. */
+  std::map<cl_device_id, PassManager*> quickPasses;
+};
+
+/* Protected by kernelCompilerLock. */
+static std::vector<KernelCompilerContext*> idleCompilerContexts;
+
 static void InitializeLLVM();
 
 //#define DEBUG_POCL_LLVM_API
@@ -223,8 +253,10 @@ int pocl_llvm_build_program(cl_program program,
                             int fd)
 
 {
-  llvm::MutexGuard lockHolder(kernelCompilerLock);
-  InitializeLLVM();
+  {
+    llvm::MutexGuard lockHolder(kernelCompilerLock);
+    InitializeLLVM();
+  }
 
   // Use CompilerInvocation::CreateFromArgs to initialize
   // CompilerInvocation. This way we can reuse the Clang's
@@ -403,9 +435,18 @@ int pocl_llvm_build_program(cl_program program,
   // the compilation flags used to compile it and the current translation
   // unit via the preprocessor options directly.
 
+  llvm::Module **mod = (llvm::Module **)&program->llvm_irs[device_i];
+
+  /* Rebuilds reuse the context of the previous build of the program. */
+  LLVMContext *context;
+  if (*mod != NULL)
+    context = &(*mod)->getContext();
+  else
+    context = new LLVMContext();
+
   bool success = true;
   clang::CodeGenAction *action = NULL;
-  action = new clang::EmitLLVMOnlyAction(GlobalContext());
+  action = new clang::EmitLLVMOnlyAction(context);
   success |= CI.ExecuteAction(*action);
 
   SourceManager &source_manager = CI.getSourceManager();
@@ -428,7 +469,6 @@ int pocl_llvm_build_program(cl_program program,
   // FIXME: memleak, see FIXME below
   if (!success) return CL_BUILD_PROGRAM_FAILURE;
 
-  llvm::Module **mod = (llvm::Module **)&program->llvm_irs[device_i];
   if (*mod != NULL)
     delete (llvm::Module*)*mod;
 
@@ -603,6 +643,7 @@ int pocl_llvm_get_kernel_metadata(cl_program program,
                                   char* descriptor_filename,
                                   int * errcode)
 {
+  llvm::MutexGuard lockHolder(kernelCompilerLock);
 
   int i;
   llvm::Module *input = NULL;
@@ -915,20 +956,30 @@ static void InitializeLLVM() {
   InitializeAllAsmPrinters();
   InitializeAllAsmParsers();
 
+#if (defined LLVM_3_2 || defined LLVM_3_3 || defined LLVM_3_4)
+  // Make LLVM guard its global state for the parallel compilations.
+  llvm::llvm_start_multithreaded();
+#endif
+
   LLVMInitialized = true;
 }
 
 /**
  * Prepare the kernel compiler passes.
  *
- * The passes are created only once per program run per device.
+ * The passes are created only once per kernel compiler context per device.
  * The returned pass manager should not be modified, only the Module
  * should be optimized using it.
+ *
+ * Unless optimize is set, the standard optimizations run at -O1 without
+ * the vectorizers. The code is slower but compiles much faster.
  */
 static PassManager& kernel_compiler_passes
-(cl_device_id device, std::string module_data_layout)
+(KernelCompilerContext *ctx, cl_device_id device,
+ std::string module_data_layout, bool optimize)
 {
-  static std::map<cl_device_id, PassManager*> kernel_compiler_passes;
+  std::map<cl_device_id, PassManager*> &kernel_compiler_passes =
+    optimize ? ctx->passes : ctx->quickPasses;
 
   if (kernel_compiler_passes.find(device) != 
       kernel_compiler_passes.end())
@@ -936,10 +987,15 @@ static PassManager& kernel_compiler_passes
       return *kernel_compiler_passes[device];
     }
 
+  // The pass registry and the LLVM options are global.
+  llvm::MutexGuard lockHolder(kernelCompilerLock);
+
   Triple triple(device->llvm_target_triplet);
   PassRegistry &Registry = *PassRegistry::getPassRegistry();
 
-  const bool first_initialization_call = kernel_compiler_passes.size() == 0;
+  static bool passesInitialized = false;
+  const bool first_initialization_call = !passesInitialized;
+  passesInitialized = true;
 
   if (first_initialization_call) {
     // TODO: do this globally, and just once per program
@@ -1060,7 +1116,7 @@ static PassManager& kernel_compiler_passes
           passes.push_back("scalarizer");
         }
 
-      if (kernel_compiler_passes.size() == 0) 
+      if (first_initialization_call) 
         {
           // Set the options only once. TODO: fix it so that each
           // device can reset their own options. Now one cannot compile
@@ -1127,13 +1183,13 @@ static PassManager& kernel_compiler_passes
       if (passes[i] == "STANDARD_OPTS")
         {
           PassManagerBuilder Builder;
-          Builder.OptLevel = 3;
+          Builder.OptLevel = optimize ? 3 : 1;
           Builder.SizeLevel = 0;
 
 #if !(defined LLVM_3_2 || defined LLVM_3_3 || defined LLVM_3_4)
           // These need to be setup in addition to invoking the passes
           // to get the vectorizers initialized properly.
-          if (wg_method == "loopvec") {
+          if (wg_method == "loopvec" && optimize) {
             Builder.LoopVectorize = true;
             Builder.SLPVectorize = true;
             Builder.BBVectorize = true;
@@ -1166,24 +1222,15 @@ static PassManager& kernel_compiler_passes
   return *Passes;
 }
 
-/* This is used to communicate the work-group dimensions command-line parameter to the 
-   workitem loop. */
-namespace pocl {
-extern llvm::cl::list<int> LocalSize;
-} 
-
 /**
  * Return the OpenCL C built-in function library bitcode
- * for the given device.
+ * for the given device loaded to the kernel compiler context.
  */
 static llvm::Module*
 kernel_library
-(cl_device_id device, llvm::Module* root)
+(KernelCompilerContext *ctx, cl_device_id device)
 {
-  llvm::MutexGuard lockHolder(kernelCompilerLock);
-  InitializeLLVM();
-
-  static std::map<cl_device_id, llvm::Module*> libs;
+  std::map<cl_device_id, llvm::Module*> &libs = ctx->libs;
 
   Triple triple(device->llvm_target_triplet);
 
@@ -1226,29 +1273,91 @@ kernel_library
     }
 
   SMDiagnostic Err;
-  llvm::Module *lib = ParseIRFile(kernellib.c_str(), Err, *GlobalContext());
+  llvm::Module *lib = ParseIRFile(kernellib.c_str(), Err, *ctx->context);
   assert (lib != NULL);
   libs[device] = lib;
 
   return lib;
 }
 
-/* This is used to control the kernel we want to process in the kernel compilation. */
-extern cl::opt<std::string> KernelName;
-
-int pocl_llvm_generate_workgroup_function(cl_device_id device,
-                                          cl_kernel kernel,
-                                          size_t local_x, size_t local_y, size_t local_z,
-                                          const char* parallel_filename,
-                                          const char* kernel_filename)
+/**
+ * Returns an idle kernel compiler context for the calling thread.
+ */
+static KernelCompilerContext*
+acquire_compiler_context()
 {
   llvm::MutexGuard lockHolder(kernelCompilerLock);
   InitializeLLVM();
 
+  if (idleCompilerContexts.empty())
+    {
+      KernelCompilerContext *ctx = new KernelCompilerContext();
+      ctx->context = new LLVMContext();
+      return ctx;
+    }
+  KernelCompilerContext *ctx = idleCompilerContexts.back();
+  idleCompilerContexts.pop_back();
+  return ctx;
+}
+
+static void
+release_compiler_context(KernelCompilerContext *ctx)
+{
+  llvm::MutexGuard lockHolder(kernelCompilerLock);
+  idleCompilerContexts.push_back(ctx);
+}
+
+/**
+ * Copies the llvm::Module of a program to the given context through an
+ * in-memory bitcode buffer, as CloneModule() works only within a single
+ * context. The program's module is shared by all of its kernels, thus
+ * only the serialization is done with the kernelCompilerLock held.
+ */
+static llvm::Module*
+copy_module_to_context(const llvm::Module *mod, LLVMContext &context)
+{
+  std::string bitcode;
+  {
+    llvm::MutexGuard lockHolder(kernelCompilerLock);
+    raw_string_ostream os(bitcode);
+    WriteBitcodeToFile(mod, os);
+    os.flush();
+  }
+
+#if (defined LLVM_3_2 || defined LLVM_3_3 || defined LLVM_3_4)
+  MemoryBuffer *buffer = MemoryBuffer::getMemBuffer(bitcode, "", false);
+  llvm::Module *copy = ParseBitcodeFile(buffer, context);
+  delete buffer;
+  return copy;
+#elif (defined LLVM_3_5)
+  MemoryBuffer *buffer = MemoryBuffer::getMemBuffer(bitcode, "", false);
+  ErrorOr<llvm::Module*> copy = parseBitcodeFile(buffer, context);
+  delete buffer;
+  return copy ? copy.get() : NULL;
+#else
+  ErrorOr<llvm::Module*> copy =
+    parseBitcodeFile(MemoryBufferRef(bitcode, ""), context);
+  return copy ? copy.get() : NULL;
+#endif
+}
+
+/**
+ * Links the kernel with the built-in library and runs the kernel compiler
+ * passes on it for the given local size. Returns the module containing
+ * the work-group function in the given kernel compiler context.
+ */
+static llvm::Module*
+generate_workgroup_module(KernelCompilerContext *ctx,
+                          cl_device_id device,
+                          cl_kernel kernel,
+                          size_t local_x, size_t local_y, size_t local_z,
+                          const char* kernel_filename,
+                          bool optimize)
+{
 #ifdef DEBUG_POCL_LLVM_API        
   printf("### calling the kernel compiler for kernel %s local_x %zu "
-         "local_y %zu local_z %zu parallel_filename: %s\n",
-         kernel->name, local_x, local_y, local_z, parallel_filename);
+         "local_y %zu local_z %zu\n",
+         kernel->name, local_x, local_y, local_z);
 #endif
 
   Triple triple(device->llvm_target_triplet);
@@ -1256,49 +1365,65 @@ int pocl_llvm_generate_workgroup_function(cl_device_id device,
   SMDiagnostic Err;
   std::string errmsg;
 
-  // Link the kernel and runtime library
+  // Link the kernel and runtime library.
   llvm::Module *input = NULL;
-  if (kernel->program->llvm_irs != NULL && 
-      kernel->program->llvm_irs[device->dev_id] != NULL) 
+  cl_program program = kernel->program;
+  if (program != NULL && program->llvm_irs != NULL &&
+      program->llvm_irs[device->dev_id] != NULL)
     {
 #ifdef DEBUG_POCL_LLVM_API        
-      printf("### cloning the preloaded LLVM IR\n");
+      printf("### copying the preloaded LLVM IR\n");
 #endif
-      input = 
-        llvm::CloneModule
-        ((llvm::Module*)kernel->program->llvm_irs[device->dev_id]);
+      input = copy_module_to_context
+        ((llvm::Module*)program->llvm_irs[device->dev_id], *ctx->context);
     }
   else
     {
 #ifdef DEBUG_POCL_LLVM_API        
       printf("### loading the kernel bitcode from disk\n");
 #endif
-      input = ParseIRFile(kernel_filename, Err, *GlobalContext());
+      input = ParseIRFile(kernel_filename, Err, *ctx->context);
+    }
+  if (input == NULL)
+    {
+      fprintf(stderr, "pocl error: could not load %s\n", kernel_filename);
+      POCL_ABORT("Failed loading the kernel bitcode.\n");
     }
 
   // Later this should be replaced with indexed linking of source code
   // and/or bitcode for each kernel.
-  llvm::Module *libmodule = kernel_library(device, input);
+  llvm::Module *libmodule = kernel_library(ctx, device);
   assert (libmodule != NULL);
   link(input, libmodule);
 
-  /* Now finally run the set of passes assembled above */
-  // TODO pass these as parameters instead, this is not thread safe!
-  pocl::LocalSize.clear();
-  pocl::LocalSize.addValue(local_x);
-  pocl::LocalSize.addValue(local_y);
-  pocl::LocalSize.addValue(local_z);
-  KernelName = kernel->name;
+  /* Now finally run the set of passes assembled above. The passes read
+     the kernel and the local size from the Module. */
+  pocl::set_kernel_compiler_params(*input, kernel->name,
+                                   local_x, local_y, local_z);
 
 #if (defined LLVM_3_2 || defined LLVM_3_3 || defined LLVM_3_4)
-  kernel_compiler_passes(device, input->getDataLayout()).run(*input);
-#else
-  kernel_compiler_passes(device,
-                         input->getDataLayout()->getStringRepresentation())
+  kernel_compiler_passes(ctx, device, input->getDataLayout(), optimize)
                         .run(*input);
+#else
+  kernel_compiler_passes(ctx, device,
+                         input->getDataLayout()->getStringRepresentation(),
+                         optimize).run(*input);
 #endif
 
-  // TODO: don't write this once LLC is called via API, not system()
+  return input;
+}
+
+int pocl_llvm_generate_workgroup_function(cl_device_id device,
+                                          cl_kernel kernel,
+                                          size_t local_x, size_t local_y, size_t local_z,
+                                          const char* parallel_filename,
+                                          const char* kernel_filename)
+{
+  KernelCompilerContext *ctx = acquire_compiler_context();
+
+  llvm::Module *input = generate_workgroup_module
+    (ctx, device, kernel, local_x, local_y, local_z, kernel_filename, true);
+
   int fd;
   if ((fd = open(parallel_filename, (O_CREAT | O_EXCL | O_WRONLY),
       (S_IRUSR | S_IWUSR))) >= 0)
@@ -1307,21 +1432,244 @@ int pocl_llvm_generate_workgroup_function(cl_device_id device,
 #ifndef LLVM_3_2
   // In LLVM 3.2 the Linker object deletes the associated Modules.
   // If we delete here, it will crash.
-  /* OPTIMIZE: store the fully linked work-group function llvm::Module 
-     and pass it to code generation without writing to disk. */
+  /* The devices that generate code for the host use
+     pocl_llvm_jit_workgroup_function() which compiles the module in
+     memory instead. */
+  delete input;
 #endif
 
+  release_compiler_context(ctx);
   return 0;
 }
 
+#if !(defined LLVM_3_2 || defined LLVM_3_3 || defined LLVM_3_4 || \
+      defined LLVM_3_5)
+/**
+ * Stores the object file of a JIT compiled work-group function in the
+ * kernel compiler cache, from where the later runs of the program load
+ * it instead of compiling the kernel again.
+ */
+class WorkgroupObjectCache : public llvm::ObjectCache {
+public:
+  WorkgroupObjectCache(const char *filename) : filename(filename) {}
+
+  virtual void notifyObjectCompiled(const llvm::Module *,
+                                    llvm::MemoryBufferRef object) {
+    /* Written under a name of its own and renamed, thus a concurrent
+       process never loads a partially written object. */
+    std::ostringstream tmp;
+    tmp << filename << "." << getpid() << ".tmp";
+    int fd = open(tmp.str().c_str(), (O_CREAT | O_EXCL | O_WRONLY),
+                  (S_IRUSR | S_IWUSR));
+    if (fd < 0)
+      return;
+    const char *data = object.getBufferStart();
+    size_t left = object.getBufferSize();
+    while (left > 0)
+      {
+        ssize_t written = write(fd, data, left);
+        if (written <= 0)
+          break;
+        data += written;
+        left -= written;
+      }
+    close(fd);
+    if (left > 0 || rename(tmp.str().c_str(), filename.c_str()) != 0)
+      unlink(tmp.str().c_str());
+  }
+
+  /* The cached objects are loaded before generating the module, see
+     load_workgroup_object(). */
+  virtual std::unique_ptr<llvm::MemoryBuffer> getObject(const llvm::Module *) {
+    return nullptr;
+  }
+
+private:
+  std::string filename;
+};
+
+/**
+ * Reads a work-group function object written by WorkgroupObjectCache.
+ * Returns false if there is none or it cannot be parsed, in which case
+ * the kernel is compiled.
+ */
+static bool
+load_workgroup_object(const char *object_filename,
+                      llvm::object::OwningBinary<llvm::object::ObjectFile> &object)
+{
+  if (object_filename == NULL || access(object_filename, F_OK) != 0)
+    return false;
+
+  ErrorOr<std::unique_ptr<MemoryBuffer> > buffer =
+    MemoryBuffer::getFile(object_filename);
+  if (!buffer)
+    return false;
+  ErrorOr<std::unique_ptr<llvm::object::ObjectFile> > file =
+    llvm::object::ObjectFile::createObjectFile((*buffer)->getMemBufferRef());
+  if (!file)
+    return false;
+  object = llvm::object::OwningBinary<llvm::object::ObjectFile>
+    (std::move(*file), std::move(*buffer));
+  return true;
+}
+#endif
+
+void*
+pocl_llvm_jit_workgroup_function(cl_device_id device,
+                                 cl_kernel kernel,
+                                 size_t local_x, size_t local_y, size_t local_z,
+                                 const char* parallel_filename,
+                                 const char* kernel_filename,
+                                 const char* object_filename,
+                                 int optimize,
+                                 void** jit)
+{
+  {
+    llvm::MutexGuard lockHolder(kernelCompilerLock);
+    static bool processSymbolsLoaded = false;
+    if (!processSymbolsLoaded)
+      {
+        // Let the JIT resolve the libcalls of the generated code (memcpy,
+        // math functions) from the libraries the process has loaded.
+        llvm::sys::DynamicLibrary::LoadLibraryPermanently(NULL);
+        processSymbolsLoaded = true;
+      }
+  }
+
+  KernelCompilerContext *ctx = acquire_compiler_context();
+
+  llvm::Module *input;
+  bool cached = false;
+#if !(defined LLVM_3_2 || defined LLVM_3_3 || defined LLVM_3_4 || \
+      defined LLVM_3_5)
+  llvm::object::OwningBinary<llvm::object::ObjectFile> object;
+  WorkgroupObjectCache objectCache(object_filename != NULL ?
+                                   object_filename : "");
+  cached = load_workgroup_object(object_filename, object);
+#endif
+  if (cached)
+    {
+      /* The engine needs a module even though the code comes from the
+         object file. */
+      input = new llvm::Module("pocl_cached_workgroup", *ctx->context);
+      input->setTargetTriple(device->llvm_target_triplet);
+    }
+  else
+    {
+      input = generate_workgroup_module
+        (ctx, device, kernel, local_x, local_y, local_z, kernel_filename,
+         optimize != 0);
+
+      if (parallel_filename != NULL)
+        {
+          int fd;
+          if ((fd = open(parallel_filename, (O_CREAT | O_EXCL | O_WRONLY),
+              (S_IRUSR | S_IWUSR))) >= 0)
+            write_temporary_file_fd(input, parallel_filename, fd);
+        }
+    }
+
+  std::string errmsg;
+#if (defined LLVM_3_2 || defined LLVM_3_3 || defined LLVM_3_4 || \
+     defined LLVM_3_5)
+  llvm::EngineBuilder builder(input);
+  builder.setUseMCJIT(true);
+#else
+  llvm::EngineBuilder builder(std::unique_ptr<llvm::Module>(input));
+#endif
+  builder.setEngineKind(llvm::EngineKind::JIT);
+  builder.setErrorStr(&errmsg);
+  builder.setTargetOptions(GetTargetOptions());
+  builder.setOptLevel(optimize ? CodeGenOpt::Aggressive : CodeGenOpt::Less);
+  if (device->llvm_cpu != NULL)
+    builder.setMCPU(device->llvm_cpu);
+
+  llvm::ExecutionEngine *engine = builder.create();
+  if (engine == NULL)
+    {
+      fprintf(stderr, "pocl error: %s\n", errmsg.c_str());
+      POCL_ABORT("Could not create the JIT for the work-group function.\n");
+    }
+
+#if !(defined LLVM_3_2 || defined LLVM_3_3 || defined LLVM_3_4 || \
+      defined LLVM_3_5)
+  if (cached)
+    engine->addObjectFile(std::move(object));
+  else if (object_filename != NULL)
+    engine->setObjectCache(&objectCache);
+#endif
+
+  std::string wg_name = std::string("_") + kernel->function_name + 
+    "_workgroup_range";
+#if defined LLVM_3_2 || defined LLVM_3_3
+  void *wg = engine->getPointerToFunction(input->getFunction(wg_name));
+#else
+  engine->finalizeObject();
+  void *wg = (void*)engine->getFunctionAddress(wg_name);
+#endif
+  if (wg == NULL)
+    {
+      fprintf(stderr, "pocl error: no symbol %s\n", wg_name.c_str());
+      POCL_ABORT("Could not find the JIT compiled work-group function.\n");
+    }
+
+#if !(defined LLVM_3_2 || defined LLVM_3_3 || defined LLVM_3_4 || \
+      defined LLVM_3_5)
+  engine->setObjectCache(NULL);
+#endif
+  /* The machine code is owned by the engine, the module is not needed
+     anymore. It is deleted while we still own its context, thus freeing
+     the engine later does not touch a context another thread might be
+     compiling in. */
+  engine->removeModule(input);
+  delete input;
+  release_compiler_context(ctx);
+
+  *jit = engine;
+  return wg;
+}
+
+void
+pocl_llvm_free_jit_workgroup_function(void* jit)
+{
+  delete (llvm::ExecutionEngine*)jit;
+}
+
 void
 pocl_update_program_llvm_irs(cl_program program,
                              cl_device_id device, const char* program_filename)
 {
   SMDiagnostic Err;
+  llvm::Module **mod = (llvm::Module **)&program->llvm_irs[device->dev_id];
+
+  /* Reuse the context of the previously loaded module. */
+  LLVMContext *context;
+  if (*mod != NULL)
+    {
+      llvm::MutexGuard lockHolder(kernelCompilerLock);
+      context = &(*mod)->getContext();
+      delete *mod;
+    }
+  else
+    context = new LLVMContext();
 
-  program->llvm_irs[device->dev_id] =
-              ParseIRFile(program_filename, Err, *GlobalContext());
+  *mod = ParseIRFile(program_filename, Err, *context);
+  if (*mod == NULL)
+    delete context;
+}
+
+void
+pocl_free_llvm_irs(cl_program program, int device_i)
+{
+  llvm::Module *mod = (llvm::Module *)program->llvm_irs[device_i];
+  if (mod == NULL)
+    return;
+
+  llvm::MutexGuard lockHolder(kernelCompilerLock);
+  LLVMContext *context = &mod->getContext();
+  delete mod;
+  delete context;
+  program->llvm_irs[device_i] = NULL;
 }
 
 void pocl_llvm_update_binaries (cl_program program) {
@@ -1424,7 +1772,8 @@ pocl_llvm_codegen(cl_kernel kernel,
 #endif
     llvm::Triple triple(device->llvm_target_triplet);
     llvm::TargetMachine *target = GetTargetMachine(device);
-    llvm::Module *input = ParseIRFile(infilename, Err, *GlobalContext());
+    KernelCompilerContext *ctx = acquire_compiler_context();
+    llvm::Module *input = ParseIRFile(infilename, Err, *ctx->context);
 
     llvm::PassManager PM;
     llvm::TargetLibraryInfo *TLI = new TargetLibraryInfo(triple);
@@ -1452,11 +1801,15 @@ pocl_llvm_codegen(cl_kernel kernel,
     formatted_raw_ostream FOS(outfile.os());
     llvm::MCContext *mcc;
     if(target->addPassesToEmitMC(PM, mcc, FOS, llvm::TargetMachine::CGFT_ObjectFile))
+      {
+        release_compiler_context(ctx);
         return 1;
+      }
 
     PM.run(*input);
     outfile.keep();
 
+    release_compiler_context(ctx);
     return 0;
 }
 /* vim: set ts=4 expandtab: */
@@ -21,6 +21,8 @@
    THE SOFTWARE.
 */
 
+#include <string.h>
+
 #include "pocl_mem_management.h"
 #include "pocl.h"
 #include "utlist.h"
@@ -29,13 +31,29 @@ typedef struct _mem_manager
 {
   pocl_lock_t event_lock;
   pocl_lock_t cmd_lock;
+  pocl_lock_t mapping_lock;
   cl_event event_list;
   _cl_command_node *volatile cmd_list;
+  mem_mapping_t *mapping_list;
 } pocl_mem_manager;
 
 
 static pocl_mem_manager *mm = NULL;
 
+/* The number of the objects allocated from the heap instead of reused
+   from the pools. */
+static volatile unsigned long allocation_count = 0;
+
+void pocl_mem_manager_count_allocation (void)
+{
+  __sync_fetch_and_add (&allocation_count, 1);
+}
+
+unsigned long pocl_mem_manager_allocation_count (void)
+{
+  return allocation_count;
+}
+
 void pocl_init_mem_manager (void)
 {
   static unsigned int init_done = 0;
@@ -52,6 +70,7 @@ void pocl_init_mem_manager (void)
       mm = (pocl_mem_manager*) calloc (1, sizeof (pocl_mem_manager));
       POCL_INIT_LOCK (mm->event_lock);
       POCL_INIT_LOCK (mm->cmd_lock);
+      POCL_INIT_LOCK (mm->mapping_lock);
     }
   POCL_UNLOCK(pocl_init_lock);
 }
@@ -65,13 +84,16 @@ cl_event pocl_mem_manager_new_event ()
       LL_DELETE (mm->event_list, ev);
       POCL_UNLOCK (mm->event_lock);
       POCL_INIT_LOCK (ev->pocl_lock);
+      pthread_cond_init (&ev->status_cond, NULL);
       ev->pocl_refcount = 1; /* no need to lock because event is not in use */
       return ev;
     }
   POCL_UNLOCK (mm->event_lock);
     
   ev = (struct _cl_event*) calloc (1, sizeof (struct _cl_event));
+  pocl_mem_manager_count_allocation ();
   POCL_INIT_OBJECT(ev);
+  pthread_cond_init (&ev->status_cond, NULL);
   ev->pocl_refcount = 1;
   return ev;
 }
@@ -94,6 +116,7 @@ _cl_command_node* pocl_mem_manager_new_command ()
   if (cmd)
     return cmd;
   
+  pocl_mem_manager_count_allocation ();
   return (_cl_command_node*) calloc (1, sizeof (_cl_command_node));
 }
 
@@ -103,3 +126,30 @@ void pocl_mem_manager_free_command ( _cl_command_node *cmd_ptr)
   LL_PREPEND (mm->cmd_list, cmd_ptr);
   POCL_UNLOCK(mm->cmd_lock);
 }
+
+mem_mapping_t* pocl_mem_manager_new_mapping ()
+{
+  mem_mapping_t *mapping = NULL;
+  POCL_LOCK (mm->mapping_lock);
+  if ((mapping = mm->mapping_list))
+    LL_DELETE (mm->mapping_list, mapping);
+  POCL_UNLOCK (mm->mapping_lock);
+
+  if (mapping)
+    {
+      memset (mapping, 0, sizeof (mem_mapping_t));
+      return mapping;
+    }
+
+  pocl_mem_manager_count_allocation ();
+  return (mem_mapping_t*) calloc (1, sizeof (mem_mapping_t));
+}
+
+void pocl_mem_manager_free_mapping (mem_mapping_t *mapping)
+{
+  if (mapping == NULL)
+    return;
+  POCL_LOCK (mm->mapping_lock);
+  LL_PREPEND (mm->mapping_list, mapping);
+  POCL_UNLOCK (mm->mapping_lock);
+}
@@ -33,3 +33,15 @@ void pocl_mem_manager_free_event (cl_event event);
 _cl_command_node* pocl_mem_manager_new_command (void);
 
 void pocl_mem_manager_free_command (_cl_command_node *cmd_ptr);
+
+mem_mapping_t* pocl_mem_manager_new_mapping (void);
+
+void pocl_mem_manager_free_mapping (mem_mapping_t *mapping);
+
+/* Counts an object allocated from the heap by the runtime on the launch
+   path, i.e., one that could not be reused. */
+void pocl_mem_manager_count_allocation (void);
+
+/* Returns the number of such allocations so far. It stays flat once the
+   pools have warmed up to the number of the commands in flight. */
+unsigned long pocl_mem_manager_allocation_count (void);
@@ -43,6 +43,7 @@
 #include "common.h"
 #include "pocl_mem_management.h"
 #include "pocl_runtime_config.h"
+#include "pocl_exec.h"
 
 
 #define CACHE_DIR_PATH_CHARS 512
@@ -301,6 +302,7 @@ cl_int pocl_create_event (cl_event *event, cl_command_queue command_queue,
       POname(clRetainCommandQueue) (command_queue);
       (*event)->command_type = command_type;
       (*event)->callback_list = NULL;
+      (*event)->dependents = NULL;
       (*event)->implicit_event = 0;
       (*event)->next = NULL;
     }
@@ -331,48 +333,55 @@ cl_int pocl_create_command (_cl_command_node **cmd,
   if (*cmd == NULL)
     return CL_OUT_OF_HOST_MEMORY;
   
+  /* Copy the wait list as the command outlives the caller's array. Retain
+     the events so they are not recycled before the command has executed.
+     Leave room for the implicit dependency (the previous command of an
+     in-order queue or a barrier) added in pocl_exec_submit(). Short
+     lists, the common case, fit in the node itself. The list is allocated
+     before the event so a failure leaves nothing to undo but the node. */
+  if (num_events + 1 <= POCL_INLINE_WAIT_LIST_SIZE)
+    (*cmd)->event_wait_list = (*cmd)->inline_wait_list;
+  else
+    {
+      (*cmd)->event_wait_list = 
+        (cl_event*)malloc ((num_events + 1) * sizeof (cl_event));
+      if ((*cmd)->event_wait_list == NULL)
+        {
+          pocl_mem_manager_free_command (*cmd);
+          *cmd = NULL;
+          return CL_OUT_OF_HOST_MEMORY;
+        }
+    }
+
   /* if user does not provide event pointer, create event anyway */
   event = &((*cmd)->event);
   err = pocl_create_event(event, command_queue, command_type);
   if (err != CL_SUCCESS)
     {
-      POCL_MEM_FREE(*cmd);
+      if ((*cmd)->event_wait_list != (*cmd)->inline_wait_list)
+        POCL_MEM_FREE ((*cmd)->event_wait_list);
+      pocl_mem_manager_free_command (*cmd);
+      *cmd = NULL;
       return err;
     }
   if (event_p)
-    *event_p = *event;
-  else
-    (*event)->implicit_event = 1;
-  
-  /* if in-order command queue and queue is not empty, add event from 
-     previous command to new commands event_waitlist */
-  if (!(command_queue->properties & CL_QUEUE_OUT_OF_ORDER_EXEC_MODE_ENABLE) 
-      && command_queue->root != NULL)
     {
-      _cl_command_node *prev_command;
-      for (prev_command = command_queue->root; prev_command->next != NULL;
-           prev_command = prev_command->next){}
-      //printf("create_command: prev_com=%d prev_com->event = %d \n",prev_command, prev_command->event);
-      cl_event *new_wl = (cl_event*)malloc ((num_events +1)*sizeof (cl_event));
-      for (i = 0; i < num_events; ++i)
-        {
-          new_wl[i] = wait_list[i];
-        }
-      new_wl[i] = prev_command->event;
-      (*cmd)->event_wait_list = new_wl;
-      (*cmd)->num_events_in_wait_list = num_events + 1;
-      for (i = 0; i < num_events + 1; ++i)
-        {
-          //printf("create-command: new_wl[%i]=%d\n", i, new_wl[i]);
-        }
+      /* One reference for the user, one for the command. */
+      POCL_RETAIN_OBJECT (*event);
+      *event_p = *event;
     }
   else
+    (*event)->implicit_event = 1;
+
+  for (i = 0; i < num_events; ++i)
     {
-      (*cmd)->event_wait_list = wait_list;  
-      (*cmd)->num_events_in_wait_list = num_events;
+      POCL_RETAIN_OBJECT (wait_list[i]);
+      (*cmd)->event_wait_list[i] = wait_list[i];
     }
+  (*cmd)->num_events_in_wait_list = num_events;
   (*cmd)->type = command_type;
   (*cmd)->next = NULL;
+  (*cmd)->prev = NULL;
   (*cmd)->device = command_queue->device;
 
   //printf("create_command (end): event=%d new_event=%d cmd->event=%d cmd=%d\n", event, new_event, (*cmd)->event, *cmd);
@@ -384,15 +393,13 @@ cl_int pocl_create_command (_cl_command_node **cmd,
 void pocl_command_enqueue (cl_command_queue command_queue,
                           _cl_command_node *node)
 {
-  POCL_LOCK_OBJ(command_queue);
-  LL_APPEND (command_queue->root, node);
-  POCL_UNLOCK_OBJ(command_queue);
+  /* The status must be set before the executor can see the command. */
+  POCL_UPDATE_EVENT_QUEUED (&node->event, command_queue);
+  pocl_exec_submit (command_queue, node);
   #ifdef POCL_DEBUG_BUILD
   if (pocl_is_option_set("POCL_IMPLICIT_FINISH"))
     POclFinish (command_queue);
   #endif
-  POCL_UPDATE_EVENT_QUEUED (&node->event, command_queue);
-
 }
 
 char* pocl_get_process_name ()
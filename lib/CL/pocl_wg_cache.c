@@ -0,0 +1,135 @@
+/* OpenCL runtime library: pocl_wg_cache cache of compiled work-group
+   functions
+
+   Copyright (c) 2015 pocl developers
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+   
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+   
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+   THE SOFTWARE.
+*/
+
+#include "pocl_wg_cache.h"
+#include "pocl_llvm.h"
+
+/* Orders the initialization of an entry before its publication to the
+   lock-free readers. */
+#define PUBLISH_BARRIER() __sync_synchronize ()
+
+static unsigned
+wg_cache_bucket (cl_device_id device, size_t local_x, size_t local_y,
+                 size_t local_z)
+{
+  size_t h = (size_t)device->dev_id;
+  h = h * 31 + local_x;
+  h = h * 31 + local_y;
+  h = h * 31 + local_z;
+  return (unsigned)(h ^ (h >> 7)) & (POCL_WG_CACHE_BUCKETS - 1);
+}
+
+void
+pocl_wg_cache_compiled_local_size (cl_kernel kernel, cl_device_id device,
+                                   size_t *local_x, size_t *local_y,
+                                   size_t *local_z)
+{
+  if (!device->dynamic_local_size)
+    return;
+  if (kernel->reqd_wg_size != NULL
+      && (kernel->reqd_wg_size[0] != 0 || kernel->reqd_wg_size[1] != 0
+          || kernel->reqd_wg_size[2] != 0))
+    return;
+  *local_x = *local_y = *local_z = 0;
+}
+
+pocl_wg_cache_entry *
+pocl_wg_cache_lookup (cl_kernel kernel, cl_device_id device,
+                      size_t local_x, size_t local_y, size_t local_z)
+{
+  pocl_wg_cache_entry *e =
+    kernel->wg_cache[wg_cache_bucket (device, local_x, local_y, local_z)];
+
+  for (; e != NULL; e = e->next)
+    {
+      if (e->device == device && e->local_x == local_x
+          && e->local_y == local_y && e->local_z == local_z)
+        return e;
+    }
+  return NULL;
+}
+
+pocl_wg_cache_entry *
+pocl_wg_cache_insert (cl_kernel kernel, cl_device_id device,
+                      size_t local_x, size_t local_y, size_t local_z,
+                      char *tmp_dir)
+{
+  unsigned b = wg_cache_bucket (device, local_x, local_y, local_z);
+  pocl_wg_cache_entry *e =
+    (pocl_wg_cache_entry*)malloc (sizeof (pocl_wg_cache_entry));
+  if (e == NULL)
+    return NULL;
+
+  e->device = device;
+  e->local_x = local_x;
+  e->local_y = local_y;
+  e->local_z = local_z;
+  e->tmp_dir = tmp_dir;
+  e->wg = NULL;
+  e->jit = NULL;
+  e->retired_jit = NULL;
+  e->launches = 0;
+  /* The readers walk the bucket without the lock: the entry must be
+     complete before it becomes reachable. */
+  e->next = kernel->wg_cache[b];
+  PUBLISH_BARRIER ();
+  kernel->wg_cache[b] = e;
+  return e;
+}
+
+void
+pocl_wg_cache_set_wg (pocl_wg_cache_entry *e, pocl_workgroup_range wg,
+                      void *jit)
+{
+  PUBLISH_BARRIER ();
+  e->wg = wg;
+  /* A work-group function is replaced at most once, by tiered
+     compilation. */
+  if (e->jit != NULL)
+    {
+      assert (e->retired_jit == NULL);
+      e->retired_jit = e->jit;
+    }
+  e->jit = jit;
+}
+
+void
+pocl_wg_cache_free (cl_kernel kernel)
+{
+  pocl_wg_cache_entry *e, *next;
+  unsigned b;
+
+  for (b = 0; b < POCL_WG_CACHE_BUCKETS; ++b)
+    {
+      for (e = kernel->wg_cache[b]; e != NULL; e = next)
+        {
+          next = e->next;
+          pocl_llvm_free_jit_workgroup_function (e->jit);
+          pocl_llvm_free_jit_workgroup_function (e->retired_jit);
+          POCL_MEM_FREE (e->tmp_dir);
+          POCL_MEM_FREE (e);
+        }
+      kernel->wg_cache[b] = NULL;
+    }
+}
@@ -0,0 +1,114 @@
+/* OpenCL runtime library: pocl_wg_cache cache of the prepared launch
+   configurations and compiled work-group functions of kernels
+
+   Copyright (c) 2015 pocl developers
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+   
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+   
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+   THE SOFTWARE.
+*/
+
+#ifndef POCL_WG_CACHE_H
+#define POCL_WG_CACHE_H
+
+#include "pocl_cl.h"
+
+#pragma GCC visibility push(hidden)
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* A launch configuration of a kernel (a device and a local size) that
+   has been prepared for execution. The entries are created by the first
+   enqueue of the configuration; the later ones find everything they need
+   here without touching the file system. */
+typedef struct pocl_wg_cache_entry
+{
+  cl_device_id device;
+  size_t local_x;
+  size_t local_y;
+  size_t local_z;
+  /* The kernel compiler cache directory of the configuration. Owned by
+     the entry; the commands only borrow it. */
+  char *tmp_dir;
+  /* The work-group range function compiled by the device, NULL until
+     the first execution. Set with wg_cache_lock held, once more in case
+     of tiered compilation when the optimized version replaces the quick
+     one. The launches that loaded the old value keep using it. */
+  volatile pocl_workgroup_range wg;
+  /* The handle of the JIT compiled code of wg, NULL if the device loaded
+     it otherwise. Freed with the entry. */
+  void *jit;
+  /* The JIT compiled code of the quick version replaced by tiered
+     compilation. The launches that loaded it might still be executing
+     it, thus it is retired until the entry is freed. */
+  void *retired_jit;
+  /* The launches of the local size executed with the generic work-group
+     function of a dynamic local size before a specialized one has been
+     compiled for the entry. */
+  volatile unsigned launches;
+  struct pocl_wg_cache_entry *next;
+} pocl_wg_cache_entry;
+
+/* Maps the local size of a launch to the local size its work-group
+   function is compiled for, which is also the key of its cache entry.
+   On a device with dynamic_local_size set, all the launches of a kernel
+   without a required work-group size share the entry of the local size
+   0, 0, 0. The device can still add entries for the hot local sizes with
+   specialized functions and prefer them when executing a launch. */
+void pocl_wg_cache_compiled_local_size (cl_kernel kernel,
+                                        cl_device_id device,
+                                        size_t *local_x, size_t *local_y,
+                                        size_t *local_z);
+
+/* Returns the cache entry of the kernel for the device and local size,
+   or NULL in case the configuration has not been enqueued yet. Takes no
+   locks, thus launches from concurrent queues never contend here. The
+   program build is implied by the kernel, which cannot outlive it. */
+pocl_wg_cache_entry *pocl_wg_cache_lookup (cl_kernel kernel,
+                                           cl_device_id device,
+                                           size_t local_x, size_t local_y,
+                                           size_t local_z);
+
+/* Publishes a new configuration to the cache of the kernel, taking the
+   ownership of tmp_dir. Must be called with the kernel's wg_cache_lock
+   held, which also serializes the preparation of the missing
+   entries. */
+pocl_wg_cache_entry *pocl_wg_cache_insert (cl_kernel kernel,
+                                           cl_device_id device,
+                                           size_t local_x, size_t local_y,
+                                           size_t local_z, char *tmp_dir);
+
+/* Publishes the compiled work-group function of the entry, replacing the
+   previous one if any. The entry takes the ownership of the JIT compiled
+   code of the function in case jit is not NULL; the code of the replaced
+   function is retired. Must be called with the kernel's wg_cache_lock
+   held. */
+void pocl_wg_cache_set_wg (pocl_wg_cache_entry *e, pocl_workgroup_range wg,
+                           void *jit);
+
+/* Frees the cache entries of a kernel that is being destroyed along with
+   their JIT compiled code. No launch of the kernel can be executing
+   anymore as the commands hold a reference to it. */
+void pocl_wg_cache_free (cl_kernel kernel);
+
+#ifdef __cplusplus
+}
+#endif
+#pragma GCC visibility pop
+
+#endif
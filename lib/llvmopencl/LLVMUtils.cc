@@ -28,10 +28,19 @@
 #ifdef LLVM_3_2
 #include <llvm/Module.h>
 #include <llvm/Metadata.h>
+#include <llvm/Constants.h>
+#include <llvm/LLVMContext.h>
 #else
 #include <llvm/IR/Module.h>
 #include <llvm/IR/Metadata.h>
+#include <llvm/IR/Constants.h>
+#include <llvm/IR/LLVMContext.h>
 #endif
+#include "llvm/Support/Casting.h"
+
+/* The named metadata holding the kernel compiler parameters as
+   !{kernel name, local size x, local size y, local size z}. */
+#define KERNEL_COMPILER_PARAMS_MD "pocl.kernel_compiler_params"
 
 using namespace llvm;
 
@@ -107,5 +116,75 @@ regenerate_kernel_metadata(llvm::Module &M, FunctionMapping &kernels)
   }
 }
 
+void
+set_kernel_compiler_params(llvm::Module &M, const std::string &kernelName,
+                           size_t localX, size_t localY, size_t localZ)
+{
+  NamedMDNode *params = M.getNamedMetadata(KERNEL_COMPILER_PARAMS_MD);
+  if (params != NULL)
+    M.eraseNamedMetadata(params);
+
+  LLVMContext &C = M.getContext();
+  Type *i32 = Type::getInt32Ty(C);
+#ifdef LLVM_OLDER_THAN_3_6
+  SmallVector<Value*, 4> operands;
+  operands.push_back(MDString::get(C, kernelName));
+  operands.push_back(ConstantInt::get(i32, localX));
+  operands.push_back(ConstantInt::get(i32, localY));
+  operands.push_back(ConstantInt::get(i32, localZ));
+#else
+  SmallVector<Metadata*, 4> operands;
+  operands.push_back(MDString::get(C, kernelName));
+  operands.push_back(ConstantAsMetadata::get(ConstantInt::get(i32, localX)));
+  operands.push_back(ConstantAsMetadata::get(ConstantInt::get(i32, localY)));
+  operands.push_back(ConstantAsMetadata::get(ConstantInt::get(i32, localZ)));
+#endif
+  params = M.getOrInsertNamedMetadata(KERNEL_COMPILER_PARAMS_MD);
+  params->addOperand(MDNode::get(C, operands));
+}
+
+static MDNode *
+kernel_compiler_params(const llvm::Module &M)
+{
+  NamedMDNode *params = M.getNamedMetadata(KERNEL_COMPILER_PARAMS_MD);
+  if (params == NULL || params->getNumOperands() == 0)
+    return NULL;
+  MDNode *md = params->getOperand(0);
+  if (md->getNumOperands() != 4)
+    return NULL;
+  return md;
+}
+
+bool
+get_kernel_compiler_kernel_name(const llvm::Module &M, std::string &kernelName)
+{
+  MDNode *md = kernel_compiler_params(M);
+  if (md == NULL)
+    return false;
+  kernelName = cast<MDString>(md->getOperand(0))->getString().str();
+  return true;
+}
+
+bool
+get_kernel_compiler_local_size(const llvm::Module &M,
+                               size_t &localX, size_t &localY, size_t &localZ)
+{
+  MDNode *md = kernel_compiler_params(M);
+  if (md == NULL)
+    return false;
+#ifdef LLVM_OLDER_THAN_3_6
+  localX = cast<ConstantInt>(md->getOperand(1))->getLimitedValue();
+  localY = cast<ConstantInt>(md->getOperand(2))->getLimitedValue();
+  localZ = cast<ConstantInt>(md->getOperand(3))->getLimitedValue();
+#else
+  localX = cast<ConstantInt>(
+    dyn_cast<ConstantAsMetadata>(md->getOperand(1))->getValue())->getLimitedValue();
+  localY = cast<ConstantInt>(
+    dyn_cast<ConstantAsMetadata>(md->getOperand(2))->getValue())->getLimitedValue();
+  localZ = cast<ConstantInt>(
+    dyn_cast<ConstantAsMetadata>(md->getOperand(3))->getValue())->getLimitedValue();
+#endif
+  return true;
 }
 
+}
@@ -52,6 +52,32 @@ typedef std::map<llvm::Function*, llvm::Function*> FunctionMapping;
 void
 regenerate_kernel_metadata(llvm::Module &M, FunctionMapping &kernels);
 
+/**
+ * Stores the kernel to process and the local size of the work-group
+ * function to generate in the Module for the kernel compiler passes.
+ *
+ * Passing these with the Module instead of via the command line options
+ * allows compiling several Modules in parallel threads.
+ */
+void
+set_kernel_compiler_params(llvm::Module &M, const std::string &kernelName,
+                           size_t localX, size_t localY, size_t localZ);
+
+/**
+ * Returns the kernel name stored with set_kernel_compiler_params(), or
+ * false in case the Module does not carry the kernel compiler parameters.
+ */
+bool
+get_kernel_compiler_kernel_name(const llvm::Module &M, std::string &kernelName);
+
+/**
+ * Returns the local size stored with set_kernel_compiler_params(), or
+ * false in case the Module does not carry the kernel compiler parameters.
+ */
+bool
+get_kernel_compiler_local_size(const llvm::Module &M,
+                               size_t &localX, size_t &localY, size_t &localZ);
+
 inline bool
 is_automatic_local(const std::string& funcName, llvm::GlobalVariable &var) 
 {
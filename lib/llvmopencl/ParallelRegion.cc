@@ -39,6 +39,8 @@
 #endif
 #include "llvm/Transforms/Utils/BasicBlockUtils.h"
 #include "llvm/Transforms/Utils/Cloning.h"
+#include "llvm/Support/Mutex.h"
+#include "llvm/Support/MutexGuard.h"
 
 #include <set>
 #include <sstream>
@@ -64,7 +66,7 @@ ParallelRegion::ParallelRegion(int forcedRegionId) :
   exitIndex_(0), entryIndex_(0), pRegionId(forcedRegionId)
 {
   if (forcedRegionId == -1)
-    pRegionId = idGen++;
+    pRegionId = __sync_fetch_and_add (&idGen, 1);
 }
 
 /**
@@ -112,8 +114,10 @@ ParallelRegion::replicate(ValueToValueMapTy &map,
      by LLVM). This causes the variable references to become
      broken. This hack ensures the BB suffixes are unique
      before cloning so each path gets their own value
-     names. Split points can be such paths.*/
+     names. Split points can be such paths. The counts are shared by
+     all the kernel compilations running in parallel. */
   static std::map<std::string, int> cloneCounts;
+  static llvm::sys::Mutex cloneCountsLock;
 
   for (iterator i = begin(), e = end(); i != e; ++i) {
     BasicBlock *block = *i;
@@ -121,12 +125,16 @@ ParallelRegion::replicate(ValueToValueMapTy &map,
     std::ostringstream suf;
     suf << suffix.str();
     std::string block_name = block->getName().str() + "." + suffix.str();
-    if (cloneCounts[block_name] > 0)
+    int cloneCount;
+    {
+      llvm::MutexGuard lockHolder(cloneCountsLock);
+      cloneCount = cloneCounts[block_name]++;
+    }
+    if (cloneCount > 0)
       {
-        suf << ".pocl_" << cloneCounts[block_name];
+        suf << ".pocl_" << cloneCount;
       }
     BasicBlock *new_block = CloneBasicBlock(block, map, suf.str());
-    cloneCounts[block_name]++;
     // Insert the block itself into the map.
     map[block] = new_block;
     new_region->push_back(new_block);
@@ -50,6 +50,9 @@ namespace pocl {
 #define POCL_LOCAL_ID_X_GLOBAL "_local_id_x"
 #define POCL_LOCAL_ID_Y_GLOBAL "_local_id_y"
 #define POCL_LOCAL_ID_Z_GLOBAL "_local_id_z"
+#define POCL_LOCAL_SIZE_X_GLOBAL "_local_size_x"
+#define POCL_LOCAL_SIZE_Y_GLOBAL "_local_size_y"
+#define POCL_LOCAL_SIZE_Z_GLOBAL "_local_size_z"
 
 class Kernel;
 
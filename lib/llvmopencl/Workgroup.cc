@@ -27,6 +27,7 @@
 #include "CanonicalizeBarriers.h"
 #include "BarrierTailReplication.h"
 #include "WorkitemReplication.h"
+#include "LLVMUtils.h"
 #include "llvm/Analysis/ConstantFolding.h"
 #include "llvm/Pass.h"
 #include "llvm/Support/CommandLine.h"
@@ -71,6 +72,12 @@
 
 #define STRING_LENGTH 32
 
+#ifdef _MSC_VER
+#  define POCL_THREAD_LOCAL __declspec(thread)
+#else
+#  define POCL_THREAD_LOCAL __thread
+#endif
+
 using namespace std;
 using namespace llvm;
 using namespace pocl;
@@ -79,6 +86,7 @@ static Function *createLauncher(Module &M, Function *F);
 static void privatizeContext(Module &M, Function *F);
 static void createWorkgroup(Module &M, Function *F);
 static void createWorkgroupFast(Module &M, Function *F);
+static void createWorkgroupRange(Module &M, Function *F);
 
 // extern cl::opt<string> Header;
 // extern cl::list<int> LocalSize;
@@ -104,6 +112,7 @@ namespace llvm {
              TypeBuilder<types::i<64>[3], xcompile>::get(Context),
              TypeBuilder<types::i<64>[3], xcompile>::get(Context),
              TypeBuilder<types::i<64>[3], xcompile>::get(Context),
+             TypeBuilder<types::i<64>[3], xcompile>::get(Context),
              NULL);
         }
       else if (size_t_width == 32)
@@ -113,6 +122,7 @@ namespace llvm {
              TypeBuilder<types::i<32>[3], xcompile>::get(Context),
              TypeBuilder<types::i<32>[3], xcompile>::get(Context),
              TypeBuilder<types::i<32>[3], xcompile>::get(Context),
+             TypeBuilder<types::i<32>[3], xcompile>::get(Context),
              NULL);
         }
       else
@@ -127,9 +137,10 @@ namespace llvm {
      * type that depends on the pointer type. 
      *
      * This should be set when the correct type is known. This is a hack
-     * until a better way is found. It's not thread safe, e.g. if one
-     * compiles multiple Modules for multiple different pointer widths in
-     * a same process with multiple threads. */
+     * until a better way is found. The width is thread local: it is set
+     * and used by Workgroup::runOnModule() on the thread running the
+     * pass, thus Modules for targets with different pointer widths can
+     * be compiled in parallel threads. */
     static void setSizeTWidth(int width) {
       size_t_width = width;
     }    
@@ -138,22 +149,22 @@ namespace llvm {
       WORK_DIM,
       NUM_GROUPS,
       GROUP_ID,
-      GLOBAL_OFFSET
+      GLOBAL_OFFSET,
+      LOCAL_SIZE
     };
   private:
-    static int size_t_width;
+    static POCL_THREAD_LOCAL int size_t_width;
     
   };  
 
   template<bool xcompile>  
-  int TypeBuilder<PoclContext, xcompile>::size_t_width = 0;
+  POCL_THREAD_LOCAL int TypeBuilder<PoclContext, xcompile>::size_t_width = 0;
 
 }  // namespace llvm
   
 char Workgroup::ID = 0;
 static RegisterPass<Workgroup> X("workgroup", "Workgroup creation pass");
 
-
 bool
 Workgroup::runOnModule(Module &M)
 {
@@ -206,6 +217,7 @@ Workgroup::runOnModule(Module &M)
 
     createWorkgroup(M, L);
     createWorkgroupFast(M, L);
+    createWorkgroupRange(M, L);
   }
 
   Function *barrier = cast<Function> 
@@ -329,6 +341,26 @@ createLauncher(Module &M, Function *F)
     }
   }
 
+  /* The kernels compiled for a fixed local size overwrite these with
+     constants. */
+  ptr = builder.CreateStructGEP(ai,
+				TypeBuilder<PoclContext, true>::LOCAL_SIZE);
+  for (int i = 0; i < 3; ++i) {
+    snprintf(s, STRING_LENGTH, "_local_size_%c", 'x' + i);
+    gv = M.getGlobalVariable(s);
+    if (gv != NULL) {
+      if (size_t_width == 64)
+        {
+          v = builder.CreateLoad(builder.CreateConstGEP2_64(ptr, 0, i));
+        }
+      else
+        {
+          v = builder.CreateLoad(builder.CreateConstGEP2_32(ptr, 0, i));
+        }
+      builder.CreateStore(v, gv);
+    }
+  }
+
   CallInst *c = builder.CreateCall(F, ArrayRef<Value*>(arguments));
   builder.CreateRetVoid();
 
@@ -470,6 +502,40 @@ privatizeContext(Module &M, Function *F)
   }
 }
 
+/**
+ * Emits the load of the i:th kernel argument from the argument array of
+ * a work group launcher, which stores pointers to the argument values.
+ */
+static Value *
+createArgumentLoad(IRBuilder<> &builder, Module &M, Value *argArray, int i,
+                   const Argument *arg)
+{
+  Type *t = arg->getType();
+
+  Value *gep = builder.CreateGEP(argArray,
+          ConstantInt::get(IntegerType::get(M.getContext(), 32), i));
+  Value *pointer = builder.CreateLoad(gep);
+
+  /* If it's a pass by value pointer argument, we just pass the pointer
+   * as is to the function, no need to load form it first. */
+  Value *value;
+  if (arg->hasByValAttr()) {
+#if defined(LLVM_3_2) || defined(LLVM_3_3)
+      value = builder.CreateBitCast(pointer, t);
+#else
+      value = builder.CreatePointerCast(pointer, t);
+#endif
+  } else {
+#if defined(LLVM_3_2) || defined(LLVM_3_3)
+      value = builder.CreateBitCast(pointer, t->getPointerTo());
+#else
+      value = builder.CreatePointerCast(pointer, t->getPointerTo());
+#endif
+      value = builder.CreateLoad(value);
+  }
+  return value;
+}
+
 /**
  * Creates a work group launcher function (called KERNELNAME_workgroup)
  * that assumes kernel pointer arguments are stored as pointers to the
@@ -499,31 +565,7 @@ createWorkgroup(Module &M, Function *F)
   int i = 0;
   for (Function::const_arg_iterator ii = F->arg_begin(), ee = F->arg_end();
        ii != ee; ++ii) {
-    Type *t = ii->getType();
-
-    Value *gep = builder.CreateGEP(ai,
-            ConstantInt::get(IntegerType::get(M.getContext(), 32), i));
-    Value *pointer = builder.CreateLoad(gep);
-
-    /* If it's a pass by value pointer argument, we just pass the pointer
-     * as is to the function, no need to load form it first. */
-    Value *value;
-    if (ii->hasByValAttr()) {
-#if defined(LLVM_3_2) || defined(LLVM_3_3)
-        value = builder.CreateBitCast(pointer, t);
-#else
-        value = builder.CreatePointerCast(pointer, t);
-#endif
-    } else {
-#if defined(LLVM_3_2) || defined(LLVM_3_3)
-        value = builder.CreateBitCast(pointer, t->getPointerTo());
-#else
-        value = builder.CreatePointerCast(pointer, t->getPointerTo());
-#endif
-        value = builder.CreateLoad(value);
-    }
-
-    arguments.push_back(value);
+    arguments.push_back(createArgumentLoad(builder, M, ai, i, ii));
     ++i;
   }
 
@@ -613,6 +655,150 @@ createWorkgroupFast(Module &M, Function *F)
 }
 
 
+/**
+ * Creates a launcher that executes a range of work groups per call
+ * (called KERNELNAME_workgroup_range). The arguments are passed like to
+ * KERNELNAME_workgroup, followed by the first and the last flat work group
+ * index to execute, x being the fastest changing dimension. The group ids
+ * in the given context are not used nor modified.
+ *
+ * The arguments are loaded and the group ids unflattened only once per
+ * call. The kernel is inlined into the loop over the groups and reads the
+ * context from a private copy, so everything that does not depend on the
+ * group id can be hoisted out of the loop.
+ */
+static void
+createWorkgroupRange(Module &M, Function *F)
+{
+  LLVMContext &C = M.getContext();
+  IRBuilder<> builder(C);
+
+  int size_t_width = 32;
+#if (defined LLVM_3_2 || defined LLVM_3_3 || defined LLVM_3_4)
+  if (M.getPointerSize() == llvm::Module::Pointer64)
+#else
+  if (M.getDataLayout()->getPointerSize(0) == 8)
+#endif
+    size_t_width = 64;
+  IntegerType *sizeT = IntegerType::get(C, size_t_width);
+
+  SmallVector<Type *, 4> sv;
+  sv.push_back(TypeBuilder<types::i<8>**, true>::get(C));
+  sv.push_back(TypeBuilder<PoclContext*, true>::get(C));
+  sv.push_back(sizeT);
+  sv.push_back(sizeT);
+  FunctionType *ft = FunctionType::get(Type::getVoidTy(C),
+                                       ArrayRef<Type *> (sv), false);
+
+  std::string funcName = "";
+  funcName = F->getName().str();
+  Function *workgroup =
+    dyn_cast<Function>(M.getOrInsertFunction(funcName + "_workgroup_range",
+                                              ft));
+  assert(workgroup != NULL);
+
+  Function::arg_iterator ai = workgroup->arg_begin();
+  Value *argArray = ai++;
+  Value *context = ai++;
+  Value *first = ai++;
+  Value *last = ai;
+
+  BasicBlock *entry = BasicBlock::Create(C, "entry", workgroup);
+  BasicBlock *loop = BasicBlock::Create(C, "group.loop", workgroup);
+  BasicBlock *exit = BasicBlock::Create(C, "group.exit", workgroup);
+  builder.SetInsertPoint(entry);
+
+  /* The kernel gets a copy of the context that does not escape, thus the
+     loads of its fields become plain values once the kernel is inlined. */
+  Value *ctx =
+    builder.CreateAlloca(TypeBuilder<PoclContext, true>::get(C), 0, "ctx");
+  builder.CreateStore(builder.CreateLoad(context), ctx);
+
+  SmallVector<Value*, 8> arguments;
+  int i = 0;
+  for (Function::const_arg_iterator ii = F->arg_begin(), ee = F->arg_end();
+       ii != ee; ++ii, ++i) {
+    /* The last one is the context. */
+    if (i + 1 == (int)F->getArgumentList().size())
+      break;
+    arguments.push_back(createArgumentLoad(builder, M, argArray, i, ii));
+  }
+  arguments.push_back(ctx);
+
+  Value *numGroupsPtr =
+    builder.CreateStructGEP(ctx, TypeBuilder<PoclContext, true>::NUM_GROUPS);
+  Value *numGroupsX =
+    builder.CreateLoad(builder.CreateConstGEP2_32(numGroupsPtr, 0, 0));
+  Value *numGroupsY =
+    builder.CreateLoad(builder.CreateConstGEP2_32(numGroupsPtr, 0, 1));
+  Value *numGroupsXY = builder.CreateMul(numGroupsX, numGroupsY);
+
+  /* Unflatten the first index, the rest are stepped to without
+     divisions. */
+  Value *firstZ = builder.CreateUDiv(first, numGroupsXY);
+  Value *firstXY = builder.CreateURem(first, numGroupsXY);
+  Value *firstY = builder.CreateUDiv(firstXY, numGroupsX);
+  Value *firstX = builder.CreateURem(firstXY, numGroupsX);
+  builder.CreateBr(loop);
+
+  builder.SetInsertPoint(loop);
+  PHINode *flat = builder.CreatePHI(sizeT, 2, "group.flat");
+  PHINode *groupX = builder.CreatePHI(sizeT, 2, "group.x");
+  PHINode *groupY = builder.CreatePHI(sizeT, 2, "group.y");
+  PHINode *groupZ = builder.CreatePHI(sizeT, 2, "group.z");
+
+  Value *groupIdPtr =
+    builder.CreateStructGEP(ctx, TypeBuilder<PoclContext, true>::GROUP_ID);
+  builder.CreateStore(groupX, builder.CreateConstGEP2_32(groupIdPtr, 0, 0));
+  builder.CreateStore(groupY, builder.CreateConstGEP2_32(groupIdPtr, 0, 1));
+  builder.CreateStore(groupZ, builder.CreateConstGEP2_32(groupIdPtr, 0, 2));
+
+  CallInst *c = builder.CreateCall(F, ArrayRef<Value*>(arguments));
+
+  Value *one = ConstantInt::get(sizeT, 1);
+  Value *zero = ConstantInt::get(sizeT, 0);
+  Value *nextX = builder.CreateAdd(groupX, one);
+  Value *wrapX = builder.CreateICmpEQ(nextX, numGroupsX);
+  Value *nextY = builder.CreateSelect(wrapX, builder.CreateAdd(groupY, one),
+                                      groupY);
+  Value *wrapY = builder.CreateICmpEQ(nextY, numGroupsY);
+  Value *nextFlat = builder.CreateAdd(flat, one);
+
+  flat->addIncoming(first, entry);
+  flat->addIncoming(nextFlat, loop);
+  groupX->addIncoming(firstX, entry);
+  groupX->addIncoming(builder.CreateSelect(wrapX, zero, nextX), loop);
+  groupY->addIncoming(firstY, entry);
+  groupY->addIncoming(builder.CreateSelect(wrapY, zero, nextY), loop);
+  groupZ->addIncoming(firstZ, entry);
+  groupZ->addIncoming(builder.CreateSelect(wrapY,
+                                           builder.CreateAdd(groupZ, one),
+                                           groupZ), loop);
+
+  builder.CreateCondBr(builder.CreateICmpEQ(flat, last), exit, loop);
+
+  builder.SetInsertPoint(exit);
+  builder.CreateRetVoid();
+
+  /* The launcher is not inlined to the single work group functions, but
+     here the loop is where the group invariant code is hoisted from. */
+  InlineFunctionInfo IFI;
+  InlineFunction(c, IFI);
+}
+
+/**
+ * Returns the name of the kernel the work-group function is generated for,
+ * or an empty string in case all kernels should be processed.
+ */
+std::string
+Workgroup::getKernelName(const Module &M)
+{
+  std::string kernelName;
+  if (get_kernel_compiler_kernel_name(M, kernelName))
+    return kernelName;
+  return KernelName;
+}
+
 /**
  * Returns true in case the given function is a kernel that
  * should be processed by the kernel compiler.
@@ -624,9 +810,10 @@ Workgroup::isKernelToProcess(const Function &F)
 
   NamedMDNode *kernels = m->getNamedMetadata("opencl.kernels");
   if (kernels == NULL) {
-    if (KernelName == "")
+    std::string kernelName = getKernelName(*m);
+    if (kernelName == "")
       return true;
-    if (F.getName() == KernelName)
+    if (F.getName() == kernelName)
       return true;
 
     return false;
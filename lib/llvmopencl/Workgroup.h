@@ -30,6 +30,7 @@
 #include "llvm/IR/Module.h"
 #endif
 #include "llvm/Pass.h"
+#include <string>
 
 namespace pocl {
   class Workgroup : public llvm::ModulePass {  
@@ -45,6 +46,7 @@ namespace pocl {
         AU.setPreservesAll();
     }
 
+    static std::string getKernelName(const llvm::Module &M);
     static bool isKernelToProcess(const llvm::Function &F);
     static bool hasWorkgroupBarriers(const llvm::Function &F);
 
@@ -43,6 +43,7 @@
 #include "WorkitemHandler.h"
 #include "Kernel.h"
 #include "DebugHelpers.h"
+#include "LLVMUtils.h"
 #include "pocl.h"
 
 //#define DEBUG_REFERENCE_FIXING
@@ -74,9 +75,18 @@ WorkitemHandler::Initialize(Kernel *K) {
 
   llvm::Module *M = K->getParent();
   
-  LocalSizeX = LocalSize[0];
-  LocalSizeY = LocalSize[1];
-  LocalSizeZ = LocalSize[2];
+  /* The local size comes with the Module when generating the work-group
+     function via the LLVM API and from the command line when using opt. */
+  size_t localX, localY, localZ;
+  if (get_kernel_compiler_local_size(*M, localX, localY, localZ)) {
+    LocalSizeX = localX;
+    LocalSizeY = localY;
+    LocalSizeZ = localZ;
+  } else {
+    LocalSizeX = LocalSize[0];
+    LocalSizeY = LocalSize[1];
+    LocalSizeZ = LocalSize[2];
+  }
   
   llvm::NamedMDNode *size_info = M->getNamedMetadata("opencl.kernel_wg_size_info");
   if (size_info) {
@@ -130,6 +140,18 @@ WorkitemHandler::Initialize(Kernel *K) {
   localIdZ = M->getOrInsertGlobal(POCL_LOCAL_ID_Z_GLOBAL, localIdType);
   localIdY = M->getOrInsertGlobal(POCL_LOCAL_ID_Y_GLOBAL, localIdType);
   localIdX = M->getOrInsertGlobal(POCL_LOCAL_ID_X_GLOBAL, localIdType);
+
+  /* A zero local size stands for any local size (unless the kernel
+     requires a specific one, see above). The work-group launcher then
+     stores the local size of the launch to the globals. */
+  DynamicLocalSize = LocalSizeX == 0 && LocalSizeY == 0 && LocalSizeZ == 0;
+  if (DynamicLocalSize) {
+    localSizeZ = M->getOrInsertGlobal(POCL_LOCAL_SIZE_Z_GLOBAL, localIdType);
+    localSizeY = M->getOrInsertGlobal(POCL_LOCAL_SIZE_Y_GLOBAL, localIdType);
+    localSizeX = M->getOrInsertGlobal(POCL_LOCAL_SIZE_X_GLOBAL, localIdType);
+  } else {
+    localSizeZ = localSizeY = localSizeX = NULL;
+  }
 }
 
 
@@ -69,11 +69,21 @@ namespace pocl {
 
     int LocalSizeX, LocalSizeY, LocalSizeZ;
 
+    /* True in case the work-group function is generated for any local
+       size, that is, the local size given to the kernel compiler was zero.
+       The local size is then known only at runtime and is read from the
+       _local_size globals. */
+    bool DynamicLocalSize;
+
     unsigned size_t_width;
 
     /* The global variables that store the current local id. */
     llvm::Value *localIdZ, *localIdY, *localIdX;
 
+    /* The global variables that store the local size. Set only in case
+       of a dynamic local size. */
+    llvm::Value *localSizeZ, *localSizeY, *localSizeX;
+
   };
 
   extern llvm::cl::opt<bool> AddWIMetadata;
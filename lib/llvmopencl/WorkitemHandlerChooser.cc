@@ -66,12 +66,10 @@ WorkitemHandlerChooser::runOnFunction(Function &F)
 
   Kernel *K = cast<Kernel> (&F);
 
-  /* FIXME: this is not thread safe. We cannot compile multiple kernels at
-     the same time with the same instances of these passes as they store
-     to private attributes and use global values to pass in the dimensions.
-     In the LLVMAPI version this logic should be at higher-level when
-     constructing the passes for the kernel, or done fully inside a single
-     FunctionPass that delegates to other passes. */    
+  /* The passes store the dimensions to private attributes, thus the same
+     pass instances must not be used to compile multiple kernels at the
+     same time. The LLVM API creates a separate set of passes for each
+     parallel compilation and passes the dimensions in with the Module. */
   Initialize(K);
 
   std::string method = "auto";
@@ -107,6 +105,10 @@ WorkitemHandlerChooser::runOnFunction(Function &F)
         }
     }
 
+  /* The work-items cannot be replicated without knowing their count. */
+  if (DynamicLocalSize)
+    chosenHandler_ = POCL_WIH_LOOPS;
+
   return false;
 }
 
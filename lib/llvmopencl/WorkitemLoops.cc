@@ -75,9 +75,20 @@
 
 #define CONTEXT_ARRAY_ALIGN 64
 
+/* The maximum number of instructions to recompute in a region instead of
+   restoring the value from its context array. */
+#define MAX_REMATERIALIZATION_COST 8
+
 using namespace llvm;
 using namespace pocl;
 
+STATISTIC(NumContextSavedValues,
+          "Number of values stored to work-item context arrays");
+STATISTIC(NumRematerializedValues,
+          "Number of values recomputed instead of context saved");
+STATISTIC(NumSharedContextArrays,
+          "Number of context arrays merged with another one");
+
 namespace {
   static
   RegisterPass<WorkitemLoops> X("workitemloops", 
@@ -159,6 +170,8 @@ WorkitemLoops::runOnFunction(Function &F)
 #endif
   contextArrays.clear();
   tempInstructionIds.clear();
+  restorePoints.clear();
+  rematerializedValues.clear();
 
   return changed;
 }
@@ -168,7 +181,7 @@ WorkitemLoops::CreateLoopAround
 (ParallelRegion &region,
  llvm::BasicBlock *entryBB, llvm::BasicBlock *exitBB, 
  bool peeledFirst, llvm::Value *localIdVar, size_t LocalSizeForDim,
- bool addIncBlock) 
+ llvm::Value *localSizeVar, bool addIncBlock) 
 {
   assert (localIdVar != NULL);
 
@@ -188,6 +201,9 @@ WorkitemLoops::CreateLoopAround
 
     br label %for.body
 
+    ; in case of a dynamic local size the peeled loop branches to for.cond
+    ; instead as the local size might be 1
+
     for.body: 
 
     ; the parallel region code here
@@ -208,6 +224,7 @@ WorkitemLoops::CreateLoopAround
     for.cond:
 
     ; loop header, compare the id to the local size
+    ; (a load of %_local_size_x in case of a dynamic local size)
     %0 = load i32* %_local_id_x, align 4
     %cmp = icmp ult i32 %0, i32 123
     br i1 %cmp, label %for.body, label %for.end
@@ -284,7 +301,12 @@ WorkitemLoops::CreateLoopAround
         (ConstantInt::get(IntegerType::get(C, size_t_width), 0), localIdVar);
     }
 
-  builder.CreateBr(loopBodyEntryBB);
+  /* The loops execute at least one iteration, which is not the case for
+     a peeled loop of a single work-item wide dynamic work-group. */
+  if (peeledFirst && localSizeVar != NULL)
+    builder.CreateBr(forCondBB);
+  else
+    builder.CreateBr(loopBodyEntryBB);
 
   exitBB->getTerminator()->replaceUsesOfWith(oldExit, forCondBB);
   if (addIncBlock)
@@ -293,12 +315,14 @@ WorkitemLoops::CreateLoopAround
     }
 
   builder.SetInsertPoint(forCondBB);
+  llvm::Value *localSize;
+  if (localSizeVar != NULL)
+    localSize = builder.CreateLoad(localSizeVar);
+  else
+    localSize = 
+      ConstantInt::get(IntegerType::get(C, size_t_width), LocalSizeForDim);
   llvm::Value *cmpResult = 
-    builder.CreateICmpULT
-    (builder.CreateLoad(localIdVar),
-     (ConstantInt::get
-      (IntegerType::get(C, size_t_width), 
-       LocalSizeForDim)));
+    builder.CreateICmpULT(builder.CreateLoad(localIdVar), localSize);
       
   Instruction *loopBranch =
       builder.CreateCondBr(cmpResult, loopBodyEntryBB, loopEndBB);
@@ -379,6 +403,18 @@ WorkitemLoops::ProcessFunction(Function &F)
     builder.CreateAlloca
     (IntegerType::get(F.getContext(), size_t_width), 0, ".pocl.local_id_x_init");
 
+  workItemCountVar = NULL;
+  if (DynamicLocalSize)
+    {
+      /* The work-group launcher has stored the local size to the globals
+         before entering the kernel. */
+      workItemCountVar = cast<Instruction>
+        (builder.CreateMul
+         (builder.CreateMul
+          (builder.CreateLoad(localSizeZ), builder.CreateLoad(localSizeY)),
+          builder.CreateLoad(localSizeX), ".pocl.wi_count"));
+    }
+
   //  F.viewCFGOnly();
 
 #if 0
@@ -485,7 +521,9 @@ WorkitemLoops::ProcessFunction(Function &F)
           }
 
         int unrollCount;
-        if (getenv("POCL_WILOOPS_MAX_UNROLL_COUNT") != NULL)
+        if (DynamicLocalSize)
+            unrollCount = 1;
+        else if (getenv("POCL_WILOOPS_MAX_UNROLL_COUNT") != NULL)
             unrollCount = atoi(getenv("POCL_WILOOPS_MAX_UNROLL_COUNT"));
         else
             unrollCount = 1;
@@ -527,14 +565,17 @@ WorkitemLoops::ProcessFunction(Function &F)
         }
       }
 
-    if (LocalSizeX > 1)
-      l = CreateLoopAround(*original, l.first, l.second, peelFirst, localIdX, LocalSizeX, !unrolled);
+    if (LocalSizeX > 1 || DynamicLocalSize)
+      l = CreateLoopAround(*original, l.first, l.second, peelFirst, localIdX,
+                           LocalSizeX, localSizeX, !unrolled);
 
-    if (LocalSizeY > 1)
-      l = CreateLoopAround(*original, l.first, l.second, false, localIdY, LocalSizeY);
+    if (LocalSizeY > 1 || DynamicLocalSize)
+      l = CreateLoopAround(*original, l.first, l.second, false, localIdY,
+                           LocalSizeY, localSizeY);
 
-    if (LocalSizeZ > 1)
-      l = CreateLoopAround(*original, l.first, l.second, false, localIdZ, LocalSizeZ);
+    if (LocalSizeZ > 1 || DynamicLocalSize)
+      l = CreateLoopAround(*original, l.first, l.second, false, localIdZ,
+                           LocalSizeZ, localSizeZ);
 
     /* Loop edges coming from another region mean B-loops which means 
        we have to fix the loop edge to jump to the beginning of the wi-loop 
@@ -571,7 +612,10 @@ WorkitemLoops::ProcessFunction(Function &F)
        localIdXFirstVar);       
   }
 
-  K->addLocalSizeInitCode(LocalSizeX, LocalSizeY, LocalSizeZ);
+  ShareContextArrays();
+
+  if (!DynamicLocalSize)
+    K->addLocalSizeInitCode(LocalSizeX, LocalSizeY, LocalSizeZ);
   ParallelRegion::insertLocalIdInit(&F.getEntryBlock(), 0, 0, 0);
 
 #if 0
@@ -659,7 +703,7 @@ WorkitemLoops::FixMultiRegionVariables(ParallelRegion *region)
       (*i)->dump();
 #endif 
       llvm::Instruction *instructionToFix = *i;
-      AddContextSaveRestore(instructionToFix);
+      AddContextSaveRestore(instructionToFix, region);
     }
 }
 
@@ -684,20 +728,13 @@ WorkitemLoops::AddContextSave
   while (isa<PHINode>(definition)) ++definition;
 
   IRBuilder<> builder(definition); 
-  std::vector<llvm::Value *> gepArgs;
-  gepArgs.push_back(ConstantInt::get(IntegerType::get(instruction->getContext(), size_t_width), 0));
 
-  /* Reuse the id loads earlier in the region, if possible, to
-     avoid messy output with lots of redundant loads. */
   ParallelRegion *region = RegionOfBlock(instruction->getParent());
   assert ("Adding context save outside any region produces illegal code." && 
           region != NULL);
 
-  gepArgs.push_back(region->LocalIDZLoad());
-  gepArgs.push_back(region->LocalIDYLoad());
-  gepArgs.push_back(region->LocalIDXLoad());
-
-  return builder.CreateStore(instruction, builder.CreateGEP(alloca, gepArgs));
+  return builder.CreateStore
+    (instruction, GetContextArraySlot(alloca, definition, region));
 }
 
 llvm::Instruction *
@@ -723,22 +760,12 @@ WorkitemLoops::AddContextRestore
     }
 
   
-  std::vector<llvm::Value *> gepArgs;
-  gepArgs.push_back(ConstantInt::get(IntegerType::get(val->getContext(), size_t_width), 0));
-
-  /* Reuse the id loads earlier in the region, if possible, to
-     avoid messy output with lots of redundant loads. */
   ParallelRegion *region = RegionOfBlock(before->getParent());
   assert ("Adding context save outside any region produces illegal code." && 
           region != NULL);
 
-  gepArgs.push_back(region->LocalIDZLoad());
-  gepArgs.push_back(region->LocalIDYLoad());
-  gepArgs.push_back(region->LocalIDXLoad());
-
-
   llvm::Instruction *gep = 
-    dyn_cast<Instruction>(builder.CreateGEP(alloca, gepArgs));
+    dyn_cast<Instruction>(GetContextArraySlot(alloca, before, region));
   if (isAlloca) {
     /* In case the context saved instruction was an alloca, we created a
        context array with pointed-to elements, and now want to return a pointer 
@@ -748,6 +775,44 @@ WorkitemLoops::AddContextRestore
   return builder.CreateLoad(gep);
 }
 
+/**
+ * Returns a pointer to the slot of the current work-item in the given
+ * context array, computed before the given instruction.
+ */
+llvm::Value *
+WorkitemLoops::GetContextArraySlot
+(llvm::Instruction *alloca, llvm::Instruction *before, ParallelRegion *region)
+{
+  IRBuilder<> builder(before);
+
+  /* Reuse the id loads earlier in the region, if possible, to
+     avoid messy output with lots of redundant loads. */
+  if (DynamicLocalSize)
+    {
+      /* A flat array of work-item count elements, x being the fastest
+         changing index like in the 3D arrays. */
+      llvm::Value *index =
+        builder.CreateAdd
+        (builder.CreateMul
+         (builder.CreateAdd
+          (builder.CreateMul(region->LocalIDZLoad(),
+                             builder.CreateLoad(localSizeY)),
+           region->LocalIDYLoad()),
+          builder.CreateLoad(localSizeX)),
+         region->LocalIDXLoad());
+      return builder.CreateGEP(alloca, index);
+    }
+
+  std::vector<llvm::Value *> gepArgs;
+  gepArgs.push_back(ConstantInt::get(IntegerType::get(alloca->getContext(), size_t_width), 0));
+
+  gepArgs.push_back(region->LocalIDZLoad());
+  gepArgs.push_back(region->LocalIDYLoad());
+  gepArgs.push_back(region->LocalIDXLoad());
+
+  return builder.CreateGEP(alloca, gepArgs);
+}
+
 /**
  * Returns the context array (alloca) for the given Value, creates it if not
  * found.
@@ -804,17 +869,28 @@ WorkitemLoops::GetContextArray(llvm::Instruction *instruction)
       elementType = instruction->getType();
     }
 
-  /* 3D context array. */
-  llvm::Type *contextArrayType = 
-    ArrayType::get(
+  llvm::AllocaInst *alloca;
+  if (DynamicLocalSize)
+    {
+      /* The size is known only at runtime, allocate a flat array after
+         the work-item count has been computed in the entry block. */
+      BasicBlock::iterator afterCount = workItemCountVar;
+      builder.SetInsertPoint(++afterCount);
+      alloca = builder.CreateAlloca(elementType, workItemCountVar, varName);
+    }
+  else
+    {
+      /* 3D context array. */
+      llvm::Type *contextArrayType = 
         ArrayType::get(
             ArrayType::get(
-                elementType, LocalSizeX), 
-            LocalSizeY), LocalSizeZ);
+                ArrayType::get(
+                    elementType, LocalSizeX), 
+                LocalSizeY), LocalSizeZ);
 
-  /* Allocate the context data array for the variable. */
-  llvm::AllocaInst *alloca = 
-    builder.CreateAlloca(contextArrayType, 0, varName);
+      /* Allocate the context data array for the variable. */
+      alloca = builder.CreateAlloca(contextArrayType, 0, varName);
+    }
   /* Align the context arrays to stack to enable wide vectors
      accesses to them. Also, LLVM 3.3 seems to produce illegal
      code at least with Core i5 when aligned only at the element
@@ -825,36 +901,200 @@ WorkitemLoops::GetContextArray(llvm::Instruction *instruction)
   return alloca;
 }
 
+/**
+ * Collects the blocks that save to and restore from the given context
+ * array. Returns false in case the array is accessed some other way than
+ * through the context save and restore code.
+ */
+bool
+WorkitemLoops::ContextArrayAccesses
+(llvm::Instruction *alloca, BasicBlockSet &saves, BasicBlockSet &restores)
+{
+  for (Instruction::use_iterator ui = alloca->use_begin(),
+         ue = alloca->use_end();
+       ui != ue; ++ui)
+    {
+#if defined LLVM_3_2 || defined LLVM_3_3 || defined LLVM_3_4
+      llvm::GetElementPtrInst *gep = dyn_cast<GetElementPtrInst>(*ui);
+#else
+      llvm::GetElementPtrInst *gep = dyn_cast<GetElementPtrInst>(ui->getUser());
+#endif
+      if (gep == NULL || gep->getPointerOperand() != alloca) return false;
+
+      for (Instruction::use_iterator gi = gep->use_begin(),
+             ge = gep->use_end();
+           gi != ge; ++gi)
+        {
+#if defined LLVM_3_2 || defined LLVM_3_3 || defined LLVM_3_4
+          llvm::Instruction *access = dyn_cast<Instruction>(*gi);
+#else
+          llvm::Instruction *access = dyn_cast<Instruction>(gi->getUser());
+#endif
+          if (access == NULL)
+            return false;
+          else if (isa<LoadInst>(access))
+            restores.insert(access->getParent());
+          else if (isa<StoreInst>(access) &&
+                   cast<StoreInst>(access)->getPointerOperand() == gep)
+            saves.insert(access->getParent());
+          else
+            return false;
+        }
+    }
+  return true;
+}
+
+/**
+ * Lets the context arrays of the variables whose live ranges do not
+ * overlap share the same storage to reduce the stack usage of the
+ * work-group function.
+ *
+ * A context array is live in the blocks that are on some path from a
+ * block saving to it to a block restoring from it. As the work-item loops
+ * have been created at this point, this includes the whole work-item loops
+ * of the regions the variable is saved and restored in. Thus, in case the
+ * live blocks of two context arrays of the same type are disjoint, all
+ * the work-items have restored the first variable for the last time before
+ * any of them saves the second one and the arrays can be merged. The
+ * merged arrays retain the layout of one array per variable with the
+ * consecutive work-items in the consecutive elements, which the
+ * vectorized work-item loops access with wide loads and stores.
+ *
+ * The context arrays with element pointers used for anything else than
+ * loads and stores, such as the ones of the private arrays, are not shared
+ * as the accesses through them cannot be tracked.
+ */
+void
+WorkitemLoops::ShareContextArrays()
+{
+  std::vector<llvm::AllocaInst*> slots;
+  std::vector<BasicBlockSet> slotLiveBlocks;
+  std::vector<std::string> merged;
+
+  for (StrInstructionMap::iterator i = contextArrays.begin(),
+         e = contextArrays.end();
+       i != e; ++i)
+    {
+      llvm::AllocaInst *array = cast<AllocaInst>(i->second);
+      BasicBlockSet saves, restores;
+      if (!ContextArrayAccesses(array, saves, restores)) continue;
+
+      /* The blocks reachable from the saves... */
+      BasicBlockSet reachable;
+      BasicBlockVector worklist(saves.begin(), saves.end());
+      while (!worklist.empty())
+        {
+          llvm::BasicBlock *bb = worklist.back();
+          worklist.pop_back();
+          if (!reachable.insert(bb).second) continue;
+          for (succ_iterator s = succ_begin(bb), se = succ_end(bb);
+               s != se; ++s)
+            worklist.push_back(*s);
+        }
+
+      /* ...that reach a restore. The saves are always included to not let
+         a save without restores clobber another variable. */
+      BasicBlockSet liveBlocks(saves.begin(), saves.end());
+      BasicBlockSet visited;
+      worklist.assign(restores.begin(), restores.end());
+      while (!worklist.empty())
+        {
+          llvm::BasicBlock *bb = worklist.back();
+          worklist.pop_back();
+          if (!visited.insert(bb).second) continue;
+          if (reachable.find(bb) != reachable.end())
+            liveBlocks.insert(bb);
+          for (pred_iterator p = pred_begin(bb), pe = pred_end(bb);
+               p != pe; ++p)
+            worklist.push_back(*p);
+        }
+      liveBlocks.insert(restores.begin(), restores.end());
+
+      size_t slot;
+      for (slot = 0; slot < slots.size(); ++slot)
+        {
+          if (slots[slot]->getAllocatedType() != array->getAllocatedType() ||
+              slots[slot]->getArraySize() != array->getArraySize())
+            continue;
+
+          BasicBlockSet &slotLive = slotLiveBlocks[slot];
+          bool overlaps = false;
+          for (BasicBlockSet::iterator bb = liveBlocks.begin(),
+                 be = liveBlocks.end();
+               bb != be && !overlaps; ++bb)
+            overlaps = slotLive.find(*bb) != slotLive.end();
+          if (!overlaps) break;
+        }
+
+      if (slot == slots.size())
+        {
+          slots.push_back(array);
+          slotLiveBlocks.push_back(liveBlocks);
+          continue;
+        }
+
+#ifdef DEBUG_WORK_ITEM_LOOPS
+      std::cerr << "### sharing the context array " << i->first
+                << " with " << slots[slot]->getName().str() << std::endl;
+#endif
+      array->replaceAllUsesWith(slots[slot]);
+      array->eraseFromParent();
+      slotLiveBlocks[slot].insert(liveBlocks.begin(), liveBlocks.end());
+      merged.push_back(i->first);
+      ++NumSharedContextArrays;
+    }
+
+  for (std::vector<std::string>::iterator i = merged.begin(),
+         e = merged.end();
+       i != e; ++i)
+    contextArrays.erase(*i);
+}
+
 
 /**
  * Adds context save/restore code for the value produced by the
  * given instruction.
  *
- * TODO: add only one restore per variable per region.
+ * Values that are cheap to compute from the work-group invariant data
+ * and the local id are recomputed in the regions that use them instead
+ * (see RematerializationCost()). Both the restores and the recomputed
+ * values are added only once per variable per region, at the beginning
+ * of the region.
+ *
  * TODO: add only one load of the id variables per region. 
  * Could be done by having a context restore BB in the beginning of the
  * region and a context save BB at the end.
  * TODO: ignore work group variables completely (the iteration variables)
  * The LLVM should optimize these away but it would improve
  * the readability of the output during debugging.
- * TODO: rematerialize some values such as extended values of global 
- * variables (especially global id which is computed from local id) or kernel 
- * argument values instead of allocating stack space for them
  */
 void
 WorkitemLoops::AddContextSaveRestore
-(llvm::Instruction *instruction) {
+(llvm::Instruction *instruction, ParallelRegion *definingRegion) {
 
-  /* Allocate the context data array for the variable. */
-  llvm::Instruction *alloca = GetContextArray(instruction);
-  llvm::Instruction *theStore = AddContextSave(instruction, alloca);
+  bool isAlloca = isa<AllocaInst>(instruction);
+  bool rematerialize = !isAlloca && RematerializationCost(instruction) >= 0;
+
+  llvm::Instruction *alloca = NULL;
+  llvm::Instruction *theStore = NULL;
+  if (rematerialize)
+    {
+      ++NumRematerializedValues;
+    }
+  else
+    {
+      /* Allocate the context data array for the variable. */
+      alloca = GetContextArray(instruction);
+      theStore = AddContextSave(instruction, alloca);
+      ++NumContextSavedValues;
+    }
 
   InstructionVec uses;
-  /* Restore the produced variable before each use to ensure the correct context
-     copy is used.
+  /* Restore the produced variable in each region that uses it to ensure
+     the correct context copy is used.
      
-     We could add the restore only to other regions outside the 
-     variable defining region and use the original variable in the defining
+     The restore is added only to the regions outside the variable
+     defining region, the original variable is used in the defining
      region due to the SSA virtual registers being unique. However,
      alloca variables can be redefined also in the same region, thus we 
      need to ensure the correct alloca context position is written, not
@@ -879,56 +1119,50 @@ WorkitemLoops::AddContextSaveRestore
       uses.push_back(user);
     }
 
+  std::map<ParallelRegion*, llvm::Value*> regionValues;
   for (InstructionVec::iterator i = uses.begin(); i != uses.end(); ++i)
     {
       Instruction *user = *i;
-      Instruction *contextRestoreLocation = user;
+      ParallelRegion *region = RegionOfBlock(user->getParent());
       /* If the user is in a block that doesn't belong to a region,
          the variable itself must be a "work group variable", that is,
          not dependent on the work item. Most likely an iteration
          variable of a for loop with a barrier. */
-      if (RegionOfBlock(user->getParent()) == NULL) continue;
+      if (region == NULL) continue;
+
+      if (!isAlloca && definingRegion->HasBlock(user->getParent()))
+        continue;
 
       PHINode* phi = dyn_cast<PHINode>(user);
       if (phi != NULL)
         {
-          /* In case of PHI nodes, we cannot just insert the context 
-             restore code before it in the same basic block because it is 
-             assumed there are no non-phi Instructions before PHIs which 
-             the context restore code constitutes to. Add the context
-             restore to the incomingBB instead.
-
-             There can be values in the PHINode that are incoming
-             from another region even though the decision BB is within the region. 
-             For those values we need to add the context restore code in the 
-             incoming BB (which is known to be inside the region due to the
-             assumption of not having to touch PHI nodes in PRentry BBs).
-          */          
-
-          /* PHINodes at region entries are broken down earlier. */
+          /* In case of PHI nodes, the restored value must be available at
+             the end of the incoming BB, which the region entry dominates
+             as the incoming BB is known to be inside the region due to the
+             assumption of not having to touch PHI nodes in PRentry BBs.
+
+             PHINodes at region entries are broken down earlier. */
           assert ("Cannot add context restore for a PHI node at the region entry!" &&
                   RegionOfBlock(phi->getParent())->entryBB() != phi->getParent());
+        }
+
+      llvm::Value *restoredValue = regionValues[region];
+      if (restoredValue == NULL)
+        {
+          llvm::Instruction *location = RegionRestorePoint(region);
 #ifdef DEBUG_WORK_ITEM_LOOPS
-          std::cerr << "### adding context restore code before PHI" << std::endl;
-          user->dump();
-          std::cerr << "### in BB:" << std::endl;
-          user->getParent()->dump();
+          std::cerr << "### adding context restore code to the region entry:"
+                    << std::endl;
+          location->getParent()->dump();
 #endif
-          BasicBlock *incomingBB = NULL;
-          for (unsigned incoming = 0; incoming < phi->getNumIncomingValues(); 
-               ++incoming)
-            {
-              Value *val = phi->getIncomingValue(incoming);
-              BasicBlock *bb = phi->getIncomingBlock(incoming);
-              if (val == instruction) incomingBB = bb;
-            }
-          assert (incomingBB != NULL);
-          contextRestoreLocation = incomingBB->getTerminator();
+          if (rematerialize)
+            restoredValue = Rematerialize(instruction, location, region);
+          else
+            restoredValue =
+              AddContextRestore(user, alloca, location, isAlloca);
+          regionValues[region] = restoredValue;
         }
-      llvm::Value *loadedValue = 
-        AddContextRestore
-        (user, alloca, contextRestoreLocation, isa<AllocaInst>(instruction));
-      user->replaceUsesOfWith(instruction, loadedValue);
+      user->replaceUsesOfWith(instruction, restoredValue);
 #ifdef DEBUG_WORK_ITEM_LOOPS
       std::cerr << "### done, the user was converted to:" << std::endl;
       user->dump();
@@ -936,6 +1170,145 @@ WorkitemLoops::AddContextSaveRestore
     }
 }
 
+/**
+ * Returns the instruction in the region entry BB before which the context
+ * restore code and the rematerialized values are added. It comes after
+ * the local id loads of the region so the context array slots can be
+ * computed.
+ */
+llvm::Instruction *
+WorkitemLoops::RegionRestorePoint(ParallelRegion *region)
+{
+  region->LocalIDZLoad();
+  region->LocalIDYLoad();
+  region->LocalIDXLoad();
+
+  /* Diverging regions share the entry BB. Use the same insertion point for
+     all of them so the values added earlier stay above the later ones. */
+  llvm::BasicBlock *entry = region->entryBB();
+  if (restorePoints.find(entry) != restorePoints.end())
+    return restorePoints[entry];
+
+  llvm::BasicBlock::iterator i = entry->getFirstInsertionPt();
+  while (IsLocalIdLoad(i)) ++i;
+  llvm::Instruction *point = i;
+  restorePoints[entry] = point;
+  return point;
+}
+
+bool
+WorkitemLoops::IsLocalIdLoad(llvm::Instruction *instr)
+{
+  llvm::LoadInst *load = dyn_cast<llvm::LoadInst>(instr);
+  return load != NULL &&
+    (load->getPointerOperand() == localIdZ ||
+     load->getPointerOperand() == localIdY ||
+     load->getPointerOperand() == localIdX);
+}
+
+/**
+ * Returns the number of instructions needed to recompute the given value
+ * in another region, or -1 in case it should be context saved instead.
+ *
+ * Only side effect free instructions that do not trap are recomputed. The
+ * leaves must be constants, kernel arguments or loads of the variables that
+ * do not change during the work-group execution (the group ids, the local
+ * size and such), or of the local id which is then read in the region
+ * recomputing the value. For example, the global id and the addresses
+ * computed from it and the kernel arguments are recomputed.
+ */
+int
+WorkitemLoops::RematerializationCost(llvm::Value *val)
+{
+  if (isa<Constant>(val) || isa<Argument>(val)) return 0;
+
+  llvm::Instruction *instr = dyn_cast<Instruction>(val);
+  if (instr == NULL) return -1;
+
+  if (llvm::LoadInst *load = dyn_cast<LoadInst>(instr))
+    {
+      if (load->isVolatile()) return -1;
+      if (IsLocalIdLoad(load)) return 1;
+      llvm::GlobalVariable *global =
+        dyn_cast<GlobalVariable>(load->getPointerOperand());
+      if (global == NULL) return -1;
+      llvm::StringRef name = global->getName();
+      if (global->isConstant() ||
+          name.startswith("_local_size_") ||
+          name.startswith("_group_id_") ||
+          name.startswith("_num_groups_") ||
+          name.startswith("_global_offset_") ||
+          name == "_work_dim")
+        return 1;
+      return -1;
+    }
+
+  if (llvm::BinaryOperator *binop = dyn_cast<BinaryOperator>(instr))
+    {
+      /* The recomputation is executed at the region entry, possibly in
+         the paths the original was not. */
+      switch (binop->getOpcode())
+        {
+        case Instruction::UDiv:
+        case Instruction::SDiv:
+        case Instruction::URem:
+        case Instruction::SRem:
+          return -1;
+        default:
+          break;
+        }
+    }
+  else if (!isa<CastInst>(instr) && !isa<GetElementPtrInst>(instr) &&
+           !isa<CmpInst>(instr) && !isa<SelectInst>(instr))
+    return -1;
+
+  int cost = 1;
+  for (unsigned op = 0; op < instr->getNumOperands(); ++op)
+    {
+      int opCost = RematerializationCost(instr->getOperand(op));
+      if (opCost < 0) return -1;
+      cost += opCost;
+      if (cost > MAX_REMATERIALIZATION_COST) return -1;
+    }
+  return cost;
+}
+
+/**
+ * Recomputes the value before the given instruction in the region. The
+ * value must have a non-negative RematerializationCost().
+ */
+llvm::Value *
+WorkitemLoops::Rematerialize
+(llvm::Value *val, llvm::Instruction *before, ParallelRegion *region)
+{
+  llvm::Instruction *instr = dyn_cast<Instruction>(val);
+  if (instr == NULL) return val;
+
+  if (llvm::LoadInst *load = dyn_cast<LoadInst>(instr))
+    {
+      if (load->getPointerOperand() == localIdZ)
+        return region->LocalIDZLoad();
+      if (load->getPointerOperand() == localIdY)
+        return region->LocalIDYLoad();
+      if (load->getPointerOperand() == localIdX)
+        return region->LocalIDXLoad();
+    }
+
+  std::pair<ParallelRegion*, llvm::Value*> key(region, val);
+  if (rematerializedValues.find(key) != rematerializedValues.end())
+    return rematerializedValues[key];
+
+  llvm::Instruction *copy = instr->clone();
+  for (unsigned op = 0; op < instr->getNumOperands(); ++op)
+    copy->setOperand(op, Rematerialize(instr->getOperand(op), before, region));
+  copy->insertBefore(before);
+  if (instr->hasName())
+    copy->setName(instr->getName() + ".remat");
+
+  rematerializedValues[key] = copy;
+  return copy;
+}
+
 bool
 WorkitemLoops::ShouldNotBeContextSaved(llvm::Instruction *instr)
 {
@@ -948,12 +1321,7 @@ WorkitemLoops::ShouldNotBeContextSaved(llvm::Instruction *instr)
     */
   if (isa<BranchInst>(instr)) return true;
 
-    llvm::LoadInst *load = dyn_cast<llvm::LoadInst>(instr);
-    if (load != NULL &&
-        (load->getPointerOperand() == localIdZ ||
-         load->getPointerOperand() == localIdY ||
-         load->getPointerOperand() == localIdX))
-      return true;
+    if (IsLocalIdLoad(instr)) return true;
 
     VariableUniformityAnalysis &VUA = 
       getAnalysis<VariableUniformityAnalysis>();
@@ -55,6 +55,7 @@ namespace pocl {
   private:
 
     typedef std::vector<llvm::BasicBlock *> BasicBlockVector;
+    typedef std::set<llvm::BasicBlock *> BasicBlockSet;
     typedef std::set<llvm::Instruction* > InstructionIndex;
     typedef std::vector<llvm::Instruction* > InstructionVec;
     typedef std::map<std::string, llvm::Instruction*> StrInstructionMap;
@@ -73,7 +74,8 @@ namespace pocl {
     virtual bool ProcessFunction(llvm::Function &F);
 
     void FixMultiRegionVariables(ParallelRegion *region);
-    void AddContextSaveRestore(llvm::Instruction *instruction);
+    void AddContextSaveRestore
+        (llvm::Instruction *instruction, ParallelRegion *definingRegion);
 
     llvm::Instruction *AddContextSave(llvm::Instruction *instruction, llvm::Instruction *alloca);
     llvm::Instruction *AddContextRestore
@@ -81,12 +83,19 @@ namespace pocl {
          llvm::Instruction *before=NULL, 
          bool isAlloca=false);
     llvm::Instruction *GetContextArray(llvm::Instruction *val);
+    bool ContextArrayAccesses
+        (llvm::Instruction *alloca, BasicBlockSet &saves,
+         BasicBlockSet &restores);
+    void ShareContextArrays();
+    llvm::Value *GetContextArraySlot
+        (llvm::Instruction *alloca, llvm::Instruction *before,
+         ParallelRegion *region);
 
     std::pair<llvm::BasicBlock *, llvm::BasicBlock *>
     CreateLoopAround
         (ParallelRegion &region, llvm::BasicBlock *entryBB, llvm::BasicBlock *exitBB, 
          bool peeledFirst, llvm::Value *localIdVar, size_t LocalSizeForDim,
-         bool addIncBlock=true);
+         llvm::Value *localSizeVar, bool addIncBlock=true);
 
     llvm::BasicBlock *
       AppendIncBlock
@@ -97,12 +106,28 @@ namespace pocl {
 
     bool ShouldNotBeContextSaved(llvm::Instruction *instr);
 
+    int RematerializationCost(llvm::Value *val);
+    llvm::Value *Rematerialize
+        (llvm::Value *val, llvm::Instruction *before, ParallelRegion *region);
+    llvm::Instruction *RegionRestorePoint(ParallelRegion *region);
+    bool IsLocalIdLoad(llvm::Instruction *instr);
+
     std::map<llvm::Instruction*, unsigned> tempInstructionIds;
     size_t tempInstructionIndex;
     // An alloca in the kernel which stores the first iteration to execute
     // in the inner (dimension 0) loop. This is set to 1 in an peeled iteration
     // to skip the 0, 0, 0 iteration in the loops.
     llvm::Value *localIdXFirstVar;
+    // The number of work-items in the work-group computed in the entry
+    // block in case of a dynamic local size. Sizes the context arrays.
+    llvm::Instruction *workItemCountVar;
+    // The instruction in each region entry block before which the context
+    // restores and the rematerialized values of the region are inserted.
+    std::map<llvm::BasicBlock*, llvm::Instruction*> restorePoints;
+    // The values recomputed in each region instead of restoring them
+    // from a context array.
+    std::map<std::pair<ParallelRegion*, llvm::Value*>, llvm::Value*>
+      rematerializedValues;
   };
 }
 
@@ -0,0 +1,329 @@
+/* Tests the buffer allocator of the device with concurrent allocations of
+   mixed sizes
+
+   Copyright (c) 2015 pocl developers
+   
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+   
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+   
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+   THE SOFTWARE.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <CL/opencl.h>
+#include "poclu.h"
+#include "pocl_tests.h"
+#include "config.h"
+
+#define THREADS 4
+#define BUFFERS_PER_THREAD 32
+#define CHURN_ROUNDS 8
+/* Every LARGE_EVERY'th buffer of a thread is a large one. */
+#define LARGE_EVERY 8
+#define SMALL_MAX_SIZE (16 * 1024)
+#define LARGE_MAX_SIZE (128 * 1024)
+
+typedef struct
+{
+  cl_context context;
+  cl_command_queue queue;
+  unsigned id;
+  unsigned seed;
+  unsigned next_key;
+  cl_mem buffers[BUFFERS_PER_THREAD];
+  size_t sizes[BUFFERS_PER_THREAD];
+  unsigned keys[BUFFERS_PER_THREAD];
+  char *addresses[BUFFERS_PER_THREAD];
+  int status;
+} thread_state;
+
+/* A small LCG to get the same sequence of sizes on every platform. */
+static unsigned
+next_random (unsigned *seed)
+{
+  *seed = *seed * 1103515245u + 12345u;
+  return (*seed >> 8) & 0xffffff;
+}
+
+/* The contents of the buffer with the given key. */
+static unsigned char
+pattern_byte (unsigned key, size_t i)
+{
+  unsigned x = key * 2654435761u + (unsigned)i;
+  return (unsigned char)(x ^ (x >> 11));
+}
+
+static int
+overlaps (const char *a, size_t a_size, const char *b, size_t b_size)
+{
+  return a < b + b_size && b < a + a_size;
+}
+
+#ifdef CUSTOM_BUFFER_ALLOCATOR
+/* The number of the recorded buffers the given memory overlaps. */
+static unsigned
+count_overlapping (const thread_state *states, const char *ptr, size_t size)
+{
+  unsigned t, i, count = 0;
+  for (t = 0; t < THREADS; ++t)
+    for (i = 0; i < BUFFERS_PER_THREAD; ++i)
+      if (overlaps (ptr, size, states[t].addresses[i], states[t].sizes[i]))
+        ++count;
+  return count;
+}
+#endif
+
+/* Creates a buffer of a random size and fills it with its pattern. */
+static int
+create_buffer (thread_state *s, unsigned i)
+{
+  cl_int err;
+  unsigned char *data;
+  size_t j, max_size =
+    (i % LARGE_EVERY == 0) ? LARGE_MAX_SIZE : SMALL_MAX_SIZE;
+
+  s->sizes[i] = 1 + next_random (&s->seed) % max_size;
+  s->keys[i] = s->id << 16 | s->next_key++;
+  s->buffers[i] = clCreateBuffer(s->context, CL_MEM_READ_WRITE, s->sizes[i],
+                                 NULL, &err);
+  CHECK_OPENCL_ERROR_IN("clCreateBuffer");
+
+  data = (unsigned char*)malloc (s->sizes[i]);
+  TEST_ASSERT(data != NULL);
+  for (j = 0; j < s->sizes[i]; ++j)
+    data[j] = pattern_byte (s->keys[i], j);
+  err = clEnqueueWriteBuffer(s->queue, s->buffers[i], CL_TRUE, 0,
+                             s->sizes[i], data, 0, NULL, NULL);
+  free (data);
+  CHECK_OPENCL_ERROR_IN("clEnqueueWriteBuffer");
+  return EXIT_SUCCESS;
+}
+
+/* Checks that no other buffer has overwritten the contents of the
+   buffer. */
+static int
+check_buffer (thread_state *s, unsigned i)
+{
+  cl_int err;
+  unsigned char *data;
+  size_t j;
+
+  data = (unsigned char*)malloc (s->sizes[i]);
+  TEST_ASSERT(data != NULL);
+  err = clEnqueueReadBuffer(s->queue, s->buffers[i], CL_TRUE, 0,
+                            s->sizes[i], data, 0, NULL, NULL);
+  CHECK_OPENCL_ERROR_IN("clEnqueueReadBuffer");
+  for (j = 0; j < s->sizes[i]; ++j)
+    {
+      if (data[j] != pattern_byte (s->keys[i], j))
+        {
+          printf ("FAIL: byte %zu of buffer %u of thread %u (%zu bytes) "
+                  "was overwritten\n", j, i, s->id, s->sizes[i]);
+          free (data);
+          return EXIT_FAILURE;
+        }
+    }
+  free (data);
+  return EXIT_SUCCESS;
+}
+
+static int
+check_buffers (thread_state *s)
+{
+  unsigned i;
+  for (i = 0; i < BUFFERS_PER_THREAD; ++i)
+    TEST_ASSERT(check_buffer (s, i) == EXIT_SUCCESS);
+  return EXIT_SUCCESS;
+}
+
+/* Releases every step'th buffer starting from the first one. The queue
+   is finished first so that the commands have dropped their references
+   and the memory is freed by this thread: the allocator returns the
+   blocks cached by a thread to the shared free lists when the thread
+   exits. */
+static int
+release_buffers (thread_state *s, unsigned first, unsigned step)
+{
+  cl_int err;
+  unsigned i;
+
+  err = clFinish(s->queue);
+  CHECK_OPENCL_ERROR_IN("clFinish");
+  for (i = first; i < BUFFERS_PER_THREAD; i += step)
+    {
+      err = clReleaseMemObject(s->buffers[i]);
+      CHECK_OPENCL_ERROR_IN("clReleaseMemObject");
+      s->buffers[i] = NULL;
+    }
+  return EXIT_SUCCESS;
+}
+
+/* Replaces half of the buffers in each round and records the addresses
+   of the final ones. */
+static int
+churn (thread_state *s)
+{
+  cl_int err;
+  unsigned round, i;
+  void *ptr;
+
+  for (i = 0; i < BUFFERS_PER_THREAD; ++i)
+    TEST_ASSERT(create_buffer (s, i) == EXIT_SUCCESS);
+
+  for (round = 1; round < CHURN_ROUNDS; ++round)
+    {
+      TEST_ASSERT(check_buffers (s) == EXIT_SUCCESS);
+      TEST_ASSERT(release_buffers (s, round & 1, 2) == EXIT_SUCCESS);
+      for (i = round & 1; i < BUFFERS_PER_THREAD; i += 2)
+        TEST_ASSERT(create_buffer (s, i) == EXIT_SUCCESS);
+    }
+  TEST_ASSERT(check_buffers (s) == EXIT_SUCCESS);
+
+  for (i = 0; i < BUFFERS_PER_THREAD; ++i)
+    {
+      ptr = clEnqueueMapBuffer(s->queue, s->buffers[i], CL_TRUE, CL_MAP_READ,
+                               0, s->sizes[i], 0, NULL, NULL, &err);
+      CHECK_OPENCL_ERROR_IN("clEnqueueMapBuffer");
+      s->addresses[i] = (char*)ptr;
+      err = clEnqueueUnmapMemObject(s->queue, s->buffers[i], ptr, 0, NULL,
+                                    NULL);
+      CHECK_OPENCL_ERROR_IN("clEnqueueUnmapMemObject");
+    }
+  err = clFinish(s->queue);
+  CHECK_OPENCL_ERROR_IN("clFinish");
+  return EXIT_SUCCESS;
+}
+
+/* Checks the buffers once all the threads have written theirs, then
+   releases them. */
+static int
+check_and_release (thread_state *s)
+{
+  TEST_ASSERT(check_buffers (s) == EXIT_SUCCESS);
+  return release_buffers (s, 0, 1);
+}
+
+static void *
+churn_thread (void *data)
+{
+  thread_state *s = (thread_state*)data;
+  s->status = churn (s);
+  return NULL;
+}
+
+static void *
+release_thread (void *data)
+{
+  thread_state *s = (thread_state*)data;
+  s->status = check_and_release (s);
+  return NULL;
+}
+
+static int
+run_threads (thread_state *states, void *(*func) (void *))
+{
+  pthread_t threads[THREADS];
+  unsigned t;
+
+  for (t = 0; t < THREADS; ++t)
+    TEST_ASSERT(pthread_create (&threads[t], NULL, func, &states[t]) == 0);
+  for (t = 0; t < THREADS; ++t)
+    pthread_join (threads[t], NULL);
+  for (t = 0; t < THREADS; ++t)
+    TEST_ASSERT(states[t].status == EXIT_SUCCESS);
+  return EXIT_SUCCESS;
+}
+
+int main()
+{
+  cl_int err;
+  cl_context ctx;
+  cl_command_queue queue;
+  cl_device_id did;
+  cl_mem buf;
+  thread_state states[THREADS];
+  const thread_state *s, *o;
+  size_t total = 0;
+  unsigned t, i, u, j;
+  char *ptr;
+
+  poclu_get_any_device(&ctx, &did, &queue);
+  TEST_ASSERT(ctx);
+  TEST_ASSERT(did);
+  TEST_ASSERT(queue);
+
+  memset (states, 0, sizeof (states));
+  for (t = 0; t < THREADS; ++t)
+    {
+      states[t].context = ctx;
+      states[t].queue = clCreateCommandQueue(ctx, did, 0, &err);
+      CHECK_OPENCL_ERROR_IN("clCreateCommandQueue");
+      states[t].id = t;
+      states[t].seed = t + 1;
+    }
+
+  TEST_ASSERT(run_threads (states, churn_thread) == EXIT_SUCCESS);
+
+  /* The buffers that are alive at the same time must not overlap. */
+  for (t = 0; t < THREADS; ++t)
+    for (i = 0; i < BUFFERS_PER_THREAD; ++i)
+      {
+        s = &states[t];
+        total += s->sizes[i];
+        for (u = t; u < THREADS; ++u)
+          for (j = (u == t ? i + 1 : 0); j < BUFFERS_PER_THREAD; ++j)
+            {
+              o = &states[u];
+              if (overlaps (s->addresses[i], s->sizes[i],
+                            o->addresses[j], o->sizes[j]))
+                {
+                  printf ("FAIL: buffer %u of thread %u overlaps buffer %u "
+                          "of thread %u\n", i, t, j, u);
+                  return EXIT_FAILURE;
+                }
+            }
+      }
+
+  TEST_ASSERT(run_threads (states, release_thread) == EXIT_SUCCESS);
+
+  /* All the buffers have been released, thus one buffer as large as all
+     of them together should fit in the memory they used. */
+  buf = clCreateBuffer(ctx, CL_MEM_READ_WRITE, total, NULL, &err);
+  CHECK_OPENCL_ERROR_IN("clCreateBuffer");
+  ptr = (char*)clEnqueueMapBuffer(queue, buf, CL_TRUE, CL_MAP_WRITE, 0,
+                                  total, 0, NULL, NULL, &err);
+  CHECK_OPENCL_ERROR_IN("clEnqueueMapBuffer");
+#ifdef CUSTOM_BUFFER_ALLOCATOR
+  /* The buffers of the pthread device come from the region allocator,
+     which must have merged the freed neighbours back to larger blocks. */
+  TEST_ASSERT(count_overlapping (states, ptr, total) >= 2);
+#endif
+  err = clEnqueueUnmapMemObject(queue, buf, ptr, 0, NULL, NULL);
+  CHECK_OPENCL_ERROR_IN("clEnqueueUnmapMemObject");
+  err = clFinish(queue);
+  CHECK_OPENCL_ERROR_IN("clFinish");
+
+  clReleaseMemObject(buf);
+  for (t = 0; t < THREADS; ++t)
+    clReleaseCommandQueue(states[t].queue);
+  clReleaseCommandQueue(queue);
+  clReleaseContext(ctx);
+
+  printf("OK\n");
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,123 @@
+/* Tests the cl_pocl_memory_placement buffer flags
+
+   Copyright (c) 2015 pocl developers
+   
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+   
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+   
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+   THE SOFTWARE.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <CL/opencl.h>
+#include "poclu.h"
+#include "pocl_tests.h"
+
+/* Large enough to get huge pages also without CL_MEM_HUGE_PAGES_POCL. */
+#define BUF_SIZE (9 * 1024 * 1024 + 100)
+#define SMALL_BUF_SIZE 1000
+
+/* Copies host data through two buffers with the given flags and checks
+   that it survives the round trip. */
+static int
+test_placement (cl_context ctx, cl_command_queue queue,
+                cl_mem_flags flags, size_t size)
+{
+  cl_int err;
+  cl_mem src, dst;
+  cl_mem_flags queried;
+  unsigned *host, *result;
+  size_t i, n = size / sizeof (unsigned);
+
+  host = (unsigned*)malloc (n * sizeof (unsigned));
+  result = (unsigned*)malloc (n * sizeof (unsigned));
+  TEST_ASSERT(host != NULL && result != NULL);
+  for (i = 0; i < n; ++i)
+    host[i] = (unsigned)(i * 2654435761u);
+
+  src = clCreateBuffer(ctx, CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR | flags,
+                       n * sizeof (unsigned), host, &err);
+  CHECK_OPENCL_ERROR_IN("clCreateBuffer");
+  dst = clCreateBuffer(ctx, CL_MEM_READ_WRITE | flags,
+                       n * sizeof (unsigned), NULL, &err);
+  CHECK_OPENCL_ERROR_IN("clCreateBuffer");
+
+  err = clGetMemObjectInfo(dst, CL_MEM_FLAGS, sizeof (queried), &queried,
+                           NULL);
+  CHECK_OPENCL_ERROR_IN("clGetMemObjectInfo");
+  TEST_ASSERT(queried == (CL_MEM_READ_WRITE | flags));
+
+  err = clEnqueueCopyBuffer(queue, src, dst, 0, 0, n * sizeof (unsigned),
+                            0, NULL, NULL);
+  CHECK_OPENCL_ERROR_IN("clEnqueueCopyBuffer");
+  err = clEnqueueReadBuffer(queue, dst, CL_TRUE, 0, n * sizeof (unsigned),
+                            result, 0, NULL, NULL);
+  CHECK_OPENCL_ERROR_IN("clEnqueueReadBuffer");
+
+  if (memcmp (host, result, n * sizeof (unsigned)) != 0)
+    {
+      printf ("FAIL: flags %lx size %zu\n", (unsigned long)flags, size);
+      return EXIT_FAILURE;
+    }
+
+  clReleaseMemObject(src);
+  clReleaseMemObject(dst);
+  free (host);
+  free (result);
+  return EXIT_SUCCESS;
+}
+
+int main()
+{
+  cl_int err;
+  cl_context ctx;
+  cl_command_queue queue;
+  cl_device_id did;
+  cl_mem buf;
+  const cl_mem_flags placements[] = {
+    0,
+    CL_MEM_HUGE_PAGES_POCL,
+    CL_MEM_NUMA_INTERLEAVED_POCL,
+    CL_MEM_NUMA_LOCAL_POCL,
+    CL_MEM_HUGE_PAGES_POCL | CL_MEM_NUMA_INTERLEAVED_POCL
+  };
+  unsigned i;
+
+  poclu_get_any_device(&ctx, &did, &queue);
+  TEST_ASSERT(ctx);
+  TEST_ASSERT(did);
+  TEST_ASSERT(queue);
+
+  for (i = 0; i < sizeof (placements) / sizeof (placements[0]); ++i)
+    {
+      TEST_ASSERT(test_placement (ctx, queue, placements[i], BUF_SIZE)
+                  == EXIT_SUCCESS);
+      TEST_ASSERT(test_placement (ctx, queue, placements[i], SMALL_BUF_SIZE)
+                  == EXIT_SUCCESS);
+    }
+
+  /* The NUMA policies are mutually exclusive. */
+  buf = clCreateBuffer(ctx, CL_MEM_READ_WRITE | CL_MEM_NUMA_INTERLEAVED_POCL
+                       | CL_MEM_NUMA_LOCAL_POCL, SMALL_BUF_SIZE, NULL, &err);
+  TEST_ASSERT(buf == NULL && err == CL_INVALID_VALUE);
+
+  clReleaseCommandQueue(queue);
+  clReleaseContext(ctx);
+
+  printf("OK\n");
+  return EXIT_SUCCESS;
+}
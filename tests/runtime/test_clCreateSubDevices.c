@@ -0,0 +1,248 @@
+/* Tests partitioning a device with clCreateSubDevices
+
+   Copyright (c) 2015 pocl developers
+   
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+   
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+   
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+   THE SOFTWARE.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <CL/opencl.h>
+#include "poclu.h"
+#include "pocl_tests.h"
+
+#define WORK_ITEMS 1024
+#define RELEASE_CYCLES 8
+
+static const char *source =
+  "kernel void\n"
+  "fill (global uint *out)\n"
+  "{\n"
+  "  out[get_global_id (0)] = get_global_id (0) * 3;\n"
+  "}\n";
+
+/* Runs a small kernel on the sub-device and checks its results. */
+static int
+test_execute (cl_device_id sub)
+{
+  cl_int err;
+  cl_context ctx;
+  cl_command_queue queue;
+  cl_program program;
+  cl_kernel kernel;
+  cl_mem buf;
+  cl_uint result[WORK_ITEMS];
+  size_t global = WORK_ITEMS, i;
+
+  ctx = clCreateContext(NULL, 1, &sub, NULL, NULL, &err);
+  CHECK_OPENCL_ERROR_IN("clCreateContext");
+  queue = clCreateCommandQueue(ctx, sub, 0, &err);
+  CHECK_OPENCL_ERROR_IN("clCreateCommandQueue");
+  program = clCreateProgramWithSource(ctx, 1, &source, NULL, &err);
+  CHECK_OPENCL_ERROR_IN("clCreateProgramWithSource");
+  err = clBuildProgram(program, 1, &sub, NULL, NULL, NULL);
+  CHECK_OPENCL_ERROR_IN("clBuildProgram");
+  kernel = clCreateKernel(program, "fill", &err);
+  CHECK_OPENCL_ERROR_IN("clCreateKernel");
+  buf = clCreateBuffer(ctx, CL_MEM_WRITE_ONLY, sizeof (result), NULL, &err);
+  CHECK_OPENCL_ERROR_IN("clCreateBuffer");
+
+  err = clSetKernelArg(kernel, 0, sizeof (cl_mem), &buf);
+  CHECK_OPENCL_ERROR_IN("clSetKernelArg");
+  err = clEnqueueNDRangeKernel(queue, kernel, 1, NULL, &global, NULL,
+                               0, NULL, NULL);
+  CHECK_OPENCL_ERROR_IN("clEnqueueNDRangeKernel");
+  err = clEnqueueReadBuffer(queue, buf, CL_TRUE, 0, sizeof (result),
+                            result, 0, NULL, NULL);
+  CHECK_OPENCL_ERROR_IN("clEnqueueReadBuffer");
+
+  for (i = 0; i < WORK_ITEMS; ++i)
+    TEST_ASSERT(result[i] == i * 3);
+
+  clReleaseMemObject(buf);
+  clReleaseKernel(kernel);
+  clReleaseProgram(program);
+  clReleaseCommandQueue(queue);
+  clReleaseContext(ctx);
+  return EXIT_SUCCESS;
+}
+
+/* Checks the queries of a sub-device created with the given properties. */
+static int
+test_sub_device (cl_device_id parent, cl_device_id sub,
+                 const cl_device_partition_property *properties,
+                 size_t num_properties, cl_uint compute_units)
+{
+  cl_int err;
+  cl_device_id queried_parent;
+  cl_device_partition_property type[8];
+  cl_uint units;
+  size_t size;
+
+  err = clGetDeviceInfo(sub, CL_DEVICE_PARENT_DEVICE, sizeof (queried_parent),
+                        &queried_parent, NULL);
+  CHECK_OPENCL_ERROR_IN("clGetDeviceInfo");
+  TEST_ASSERT(queried_parent == parent);
+
+  err = clGetDeviceInfo(sub, CL_DEVICE_MAX_COMPUTE_UNITS, sizeof (units),
+                        &units, NULL);
+  CHECK_OPENCL_ERROR_IN("clGetDeviceInfo");
+  TEST_ASSERT(units == compute_units);
+
+  err = clGetDeviceInfo(sub, CL_DEVICE_PARTITION_TYPE, sizeof (type), type,
+                        &size);
+  CHECK_OPENCL_ERROR_IN("clGetDeviceInfo");
+  TEST_ASSERT(size == (num_properties + 1) * sizeof (type[0]));
+  TEST_ASSERT(memcmp (type, properties, num_properties * sizeof (type[0]))
+              == 0);
+  TEST_ASSERT(type[num_properties] == 0);
+  return EXIT_SUCCESS;
+}
+
+static int
+supports (const cl_device_partition_property *supported,
+          cl_device_partition_property type)
+{
+  for (; *supported != 0; ++supported)
+    if (*supported == type)
+      return 1;
+  return 0;
+}
+
+int main()
+{
+  cl_int err;
+  cl_context ctx;
+  cl_command_queue queue;
+  cl_device_id did, parent;
+  cl_device_id *subs;
+  cl_device_partition_property supported[8];
+  cl_uint units, max_subs, num_subs, i;
+
+  poclu_get_any_device(&ctx, &did, &queue);
+  TEST_ASSERT(ctx);
+  TEST_ASSERT(did);
+  TEST_ASSERT(queue);
+
+  err = clGetDeviceInfo(did, CL_DEVICE_PARENT_DEVICE, sizeof (parent),
+                        &parent, NULL);
+  CHECK_OPENCL_ERROR_IN("clGetDeviceInfo");
+  TEST_ASSERT(parent == NULL);
+
+  err = clGetDeviceInfo(did, CL_DEVICE_MAX_COMPUTE_UNITS, sizeof (units),
+                        &units, NULL);
+  CHECK_OPENCL_ERROR_IN("clGetDeviceInfo");
+  err = clGetDeviceInfo(did, CL_DEVICE_PARTITION_MAX_SUB_DEVICES,
+                        sizeof (max_subs), &max_subs, NULL);
+  CHECK_OPENCL_ERROR_IN("clGetDeviceInfo");
+  err = clGetDeviceInfo(did, CL_DEVICE_PARTITION_PROPERTIES,
+                        sizeof (supported), supported, NULL);
+  CHECK_OPENCL_ERROR_IN("clGetDeviceInfo");
+
+  if (max_subs == 0)
+    {
+      /* Devices that cannot be partitioned must say so. */
+      const cl_device_partition_property props[] =
+        {CL_DEVICE_PARTITION_EQUALLY, 1, 0};
+      TEST_ASSERT(supported[0] == 0);
+      err = clCreateSubDevices(did, props, 0, NULL, &num_subs);
+      TEST_ASSERT(err == CL_INVALID_VALUE);
+    }
+  else
+    {
+      const cl_device_partition_property equally[] =
+        {CL_DEVICE_PARTITION_EQUALLY, 1, 0};
+      const cl_device_partition_property by_counts[] =
+        {CL_DEVICE_PARTITION_BY_COUNTS, units,
+         CL_DEVICE_PARTITION_BY_COUNTS_LIST_END, 0};
+      const cl_device_partition_property too_many[] =
+        {CL_DEVICE_PARTITION_BY_COUNTS, units + 1,
+         CL_DEVICE_PARTITION_BY_COUNTS_LIST_END, 0};
+      const cl_device_partition_property by_affinity[] =
+        {CL_DEVICE_PARTITION_BY_AFFINITY_DOMAIN,
+         CL_DEVICE_AFFINITY_DOMAIN_NEXT_PARTITIONABLE, 0};
+
+      TEST_ASSERT(max_subs == units);
+      TEST_ASSERT(supports (supported, CL_DEVICE_PARTITION_EQUALLY));
+      TEST_ASSERT(supports (supported, CL_DEVICE_PARTITION_BY_COUNTS));
+      subs = (cl_device_id*)malloc (units * sizeof (cl_device_id));
+      TEST_ASSERT(subs != NULL);
+
+      /* One compute unit per sub-device. */
+      err = clCreateSubDevices(did, equally, 0, NULL, &num_subs);
+      CHECK_OPENCL_ERROR_IN("clCreateSubDevices");
+      TEST_ASSERT(num_subs == units);
+      err = clCreateSubDevices(did, equally, num_subs, subs, NULL);
+      CHECK_OPENCL_ERROR_IN("clCreateSubDevices");
+      for (i = 0; i < num_subs; ++i)
+        TEST_ASSERT(test_sub_device (did, subs[i], equally, 2, 1)
+                    == EXIT_SUCCESS);
+      TEST_ASSERT(test_execute (subs[num_subs - 1]) == EXIT_SUCCESS);
+      for (i = 0; i < num_subs; ++i)
+        {
+          err = clReleaseDevice(subs[i]);
+          CHECK_OPENCL_ERROR_IN("clReleaseDevice");
+        }
+
+      /* All the compute units in a single sub-device. */
+      err = clCreateSubDevices(did, by_counts, 1, subs, &num_subs);
+      CHECK_OPENCL_ERROR_IN("clCreateSubDevices");
+      TEST_ASSERT(num_subs == 1);
+      TEST_ASSERT(test_sub_device (did, subs[0], by_counts, 3, units)
+                  == EXIT_SUCCESS);
+      TEST_ASSERT(test_execute (subs[0]) == EXIT_SUCCESS);
+      err = clReleaseDevice(subs[0]);
+      CHECK_OPENCL_ERROR_IN("clReleaseDevice");
+
+      /* Released sub-devices stop their executor threads, repeated
+         create/use/release cycles must keep working. */
+      for (i = 0; i < RELEASE_CYCLES; ++i)
+        {
+          err = clCreateSubDevices(did, by_counts, 1, subs, NULL);
+          CHECK_OPENCL_ERROR_IN("clCreateSubDevices");
+          TEST_ASSERT(test_execute (subs[0]) == EXIT_SUCCESS);
+          err = clReleaseDevice(subs[0]);
+          CHECK_OPENCL_ERROR_IN("clReleaseDevice");
+        }
+
+      err = clCreateSubDevices(did, too_many, 1, subs, NULL);
+      TEST_ASSERT(err == CL_INVALID_DEVICE_PARTITION_COUNT);
+
+      /* Whether the host has more than one cache or NUMA domain varies. */
+      if (supports (supported, CL_DEVICE_PARTITION_BY_AFFINITY_DOMAIN))
+        {
+          err = clCreateSubDevices(did, by_affinity, units, subs,
+                                   &num_subs);
+          TEST_ASSERT(err == CL_SUCCESS || err == CL_DEVICE_PARTITION_FAILED);
+          if (err == CL_SUCCESS)
+            {
+              TEST_ASSERT(num_subs > 1);
+              for (i = 0; i < num_subs; ++i)
+                clReleaseDevice(subs[i]);
+            }
+        }
+      free (subs);
+    }
+
+  clReleaseCommandQueue(queue);
+  clReleaseContext(ctx);
+
+  printf("OK\n");
+  return EXIT_SUCCESS;
+}
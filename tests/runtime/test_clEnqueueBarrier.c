@@ -0,0 +1,135 @@
+/* Tests out-of-order command queues and clEnqueueBarrier
+
+   Copyright (c) 2015 pocl developers
+   
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+   
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+   
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+   THE SOFTWARE.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <CL/opencl.h>
+#include "poclu.h"
+#include "pocl_tests.h"
+
+#define BUF_SIZE 1024
+#define MAX_POLLS 10000
+#define POLL_INTERVAL_US 1000
+
+static cl_int
+poll_event (cl_event event)
+{
+  cl_int status = CL_QUEUED;
+  int i;
+  for (i = 0; i < MAX_POLLS; ++i)
+    {
+      if (clGetEventInfo (event, CL_EVENT_COMMAND_EXECUTION_STATUS,
+                          sizeof (cl_int), &status, NULL) != CL_SUCCESS)
+        return -1;
+      if (status == CL_COMPLETE || status < 0)
+        break;
+      usleep (POLL_INTERVAL_US);
+    }
+  return status;
+}
+
+int main()
+{
+  cl_int err;
+  cl_context ctx;
+  cl_command_queue in_order_queue, queue;
+  cl_device_id did;
+  cl_mem buf_a, buf_b;
+  cl_event user_event, event_a, event_b, event_c;
+  cl_int status;
+  cl_int src_a[BUF_SIZE], src_b[BUF_SIZE], dst[BUF_SIZE];
+  int i;
+
+  poclu_get_any_device(&ctx, &did, &in_order_queue);
+  TEST_ASSERT(ctx);
+  TEST_ASSERT(did);
+  TEST_ASSERT(in_order_queue);
+
+  queue = clCreateCommandQueue(ctx, did, 
+                               CL_QUEUE_OUT_OF_ORDER_EXEC_MODE_ENABLE, &err);
+  CHECK_OPENCL_ERROR_IN("clCreateCommandQueue");
+
+  for (i = 0; i < BUF_SIZE; ++i)
+    {
+      src_a[i] = i;
+      src_b[i] = -i;
+    }
+
+  buf_a = clCreateBuffer(ctx, CL_MEM_READ_WRITE, sizeof(src_a), NULL, &err);
+  CHECK_OPENCL_ERROR_IN("clCreateBuffer");
+  buf_b = clCreateBuffer(ctx, CL_MEM_READ_WRITE, sizeof(src_b), NULL, &err);
+  CHECK_OPENCL_ERROR_IN("clCreateBuffer");
+
+  user_event = clCreateUserEvent(ctx, &err);
+  CHECK_OPENCL_ERROR_IN("clCreateUserEvent");
+
+  err = clEnqueueWriteBuffer(queue, buf_a, CL_FALSE, 0, sizeof(src_a), src_a,
+                             1, &user_event, &event_a);
+  CHECK_OPENCL_ERROR_IN("clEnqueueWriteBuffer");
+
+  /* Does not depend on the blocked write, must be able to complete. */
+  err = clEnqueueWriteBuffer(queue, buf_b, CL_FALSE, 0, sizeof(src_b), src_b,
+                             0, NULL, &event_b);
+  CHECK_OPENCL_ERROR_IN("clEnqueueWriteBuffer");
+  TEST_ASSERT(poll_event(event_b) == CL_COMPLETE);
+
+  /* The read after the barrier must wait for the blocked write. */
+  err = clEnqueueBarrier(queue);
+  CHECK_OPENCL_ERROR_IN("clEnqueueBarrier");
+  err = clEnqueueReadBuffer(queue, buf_b, CL_FALSE, 0, sizeof(dst), dst,
+                            0, NULL, &event_c);
+  CHECK_OPENCL_ERROR_IN("clEnqueueReadBuffer");
+
+  usleep (10 * POLL_INTERVAL_US);
+  err = clGetEventInfo(event_c, CL_EVENT_COMMAND_EXECUTION_STATUS,
+                       sizeof(cl_int), &status, NULL);
+  CHECK_OPENCL_ERROR_IN("clGetEventInfo");
+  TEST_ASSERT(status != CL_COMPLETE);
+
+  err = clSetUserEventStatus(user_event, CL_COMPLETE);
+  CHECK_OPENCL_ERROR_IN("clSetUserEventStatus");
+
+  err = clFinish(queue);
+  CHECK_OPENCL_ERROR_IN("clFinish");
+  TEST_ASSERT(memcmp(src_b, dst, sizeof(dst)) == 0);
+
+  err = clEnqueueReadBuffer(queue, buf_a, CL_TRUE, 0, sizeof(dst), dst,
+                            0, NULL, NULL);
+  CHECK_OPENCL_ERROR_IN("clEnqueueReadBuffer");
+  TEST_ASSERT(memcmp(src_a, dst, sizeof(dst)) == 0);
+
+  clReleaseEvent(event_c);
+  clReleaseEvent(event_b);
+  clReleaseEvent(event_a);
+  clReleaseEvent(user_event);
+  clReleaseMemObject(buf_b);
+  clReleaseMemObject(buf_a);
+  clReleaseCommandQueue(queue);
+  clReleaseCommandQueue(in_order_queue);
+  clReleaseContext(ctx);
+
+  printf("OK\n");
+  return EXIT_SUCCESS;
+}
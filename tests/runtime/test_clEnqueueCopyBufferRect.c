@@ -0,0 +1,149 @@
+/* Tests clEnqueue{Read,Write,Copy}BufferRect
+
+   Copyright (c) 2015 pocl developers
+   
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+   
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+   
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+   THE SOFTWARE.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <CL/opencl.h>
+#include "poclu.h"
+#include "pocl_tests.h"
+
+/* Copies a rect region between two host arrays, the reference for the
+   device transfers. */
+static void
+copy_rect_ref (unsigned char *dst, const unsigned char *src,
+               const size_t *dst_origin, const size_t *src_origin,
+               const size_t *region, size_t dst_row_pitch,
+               size_t dst_slice_pitch, size_t src_row_pitch,
+               size_t src_slice_pitch)
+{
+  size_t y, z;
+  for (z = 0; z < region[2]; ++z)
+    for (y = 0; y < region[1]; ++y)
+      memcpy (dst + dst_origin[0] + (dst_origin[1] + y) * dst_row_pitch
+              + (dst_origin[2] + z) * dst_slice_pitch,
+              src + src_origin[0] + (src_origin[1] + y) * src_row_pitch
+              + (src_origin[2] + z) * src_slice_pitch, region[0]);
+}
+
+/* Writes a rect of a host array to a buffer, copies it within the buffer
+   to another buffer and reads a rect of that back, comparing the results
+   to the same transfers done on the host. */
+static int
+test_rect (cl_context ctx, cl_command_queue queue, const size_t *dims,
+           const size_t *origin, const size_t *region)
+{
+  cl_int err;
+  cl_mem src_buf, dst_buf;
+  size_t size = dims[0] * dims[1] * dims[2];
+  size_t row_pitch = dims[0], slice_pitch = dims[0] * dims[1];
+  size_t zero[3] = {0, 0, 0};
+  unsigned char *host, *src, *dst, *result;
+  size_t i;
+
+  host = (unsigned char*)malloc (size);
+  src = (unsigned char*)calloc (size, 1);
+  dst = (unsigned char*)calloc (size, 1);
+  result = (unsigned char*)calloc (size, 1);
+  TEST_ASSERT(host && src && dst && result);
+
+  for (i = 0; i < size; ++i)
+    host[i] = (unsigned char)(i * 13 + i / 251);
+
+  src_buf = clCreateBuffer(ctx, CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR,
+                           size, src, &err);
+  CHECK_OPENCL_ERROR_IN("clCreateBuffer");
+  dst_buf = clCreateBuffer(ctx, CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR,
+                           size, dst, &err);
+  CHECK_OPENCL_ERROR_IN("clCreateBuffer");
+
+  /* host[origin] -> src_buf[zero] -> dst_buf[origin] -> result[zero] */
+  err = clEnqueueWriteBufferRect(queue, src_buf, CL_TRUE, zero, origin,
+                                 region, row_pitch, slice_pitch,
+                                 row_pitch, slice_pitch, host,
+                                 0, NULL, NULL);
+  CHECK_OPENCL_ERROR_IN("clEnqueueWriteBufferRect");
+  copy_rect_ref (src, host, zero, origin, region, row_pitch, slice_pitch,
+                 row_pitch, slice_pitch);
+
+  err = clEnqueueCopyBufferRect(queue, src_buf, dst_buf, zero, origin,
+                                region, row_pitch, slice_pitch,
+                                row_pitch, slice_pitch, 0, NULL, NULL);
+  CHECK_OPENCL_ERROR_IN("clEnqueueCopyBufferRect");
+  copy_rect_ref (dst, src, origin, zero, region, row_pitch, slice_pitch,
+                 row_pitch, slice_pitch);
+
+  err = clEnqueueReadBufferRect(queue, dst_buf, CL_TRUE, origin, zero,
+                                region, row_pitch, slice_pitch,
+                                row_pitch, slice_pitch, result,
+                                0, NULL, NULL);
+  CHECK_OPENCL_ERROR_IN("clEnqueueReadBufferRect");
+  memset (src, 0, size);
+  copy_rect_ref (src, dst, zero, origin, region, row_pitch, slice_pitch,
+                 row_pitch, slice_pitch);
+
+  TEST_ASSERT(memcmp (result, src, size) == 0);
+
+  clReleaseMemObject(src_buf);
+  clReleaseMemObject(dst_buf);
+  free (host);
+  free (src);
+  free (dst);
+  free (result);
+  return EXIT_SUCCESS;
+}
+
+int main()
+{
+  cl_context ctx;
+  cl_command_queue queue;
+  cl_device_id did;
+
+  /* A pitched 3D region. */
+  size_t dims[3] = {64, 32, 8};
+  size_t origin[3] = {5, 3, 2};
+  size_t region[3] = {40, 20, 5};
+  /* Whole rows, the slices of which are contiguous. */
+  size_t row_region[3] = {64, 32, 4};
+  size_t row_origin[3] = {0, 0, 1};
+  /* Large enough to be split to multiple threads by the pthread device. */
+  size_t large_dims[3] = {1024, 512, 8};
+  size_t large_origin[3] = {16, 8, 1};
+  size_t large_region[3] = {1000, 500, 6};
+
+  poclu_get_any_device(&ctx, &did, &queue);
+  TEST_ASSERT(ctx);
+  TEST_ASSERT(did);
+  TEST_ASSERT(queue);
+
+  TEST_ASSERT(test_rect (ctx, queue, dims, origin, region) == EXIT_SUCCESS);
+  TEST_ASSERT(test_rect (ctx, queue, dims, row_origin,
+                         row_region) == EXIT_SUCCESS);
+  TEST_ASSERT(test_rect (ctx, queue, large_dims, large_origin,
+                         large_region) == EXIT_SUCCESS);
+
+  clReleaseCommandQueue(queue);
+  clReleaseContext(ctx);
+
+  printf("OK\n");
+  return EXIT_SUCCESS;
+}
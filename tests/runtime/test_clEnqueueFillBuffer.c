@@ -0,0 +1,139 @@
+/* Tests clEnqueueFillBuffer
+
+   Copyright (c) 2015 pocl developers
+   
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+   
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+   
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+   THE SOFTWARE.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <CL/opencl.h>
+#include "poclu.h"
+#include "pocl_tests.h"
+
+#define BUF_SIZE 4096
+/* Large enough to be split to multiple threads by the pthread device. */
+#define LARGE_BUF_SIZE (16 * 1024 * 1024)
+#define SENTINEL 0xA5
+
+/* Fills [offset, offset + size) of a buffer initialized to SENTINEL and
+   checks that exactly that range was overwritten with the pattern. */
+static int
+test_fill (cl_context ctx, cl_command_queue queue, size_t buf_size,
+           size_t pattern_size, size_t offset, size_t size)
+{
+  cl_int err;
+  cl_mem buf;
+  unsigned char pattern[128];
+  unsigned char *host;
+  size_t i;
+
+  host = (unsigned char*)malloc (buf_size);
+  TEST_ASSERT(host != NULL);
+  memset (host, SENTINEL, buf_size);
+  for (i = 0; i < pattern_size; ++i)
+    pattern[i] = (unsigned char)(i * 7 + 1);
+
+  buf = clCreateBuffer(ctx, CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR,
+                       buf_size, host, &err);
+  CHECK_OPENCL_ERROR_IN("clCreateBuffer");
+
+  err = clEnqueueFillBuffer(queue, buf, pattern, pattern_size, offset, size,
+                            0, NULL, NULL);
+  CHECK_OPENCL_ERROR_IN("clEnqueueFillBuffer");
+
+  /* The pattern may be reused right after the call. */
+  memset (pattern, 0, sizeof (pattern));
+
+  memset (host, 0, buf_size);
+  err = clEnqueueReadBuffer(queue, buf, CL_TRUE, 0, buf_size, host,
+                            0, NULL, NULL);
+  CHECK_OPENCL_ERROR_IN("clEnqueueReadBuffer");
+
+  for (i = 0; i < buf_size; ++i)
+    {
+      unsigned char expected = SENTINEL;
+      if (i >= offset && i < offset + size)
+        expected = (unsigned char)(((i - offset) % pattern_size) * 7 + 1);
+      if (host[i] != expected)
+        {
+          printf ("FAIL: pattern size %zu offset %zu size %zu: byte %zu is "
+                  "%u, expected %u\n", pattern_size, offset, size, i,
+                  host[i], expected);
+          return EXIT_FAILURE;
+        }
+    }
+
+  clReleaseMemObject(buf);
+  free (host);
+  return EXIT_SUCCESS;
+}
+
+int main()
+{
+  cl_int err;
+  cl_context ctx;
+  cl_command_queue queue;
+  cl_device_id did;
+  cl_mem buf;
+  cl_int pattern = 0;
+  size_t pattern_size;
+
+  poclu_get_any_device(&ctx, &did, &queue);
+  TEST_ASSERT(ctx);
+  TEST_ASSERT(did);
+  TEST_ASSERT(queue);
+
+  for (pattern_size = 1; pattern_size <= 128; pattern_size *= 2)
+    {
+      TEST_ASSERT(test_fill (ctx, queue, BUF_SIZE, pattern_size,
+                             0, BUF_SIZE) == EXIT_SUCCESS);
+      TEST_ASSERT(test_fill (ctx, queue, BUF_SIZE, pattern_size,
+                             pattern_size * 3,
+                             BUF_SIZE - pattern_size * 8) == EXIT_SUCCESS);
+      TEST_ASSERT(test_fill (ctx, queue, BUF_SIZE, pattern_size,
+                             BUF_SIZE / 2, pattern_size) == EXIT_SUCCESS);
+    }
+
+  TEST_ASSERT(test_fill (ctx, queue, LARGE_BUF_SIZE, 4, 0,
+                         LARGE_BUF_SIZE) == EXIT_SUCCESS);
+  TEST_ASSERT(test_fill (ctx, queue, LARGE_BUF_SIZE, 16, 4096,
+                         LARGE_BUF_SIZE - 3 * 4096 - 16) == EXIT_SUCCESS);
+
+  /* Invalid pattern sizes and misaligned ranges. */
+  buf = clCreateBuffer(ctx, CL_MEM_READ_WRITE, BUF_SIZE, NULL, &err);
+  CHECK_OPENCL_ERROR_IN("clCreateBuffer");
+  TEST_ASSERT(clEnqueueFillBuffer(queue, buf, &pattern, 3, 0, 12,
+                                  0, NULL, NULL) == CL_INVALID_VALUE);
+  TEST_ASSERT(clEnqueueFillBuffer(queue, buf, &pattern, 4, 2, 8,
+                                  0, NULL, NULL) == CL_INVALID_VALUE);
+  TEST_ASSERT(clEnqueueFillBuffer(queue, buf, &pattern, 4, 0, 6,
+                                  0, NULL, NULL) == CL_INVALID_VALUE);
+  TEST_ASSERT(clEnqueueFillBuffer(queue, buf, &pattern, 4, 0, BUF_SIZE + 4,
+                                  0, NULL, NULL) == CL_INVALID_VALUE);
+  TEST_ASSERT(clEnqueueFillBuffer(queue, buf, NULL, 4, 0, 4,
+                                  0, NULL, NULL) == CL_INVALID_VALUE);
+  clReleaseMemObject(buf);
+
+  clReleaseCommandQueue(queue);
+  clReleaseContext(ctx);
+
+  printf("OK\n");
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,122 @@
+/* Tests the write-back of mapped buffer regions
+
+   Copyright (c) 2015 pocl developers
+   
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+   
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+   
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+   THE SOFTWARE.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <CL/opencl.h>
+#include "poclu.h"
+#include "pocl_tests.h"
+
+/* Spans several pages with a partial one at the end. */
+#define BUF_SIZE (5 * 4096 + 123)
+
+static int
+check_contents (cl_command_queue queue, cl_mem buf,
+                const unsigned char *expected)
+{
+  cl_int err;
+  unsigned char *result = (unsigned char*)malloc (BUF_SIZE);
+  TEST_ASSERT(result != NULL);
+
+  err = clEnqueueReadBuffer(queue, buf, CL_TRUE, 0, BUF_SIZE, result,
+                            0, NULL, NULL);
+  CHECK_OPENCL_ERROR_IN("clEnqueueReadBuffer");
+  TEST_ASSERT(memcmp (result, expected, BUF_SIZE) == 0);
+  free (result);
+  return EXIT_SUCCESS;
+}
+
+int main()
+{
+  cl_int err;
+  cl_context ctx;
+  cl_command_queue queue;
+  cl_device_id did;
+  cl_mem buf;
+  unsigned char *expected, *map;
+  size_t i;
+
+  poclu_get_any_device(&ctx, &did, &queue);
+  TEST_ASSERT(ctx);
+  TEST_ASSERT(did);
+  TEST_ASSERT(queue);
+
+  expected = (unsigned char*)malloc (BUF_SIZE);
+  TEST_ASSERT(expected != NULL);
+  buf = clCreateBuffer(ctx, CL_MEM_READ_WRITE, BUF_SIZE, NULL, &err);
+  CHECK_OPENCL_ERROR_IN("clCreateBuffer");
+
+  /* Fill the whole buffer through an invalidating map. */
+  map = (unsigned char*)clEnqueueMapBuffer(queue, buf, CL_TRUE,
+                                           CL_MAP_WRITE_INVALIDATE_REGION,
+                                           0, BUF_SIZE, 0, NULL, NULL, &err);
+  CHECK_OPENCL_ERROR_IN("clEnqueueMapBuffer");
+  for (i = 0; i < BUF_SIZE; ++i)
+    map[i] = expected[i] = (unsigned char)(i * 7 + i / 4096);
+  err = clEnqueueUnmapMemObject(queue, buf, map, 0, NULL, NULL);
+  CHECK_OPENCL_ERROR_IN("clEnqueueUnmapMemObject");
+  TEST_ASSERT(check_contents (queue, buf, expected) == EXIT_SUCCESS);
+
+  /* The same pointer cannot be unmapped twice. */
+  err = clEnqueueUnmapMemObject(queue, buf, map, 0, NULL, NULL);
+  TEST_ASSERT(err == CL_INVALID_VALUE);
+
+  /* Modify a few scattered bytes of a mapped subregion, including the
+     first and the last one. The rest must stay intact. */
+  map = (unsigned char*)clEnqueueMapBuffer(queue, buf, CL_TRUE,
+                                           CL_MAP_READ | CL_MAP_WRITE,
+                                           100, BUF_SIZE - 100, 0, NULL,
+                                           NULL, &err);
+  CHECK_OPENCL_ERROR_IN("clEnqueueMapBuffer");
+  TEST_ASSERT(memcmp (map, expected + 100, BUF_SIZE - 100) == 0);
+  map[0] = expected[100] = 0xaa;
+  map[3 * 4096] = expected[100 + 3 * 4096] = 0xbb;
+  map[BUF_SIZE - 101] = expected[BUF_SIZE - 1] = 0xcc;
+  err = clEnqueueUnmapMemObject(queue, buf, map, 0, NULL, NULL);
+  CHECK_OPENCL_ERROR_IN("clEnqueueUnmapMemObject");
+  TEST_ASSERT(check_contents (queue, buf, expected) == EXIT_SUCCESS);
+
+  /* Writes to a region mapped for reading only are not required to reach
+     the buffer, but the unmap must not clobber it either. */
+  map = (unsigned char*)clEnqueueMapBuffer(queue, buf, CL_TRUE, CL_MAP_READ,
+                                           0, BUF_SIZE, 0, NULL, NULL, &err);
+  CHECK_OPENCL_ERROR_IN("clEnqueueMapBuffer");
+  TEST_ASSERT(memcmp (map, expected, BUF_SIZE) == 0);
+  err = clEnqueueUnmapMemObject(queue, buf, map, 0, NULL, NULL);
+  CHECK_OPENCL_ERROR_IN("clEnqueueUnmapMemObject");
+  TEST_ASSERT(check_contents (queue, buf, expected) == EXIT_SUCCESS);
+
+  map = (unsigned char*)clEnqueueMapBuffer(queue, buf, CL_TRUE,
+                                           CL_MAP_READ
+                                           | CL_MAP_WRITE_INVALIDATE_REGION,
+                                           0, BUF_SIZE, 0, NULL, NULL, &err);
+  TEST_ASSERT(map == NULL && err == CL_INVALID_VALUE);
+
+  clReleaseMemObject(buf);
+  clReleaseCommandQueue(queue);
+  clReleaseContext(ctx);
+  free (expected);
+
+  printf("OK\n");
+  return EXIT_SUCCESS;
+}
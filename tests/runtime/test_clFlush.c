@@ -0,0 +1,121 @@
+/* Tests that clFlush'ed commands complete without clFinish
+
+   Copyright (c) 2015 pocl developers
+   
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+   
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+   
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+   THE SOFTWARE.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <CL/opencl.h>
+#include "poclu.h"
+#include "pocl_tests.h"
+
+#define BUF_SIZE 1024
+/* How long to wait for a flushed command before declaring it stuck. */
+#define MAX_POLLS 10000
+#define POLL_INTERVAL_US 1000
+
+/* Polls the event status without calling any of the blocking API
+   functions. Returns the last status seen. */
+static cl_int
+poll_event (cl_event event)
+{
+  cl_int status = CL_QUEUED;
+  int i;
+  for (i = 0; i < MAX_POLLS; ++i)
+    {
+      if (clGetEventInfo (event, CL_EVENT_COMMAND_EXECUTION_STATUS,
+                          sizeof (cl_int), &status, NULL) != CL_SUCCESS)
+        return -1;
+      if (status == CL_COMPLETE || status < 0)
+        break;
+      usleep (POLL_INTERVAL_US);
+    }
+  return status;
+}
+
+int main()
+{
+  cl_int err;
+  cl_context ctx;
+  cl_command_queue queue;
+  cl_device_id did;
+  cl_mem buf;
+  cl_event user_event, write_event, read_event;
+  cl_int status;
+  cl_int src[BUF_SIZE], dst[BUF_SIZE];
+  int i;
+
+  poclu_get_any_device(&ctx, &did, &queue);
+  TEST_ASSERT(ctx);
+  TEST_ASSERT(did);
+  TEST_ASSERT(queue);
+
+  for (i = 0; i < BUF_SIZE; ++i)
+    {
+      src[i] = i;
+      dst[i] = -1;
+    }
+
+  buf = clCreateBuffer(ctx, CL_MEM_READ_WRITE, sizeof(src), NULL, &err);
+  CHECK_OPENCL_ERROR_IN("clCreateBuffer");
+
+  user_event = clCreateUserEvent(ctx, &err);
+  CHECK_OPENCL_ERROR_IN("clCreateUserEvent");
+
+  /* The write must not start before the user event completes. */
+  err = clEnqueueWriteBuffer(queue, buf, CL_FALSE, 0, sizeof(src), src,
+                             1, &user_event, &write_event);
+  CHECK_OPENCL_ERROR_IN("clEnqueueWriteBuffer");
+
+  err = clEnqueueReadBuffer(queue, buf, CL_FALSE, 0, sizeof(dst), dst,
+                            0, NULL, &read_event);
+  CHECK_OPENCL_ERROR_IN("clEnqueueReadBuffer");
+
+  err = clFlush(queue);
+  CHECK_OPENCL_ERROR_IN("clFlush");
+
+  usleep (10 * POLL_INTERVAL_US);
+  err = clGetEventInfo(read_event, CL_EVENT_COMMAND_EXECUTION_STATUS,
+                       sizeof(cl_int), &status, NULL);
+  CHECK_OPENCL_ERROR_IN("clGetEventInfo");
+  TEST_ASSERT(status != CL_COMPLETE);
+
+  err = clSetUserEventStatus(user_event, CL_COMPLETE);
+  CHECK_OPENCL_ERROR_IN("clSetUserEventStatus");
+
+  /* Both commands must now finish in the background. */
+  TEST_ASSERT(poll_event(write_event) == CL_COMPLETE);
+  TEST_ASSERT(poll_event(read_event) == CL_COMPLETE);
+
+  TEST_ASSERT(memcmp(src, dst, sizeof(src)) == 0);
+
+  clReleaseEvent(read_event);
+  clReleaseEvent(write_event);
+  clReleaseEvent(user_event);
+  clReleaseMemObject(buf);
+  clReleaseCommandQueue(queue);
+  clReleaseContext(ctx);
+
+  printf("OK\n");
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,126 @@
+/* Tests clSetUserEventStatus() and the termination of the commands waiting
+   for a failed event
+
+   Copyright (c) 2015 pocl developers
+   
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+   
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+   
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+   THE SOFTWARE.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <CL/opencl.h>
+#include "poclu.h"
+#include "pocl_tests.h"
+
+#define BUF_SIZE 256
+#define FAILURE_STATUS -42
+
+static cl_int callback_status = CL_QUEUED;
+
+static void CL_CALLBACK
+record_status (cl_event event, cl_int status, void *user_data)
+{
+  callback_status = status;
+}
+
+static cl_int
+event_status (cl_event event)
+{
+  cl_int status = CL_QUEUED;
+  clGetEventInfo(event, CL_EVENT_COMMAND_EXECUTION_STATUS, sizeof (status),
+                 &status, NULL);
+  return status;
+}
+
+int main()
+{
+  cl_int err;
+  cl_context ctx;
+  cl_command_queue queue;
+  cl_device_id did;
+  cl_mem buf;
+  cl_event user_event, write_event, copy_event;
+  char zeros[BUF_SIZE], ones[BUF_SIZE], result[BUF_SIZE];
+
+  poclu_get_any_device(&ctx, &did, &queue);
+  TEST_ASSERT(ctx);
+  TEST_ASSERT(did);
+  TEST_ASSERT(queue);
+
+  memset (zeros, 0, BUF_SIZE);
+  memset (ones, 1, BUF_SIZE);
+  buf = clCreateBuffer(ctx, CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR,
+                       BUF_SIZE, zeros, &err);
+  CHECK_OPENCL_ERROR_IN("clCreateBuffer");
+
+  user_event = clCreateUserEvent(ctx, &err);
+  CHECK_OPENCL_ERROR_IN("clCreateUserEvent");
+  err = clSetEventCallback(user_event, CL_COMPLETE, record_status, NULL);
+  CHECK_OPENCL_ERROR_IN("clSetEventCallback");
+
+  /* Only CL_COMPLETE and the error codes are valid. */
+  err = clSetUserEventStatus(user_event, CL_SUBMITTED);
+  TEST_ASSERT(err == CL_INVALID_VALUE);
+
+  /* A chain of commands gated by the user event. */
+  err = clEnqueueWriteBuffer(queue, buf, CL_FALSE, 0, BUF_SIZE, ones, 1,
+                             &user_event, &write_event);
+  CHECK_OPENCL_ERROR_IN("clEnqueueWriteBuffer");
+  err = clEnqueueCopyBuffer(queue, buf, buf, 0, BUF_SIZE / 2, BUF_SIZE / 2,
+                            0, NULL, &copy_event);
+  CHECK_OPENCL_ERROR_IN("clEnqueueCopyBuffer");
+
+  /* Failing the user event terminates the whole chain without executing
+     it and calls the callbacks with the error code. */
+  err = clSetUserEventStatus(user_event, FAILURE_STATUS);
+  CHECK_OPENCL_ERROR_IN("clSetUserEventStatus");
+  TEST_ASSERT(callback_status == FAILURE_STATUS);
+
+  err = clWaitForEvents(1, &copy_event);
+  TEST_ASSERT(err == CL_EXEC_STATUS_ERROR_FOR_EVENTS_IN_WAIT_LIST);
+  err = clFinish(queue);
+  CHECK_OPENCL_ERROR_IN("clFinish");
+  TEST_ASSERT(event_status (write_event)
+              == CL_EXEC_STATUS_ERROR_FOR_EVENTS_IN_WAIT_LIST);
+  TEST_ASSERT(event_status (copy_event)
+              == CL_EXEC_STATUS_ERROR_FOR_EVENTS_IN_WAIT_LIST);
+
+  err = clEnqueueReadBuffer(queue, buf, CL_TRUE, 0, BUF_SIZE, result, 0,
+                            NULL, NULL);
+  CHECK_OPENCL_ERROR_IN("clEnqueueReadBuffer");
+  TEST_ASSERT(memcmp (result, zeros, BUF_SIZE) == 0);
+
+  /* The status can be set only once. */
+  err = clSetUserEventStatus(user_event, CL_COMPLETE);
+  TEST_ASSERT(err == CL_INVALID_OPERATION);
+
+  /* Only for user events. */
+  err = clSetUserEventStatus(write_event, CL_COMPLETE);
+  TEST_ASSERT(err == CL_INVALID_EVENT);
+
+  clReleaseEvent(copy_event);
+  clReleaseEvent(write_event);
+  clReleaseEvent(user_event);
+  clReleaseMemObject(buf);
+  clReleaseCommandQueue(queue);
+  clReleaseContext(ctx);
+
+  printf("OK\n");
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,107 @@
+/* Tests that clWaitForEvents waits only for the given events
+
+   Copyright (c) 2015 pocl developers
+   
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+   
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+   
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+   THE SOFTWARE.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <CL/opencl.h>
+#include "poclu.h"
+#include "pocl_tests.h"
+
+#define BUF_SIZE 1024
+/* A hang in clWaitForEvents() kills the test with SIGALRM. */
+#define TIMEOUT_S 60
+
+int main()
+{
+  cl_int err;
+  cl_context ctx;
+  cl_command_queue queue;
+  cl_device_id did;
+  cl_mem buf;
+  cl_event user_event, event_a, event_b;
+  cl_int status;
+  cl_int src[BUF_SIZE], dst[BUF_SIZE];
+  int i;
+
+  alarm (TIMEOUT_S);
+
+  poclu_get_any_device(&ctx, &did, &queue);
+  TEST_ASSERT(ctx);
+  TEST_ASSERT(did);
+  TEST_ASSERT(queue);
+
+  for (i = 0; i < BUF_SIZE; ++i)
+    src[i] = i;
+
+  buf = clCreateBuffer(ctx, CL_MEM_READ_WRITE, sizeof(src), NULL, &err);
+  CHECK_OPENCL_ERROR_IN("clCreateBuffer");
+
+  user_event = clCreateUserEvent(ctx, &err);
+  CHECK_OPENCL_ERROR_IN("clCreateUserEvent");
+
+  err = clEnqueueWriteBuffer(queue, buf, CL_FALSE, 0, sizeof(src), src,
+                             0, NULL, &event_a);
+  CHECK_OPENCL_ERROR_IN("clEnqueueWriteBuffer");
+
+  /* Blocked until the user event is set. */
+  err = clEnqueueReadBuffer(queue, buf, CL_FALSE, 0, sizeof(dst), dst,
+                            1, &user_event, &event_b);
+  CHECK_OPENCL_ERROR_IN("clEnqueueReadBuffer");
+
+  /* Must return although the queue still has a blocked command. */
+  err = clWaitForEvents(1, &event_a);
+  CHECK_OPENCL_ERROR_IN("clWaitForEvents");
+
+  err = clGetEventInfo(event_a, CL_EVENT_COMMAND_EXECUTION_STATUS,
+                       sizeof(cl_int), &status, NULL);
+  CHECK_OPENCL_ERROR_IN("clGetEventInfo");
+  TEST_ASSERT(status == CL_COMPLETE);
+
+  err = clGetEventInfo(event_b, CL_EVENT_COMMAND_EXECUTION_STATUS,
+                       sizeof(cl_int), &status, NULL);
+  CHECK_OPENCL_ERROR_IN("clGetEventInfo");
+  TEST_ASSERT(status != CL_COMPLETE);
+
+  err = clSetUserEventStatus(user_event, CL_COMPLETE);
+  CHECK_OPENCL_ERROR_IN("clSetUserEventStatus");
+
+  err = clWaitForEvents(1, &event_b);
+  CHECK_OPENCL_ERROR_IN("clWaitForEvents");
+  TEST_ASSERT(memcmp(src, dst, sizeof(src)) == 0);
+
+  /* User events can be waited for as well. */
+  err = clWaitForEvents(1, &user_event);
+  CHECK_OPENCL_ERROR_IN("clWaitForEvents");
+
+  clReleaseEvent(event_b);
+  clReleaseEvent(event_a);
+  clReleaseEvent(user_event);
+  clReleaseMemObject(buf);
+  clReleaseCommandQueue(queue);
+  clReleaseContext(ctx);
+
+  printf("OK\n");
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,148 @@
+/* Tests executing a kernel with many local sizes using a single
+   work-group function compiled for any local size
+
+   Copyright (c) 2015 pocl developers
+   
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+   
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+   
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+   THE SOFTWARE.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <CL/opencl.h>
+#include "poclu.h"
+#include "pocl_tests.h"
+
+#define GLOBAL_X 16
+#define GLOBAL_Y 4
+#define GLOBAL_Z 2
+#define WORK_ITEMS (GLOBAL_X * GLOBAL_Y * GLOBAL_Z)
+#define HOT_LAUNCHES 100
+
+/* Each work-item reads the flat global id stored by its mirror work-item
+   in the work-group. The ids live across the barrier, thus they are
+   stored in the context arrays of the work-item loops. */
+static const char *source =
+  "kernel void\n"
+  "mirror (global uint *out, local uint *tmp)\n"
+  "{\n"
+  "  uint lid = get_local_id (0) + get_local_size (0)\n"
+  "    * (get_local_id (1) + get_local_size (1) * get_local_id (2));\n"
+  "  uint size = get_local_size (0) * get_local_size (1)\n"
+  "    * get_local_size (2);\n"
+  "  uint gid = get_global_id (0) + get_global_size (0)\n"
+  "    * (get_global_id (1) + get_global_size (1) * get_global_id (2));\n"
+  "  uint count = 0;\n"
+  "  for (uint i = 0; i <= lid; ++i)\n"
+  "    count += i;\n"
+  "  tmp[lid] = gid;\n"
+  "  barrier (CLK_LOCAL_MEM_FENCE);\n"
+  "  out[gid] = tmp[size - 1 - lid] * 1000 + count;\n"
+  "}\n";
+
+static int
+test_local_size (cl_command_queue queue, cl_kernel kernel, cl_mem buf,
+                 const size_t *local)
+{
+  const size_t global[3] = {GLOBAL_X, GLOBAL_Y, GLOBAL_Z};
+  size_t size = local[0] * local[1] * local[2];
+  cl_uint result[WORK_ITEMS];
+  size_t x, y, z;
+  cl_int err;
+
+  err = clSetKernelArg(kernel, 1, size * sizeof (cl_uint), NULL);
+  CHECK_OPENCL_ERROR_IN("clSetKernelArg");
+  err = clEnqueueNDRangeKernel(queue, kernel, 3, NULL, global, local,
+                               0, NULL, NULL);
+  CHECK_OPENCL_ERROR_IN("clEnqueueNDRangeKernel");
+  err = clEnqueueReadBuffer(queue, buf, CL_TRUE, 0, sizeof (result),
+                            result, 0, NULL, NULL);
+  CHECK_OPENCL_ERROR_IN("clEnqueueReadBuffer");
+
+  for (z = 0; z < GLOBAL_Z; ++z)
+    for (y = 0; y < GLOBAL_Y; ++y)
+      for (x = 0; x < GLOBAL_X; ++x)
+        {
+          size_t lx = x % local[0], ly = y % local[1], lz = z % local[2];
+          size_t lid = lx + local[0] * (ly + local[1] * lz);
+          size_t mirror = size - 1 - lid;
+          size_t mx = x - lx + mirror % local[0];
+          size_t my = y - ly + mirror / local[0] % local[1];
+          size_t mz = z - lz + mirror / (local[0] * local[1]);
+          size_t gid = x + GLOBAL_X * (y + GLOBAL_Y * z);
+          size_t mgid = mx + GLOBAL_X * (my + GLOBAL_Y * mz);
+          TEST_ASSERT(result[gid] == mgid * 1000 + lid * (lid + 1) / 2);
+        }
+  return EXIT_SUCCESS;
+}
+
+int main()
+{
+  /* The local sizes in the order they are launched, including the
+     single work-item work-group and a repeated one. */
+  static const size_t locals[][3] =
+    {{1, 1, 1}, {2, 1, 1}, {16, 1, 1}, {4, 2, 1}, {8, 4, 2}, {1, 4, 2},
+     {1, 2, 1}, {16, 4, 2}, {2, 1, 1}};
+  cl_int err;
+  cl_context ctx;
+  cl_command_queue queue;
+  cl_device_id did;
+  cl_program program;
+  cl_kernel kernel;
+  cl_mem buf;
+  unsigned i;
+
+  poclu_get_any_device(&ctx, &did, &queue);
+  TEST_ASSERT(ctx);
+  TEST_ASSERT(did);
+  TEST_ASSERT(queue);
+
+  program = clCreateProgramWithSource(ctx, 1, &source, NULL, &err);
+  CHECK_OPENCL_ERROR_IN("clCreateProgramWithSource");
+  err = clBuildProgram(program, 1, &did, NULL, NULL, NULL);
+  CHECK_OPENCL_ERROR_IN("clBuildProgram");
+  kernel = clCreateKernel(program, "mirror", &err);
+  CHECK_OPENCL_ERROR_IN("clCreateKernel");
+  buf = clCreateBuffer(ctx, CL_MEM_WRITE_ONLY, WORK_ITEMS * sizeof (cl_uint),
+                       NULL, &err);
+  CHECK_OPENCL_ERROR_IN("clCreateBuffer");
+  err = clSetKernelArg(kernel, 0, sizeof (cl_mem), &buf);
+  CHECK_OPENCL_ERROR_IN("clSetKernelArg");
+
+  for (i = 0; i < sizeof (locals) / sizeof (locals[0]); ++i)
+    TEST_ASSERT(test_local_size (queue, kernel, buf, locals[i])
+                == EXIT_SUCCESS);
+
+  /* The hot local sizes switch to specialized work-group functions
+     compiled in the background at some point during these launches. */
+  for (i = 0; i < HOT_LAUNCHES; ++i)
+    {
+      const size_t *local = locals[3 + (i & 1)];
+      TEST_ASSERT(test_local_size (queue, kernel, buf, local)
+                  == EXIT_SUCCESS);
+    }
+
+  clReleaseMemObject(buf);
+  clReleaseKernel(kernel);
+  clReleaseProgram(program);
+  clReleaseCommandQueue(queue);
+  clReleaseContext(ctx);
+
+  printf("OK\n");
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,147 @@
+/* Tests that the steady state kernel launches allocate nothing from the heap
+
+   Copyright (c) 2015 pocl developers
+   
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+   
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+   
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+   THE SOFTWARE.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+/* pocl does not implement clGetExtensionFunctionAddressForPlatform. */
+#define CL_USE_DEPRECATED_OPENCL_1_1_APIS
+#include <CL/opencl.h>
+#include "poclu.h"
+#include "pocl_tests.h"
+
+#define NUM_ITEMS 256
+#define MAX_LOCAL_SIZE 16
+/* The number of the launches in flight at a time. The warm-up uses
+   twice as many to leave room for the commands still being freed by the
+   executor threads when clFinish() returns. */
+#define BATCH 64
+#define WARMUP_ROUNDS 4
+#define ROUNDS 16
+
+static const char *source =
+  "kernel void increment (global int *data, local int *scratch)\n"
+  "{\n"
+  "  size_t l = get_local_id (0);\n"
+  "  scratch[l] = data[get_global_id (0)];\n"
+  "  barrier (CLK_LOCAL_MEM_FENCE);\n"
+  "  data[get_global_id (0)] = scratch[l] + 1;\n"
+  "}\n";
+
+static cl_int
+enqueue_launches (cl_command_queue queue, cl_kernel kernel, int count)
+{
+  cl_int err;
+  size_t global = NUM_ITEMS;
+  size_t local;
+  int i;
+
+  for (i = 0; i < count; ++i)
+    {
+      /* The local buffer size varies, but it never exceeds the one of
+         the warm-up. */
+      local = (size_t)1 << (i % 5);
+      err = clSetKernelArg (kernel, 1, local * sizeof (cl_int), NULL);
+      if (err != CL_SUCCESS)
+        return err;
+      err = clEnqueueNDRangeKernel (queue, kernel, 1, NULL, &global, &local,
+                                    0, NULL, NULL);
+      if (err != CL_SUCCESS)
+        return err;
+    }
+  return clFinish (queue);
+}
+
+int main()
+{
+  cl_int err;
+  cl_context ctx;
+  cl_command_queue queue;
+  cl_device_id did;
+  cl_program program;
+  cl_kernel kernel;
+  cl_mem buf;
+  clGetAllocationCountPOCL_fn get_allocation_count;
+  cl_ulong warm_count, count;
+  cl_int data[NUM_ITEMS];
+  int i, launches;
+
+  poclu_get_any_device(&ctx, &did, &queue);
+  TEST_ASSERT(ctx);
+  TEST_ASSERT(did);
+  TEST_ASSERT(queue);
+
+  get_allocation_count = (clGetAllocationCountPOCL_fn)
+    clGetExtensionFunctionAddress("clGetAllocationCountPOCL");
+  TEST_ASSERT(get_allocation_count != NULL);
+
+  for (i = 0; i < NUM_ITEMS; ++i)
+    data[i] = 0;
+  buf = clCreateBuffer(ctx, CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR,
+                       sizeof (data), data, &err);
+  CHECK_OPENCL_ERROR_IN("clCreateBuffer");
+
+  program = clCreateProgramWithSource(ctx, 1, &source, NULL, &err);
+  CHECK_OPENCL_ERROR_IN("clCreateProgramWithSource");
+  err = clBuildProgram(program, 0, NULL, NULL, NULL, NULL);
+  CHECK_OPENCL_ERROR_IN("clBuildProgram");
+  kernel = clCreateKernel(program, "increment", &err);
+  CHECK_OPENCL_ERROR_IN("clCreateKernel");
+  err = clSetKernelArg(kernel, 0, sizeof (cl_mem), &buf);
+  CHECK_OPENCL_ERROR_IN("clSetKernelArg");
+
+  /* Fills the pools and the launch arenas of the threads. */
+  launches = 0;
+  for (i = 0; i < WARMUP_ROUNDS; ++i)
+    {
+      err = enqueue_launches(queue, kernel, 2 * BATCH);
+      CHECK_OPENCL_ERROR_IN("warm-up launches");
+      launches += 2 * BATCH;
+    }
+  warm_count = get_allocation_count();
+
+  for (i = 0; i < ROUNDS; ++i)
+    {
+      err = enqueue_launches(queue, kernel, BATCH);
+      CHECK_OPENCL_ERROR_IN("launches");
+      launches += BATCH;
+    }
+  count = get_allocation_count();
+  if (count != warm_count)
+    fprintf(stderr, "%lu allocations during %d launches\n",
+            (unsigned long)(count - warm_count), ROUNDS * BATCH);
+  TEST_ASSERT(count == warm_count);
+
+  err = clEnqueueReadBuffer(queue, buf, CL_TRUE, 0, sizeof (data), data, 0,
+                            NULL, NULL);
+  CHECK_OPENCL_ERROR_IN("clEnqueueReadBuffer");
+  for (i = 0; i < NUM_ITEMS; ++i)
+    TEST_ASSERT(data[i] == launches);
+
+  clReleaseMemObject(buf);
+  clReleaseKernel(kernel);
+  clReleaseProgram(program);
+  clReleaseCommandQueue(queue);
+  clReleaseContext(ctx);
+
+  printf("OK\n");
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,112 @@
+/* Tests replacing the quickly compiled work-group function of a kernel
+   with the optimized one while the kernel is being launched
+
+   Copyright (c) 2015 pocl developers
+   
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+   
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+   
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+   THE SOFTWARE.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <CL/opencl.h>
+#include "poclu.h"
+#include "pocl_tests.h"
+
+#define WORK_ITEMS 4096
+#define LOCAL_SIZE 64
+#define LAUNCHES 200
+
+/* Only the optimized tier vectorizes the work-item loop of this kernel,
+   thus the two tiers execute different code for it. */
+static const char *source =
+  "kernel void\n"
+  "saxpy (global float *y, global const float *x, float a, uint launch)\n"
+  "{\n"
+  "  size_t i = get_global_id (0);\n"
+  "  y[i] = a * x[i] + (float)launch;\n"
+  "}\n";
+
+int main()
+{
+  cl_int err;
+  cl_context ctx;
+  cl_command_queue queue;
+  cl_device_id did;
+  cl_program program;
+  cl_kernel kernel;
+  cl_mem x_buf, y_buf;
+  cl_float x[WORK_ITEMS], y[WORK_ITEMS];
+  cl_float a = 2.0f;
+  size_t global = WORK_ITEMS, local = LOCAL_SIZE;
+  cl_uint launch;
+  unsigned i;
+
+  poclu_get_any_device(&ctx, &did, &queue);
+  TEST_ASSERT(ctx);
+  TEST_ASSERT(did);
+  TEST_ASSERT(queue);
+
+  for (i = 0; i < WORK_ITEMS; ++i)
+    x[i] = (cl_float)i;
+
+  program = clCreateProgramWithSource(ctx, 1, &source, NULL, &err);
+  CHECK_OPENCL_ERROR_IN("clCreateProgramWithSource");
+  err = clBuildProgram(program, 1, &did, NULL, NULL, NULL);
+  CHECK_OPENCL_ERROR_IN("clBuildProgram");
+  kernel = clCreateKernel(program, "saxpy", &err);
+  CHECK_OPENCL_ERROR_IN("clCreateKernel");
+  x_buf = clCreateBuffer(ctx, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
+                         sizeof (x), x, &err);
+  CHECK_OPENCL_ERROR_IN("clCreateBuffer");
+  y_buf = clCreateBuffer(ctx, CL_MEM_WRITE_ONLY, sizeof (y), NULL, &err);
+  CHECK_OPENCL_ERROR_IN("clCreateBuffer");
+
+  err = clSetKernelArg(kernel, 0, sizeof (cl_mem), &y_buf);
+  CHECK_OPENCL_ERROR_IN("clSetKernelArg");
+  err = clSetKernelArg(kernel, 1, sizeof (cl_mem), &x_buf);
+  CHECK_OPENCL_ERROR_IN("clSetKernelArg");
+  err = clSetKernelArg(kernel, 2, sizeof (cl_float), &a);
+  CHECK_OPENCL_ERROR_IN("clSetKernelArg");
+
+  /* The optimized version replaces the quick one at some point during
+     the launches; every launch must see correct results regardless. */
+  for (launch = 0; launch < LAUNCHES; ++launch)
+    {
+      err = clSetKernelArg(kernel, 3, sizeof (cl_uint), &launch);
+      CHECK_OPENCL_ERROR_IN("clSetKernelArg");
+      err = clEnqueueNDRangeKernel(queue, kernel, 1, NULL, &global, &local,
+                                   0, NULL, NULL);
+      CHECK_OPENCL_ERROR_IN("clEnqueueNDRangeKernel");
+      err = clEnqueueReadBuffer(queue, y_buf, CL_TRUE, 0, sizeof (y), y,
+                                0, NULL, NULL);
+      CHECK_OPENCL_ERROR_IN("clEnqueueReadBuffer");
+      for (i = 0; i < WORK_ITEMS; ++i)
+        TEST_ASSERT(y[i] == a * x[i] + (cl_float)launch);
+    }
+
+  clReleaseMemObject(x_buf);
+  clReleaseMemObject(y_buf);
+  clReleaseKernel(kernel);
+  clReleaseProgram(program);
+  clReleaseCommandQueue(queue);
+  clReleaseContext(ctx);
+
+  printf("OK\n");
+  return EXIT_SUCCESS;
+}